@@ -0,0 +1,688 @@
+; BENCH.COM - Guest-side benchmarks (RomWBW/HBIOS version)
+;
+; Usage: BENCH [test [unit]]
+;   CON   Console output through BDOS (64 lines of 64 characters)
+;   SEQ   Sequential write, then read, of a 32K file through BDOS
+;   RND   Random-record write, then read, of the same 256 records
+;   DIO   HBIOS DIOSEEK/DIOREAD of 256 sectors from disk unit (default 0)
+;   BNK   HBIOS SYSSETCPY/SYSBNKCPY, 256 copies of 4K
+;   MATH  Sieve of Eratosthenes, 10 passes over 8191 flags
+;   ALL   All of the above (the default)
+;
+; Each timed loop reports host nanoseconds and emulated T-states, both
+; read with the HCSCLOCK extension. T-states are what the program costs
+; on a real Z80; host time against them shows what the emulator adds
+; (HBIOS proxying, disk and console paths) from the guest's side.
+;
+; Assemble with: um80 bench.asm; ul80 -o bench.com -p 0100 bench.rel
+
+	.z80
+
+; CP/M addresses
+TPA	equ	0100h
+CMDBUF	equ	0080h	; Command line: length byte + text
+
+; BDOS function codes
+BDOS	equ	0005h
+C_WRITE	equ	2
+C_PRINT	equ	9
+F_OPEN	equ	15
+F_CLOSE	equ	16
+F_DELETE equ	19
+F_READ	equ	20
+F_WRITE	equ	21
+F_MAKE	equ	22
+F_DMA	equ	26
+F_READRAND equ	33
+F_WRITERAND equ	34
+
+; HBIOS functions
+H_DIOSEEK equ	12h	; Seek (C=unit, DE:HL=LBA, bit 31 set for LBA)
+H_DIOREAD equ	13h	; Read (C=unit, HL=buffer, D=bank, E=count)
+H_SETCPY equ	0F4h	; Bank copy setup (D=dest bank, E=src bank, HL=count)
+H_BNKCPY equ	0F5h	; Bank copy (HL=src, DE=dest)
+H_CLOCK	equ	0EEh	; HCSCLOCK (HL=block: host ns, T-states, 64-bit each)
+H_HCSINFO equ	0EFh	; HCSINFO (HL=bitmap, bit n = function 0E8h+n)
+
+; Work areas outside the program image. The sieve flags sit in the
+; banked half of the TPA; the disk and bank-copy buffers sit in the
+; common bank, so HBIOS reaches them whatever bank is selected.
+FLAGS	equ	4000h	; Sieve flags (8191 bytes)
+SIEVEN	equ	8190	; Last flag index
+FLAGEND	equ	FLAGS+SIEVEN+1
+COMBNK	equ	8Fh	; Common bank ID
+DIOBUF	equ	9000h	; DIOREAD target (one sector)
+CPYSRC	equ	9000h	; Bank copy source (4K)
+CPYDST	equ	0A000h	; Bank copy destination (4K)
+CPYLEN	equ	1000h
+
+RECORDS	equ	256	; Records in the SEQ/RND file (32K)
+
+	org	TPA
+
+start:
+	ld	sp,stack_top
+
+	ld	de,msg_banner
+	ld	c,C_PRINT
+	call	BDOS
+
+	; Make sure the emulator provides HCSCLOCK (bit 6 = function 0EEh)
+	ld	b,H_HCSINFO
+	rst	8
+	or	a
+	jp	nz,no_clock
+	bit	6,l
+	jp	z,no_clock
+
+	; Copy the command tail and terminate it with a zero
+	ld	hl,CMDBUF
+	ld	c,(hl)
+	ld	b,0
+	inc	hl
+	ld	de,tail
+	ld	a,c
+	or	a
+	jr	z,tail_done
+	ldir
+tail_done:
+	xor	a
+	ld	(de),a
+
+	; First word (up to 4 characters) selects the test
+	ld	hl,tail
+	call	skip_spaces
+	or	a
+	jr	z,run_all
+	ld	de,arg_name
+	ld	b,4
+copy_arg:
+	ld	a,(hl)
+	or	a
+	jr	z,arg_end
+	cp	' '
+	jr	z,arg_end
+	ld	(de),a
+	inc	de
+	inc	hl
+	djnz	copy_arg
+skip_word:
+	ld	a,(hl)
+	or	a
+	jr	z,arg_end
+	cp	' '
+	jr	z,arg_end
+	inc	hl
+	jr	skip_word
+
+arg_end:
+	; Optional second word: disk unit for DIO (one digit)
+	call	skip_spaces
+	sub	'0'
+	cp	10
+	jr	nc,find_test
+	ld	(dio_unit),a
+
+find_test:
+	ld	hl,tests
+find_loop:
+	ld	a,(hl)
+	or	a
+	jp	z,usage
+	push	hl
+	ld	de,arg_name
+	ld	b,4
+cmp_loop:
+	ld	a,(de)
+	cp	(hl)
+	jr	nz,no_match
+	inc	hl
+	inc	de
+	djnz	cmp_loop
+	pop	de		; Discard entry start
+	ld	e,(hl)
+	inc	hl
+	ld	d,(hl)
+	ex	de,hl
+	call	call_hl
+	rst	0
+no_match:
+	pop	hl
+	ld	de,6
+	add	hl,de
+	jr	find_loop
+
+run_all:
+	call	t_all
+	rst	0
+
+call_hl:
+	jp	(hl)
+
+; Skip spaces at HL; returns A = first other character
+skip_spaces:
+	ld	a,(hl)
+	cp	' '
+	ret	nz
+	inc	hl
+	jr	skip_spaces
+
+;--------------------------------------------------------------------------
+; Tests
+;--------------------------------------------------------------------------
+
+t_all:
+	call	t_con
+	call	t_seq
+	call	t_rnd
+	call	t_dio
+	call	t_bnk
+	jp	t_math
+
+; Console output: 64 BDOS print calls of a 64-character line
+t_con:
+	call	clk_start
+	ld	b,64
+con_loop:
+	push	bc
+	ld	de,con_line
+	ld	c,C_PRINT
+	call	BDOS
+	pop	bc
+	djnz	con_loop
+	ld	de,lbl_con
+	jp	clk_end
+
+; Sequential BDOS write and read of RECORDS records
+t_seq:
+	call	tmp_make
+	call	clk_start
+	ld	b,RECORDS and 0FFh
+seq_write:
+	push	bc
+	ld	de,fcb
+	ld	c,F_WRITE
+	call	BDOS
+	pop	bc
+	or	a
+	jp	nz,disk_error
+	djnz	seq_write
+	call	tmp_close
+	ld	de,lbl_seqw
+	call	clk_end
+
+	call	tmp_open
+	call	clk_start
+	ld	b,RECORDS and 0FFh
+seq_read:
+	push	bc
+	ld	de,fcb
+	ld	c,F_READ
+	call	BDOS
+	pop	bc
+	or	a
+	jp	nz,disk_error
+	djnz	seq_read
+	ld	de,lbl_seqr
+	call	clk_end
+	jp	tmp_delete
+
+; Random-record BDOS write and read. The record order comes from
+; x = 5x + 1 (mod 256), which visits every record once.
+t_rnd:
+	call	tmp_make	; Lay the file out first (not timed)
+	ld	b,RECORDS and 0FFh
+rnd_fill:
+	push	bc
+	ld	de,fcb
+	ld	c,F_WRITE
+	call	BDOS
+	pop	bc
+	or	a
+	jp	nz,disk_error
+	djnz	rnd_fill
+	call	tmp_close
+
+	call	tmp_open
+	call	clk_start
+	ld	b,RECORDS and 0FFh
+rnd_write:
+	push	bc
+	call	next_record
+	ld	de,fcb
+	ld	c,F_WRITERAND
+	call	BDOS
+	pop	bc
+	or	a
+	jp	nz,disk_error
+	djnz	rnd_write
+	ld	de,lbl_rndw
+	call	clk_end
+
+	call	clk_start
+	ld	b,RECORDS and 0FFh
+rnd_read:
+	push	bc
+	call	next_record
+	ld	de,fcb
+	ld	c,F_READRAND
+	call	BDOS
+	pop	bc
+	or	a
+	jp	nz,disk_error
+	djnz	rnd_read
+	ld	de,lbl_rndr
+	call	clk_end
+	call	tmp_close
+	jp	tmp_delete
+
+; Set the FCB random record field to the next record number
+next_record:
+	ld	a,(seed)
+	ld	c,a
+	add	a,a
+	add	a,a
+	add	a,c
+	inc	a
+	ld	(seed),a
+	ld	(fcb+33),a
+	xor	a
+	ld	(fcb+34),a
+	ld	(fcb+35),a
+	ret
+
+; Direct HBIOS disk reads: 256 single-sector reads cycling over LBA 0-63
+t_dio:
+	ld	hl,0
+	ld	(lba),hl
+	call	clk_start
+	ld	b,0
+dio_loop:
+	push	bc
+	ld	a,(dio_unit)
+	ld	c,a
+	ld	b,H_DIOSEEK
+	ld	de,8000h	; LBA mode, high word 0
+	ld	hl,(lba)
+	rst	8
+	or	a
+	jr	nz,dio_fail
+	ld	a,(dio_unit)
+	ld	c,a
+	ld	b,H_DIOREAD
+	ld	hl,DIOBUF
+	ld	d,COMBNK
+	ld	e,1
+	rst	8
+	or	a
+	jr	nz,dio_fail
+	pop	bc
+	ld	a,(lba)
+	inc	a
+	and	3Fh
+	ld	(lba),a
+	djnz	dio_loop
+	ld	de,lbl_dio
+	jp	clk_end
+dio_fail:
+	ld	de,msg_dio_err
+	ld	c,C_PRINT
+	call	BDOS
+	rst	0
+
+; HBIOS bank copy: 256 copies of 4K within the common bank (1M total)
+t_bnk:
+	call	clk_start
+	ld	b,0
+bnk_loop:
+	push	bc
+	ld	b,H_SETCPY
+	ld	d,COMBNK
+	ld	e,COMBNK
+	ld	hl,CPYLEN
+	rst	8
+	ld	b,H_BNKCPY
+	ld	hl,CPYSRC
+	ld	de,CPYDST
+	rst	8
+	pop	bc
+	djnz	bnk_loop
+	ld	de,lbl_bnk
+	jp	clk_end
+
+; Arithmetic kernel: the classic sieve, 10 passes (1899 primes each)
+t_math:
+	call	clk_start
+	ld	a,10
+	ld	(passes),a
+sieve_pass:
+	ld	hl,FLAGS
+	ld	de,FLAGS+1
+	ld	bc,SIEVEN
+	ld	(hl),1
+	ldir
+	ld	hl,0
+	ld	(primes),hl
+	ld	bc,0		; BC = i
+sieve_i:
+	ld	hl,FLAGS
+	add	hl,bc
+	ld	a,(hl)
+	or	a
+	jr	z,sieve_next
+	ld	h,b		; DE = prime = i + i + 3
+	ld	l,c
+	add	hl,hl
+	inc	hl
+	inc	hl
+	inc	hl
+	ex	de,hl
+	ld	hl,FLAGS	; HL = &flags[i + prime]
+	add	hl,bc
+	add	hl,de
+sieve_k:
+	ld	a,l		; Stop at FLAGEND
+	sub	FLAGEND and 0FFh
+	ld	a,h
+	sbc	a,FLAGEND shr 8
+	jr	nc,sieve_count
+	ld	(hl),0
+	add	hl,de
+	jr	sieve_k
+sieve_count:
+	ld	hl,(primes)
+	inc	hl
+	ld	(primes),hl
+sieve_next:
+	inc	bc
+	ld	a,c
+	sub	(SIEVEN+1) and 0FFh
+	ld	a,b
+	sbc	a,(SIEVEN+1) shr 8
+	jr	c,sieve_i
+	ld	a,(passes)
+	dec	a
+	ld	(passes),a
+	jr	nz,sieve_pass
+	ld	de,lbl_math
+	call	clk_end
+
+	; Print the prime count as a check on the kernel
+	ld	hl,(primes)
+	ld	(num64),hl
+	ld	hl,0
+	ld	(num64+2),hl
+	ld	(num64+4),hl
+	ld	(num64+6),hl
+	ld	hl,num64
+	call	print_u64
+	ld	de,msg_primes
+	ld	c,C_PRINT
+	jp	BDOS
+
+;--------------------------------------------------------------------------
+; Scratch file (BENCH.TMP on the current drive)
+;--------------------------------------------------------------------------
+
+tmp_init:
+	ld	hl,fcb_template
+	ld	de,fcb
+	ld	bc,36
+	ldir
+	ret
+
+tmp_make:
+	ld	de,dma_buffer
+	ld	c,F_DMA
+	call	BDOS
+	call	tmp_delete
+	call	tmp_init
+	ld	de,fcb
+	ld	c,F_MAKE
+	call	BDOS
+	inc	a		; 0FFh = directory full
+	jp	z,disk_error
+	ret
+
+tmp_open:
+	call	tmp_init
+	ld	de,fcb
+	ld	c,F_OPEN
+	call	BDOS
+	inc	a
+	jp	z,disk_error
+	ret
+
+tmp_close:
+	ld	de,fcb
+	ld	c,F_CLOSE
+	jp	BDOS
+
+tmp_delete:
+	call	tmp_init
+	ld	de,fcb
+	ld	c,F_DELETE
+	jp	BDOS
+
+disk_error:
+	call	tmp_delete
+	ld	de,msg_disk_err
+	ld	c,C_PRINT
+	call	BDOS
+	rst	0
+
+;--------------------------------------------------------------------------
+; Timing and output
+;--------------------------------------------------------------------------
+
+clk_start:
+	ld	hl,clk_t0
+	ld	b,H_CLOCK
+	rst	8
+	ret
+
+; Sample the clock again and print "<label> <ns> ns <T> T-states"
+; Input: DE = label ('$'-terminated)
+clk_end:
+	push	de
+	ld	hl,clk_t1
+	ld	b,H_CLOCK
+	rst	8
+	ld	hl,clk_t1
+	ld	de,clk_t0
+	call	sub64
+	ld	hl,clk_t1+8
+	ld	de,clk_t0+8
+	call	sub64
+	pop	de
+	ld	c,C_PRINT
+	call	BDOS
+	ld	hl,clk_t1
+	call	print_u64
+	ld	de,msg_ns
+	ld	c,C_PRINT
+	call	BDOS
+	ld	hl,clk_t1+8
+	call	print_u64
+	ld	de,msg_tstates
+	ld	c,C_PRINT
+	jp	BDOS
+
+; (HL) = (HL) - (DE), 64-bit little-endian
+sub64:
+	ld	b,8
+	or	a
+sub64_loop:
+	ld	a,(de)
+	ld	c,a
+	ld	a,(hl)
+	sbc	a,c
+	ld	(hl),a
+	inc	hl
+	inc	de
+	djnz	sub64_loop
+	ret
+
+; Print the 64-bit number at HL in decimal (the number is destroyed)
+print_u64:
+	ld	(num_ptr),hl
+	ld	hl,num_end
+	ld	(hl),'$'
+print_u64_loop:
+	dec	hl
+	push	hl
+	ld	hl,(num_ptr)
+	call	div10
+	pop	hl
+	add	a,'0'
+	ld	(hl),a
+	push	hl
+	ld	hl,(num_ptr)
+	call	is_zero64
+	pop	hl
+	jr	nz,print_u64_loop
+	ex	de,hl
+	ld	c,C_PRINT
+	jp	BDOS
+
+; Divide the 64-bit number at HL by 10 in place; returns A = remainder
+div10:
+	ld	de,7		; Start at the most significant byte
+	add	hl,de
+	ld	b,8
+	xor	a
+div10_byte:
+	ld	c,(hl)
+	ld	d,8
+div10_bit:
+	sla	c		; Remainder:byte shifted left one bit
+	rla
+	cp	10
+	jr	c,div10_next
+	sub	10
+	inc	c		; Quotient bit
+div10_next:
+	dec	d
+	jr	nz,div10_bit
+	ld	(hl),c
+	dec	hl
+	djnz	div10_byte
+	ret
+
+; Z set if the 64-bit number at HL is zero
+is_zero64:
+	ld	b,8
+	xor	a
+is_zero64_loop:
+	or	(hl)
+	inc	hl
+	djnz	is_zero64_loop
+	ret
+
+; Error handlers
+usage:
+	ld	de,msg_usage
+	ld	c,C_PRINT
+	call	BDOS
+	rst	0
+
+no_clock:
+	ld	de,msg_no_clock
+	ld	c,C_PRINT
+	call	BDOS
+	rst	0
+
+; Test table: 4-character name, routine
+tests:
+	db	'CON '
+	dw	t_con
+	db	'SEQ '
+	dw	t_seq
+	db	'RND '
+	dw	t_rnd
+	db	'DIO '
+	dw	t_dio
+	db	'BNK '
+	dw	t_bnk
+	db	'MATH'
+	dw	t_math
+	db	'ALL '
+	dw	t_all
+	db	0
+
+; Messages
+msg_banner:
+	db	'BENCH - Guest-side benchmarks',0Dh,0Ah,'$'
+msg_usage:
+	db	'Usage: BENCH [CON|SEQ|RND|DIO [unit]|BNK|MATH|ALL]',0Dh,0Ah,'$'
+msg_no_clock:
+	db	'Error: HCSCLOCK not available (needs romwbw_emu)',0Dh,0Ah,'$'
+msg_disk_err:
+	db	'Error: BENCH.TMP create/read/write failed',0Dh,0Ah,'$'
+msg_dio_err:
+	db	'Error: HBIOS disk read failed',0Dh,0Ah,'$'
+msg_ns:
+	db	' ns  $'
+msg_tstates:
+	db	' T-states',0Dh,0Ah,'$'
+msg_primes:
+	db	' primes',0Dh,0Ah,'$'
+lbl_con:
+	db	'CON  4096 chars    $'
+lbl_seqw:
+	db	'SEQ  write 32K     $'
+lbl_seqr:
+	db	'SEQ  read 32K      $'
+lbl_rndw:
+	db	'RND  write 256 rec $'
+lbl_rndr:
+	db	'RND  read 256 rec  $'
+lbl_dio:
+	db	'DIO  read 256 sec  $'
+lbl_bnk:
+	db	'BNK  copy 1M       $'
+lbl_math:
+	db	'MATH sieve x10     $'
+con_line:
+	db	'0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz'
+	db	0Dh,0Ah,'$'
+
+fcb_template:
+	db	0,'BENCH   TMP'
+	ds	24,0
+
+; Data areas
+arg_name:
+	db	'    '
+dio_unit:
+	db	0
+seed:
+	db	0
+lba:
+	dw	0
+passes:
+	db	0
+primes:
+	dw	0
+num_ptr:
+	dw	0
+clk_t0:
+	ds	16
+clk_t1:
+	ds	16
+num64:
+	ds	8
+num_buf:
+	ds	20
+num_end:
+	ds	1
+tail:
+	ds	129
+fcb:
+	ds	36
+dma_buffer:
+	ds	128
+	ds	128
+stack_top:
+
+	end	start
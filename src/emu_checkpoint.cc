@@ -0,0 +1,126 @@
+/*
+ * Emulator Checkpoint - Save a running machine and resume it later
+ */
+
+#include "emu_checkpoint.h"
+#include "emu_io.h"
+#include "hbios_cpu.h"
+#include "hbios_dispatch.h"
+#include "romwbw_mem.h"
+#include <cstdio>
+#include <unistd.h>
+
+namespace {
+
+const char CKPT_MAGIC[8] = { 'R', 'W', 'C', 'K', 'P', 'T', '0', '1' };
+
+}  // namespace
+
+std::vector<uint8_t> emu_checkpoint_encode(hbios_cpu& cpu, banked_mem& memory,
+                                           HBIOSDispatch& hbios,
+                                           const StateWriter& platform) {
+  StateWriter w;
+  w.bytes(CKPT_MAGIC, sizeof(CKPT_MAGIC));
+
+  w.begin("CPU ");
+  cpu.save_state(w);
+  w.end();
+
+  w.begin("MEM ");
+  memory.save_state(w);
+  w.end();
+
+  w.begin("HBIO");
+  hbios.saveState(w);
+  w.end();
+
+  // Host input read ahead of the guest; it is handed back to the queue so
+  // this process can keep running if the write fails
+  std::vector<int> pending;
+  emu_console_take_pending(pending);
+  w.begin("CONS");
+  w.u32(pending.size());
+  for (int ch : pending) w.u16((uint16_t)ch);
+  w.end();
+  for (int ch : pending) emu_console_queue_char(ch);
+  fflush(stdout);
+
+  w.begin("PLAT");
+  w.bytes(platform.data().data(), platform.data().size());
+  w.end();
+
+  w.begin("END ");
+  w.end();
+  return w.data();
+}
+
+bool emu_checkpoint_save(const std::string& path, hbios_cpu& cpu,
+                         banked_mem& memory, HBIOSDispatch& hbios,
+                         const StateWriter& platform) {
+  std::vector<uint8_t> data = emu_checkpoint_encode(cpu, memory, hbios, platform);
+
+  // Write beside the target and rename, so a crash leaves either the old
+  // checkpoint or the new one
+  std::string tmp = path + ".tmp";
+  FILE* f = fopen(tmp.c_str(), "wb");
+  if (!f) {
+    emu_error("[CHECKPOINT] Cannot create %s\n", tmp.c_str());
+    return false;
+  }
+  bool ok = fwrite(data.data(), 1, data.size(), f) == data.size() &&
+            fflush(f) == 0 && fsync(fileno(f)) == 0;
+  ok = (fclose(f) == 0) && ok;
+  if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+    emu_error("[CHECKPOINT] Write to %s failed\n", path.c_str());
+    remove(tmp.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool emu_checkpoint_load(const std::string& path, hbios_cpu& cpu,
+                         banked_mem& memory, HBIOSDispatch& hbios,
+                         std::vector<uint8_t>& platform) {
+  std::vector<uint8_t> data;
+  if (!emu_file_load(path, data)) return false;
+  return emu_checkpoint_decode(data.data(), data.size(), path, cpu, memory, hbios, platform);
+}
+
+bool emu_checkpoint_decode(const uint8_t* data, size_t size, const std::string& name,
+                           hbios_cpu& cpu, banked_mem& memory, HBIOSDispatch& hbios,
+                           std::vector<uint8_t>& platform) {
+  if (size < sizeof(CKPT_MAGIC) || memcmp(data, CKPT_MAGIC, sizeof(CKPT_MAGIC)) != 0) {
+    emu_error("[CHECKPOINT] %s is not a checkpoint\n", name.c_str());
+    return false;
+  }
+
+  StateReader r(data + sizeof(CKPT_MAGIC), size - sizeof(CKPT_MAGIC));
+  bool ok = r.begin("CPU ") && cpu.load_state(r);
+  r.leave();
+  ok = ok && r.begin("MEM ") && memory.load_state(r);
+  r.leave();
+  ok = ok && r.begin("HBIO") && hbios.loadState(r);
+  r.leave();
+
+  if (ok && r.begin("CONS")) {
+    uint32_t count = r.u32();
+    emu_console_clear_queue();
+    for (uint32_t i = 0; i < count && r.ok(); i++) {
+      emu_console_queue_char((int16_t)r.u16());
+    }
+    ok = r.ok();
+  }
+  r.leave();
+
+  if (ok && r.begin("PLAT") && r.remaining() > 0) {
+    platform.resize(r.remaining());
+    r.bytes(platform.data(), platform.size());
+  }
+  r.leave();
+
+  ok = ok && r.begin("END ") && r.ok();
+  if (!ok) {
+    emu_error("[CHECKPOINT] %s is damaged or from an incompatible build\n", name.c_str());
+  }
+  return ok;
+}
@@ -0,0 +1,148 @@
+/*
+ * Emulator Checkpoint - Save a running machine and resume it later
+ *
+ * A checkpoint is a sequence of tagged sections, one per component:
+ *   "RWCKPT01"                    magic
+ *   { char tag[4], u32 length, payload }...
+ *   "END " section
+ *
+ * Components serialize themselves through StateWriter/StateReader
+ * (hbios_cpu and banked_mem save_state/load_state, HBIOSDispatch
+ * saveState/loadState). The platform adds its own section for state kept
+ * outside those classes.
+ * All values are little-endian, so a checkpoint written by one build can
+ * be resumed by the next one.
+ */
+
+#ifndef EMU_CHECKPOINT_H
+#define EMU_CHECKPOINT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+class StateWriter {
+public:
+  void u8(uint8_t v) { buf.push_back(v); }
+  void u16(uint16_t v) { u8(v & 0xFF); u8(v >> 8); }
+  void u32(uint32_t v) { u16(v & 0xFFFF); u16(v >> 16); }
+  void u64(uint64_t v) { u32((uint32_t)v); u32((uint32_t)(v >> 32)); }
+  void flag(bool v) { u8(v ? 1 : 0); }
+  void bytes(const void* p, size_t len) {
+    const uint8_t* b = static_cast<const uint8_t*>(p);
+    buf.insert(buf.end(), b, b + len);
+  }
+  void str(const std::string& s) { u32(s.size()); bytes(s.data(), s.size()); }
+
+  // Sections: begin writes the tag and a length placeholder, end fills it in
+  void begin(const char tag[4]) {
+    bytes(tag, 4);
+    section_start = buf.size();
+    u32(0);
+  }
+  void end() {
+    uint32_t len = buf.size() - section_start - 4;
+    for (int i = 0; i < 4; i++) buf[section_start + i] = (uint8_t)(len >> (8 * i));
+  }
+
+  const std::vector<uint8_t>& data() const { return buf; }
+
+private:
+  std::vector<uint8_t> buf;
+  size_t section_start = 0;
+};
+
+// Reads past the end of the data (or of the current section) set the
+// failed flag and return zeros, so callers check ok() once at the end
+class StateReader {
+public:
+  StateReader(const uint8_t* data, size_t len) : p(data), n(len) {}
+
+  uint8_t u8() {
+    if (pos >= limit()) { failed = true; return 0; }
+    return p[pos++];
+  }
+  uint16_t u16() { uint16_t lo = u8(); return lo | (u8() << 8); }
+  uint32_t u32() { uint32_t lo = u16(); return lo | ((uint32_t)u16() << 16); }
+  uint64_t u64() { uint64_t lo = u32(); return lo | ((uint64_t)u32() << 32); }
+  bool flag() { return u8() != 0; }
+  void bytes(void* out, size_t len) {
+    if (len > limit() - pos) { failed = true; memset(out, 0, len); return; }
+    memcpy(out, p + pos, len);
+    pos += len;
+  }
+  std::string str() {
+    uint32_t len = u32();
+    if (len > limit() - pos) { failed = true; return std::string(); }
+    std::string s(reinterpret_cast<const char*>(p + pos), len);
+    pos += len;
+    return s;
+  }
+
+  // Enter the next section, which must carry this tag; leave skips any
+  // bytes the section has that this build does not read
+  bool begin(const char tag[4]) {
+    if (section_end != 0 || n - pos < 8 || memcmp(p + pos, tag, 4) != 0) {
+      failed = true;
+      return false;
+    }
+    pos += 4;
+    uint32_t len = u32();
+    if (len > n - pos) { failed = true; return false; }
+    section_end = pos + len;
+    return true;
+  }
+  void leave() {
+    if (section_end) pos = section_end;
+    section_end = 0;
+  }
+
+  bool ok() const { return !failed; }
+
+  // Bytes left in the current section (or the data); check counts read
+  // from the stream against this before allocating for them
+  size_t remaining() const { return limit() - pos; }
+
+private:
+  const uint8_t* p;
+  size_t n;
+  size_t pos = 0;
+  size_t section_end = 0;
+  bool failed = false;
+
+  size_t limit() const { return section_end ? section_end : n; }
+};
+
+class hbios_cpu;
+class banked_mem;
+class HBIOSDispatch;
+
+// Serialize a full machine checkpoint (CPU, memory, HBIOS state with disks
+// flushed, pending console input) plus the platform section
+std::vector<uint8_t> emu_checkpoint_encode(hbios_cpu& cpu, banked_mem& memory,
+                                           HBIOSDispatch& hbios,
+                                           const StateWriter& platform);
+
+// Restore a checkpoint held in memory; name identifies it in messages.
+// Same rules as emu_checkpoint_load.
+bool emu_checkpoint_decode(const uint8_t* data, size_t size, const std::string& name,
+                           hbios_cpu& cpu, banked_mem& memory, HBIOSDispatch& hbios,
+                           std::vector<uint8_t>& platform);
+
+// Write emu_checkpoint_encode's checkpoint to path. The file is replaced
+// atomically. Returns false on I/O error.
+bool emu_checkpoint_save(const std::string& path, hbios_cpu& cpu,
+                         banked_mem& memory, HBIOSDispatch& hbios,
+                         const StateWriter& platform);
+
+// Restore a checkpoint written by emu_checkpoint_save into a machine set
+// up the same way (same ROM and disk options). platform receives the
+// platform section. Returns false if the file is missing or invalid; the
+// machine state is undefined after a failure part way through.
+bool emu_checkpoint_load(const std::string& path, hbios_cpu& cpu,
+                         banked_mem& memory, HBIOSDispatch& hbios,
+                         std::vector<uint8_t>& platform);
+
+#endif // EMU_CHECKPOINT_H
@@ -0,0 +1,348 @@
+/*
+ * Control Socket - Runtime control of a live machine over a Unix socket
+ */
+
+#include "emu_control.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+// A client sending more than this without a newline is dropped
+const size_t MAX_REQUEST = 64 * 1024;
+
+void skip_space(const char*& p) {
+  while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') p++;
+}
+
+void put_utf8(std::string& out, unsigned cp) {
+  if (cp < 0x80) {
+    out += (char)cp;
+  } else if (cp < 0x800) {
+    out += (char)(0xC0 | (cp >> 6));
+    out += (char)(0x80 | (cp & 0x3F));
+  } else {
+    out += (char)(0xE0 | (cp >> 12));
+    out += (char)(0x80 | ((cp >> 6) & 0x3F));
+    out += (char)(0x80 | (cp & 0x3F));
+  }
+}
+
+// Parse a JSON string at p (on the opening quote)
+bool parse_string(const char*& p, std::string& out) {
+  if (*p != '"') return false;
+  p++;
+  out.clear();
+  while (*p && *p != '"') {
+    if (*p != '\\') {
+      out += *p++;
+      continue;
+    }
+    p++;
+    switch (*p) {
+      case '"': case '\\': case '/': out += *p; break;
+      case 'b': out += '\b'; break;
+      case 'f': out += '\f'; break;
+      case 'n': out += '\n'; break;
+      case 'r': out += '\r'; break;
+      case 't': out += '\t'; break;
+      case 'u': {
+        unsigned cp = 0;
+        for (int i = 1; i <= 4; i++) {
+          char c = p[i];
+          if (!isxdigit((unsigned char)c)) return false;
+          cp = cp * 16 + (isdigit((unsigned char)c) ? c - '0' : (tolower(c) - 'a' + 10));
+        }
+        put_utf8(out, cp);
+        p += 4;
+        break;
+      }
+      default:
+        return false;
+    }
+    p++;
+  }
+  if (*p != '"') return false;
+  p++;
+  return true;
+}
+
+} // namespace
+
+//=============================================================================
+// Requests and replies
+//=============================================================================
+
+bool ControlRequest::parse(const std::string& line, std::string& error) {
+  fields.clear();
+  const char* p = line.c_str();
+  skip_space(p);
+  if (*p++ != '{') {
+    error = "request is not a JSON object";
+    return false;
+  }
+  skip_space(p);
+  if (*p == '}') p++;
+  else {
+    while (true) {
+      std::string key;
+      skip_space(p);
+      if (!parse_string(p, key)) {
+        error = "bad member name";
+        return false;
+      }
+      skip_space(p);
+      if (*p++ != ':') {
+        error = "expected ':' after \"" + key + "\"";
+        return false;
+      }
+      skip_space(p);
+      Value v;
+      v.quoted = *p == '"';
+      if (v.quoted) {
+        if (!parse_string(p, v.text)) {
+          error = "bad string value for \"" + key + "\"";
+          return false;
+        }
+      } else {
+        const char* start = p;
+        while (isalnum((unsigned char)*p) || *p == '-' || *p == '+' || *p == '.') p++;
+        if (p == start) {
+          error = "unsupported value for \"" + key + "\"";
+          return false;
+        }
+        v.text.assign(start, p);
+      }
+      fields[key] = v;
+      skip_space(p);
+      if (*p == ',') {
+        p++;
+        continue;
+      }
+      if (*p++ == '}') break;
+      error = "expected ',' or '}'";
+      return false;
+    }
+  }
+  skip_space(p);
+  if (*p) {
+    error = "text after the request object";
+    return false;
+  }
+  return true;
+}
+
+bool ControlRequest::isString(const std::string& key) const {
+  auto it = fields.find(key);
+  return it != fields.end() && it->second.quoted;
+}
+
+std::string ControlRequest::str(const std::string& key, const std::string& def) const {
+  auto it = fields.find(key);
+  return it == fields.end() ? def : it->second.text;
+}
+
+long long ControlRequest::num(const std::string& key, long long def) const {
+  auto it = fields.find(key);
+  if (it == fields.end()) return def;
+  const char* s = it->second.text.c_str();
+  char* end;
+  long long v = strtoll(s, &end, 0);
+  return end == s ? def : v;
+}
+
+std::string ControlReply::quote(const std::string& s) {
+  std::string out = "\"";
+  for (unsigned char c : s) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += (char)c;
+    } else if (c < 0x20) {
+      char esc[8];
+      snprintf(esc, sizeof(esc), "\\u%04x", c);
+      out += esc;
+    } else {
+      out += (char)c;
+    }
+  }
+  return out + "\"";
+}
+
+void ControlReply::error(const std::string& message) {
+  ok = false;
+  members = ",\"error\":" + quote(message);
+}
+
+void ControlReply::add(const std::string& key, const std::string& value) {
+  addRaw(key, quote(value));
+}
+
+void ControlReply::add(const std::string& key, long long value) {
+  addRaw(key, std::to_string(value));
+}
+
+void ControlReply::add(const std::string& key, bool value) {
+  addRaw(key, value ? "true" : "false");
+}
+
+void ControlReply::addRaw(const std::string& key, const std::string& json) {
+  members += "," + quote(key) + ":" + json;
+}
+
+std::string ControlReply::line() const {
+  return std::string("{\"ok\":") + (ok ? "true" : "false") + members + "}\n";
+}
+
+std::string ControlReply::eventLine(const std::string& name) const {
+  return "{\"event\":" + quote(name) + members + "}\n";
+}
+
+//=============================================================================
+// Socket
+//=============================================================================
+
+bool ControlSocket::open(const std::string& path, std::string& error) {
+  close();
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path)) {
+    error = "socket path too long";
+    return false;
+  }
+  strcpy(addr.sun_path, path.c_str());
+
+  // Replace a socket left by a crashed run, but nothing else
+  struct stat st;
+  if (lstat(path.c_str(), &st) == 0) {
+    if (!S_ISSOCK(st.st_mode)) {
+      error = path + " exists and is not a socket";
+      return false;
+    }
+    unlink(path.c_str());
+  }
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+  if (fd < 0 || bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 4) != 0) {
+    error = strerror(errno);
+    if (fd >= 0) ::close(fd);
+    return false;
+  }
+  listen_fd = fd;
+  socket_path = path;
+  return true;
+}
+
+void ControlSocket::close() {
+  for (Client& c : clients) ::close(c.fd);
+  clients.clear();
+  if (listen_fd >= 0) {
+    ::close(listen_fd);
+    listen_fd = -1;
+    unlink(socket_path.c_str());
+  }
+}
+
+// Poll the listening socket, then each client, then wake_fd
+int ControlSocket::pollAll(std::vector<struct pollfd>& fds, int timeout_ms, int wake_fd) {
+  fds.push_back({listen_fd, POLLIN, 0});
+  for (const Client& c : clients) fds.push_back({c.fd, POLLIN, 0});
+  if (wake_fd >= 0) fds.push_back({wake_fd, POLLIN, 0});
+  return poll(fds.data(), fds.size(), timeout_ms);
+}
+
+bool ControlSocket::wait(int timeout_ms, int wake_fd) {
+  if (listen_fd < 0) return false;
+  std::vector<struct pollfd> fds;
+  return pollAll(fds, timeout_ms, wake_fd) > 0;
+}
+
+bool ControlSocket::service(const Handler& handler, int timeout_ms, int wake_fd) {
+  if (listen_fd < 0) return false;
+
+  std::vector<struct pollfd> fds;
+  int n = pollAll(fds, timeout_ms, wake_fd);
+  if (n <= 0) return false;  // Timeout, or a signal for the caller to see
+
+  // Clients first: the indexes in fds match clients until accept adds more
+  size_t count = clients.size();
+  for (size_t i = 0; i < count; i++) {
+    if (!(fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+    Client& c = clients[i];
+    char buf[4096];
+    ssize_t got = read(c.fd, buf, sizeof(buf));
+    if (got <= 0) {
+      ::close(c.fd);
+      c.fd = -1;
+      continue;
+    }
+    c.pending.append(buf, got);
+    size_t nl;
+    while (c.fd >= 0 && (nl = c.pending.find('\n')) != std::string::npos) {
+      std::string line = c.pending.substr(0, nl);
+      c.pending.erase(0, nl + 1);
+      answer(c, line, handler);
+    }
+    if (c.fd >= 0 && c.pending.size() > MAX_REQUEST) {
+      ::close(c.fd);
+      c.fd = -1;
+    }
+  }
+  clients.erase(std::remove_if(clients.begin(), clients.end(),
+                               [](const Client& c) { return c.fd < 0; }),
+                clients.end());
+
+  if (fds[0].revents & POLLIN) {
+    int fd;
+    while ((fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK)) >= 0) {
+      clients.push_back({fd, std::string()});
+    }
+  }
+
+  return wake_fd >= 0 && (fds.back().revents & (POLLIN | POLLHUP | POLLERR));
+}
+
+void ControlSocket::notify(const std::string& event, const ControlReply& members) {
+  std::string out = members.eventLine(event);
+  for (Client& c : clients) {
+    if (send(c.fd, out.data(), out.size(), MSG_NOSIGNAL) != (ssize_t)out.size()) {
+      ::close(c.fd);
+      c.fd = -1;
+    }
+  }
+  clients.erase(std::remove_if(clients.begin(), clients.end(),
+                               [](const Client& c) { return c.fd < 0; }),
+                clients.end());
+}
+
+void ControlSocket::answer(Client& c, const std::string& line, const Handler& handler) {
+  if (line.find_first_not_of(" \t\r") == std::string::npos) return;
+
+  ControlRequest req;
+  ControlReply reply;
+  std::string error;
+  if (!req.parse(line, error)) {
+    reply.error(error);
+  } else if (!req.has("cmd")) {
+    reply.error("missing \"cmd\"");
+  } else {
+    handler(req, reply);
+  }
+
+  // Replies are short; a client that stops reading is dropped
+  std::string out = reply.line();
+  if (send(c.fd, out.data(), out.size(), MSG_NOSIGNAL) != (ssize_t)out.size()) {
+    ::close(c.fd);
+    c.fd = -1;
+  }
+}
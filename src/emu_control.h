@@ -0,0 +1,125 @@
+/*
+ * Control Socket - Runtime control of a live machine over a Unix socket
+ *
+ * With --control=PATH the emulator listens on a Unix stream socket. Each
+ * request is one line holding a flat JSON object with a "cmd" member;
+ * each reply is one line:
+ *
+ *   -> {"cmd":"attach","unit":1,"path":"disks/hd1k_infocom.img"}
+ *   <- {"ok":true}
+ *   -> {"cmd":"stats"}
+ *   <- {"ok":true,"instructions":123456789,"pc":"0xE406",...}
+ *   -> {"cmd":"bogus"}
+ *   <- {"ok":false,"error":"unknown command: bogus"}
+ *
+ * Commands (handled in romwbw_emu.cc):
+ *   stats                          counters, PC, bank, HBIOS calls, disks
+ *   input    text                  queue console input
+ *   pause / resume                 stop and restart the CPU
+ *   attach / replace  unit, path[, slices]   hot-plug a disk image
+ *   detach   unit
+ *   snapshot path                  write a session checkpoint
+ *   break / unbreak  addr          breakpoints ("unbreak" accepts "all");
+ *   breaks                         a hit pauses the machine
+ *
+ * Events are lines sent unasked to every connected client, with "event"
+ * in place of "ok" (notify):
+ *
+ *   <- {"event":"watchdog","pc":"8E:0100","instructions":...,"seconds":60}
+ *
+ * The socket is serviced by the main loop between execution batches
+ * (a zero-timeout poll every CONTROL_POLL instructions), while the guest
+ * blocks for console input, and continuously while paused. Requests run
+ * on the emulator thread, so handlers may touch the machine directly.
+ * Values are strings, numbers, true, false or null; nested objects and
+ * arrays are not accepted in requests.
+ */
+
+#ifndef EMU_CONTROL_H
+#define EMU_CONTROL_H
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+class ControlRequest {
+public:
+  bool has(const std::string& key) const { return fields.count(key) != 0; }
+  // True if the value was given as a JSON string
+  bool isString(const std::string& key) const;
+  std::string str(const std::string& key, const std::string& def = "") const;
+  long long num(const std::string& key, long long def = 0) const;
+
+  // Parse one request line; false with error set if it is not a flat object
+  bool parse(const std::string& line, std::string& error);
+
+private:
+  struct Value {
+    std::string text;  // Unescaped string, or the literal
+    bool quoted;
+  };
+  std::map<std::string, Value> fields;
+};
+
+class ControlReply {
+public:
+  void error(const std::string& message);
+  void add(const std::string& key, const std::string& value);
+  void add(const std::string& key, const char* value) { add(key, std::string(value)); }
+  void add(const std::string& key, long long value);
+  void add(const std::string& key, bool value);
+  // value is already JSON (an array or object built by the handler)
+  void addRaw(const std::string& key, const std::string& json);
+
+  std::string line() const;
+  // {"event":name,...members}
+  std::string eventLine(const std::string& name) const;
+
+  static std::string quote(const std::string& s);
+
+private:
+  bool ok = true;
+  std::string members;
+};
+
+struct pollfd;
+
+class ControlSocket {
+public:
+  typedef std::function<void(const ControlRequest&, ControlReply&)> Handler;
+
+  ~ControlSocket() { close(); }
+
+  // Listen on path (a stale socket file is replaced)
+  bool open(const std::string& path, std::string& error);
+  void close();
+  bool isOpen() const { return listen_fd >= 0; }
+
+  // Accept connections and answer complete request lines, waiting up to
+  // timeout_ms (-1 = until something happens) for activity. If wake_fd is
+  // given, also returns when it becomes readable; the result says so.
+  bool service(const Handler& handler, int timeout_ms, int wake_fd = -1);
+
+  // Wait like service, but leave requests unanswered: true once a client
+  // has something to send, a new one connects or wake_fd is readable
+  bool wait(int timeout_ms, int wake_fd = -1);
+
+  // Send an event (members as built by a ControlReply) to every client
+  void notify(const std::string& event, const ControlReply& members);
+
+private:
+  struct Client {
+    int fd;
+    std::string pending;  // Partial request line
+  };
+
+  std::string socket_path;
+  int listen_fd = -1;
+  std::vector<Client> clients;
+
+  void answer(Client& c, const std::string& line, const Handler& handler);
+  int pollAll(std::vector<struct pollfd>& fds, int timeout_ms, int wake_fd);
+};
+
+#endif // EMU_CONTROL_H
@@ -8,6 +8,8 @@
 ; No actual hardware I/O is performed - HBIOS calls are handled by the emulator.
 ;
 ; I/O Ports:
+;   0xEA - Console input pending (IN returns non-zero if host has input)
+;   0xEB - Console input data (IN returns next host input character)
 ;   0xEE - Signal port (init/status signaling)
 ;   0xEF - HBIOS dispatch trigger (OUT triggers emulator to handle HBIOS call)
 ;
@@ -15,7 +17,9 @@
 ;   1. Caller sets up B=function, C=unit, other regs as needed
 ;   2. Caller executes RST 08 (or CALL 0xFFF0)
 ;   3. RST 08 vector at 0x0008 is JP 0xFFF0
-;   4. At 0xFFF0: OUT (0xEF),A triggers emulator dispatch
+;   4. At 0xFFF0: OUT (0xEF),A triggers emulator dispatch (no bank switch:
+;      the emulator handles every function class in C++, including DIO
+;      transfers into the caller's bank)
 ;   5. Emulator reads B,C,D,E,H,L, performs operation, sets A=result
 ;   6. RET instruction returns to caller
 ;
@@ -24,11 +28,22 @@
 ;   - I/O port trap works regardless of memory bank configuration
 ;   - No PC-based trapping that can break during bank switches
 ;
+; Interrupt-driven console input (optional, emulator --console-int):
+;   After the proxy is installed, HB_START sends signal 0x03. If the emulator
+;   accepts, it sets HBX_CONINT and HB_START enables IM2 with the vector in
+;   the proxy. When host input arrives the emulator raises an interrupt and
+;   HBX_INT moves characters from port 0xEB into a 16 byte ring in the proxy.
+;   CIOIST/CIOIN are then answered from the ring without trapping. If the
+;   ring is empty, CIOIN and (with interrupts disabled) CIOIST still trap.
+;   Only in this mode is 0xFFF0 patched to JP HBX_INVOKE, which checks B
+;   first; otherwise 0xFFF0 stays OUT/RET and every call traps directly.
+;
 ; Memory Layout:
 ;   0x0000-0x00FF  Page zero (RST vectors, etc.)
 ;   0x0100-0x03FF  HCB and startup code
 ;   0x0400-0x05FF  Proxy image (copied to 0xFE00 at startup)
 ;   0xFE00-0xFFFF  HBIOS proxy (in upper RAM after copy)
+;   0xFFC0-0xFFD5  Console input ring and IM2 vector (in proxy)
 ;
 ; Assemble with: um80 -g emu_hbios.asm; ul80 -o emu_hbios.bin -p 0000 emu_hbios.rel
 ;
@@ -38,9 +53,22 @@ EMU_SIGNAL_PORT	equ	0EEh		; Port to signal emulator (init/status)
 EMU_DISPATCH_PORT equ	0EFh		; Port to trigger HBIOS dispatch
 EMU_BNKCALL_PORT  equ	0EDh		; Port to trigger bank call (IX=addr, A=bank)
 EMU_BNKCPY_PORT   equ	0ECh		; Port to trigger bank copy (params at 0xFFE2-0xFFE9)
+EMU_CONST_PORT	equ	0EAh		; Port to query host console input pending
+EMU_CONDAT_PORT	equ	0EBh		; Port to read next host console character
 HBX_LOC		equ	0FE00h		; Target location of proxy
 HBX_SIZ		equ	0200h		; Size of proxy (512 bytes)
 
+; Console input ring in the installed proxy (see HBX_CONRING below)
+HBX_CONBUF	equ	0FFC0h		; 16 byte ring buffer (must be 16-aligned)
+HBX_CONINT	equ	0FFD0h		; Non-zero when emulator enabled the ring
+HBX_CONHD	equ	0FFD1h		; Ring head index (written by HBX_INT)
+HBX_CONTL	equ	0FFD2h		; Ring tail index (written by CIOIN)
+HBX_CONVEC	equ	0FFD4h		; IM2 vector (I=0FFh, data bus=0D4h)
+HBX_CONMSK	equ	0Fh		; Ring index mask
+
+BF_CIOIN	equ	000h		; HBIOS CIO character input
+BF_CIOIST	equ	002h		; HBIOS CIO input status
+
 ;==================================================================================================
 ; Page Zero - RST Vectors
 ;==================================================================================================
@@ -74,8 +102,7 @@ RST30:	ret
 
 	org	0038h
 RST38:
-	ei
-	reti				; IM1 interrupt handler
+	jp	HBX_LOC + HBX_INT_START	; IM1 interrupt handler (in proxy)
 
 	org	0066h
 NMI66:
@@ -209,10 +236,30 @@ HB_START:
 	ld	a, h
 	out	(EMU_SIGNAL_PORT), a
 
+	; Offer the interrupt-driven console ring; the emulator sets
+	; HBX_CONINT if it will raise interrupts for host input
+	ld	a, 003h			; Signal: console ring available
+	out	(EMU_SIGNAL_PORT), a
+
 	; Signal done - emulator should start trapping
 	ld	a, 0FFh			; Signal: init complete
 	out	(EMU_SIGNAL_PORT), a
 
+	; Enable console interrupts if the emulator accepted the ring, and
+	; patch 0xFFF0 to JP the ring-aware invoke
+	ld	a, (HBX_CONINT)
+	or	a
+	jr	z, HB_START1
+	ld	a, 0C3h			; JP opcode over OUT (0xEF),A / RET
+	ld	(HBX_LOC + HBX_ENTRY), a
+	ld	hl, HBX_LOC + HBX_INVOKE_START
+	ld	(HBX_LOC + HBX_ENTRY + 1), hl
+	ld	a, HBX_CONVEC / 256	; IM2 table page
+	ld	i, a
+	im	2
+	ei
+HB_START1:
+
 	; Jump to romldr in bank 1
 	; We need to execute from common RAM (>= 0x8000) when switching banks,
 	; otherwise after SYSSETBNK returns, we'll be executing bank 1's code
@@ -241,19 +288,10 @@ BANK_TRAMPOLINE_END:
 ;==================================================================================================
 
 HB_INVOKE:
-	; Route to appropriate dispatcher based on function code in B
-	ld	a, b
-	cp	010h
-	jp	c, CIO_DISPATCH		; 0x00-0x0F: Character I/O
-	cp	020h
-	jp	c, DIO_DISPATCH		; 0x10-0x1F: Disk I/O
-	cp	030h
-	jp	c, RTC_DISPATCH		; 0x20-0x2F: RTC
-	cp	0F0h
-	jp	nc, SYS_DISPATCH	; 0xF0-0xFF: System
-	; Other functions not implemented
-	ld	a, 0FFh			; Error: not implemented
-	ret
+	; The emulator routes on the function code in B (and answers unknown
+	; functions with an error), so every class traps directly
+	out	(EMU_DISPATCH_PORT), a	; Trigger emulator dispatch
+	ret				; Emulator has set A with result
 
 ;==================================================================================================
 ; CIO_DISPATCH - Character I/O dispatch
@@ -330,6 +368,98 @@ HBX_SEL_ROM:
 	out	(07Ch), a		; ROM bank select port
 	ret
 
+; HBIOS invoke with console ring (HB_START patches 0xFFF0 to jump here once
+; the ring is enabled). CIOIST/CIOIN are answered from the ring, everything
+; else traps to the emulator.
+HBX_INVOKE_START equ $ - HBX_IMG
+	ld	a, b
+	cp	BF_CIOIST
+	jr	z, HBX_CIOIST
+	or	a			; BF_CIOIN?
+	jr	z, HBX_CIOIN
+HBX_TRAP:
+	out	(EMU_DISPATCH_PORT), a	; Trigger emulator dispatch
+	ret				; Emulator has set A with result
+
+HBX_CIOIST:
+	push	hl
+	ld	hl, HBX_CONTL
+	ld	a, (HBX_CONHD)
+	sub	(hl)			; A = head - tail
+	and	HBX_CONMSK		; A = chars buffered, Z if none
+	ld	e, a			; E = pending count
+	pop	hl
+	ret	nz			; Input is waiting in the ring
+	ld	a, i			; P/V = IFF2
+	jp	po, HBX_LOC + (HBX_TRAP - HBX_IMG) ; Interrupts off - ask emulator
+	xor	a			; A=0, Z set: no input yet
+	ret
+
+HBX_CIOIN:
+	push	hl
+	ld	hl, HBX_CONTL
+	ld	a, (HBX_CONHD)
+	cp	(hl)			; Ring empty?
+	jr	z, HBX_CIOIN1		; Yes - emulator waits for input
+	ld	a, (hl)			; A = tail index
+	or	HBX_CONBUF - 0FF00h	; L = low byte of ring slot
+	ld	l, a
+	ld	e, (hl)			; E = character
+	ld	hl, HBX_CONTL
+	inc	(hl)			; Advance tail (after the read)
+	res	4, (hl)			; Wrap at 16
+	pop	hl
+	xor	a			; A=0, Z set: success
+	ret
+HBX_CIOIN1:
+	pop	hl
+	jr	HBX_TRAP
+
+; Console input interrupt handler (IM2 via HBX_CONVEC, IM1 via RST 38)
+; Moves host input into the ring until the host queue is drained or the
+; ring is full. Only the head index is written here.
+HBX_INT_START equ $ - HBX_IMG
+	push	af
+	push	de
+	push	hl
+HBX_INT1:
+	in	a, (EMU_CONST_PORT)	; Host input pending?
+	or	a
+	jr	z, HBX_INT2		; No - done
+	ld	hl, HBX_CONHD
+	ld	a, (hl)
+	ld	e, a			; E = head index
+	inc	a
+	and	HBX_CONMSK
+	ld	d, a			; D = next head index
+	inc	hl			; HL = HBX_CONTL
+	cp	(hl)
+	jr	z, HBX_INT2		; Ring full - rest stays on the host
+	ld	a, e
+	or	HBX_CONBUF - 0FF00h
+	ld	l, a			; HL = ring slot
+	in	a, (EMU_CONDAT_PORT)	; A = host character
+	ld	(hl), a
+	ld	a, d
+	ld	(HBX_CONHD), a		; Publish after the store
+	jr	HBX_INT1
+HBX_INT2:
+	pop	hl
+	pop	de
+	pop	af
+	ei
+	reti
+
+	org	06C0h			; Console ring at offset 0x1C0 (0xFFC0 when installed)
+
+; Offset 0x1C0: Console input ring (see HBX_CONBUF equates)
+HBX_CONRING:	ds	16, 0		; Ring buffer
+		db	0		; HBX_CONINT: ring enabled flag
+		db	0		; HBX_CONHD: head index
+		db	0		; HBX_CONTL: tail index
+		db	0		; Reserved
+		dw	HBX_LOC + HBX_INT_START	; HBX_CONVEC: IM2 vector
+
 	org	06E0h			; PMGMT at offset 0x1E0 within HBX_IMG (0xFFE0 when installed)
 
 ; Offset 0x1E0: HBIOS Proxy Management Block (at 0xFFE0 when installed)
@@ -348,7 +478,8 @@ PMGMT_LOCK:	db	0FEh		; Mutex lock
 	org	06F0h			; Entry points at offset 0x1F0 (0xFFF0 when installed)
 
 ; Offset 0x1F0: Fixed address entry points (at 0xFFF0 when installed)
-	out	(EMU_DISPATCH_PORT), a	; 0xFFF0: HBIOS invoke (triggers emulator)
+HBX_ENTRY equ $ - HBX_IMG
+	out	(EMU_DISPATCH_PORT), a	; 0xFFF0: HBIOS invoke (HB_START may patch to JP)
 	ret				; 0xFFF2: Return to caller
 	jp	HBX_LOC + HBX_BNKSEL_START ; 0xFFF3: Bank select (in proxy)
 	out	(EMU_BNKCPY_PORT), a	; 0xFFF6: Bank copy (triggers emulator)
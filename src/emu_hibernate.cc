@@ -0,0 +1,219 @@
+/*
+ * Session Hibernation - Evict an idle machine's memory to a spool file
+ *
+ * Spool format (little-endian):
+ *   "RWHIBER2"                 magic
+ *   u32 page size, u32 RAM pages
+ *   { u8 0x01, u16 page, page bytes }...
+ *   u8 0xFF                    end marker
+ *
+ * The ROM spool holds ROM page n at offset n * page size; pages that were
+ * blank at the last hibernation are not read back.
+ */
+
+#include "emu_hibernate.h"
+#include "emu_io.h"
+#include "romwbw_mem.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+const char SPOOL_MAGIC[8] = { 'R', 'W', 'H', 'I', 'B', 'E', 'R', '2' };
+const uint8_t REGION_RAM = 0x01;
+const uint8_t REGION_END = 0xFF;
+
+// Create a file only we can read, failing if anything (a file or a
+// symlink) is already at path
+int create_private(const std::string& path) {
+  return open(path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600);
+}
+
+bool put32(FILE* f, uint32_t v) {
+  uint8_t b[4] = { (uint8_t)v, (uint8_t)(v >> 8), (uint8_t)(v >> 16), (uint8_t)(v >> 24) };
+  return fwrite(b, 1, 4, f) == 4;
+}
+
+bool get32(FILE* f, uint32_t& v) {
+  uint8_t b[4];
+  if (fread(b, 1, 4, f) != 4) return false;
+  v = b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t)b[3] << 24);
+  return true;
+}
+
+bool page_is_blank(const uint8_t* p, size_t len, uint8_t fill) {
+  if (p[0] != fill) return false;
+  return memcmp(p, p + 1, len - 1) == 0;
+}
+
+double ms_since(std::chrono::steady_clock::time_point t) {
+  return std::chrono::duration<double, std::milli>(
+      std::chrono::steady_clock::now() - t).count();
+}
+
+}  // namespace
+
+SessionHibernator::SessionHibernator(banked_mem* memory, int idle_seconds,
+                                     const std::string& spool_path)
+  : mem(memory), idle_ms(idle_seconds * 1000), spool(spool_path),
+    rom_spool(spool_path + ".rom"), wait(emu_console_wait_input) {}
+
+SessionHibernator::~SessionHibernator() {
+  if (mem && !mem->banks_resident()) {
+    remove(spool.c_str());
+  }
+  if (rom_fd >= 0) {
+    close(rom_fd);
+    remove(rom_spool.c_str());
+  }
+}
+
+void SessionHibernator::waitForInput() {
+  if (!mem || wait(idle_ms) || emu_console_wait_interrupted()) return;
+
+  auto t0 = std::chrono::steady_clock::now();
+  size_t written = 0;
+  if (!evict(written)) {
+    wait(-1);
+    return;
+  }
+  hibernations++;
+  emu_log("[HIBERNATE] Idle %d s: %zu pages spooled to %s in %.1f ms\n",
+          idle_ms / 1000, written, spool.c_str(), ms_since(t0));
+
+  wait(-1);
+
+  auto t1 = std::chrono::steady_clock::now();
+  size_t read = 0;
+  restore(read);
+  emu_log("[HIBERNATE] Restored %zu pages in %.1f ms\n", read, ms_since(t1));
+}
+
+bool SessionHibernator::evict(size_t& pages_written) {
+  pages_written = 0;
+  if (!saveRom(pages_written)) return false;
+
+  int fd = create_private(spool);
+  FILE* f = fd >= 0 ? fdopen(fd, "wb") : nullptr;
+  if (!f) {
+    if (fd >= 0) close(fd);
+    emu_error("[HIBERNATE] Cannot create spool file %s\n", spool.c_str());
+    return false;
+  }
+
+  const uint32_t ram_pages = banked_mem::RAM_SIZE / PAGE_SIZE;
+  bool ok = fwrite(SPOOL_MAGIC, 1, sizeof(SPOOL_MAGIC), f) == sizeof(SPOOL_MAGIC) &&
+            put32(f, PAGE_SIZE) && put32(f, ram_pages);
+
+  const uint8_t* ram = mem->get_ram();
+  for (uint32_t i = 0; ok && i < ram_pages; i++) {
+    const uint8_t* page = ram + i * PAGE_SIZE;
+    if (page_is_blank(page, PAGE_SIZE, 0x00)) continue;
+    uint8_t hdr[3] = { REGION_RAM, (uint8_t)i, (uint8_t)(i >> 8) };
+    ok = fwrite(hdr, 1, 3, f) == 3 && fwrite(page, 1, PAGE_SIZE, f) == PAGE_SIZE;
+    pages_written++;
+  }
+  ok = ok && fputc(REGION_END, f) != EOF;
+  ok = (fclose(f) == 0) && ok;
+
+  if (!ok) {
+    emu_error("[HIBERNATE] Write to spool file %s failed, staying resident\n",
+              spool.c_str());
+    remove(spool.c_str());
+    return false;
+  }
+
+  mem->release_banks();
+  return true;
+}
+
+// Bring the ROM spool up to date: write the pages that differ from what
+// it holds
+bool SessionHibernator::saveRom(size_t& pages_written) {
+  const uint32_t rom_pages = banked_mem::ROM_SIZE / PAGE_SIZE;
+  if (rom_fd < 0) {
+    rom_fd = create_private(rom_spool);
+    if (rom_fd < 0) {
+      emu_error("[HIBERNATE] Cannot create ROM spool file %s\n", rom_spool.c_str());
+      return false;
+    }
+    rom_saved.assign(rom_pages, 0);
+  }
+
+  const uint8_t* rom = mem->get_rom();
+  uint8_t saved[PAGE_SIZE];
+  for (uint32_t i = 0; i < rom_pages; i++) {
+    const uint8_t* page = rom + i * PAGE_SIZE;
+    off_t off = (off_t)i * PAGE_SIZE;
+    if (page_is_blank(page, PAGE_SIZE, 0xFF)) {
+      rom_saved[i] = 0;
+      continue;
+    }
+    if (rom_saved[i] && pread(rom_fd, saved, PAGE_SIZE, off) == (ssize_t)PAGE_SIZE &&
+        memcmp(saved, page, PAGE_SIZE) == 0) {
+      continue;
+    }
+    rom_saved[i] = 0;
+    if (pwrite(rom_fd, page, PAGE_SIZE, off) != (ssize_t)PAGE_SIZE) {
+      emu_error("[HIBERNATE] Write to ROM spool file %s failed, staying resident\n",
+                rom_spool.c_str());
+      return false;
+    }
+    rom_saved[i] = 1;
+    pages_written++;
+  }
+  return true;
+}
+
+void SessionHibernator::restore(size_t& pages_read) {
+  int fd = open(spool.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+  FILE* f = fd >= 0 ? fdopen(fd, "rb") : nullptr;
+  if (!f) {
+    emu_fatal("[HIBERNATE] Cannot open spool file %s", spool.c_str());
+  }
+
+  char magic[sizeof(SPOOL_MAGIC)];
+  uint32_t page_size = 0, ram_pages = 0;
+  if (fread(magic, 1, sizeof(magic), f) != sizeof(magic) ||
+      memcmp(magic, SPOOL_MAGIC, sizeof(magic)) != 0 ||
+      !get32(f, page_size) || !get32(f, ram_pages) ||
+      page_size != PAGE_SIZE) {
+    emu_fatal("[HIBERNATE] Spool file %s is not a hibernation image", spool.c_str());
+  }
+
+  mem->reacquire_banks();
+  pages_read = 0;
+
+  uint8_t* rom = mem->get_rom();
+  for (uint32_t i = 0; i < rom_saved.size(); i++) {
+    if (!rom_saved[i]) continue;
+    if (pread(rom_fd, rom + i * PAGE_SIZE, PAGE_SIZE, (off_t)i * PAGE_SIZE) !=
+        (ssize_t)PAGE_SIZE) {
+      emu_fatal("[HIBERNATE] Cannot read ROM spool file %s", rom_spool.c_str());
+    }
+    pages_read++;
+  }
+
+  bool complete = false;
+  for (;;) {
+    uint8_t hdr[3];
+    if (fread(hdr, 1, 1, f) != 1) break;
+    if (hdr[0] == REGION_END) {
+      complete = true;
+      break;
+    }
+    if (hdr[0] != REGION_RAM || fread(hdr + 1, 1, 2, f) != 2) break;
+    uint32_t page = hdr[1] | (hdr[2] << 8);
+    if (page >= ram_pages) break;
+    if (fread(mem->get_ram() + page * PAGE_SIZE, 1, PAGE_SIZE, f) != PAGE_SIZE) break;
+    pages_read++;
+  }
+  fclose(f);
+  if (!complete) {
+    emu_fatal("[HIBERNATE] Spool file %s is damaged", spool.c_str());
+  }
+  remove(spool.c_str());
+}
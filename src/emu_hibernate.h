@@ -0,0 +1,70 @@
+/*
+ * Session Hibernation - Evict an idle machine's memory to a spool file
+ *
+ * Installed as the HBIOS idle callback (HBIOSDispatch::setIdleCallback).
+ * When the guest has been blocked in CIOIN for the idle period, the 1 MB of
+ * banked ROM/RAM is written to spool files and freed. It is read back when
+ * console input arrives, before CIOIN consumes the character.
+ *
+ * Only pages that differ from the power-on state (0xFF ROM, zeroed RAM) are
+ * written. The CPU, HBIOS dispatcher and file-backed disk handles are a few
+ * KB and stay in the process; disk data already lives in the image files.
+ *
+ * ROM pages go to FILE.rom instead, which is kept until the hibernator is
+ * destroyed. The guest cannot write ROM, so after the first hibernation
+ * only pages the host has patched since (the disk unit table when a disk
+ * is attached) are written again.
+ *
+ * Both files are created with O_EXCL and O_NOFOLLOW, mode 0600. If
+ * something already exists at either path, hibernation fails and the
+ * session stays resident.
+ */
+
+#ifndef EMU_HIBERNATE_H
+#define EMU_HIBERNATE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+class banked_mem;
+
+class SessionHibernator {
+public:
+  static const size_t PAGE_SIZE = 4096;
+
+  SessionHibernator(banked_mem* memory, int idle_seconds,
+                    const std::string& spool_path);
+  ~SessionHibernator();
+
+  // Idle callback: returns once console input is available, hibernating
+  // if none arrives within the idle period
+  void waitForInput();
+
+  // Replace emu_console_wait_input (timeout_ms, -1 = forever) for both
+  // waits. It may also return true for other work that needs the machine,
+  // such as a control request; waitForInput then restores and returns.
+  // It must not touch guest memory.
+  typedef std::function<bool(int timeout_ms)> WaitFunction;
+  void setWait(WaitFunction fn) { wait = fn; }
+
+  unsigned getHibernationCount() const { return hibernations; }
+
+private:
+  banked_mem* mem;
+  int idle_ms;
+  std::string spool;
+  std::string rom_spool;            // spool + ".rom"
+  int rom_fd = -1;                  // Open from the first hibernation on
+  std::vector<uint8_t> rom_saved;   // Per ROM page: 1 = in rom_spool, 0 = blank
+  unsigned hibernations = 0;
+  WaitFunction wait;
+
+  bool evict(size_t& pages_written);
+  bool saveRom(size_t& pages_written);
+  void restore(size_t& pages_read);
+};
+
+#endif // EMU_HIBERNATE_H
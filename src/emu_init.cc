@@ -420,27 +420,20 @@ const char* emu_check_disk_mbr_file(const char* path, size_t size) {
     return nullptr;
   }
 
-  FILE* fp = fopen(path, "rb");
-  if (!fp) return nullptr;
-
+  // Not emu_disk_open: a check must not replay a journal or boot trace
   uint8_t mbr[512];
-  size_t bytes_read = fread(mbr, 1, 512, fp);
-  fclose(fp);
-
-  if (bytes_read != 512) return nullptr;
+  if (emu_disk_image_read(path, 0, mbr, 512) != 512) return nullptr;
 
   return emu_check_disk_mbr(mbr, size);
 }
 
 const char* emu_validate_disk_image(const char* path, size_t* out_size) {
-  FILE* fp = fopen(path, "rb");
-  if (!fp) {
+  if (!emu_file_exists(path)) {
     return "file does not exist";
   }
 
-  fseek(fp, 0, SEEK_END);
-  size_t size = ftell(fp);
-  fclose(fp);
+  // A compressed image is checked by the size it expands to
+  size_t size = emu_disk_image_size(path);
 
   if (out_size) *out_size = size;
 
@@ -14,7 +14,10 @@
 
 #include <cstdint>
 #include <cstddef>
+#include <cstdio>
+#include <deque>
 #include <string>
+#include <utility>
 #include <vector>
 
 //=============================================================================
@@ -49,9 +52,23 @@ bool emu_console_has_input();
 // LF is converted to CR for CP/M compatibility
 int emu_console_read_char();
 
+// Wait up to timeout_ms (-1 = forever) for console input without consuming it
+// Returns true if a character (or EOF) is ready for emu_console_read_char()
+bool emu_console_wait_input(int timeout_ms);
+
+// End console waits for good: from the call on, emu_console_wait_input()
+// returns false at once when no input is buffered, including a wait that
+// is about to start. Async-signal-safe (for a SIGTERM handler).
+void emu_console_interrupt_wait();
+bool emu_console_wait_interrupted();
+
 // Queue a character for input (for async input sources)
 void emu_console_queue_char(int ch);
 
+// Remove and return input already taken from the host but not yet read
+// by the guest, in order (for checkpoints; requeue with queue_char)
+void emu_console_take_pending(std::vector<int>& out);
+
 // Clear the input queue (call on reset)
 void emu_console_clear_queue();
 
@@ -63,6 +80,19 @@ void emu_console_write_char(uint8_t ch);
 // Returns true if escape was detected and consumed
 bool emu_console_check_escape(char escape_char);
 
+// Console buffers for an embedded machine (libromwbw, romwbw.h): input
+// queued by the host application and output written by the guest
+struct emu_console_buffers {
+  std::deque<int> input;
+  std::string output;   // Same bytes the terminal would get (CR dropped)
+};
+
+// Route the calling thread's console to buffers (nullptr = the terminal
+// again). While attached, reads never block or end the process at EOF:
+// with no input queued the guest sees none. The browser build has one
+// console and ignores this.
+void emu_console_attach(emu_console_buffers* buffers);
+
 // Check for repeated Ctrl+C exit condition
 // ch: the character just read
 // count: how many consecutive Ctrl+C required to exit
@@ -140,6 +170,9 @@ bool emu_file_save(const std::string& path, const std::vector<uint8_t>& data);
 // Check if a file exists
 bool emu_file_exists(const std::string& path);
 
+// Check if a file exists and may be opened for writing
+bool emu_file_writable(const std::string& path);
+
 // Get file size (returns 0 if file doesn't exist)
 size_t emu_file_size(const std::string& path);
 
@@ -174,12 +207,48 @@ size_t emu_disk_read(emu_disk_handle disk, size_t offset,
 size_t emu_disk_write(emu_disk_handle disk, size_t offset,
                       const uint8_t* buffer, size_t count);
 
-// Flush disk writes to storage
+// Flush disk writes to storage. On a journaled disk this ends one atomic
+// update instead (see emu_disk_set_journal).
 void emu_disk_flush(emu_disk_handle disk);
 
 // Get disk size
 size_t emu_disk_size(emu_disk_handle disk);
 
+// Size of the disk an image file holds, without opening it as a disk: the
+// file size, or what a compressed image (emu_packed.h) expands to.
+// 0 if the file cannot be read.
+size_t emu_disk_image_size(const std::string& path);
+
+// Read from the disk an image file holds, also without opening it as a
+// disk: no journal recovery, boot trace or prefetch. Returns bytes read.
+size_t emu_disk_image_read(const std::string& path, size_t offset, uint8_t* buf, size_t count);
+
+// Journal writes to disks opened read-write from now on (emu_journal.h):
+// writes go to IMAGE.wal, each flush ends an atomic update, and updates
+// are synced together every window_ms (0 = at every flush). -1 = off.
+// A log left by a crash is replayed at open either way. Platforms without
+// journaling ignore this.
+void emu_disk_set_journal(int window_ms);
+
+// Read sector ranges (first 512-byte sector, count) of an image into a
+// cache in the background, for reads expected soon (emu_prefetch.h).
+// Returns at once; later reads of cached sectors do not touch the file.
+// Platforms without a prefetch cache ignore this.
+void emu_disk_prefetch(emu_disk_handle disk,
+                       const std::vector<std::pair<uint64_t, uint32_t>>& ranges);
+
+// Sectors read ahead for an image, and how many of them were read since
+void emu_disk_prefetch_stats(emu_disk_handle disk, uint64_t* prefetched, uint64_t* used);
+
+// Record the sectors each boot reads from disks opened from now on, and
+// prefetch them on the next open of an unchanged image (emu_prefetch.h).
+// Platforms without a prefetch cache ignore this.
+void emu_disk_set_boot_trace(bool enable);
+
+// The boot is over (the guest waits for console input): save the trace
+// of a disk that has been read since it was opened
+void emu_disk_end_boot_trace(emu_disk_handle disk);
+
 //=============================================================================
 // Time - for RTC emulation
 //=============================================================================
@@ -288,4 +357,48 @@ const uint8_t* emu_host_file_get_write_data();
 size_t emu_host_file_get_write_size();
 const char* emu_host_file_get_write_name();
 
+//=============================================================================
+// Host File Handles - several host files open at once (R8/W8 file sets)
+//=============================================================================
+
+// Handles are 0 to EMU_HOST_MAX_HANDLES-1. In the browser the files live in
+// the Emscripten filesystem (the page puts files there with FS.writeFile),
+// and a file written through a handle is also offered as a download when
+// closed.
+static const int EMU_HOST_MAX_HANDLES = 8;
+
+// Open a host file for reading, or create/truncate it for writing
+// Returns: handle, or -1 if the file cannot be opened or all are in use
+int emu_host_open(const char* path, bool write);
+
+// Read/write up to count bytes
+// Returns: bytes transferred (0 at end of file, on error or bad handle)
+size_t emu_host_read(int handle, uint8_t* buf, size_t count);
+size_t emu_host_write(int handle, const uint8_t* buf, size_t count);
+
+// Returns: false if the handle was not open or the final write failed
+bool emu_host_close(int handle);
+void emu_host_close_all();
+
+// List the names of the regular files in a host directory ("" = current)
+// Returns: false if the directory cannot be read
+bool emu_host_list_dir(const std::string& dir, std::vector<std::string>& names);
+
+// Host files of an embedded machine (libromwbw, romwbw.h): the transfer
+// files and the handles above. Routed per thread like the console
+// (emu_console_attach), so machines never see or close each other's
+// files; a thread with none attached uses the process's own set. The
+// browser build has one machine and ignores this. Files still open are
+// closed when the set is destroyed.
+struct emu_host_files {
+  FILE* read_file = nullptr;
+  FILE* write_file = nullptr;
+  std::string write_name;
+  emu_host_file_state state = HOST_FILE_IDLE;
+  FILE* handles[EMU_HOST_MAX_HANDLES] = {};
+  ~emu_host_files();
+};
+
+void emu_host_files_attach(emu_host_files* files);
+
 #endif // EMU_IO_H
@@ -6,6 +6,11 @@
  */
 
 #include "emu_io.h"
+#include "emu_latency.h"
+#include "emu_logger.h"
+#include "emu_journal.h"
+#include "emu_packed.h"
+#include "emu_prefetch.h"
 #include <cstdio>
 #include <cstdlib>
 #include <cstdarg>
@@ -16,6 +21,9 @@
 #include <random>
 #include <unistd.h>
 #include <termios.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <csignal>
 #include <sys/select.h>
 #include <sys/stat.h>
 
@@ -41,6 +49,14 @@ static bool escape_requested = false;
 // Ctrl+C tracking
 static int consecutive_ctrl_c = 0;
 
+// emu_console_interrupt_wait: the flag, and a pipe that becomes readable
+// so a select() entered just after the flag was checked returns too
+static volatile sig_atomic_t wait_interrupted = 0;
+static int wake_pipe[2] = { -1, -1 };
+
+// Embedded console for this thread (emu_console_attach), or nullptr
+static thread_local emu_console_buffers* console_buffers = nullptr;
+
 // Random number generator
 static std::mt19937 rng(std::random_device{}());
 
@@ -103,7 +119,13 @@ void emu_io_cleanup() {
   close_aux_files();
 }
 
+void emu_console_attach(emu_console_buffers* buffers) {
+  console_buffers = buffers;
+}
+
 bool emu_console_has_input() {
+  if (console_buffers) return !console_buffers->input.empty();
+
   // Check queued input first
   if (!input_queue.empty()) return true;
 
@@ -135,10 +157,62 @@ bool emu_console_has_input() {
     return false;
   }
   peek_char = (unsigned char)buf;
+  emu_latency_input_queued();
   return true;
 }
 
+bool emu_console_wait_input(int timeout_ms) {
+  // The embedding application supplies input between runs, not during one
+  if (console_buffers) return !console_buffers->input.empty();
+
+  if (!input_queue.empty() || peek_char >= 0 || stdin_eof) return true;
+
+  // Created before the flag is checked, so an interrupt after the check
+  // always finds the pipe to write to
+  if (wake_pipe[0] < 0 && pipe(wake_pipe) == 0) {
+    for (int fd : wake_pipe) fcntl(fd, F_SETFD, FD_CLOEXEC);
+  }
+  if (wait_interrupted) return false;
+
+  fd_set readfds;
+  FD_ZERO(&readfds);
+  FD_SET(STDIN_FILENO, &readfds);
+  int nfds = STDIN_FILENO + 1;
+  if (wake_pipe[0] >= 0) {
+    FD_SET(wake_pipe[0], &readfds);
+    if (wake_pipe[0] >= nfds) nfds = wake_pipe[0] + 1;
+  }
+  struct timeval tv;
+  tv.tv_sec = timeout_ms / 1000;
+  tv.tv_usec = (timeout_ms % 1000) * 1000;
+
+  int result = select(nfds, &readfds, NULL, NULL, timeout_ms < 0 ? NULL : &tv);
+  if (wait_interrupted) return false;
+  return result != 0;  // Readable, or error (read reports it)
+}
+
+void emu_console_interrupt_wait() {
+  if (wait_interrupted) return;
+  wait_interrupted = 1;
+  if (wake_pipe[1] >= 0) {
+    char c = 0;
+    ssize_t n = write(wake_pipe[1], &c, 1);  // Left unread: stays readable
+    (void)n;
+  }
+}
+
+bool emu_console_wait_interrupted() {
+  return wait_interrupted != 0;
+}
+
 int emu_console_read_char() {
+  if (console_buffers) {
+    if (console_buffers->input.empty()) return -1;
+    int ch = console_buffers->input.front();
+    console_buffers->input.pop_front();
+    return ch == '\n' ? '\r' : ch;
+  }
+
   // Check queued input first
   if (!input_queue.empty()) {
     int ch = input_queue.front();
@@ -171,6 +245,7 @@ int emu_console_read_char() {
     if (n > 0) {
       int ch = (unsigned char)buf;
       if (ch == '\n') ch = '\r';
+      emu_latency_input_queued();
       return ch;
     }
     // EOF on pipe - exit cleanly
@@ -195,6 +270,7 @@ int emu_console_read_char() {
         escape_requested = true;
       }
       if (ch == '\n') ch = '\r';  // LF -> CR for CP/M
+      emu_latency_input_queued();
       return ch;
     }
   }
@@ -204,20 +280,49 @@ int emu_console_read_char() {
 }
 
 void emu_console_queue_char(int ch) {
+  if (console_buffers) {
+    console_buffers->input.push_back(ch);
+    return;
+  }
   input_queue.push(ch);
+  emu_latency_input_queued();
+}
+
+void emu_console_take_pending(std::vector<int>& out) {
+  if (console_buffers) {
+    out.insert(out.end(), console_buffers->input.begin(), console_buffers->input.end());
+    console_buffers->input.clear();
+    return;
+  }
+  while (!input_queue.empty()) {
+    out.push_back(input_queue.front());
+    input_queue.pop();
+    emu_latency_input_dropped();
+  }
+  if (peek_char >= 0) {
+    out.push_back(peek_char);
+    peek_char = -1;
+    emu_latency_input_dropped();
+  }
 }
 
 void emu_console_write_char(uint8_t ch) {
   ch &= 0x7F;  // Strip high bit
   // CP/M sends \r\n, but Unix terminals only need \n
   // Skip \r to avoid double-spacing issues
-  if (ch != '\r') {
+  if (ch == '\r') return;
+  if (console_buffers) {
+    console_buffers->output += (char)ch;
+  } else {
     putchar(ch);
     fflush(stdout);
+    emu_latency_output_echoed();
   }
 }
 
 bool emu_console_check_escape(char escape_char) {
+  if (console_buffers) return false;
+
   // Save escape char for blocking read to check
   current_escape_char = escape_char;
 
@@ -233,6 +338,7 @@ bool emu_console_check_escape(char escape_char) {
   if (peek_char >= 0) {
     if (peek_char == escape_char) {
       peek_char = -1;  // Consume
+      emu_latency_input_dropped();
       return true;
     }
     return false;
@@ -262,6 +368,7 @@ bool emu_console_check_escape(char escape_char) {
   }
   // Not escape - save for later
   peek_char = ch;
+  emu_latency_input_queued();
   return false;
 }
 
@@ -393,6 +500,7 @@ void emu_error(const char* fmt, ...) {
 }
 
 void emu_fatal(const char* fmt, ...) {
+  emu_logger_flush();  // Debug records leading up to the failure
   fprintf(stderr, "\n*** FATAL ERROR ***\n");
   va_list args;
   va_start(args, fmt);
@@ -470,6 +578,10 @@ bool emu_file_exists(const std::string& path) {
   return stat(path.c_str(), &st) == 0;
 }
 
+bool emu_file_writable(const std::string& path) {
+  return access(path.c_str(), W_OK) == 0;
+}
+
 size_t emu_file_size(const std::string& path) {
   struct stat st;
   if (stat(path.c_str(), &st) != 0) return 0;
@@ -483,8 +595,84 @@ size_t emu_file_size(const std::string& path) {
 struct disk_file {
   FILE* fp;
   size_t size;
+  DiskJournal* journal;  // Set when writes are journaled
+  PackedDisk* packed;    // Set for a compressed image
+  DiskPrefetch* prefetch;  // Set once a prefetch is requested
+  BootTrace* trace;        // Set when boots are traced
 };
 
+static int journal_window_ms = -1;
+static bool boot_trace = false;
+
+void emu_disk_set_journal(int window_ms) {
+  journal_window_ms = window_ms;
+}
+
+void emu_disk_set_boot_trace(bool enable) {
+  boot_trace = enable;
+}
+
+// A writable image first gets any log a crash left behind replayed into
+// it, then a journal of its own if journaling is on. A boot trace saved
+// for the image as it is now is replayed at once. A read-only open of an
+// image whose log still holds records is refused. Packed images have
+// none of these: they are read and written through PackedDisk, and a
+// writable one is refused while journaling is on. On an
+// error the file is closed and nullptr returned.
+static disk_file* open_disk_file(FILE* f, const std::string& path, bool writable) {
+  disk_file* disk = new disk_file;
+  disk->fp = f;
+  disk->journal = nullptr;
+  disk->packed = nullptr;
+  disk->prefetch = nullptr;
+  disk->trace = nullptr;
+  auto fail = [&](const char* what, const std::string& error) -> disk_file* {
+    emu_error("[%s] Cannot open %s: %s\n", what, path.c_str(), error.c_str());
+    delete disk->journal;
+    delete disk->packed;
+    fclose(f);
+    delete disk;
+    return nullptr;
+  };
+  if (PackedDisk::probe(fileno(f))) {
+    std::string error;
+    if (writable && journal_window_ms >= 0) {
+      return fail("PACKED", "packed images cannot be journaled (their writes are crash-safe without)");
+    }
+    disk->packed = PackedDisk::open(fileno(f), writable, error);
+    if (!disk->packed) return fail("PACKED", error);
+    disk->size = disk->packed->size();
+    return disk;
+  }
+  if (writable) {
+    std::string wal = path + ".wal";
+    std::string error;
+    int replayed = DiskJournal::replay(fileno(f), wal, error);
+    if (replayed < 0) return fail("JOURNAL", "recovery failed: " + error);
+    if (replayed > 0) emu_status("Recovered %d journaled writes into %s\n", replayed, path.c_str());
+    if (journal_window_ms >= 0) {
+      disk->journal = DiskJournal::open(fileno(f), wal, journal_window_ms, error);
+      if (!disk->journal) return fail("JOURNAL", error);
+    }
+  } else if (emu_file_size(path + ".wal") > 0) {
+    // The log may hold writes the image lacks; only a writable open
+    // replays it (and a failed one must not fall back to this)
+    return fail("JOURNAL", "log " + path + ".wal not replayed (needs write access)");
+  }
+  fseek(f, 0, SEEK_END);
+  disk->size = ftell(f);
+  if (boot_trace) {
+    disk->trace = new BootTrace(path, fileno(f));
+    DiskPrefetch::Ranges ranges = disk->trace->load();
+    if (!ranges.empty()) {
+      emu_log("[PREFETCH] Replaying boot trace of %s (%zu runs)\n", path.c_str(), ranges.size());
+      disk->prefetch = new DiskPrefetch(fileno(f));
+      disk->prefetch->start(ranges);
+    }
+  }
+  return disk;
+}
+
 emu_disk_handle emu_disk_open(const std::string& path, const char* mode) {
   const char* fmode;
   if (strcmp(mode, "r") == 0) {
@@ -499,29 +687,31 @@ emu_disk_handle emu_disk_open(const std::string& path, const char* mode) {
       f = fopen(path.c_str(), "w+b");
     }
     if (!f) return nullptr;
-
-    disk_file* disk = new disk_file;
-    disk->fp = f;
-    fseek(f, 0, SEEK_END);
-    disk->size = ftell(f);
-    return disk;
+    return open_disk_file(f, path, true);
   } else {
     return nullptr;
   }
 
   FILE* f = fopen(path.c_str(), fmode);
   if (!f) return nullptr;
-
-  disk_file* disk = new disk_file;
-  disk->fp = f;
-  fseek(f, 0, SEEK_END);
-  disk->size = ftell(f);
-  return disk;
+  return open_disk_file(f, path, fmode[1] == '+');
 }
 
 void emu_disk_close(emu_disk_handle handle) {
   if (!handle) return;
   disk_file* disk = static_cast<disk_file*>(handle);
+  if (disk->prefetch) {
+    emu_logf(LOG_DIO, LOG_INFO, "[PREFETCH] %llu sectors read ahead, %llu used\n",
+             (unsigned long long)disk->prefetch->prefetched(),
+             (unsigned long long)disk->prefetch->used());
+    delete disk->prefetch;
+  }
+  if (disk->trace) {
+    disk->trace->finish();
+    delete disk->trace;
+  }
+  delete disk->journal;
+  delete disk->packed;
   if (disk->fp) fclose(disk->fp);
   delete disk;
 }
@@ -531,6 +721,10 @@ size_t emu_disk_read(emu_disk_handle handle, size_t offset,
   if (!handle) return 0;
   disk_file* disk = static_cast<disk_file*>(handle);
   if (!disk->fp) return 0;
+  if (disk->packed) return disk->packed->read(offset, buffer, count);
+  if (disk->trace && disk->trace->recording()) disk->trace->read(offset, count);
+  if (disk->prefetch && disk->prefetch->read(offset, buffer, count)) return count;
+  if (disk->journal) return disk->journal->read(offset, buffer, count);
 
   fseek(disk->fp, offset, SEEK_SET);
   return fread(buffer, 1, count, disk->fp);
@@ -542,8 +736,16 @@ size_t emu_disk_write(emu_disk_handle handle, size_t offset,
   disk_file* disk = static_cast<disk_file*>(handle);
   if (!disk->fp) return 0;
 
-  fseek(disk->fp, offset, SEEK_SET);
-  size_t written = fwrite(buffer, 1, count, disk->fp);
+  size_t written;
+  if (disk->packed) {
+    written = disk->packed->write(offset, buffer, count);
+  } else if (disk->journal) {
+    written = disk->journal->write(offset, buffer, count);
+  } else {
+    fseek(disk->fp, offset, SEEK_SET);
+    written = fwrite(buffer, 1, count, disk->fp);
+  }
+  if (disk->prefetch) disk->prefetch->written(offset, buffer, written);
 
   // Update size if we wrote past the end
   size_t new_end = offset + written;
@@ -557,7 +759,9 @@ size_t emu_disk_write(emu_disk_handle handle, size_t offset,
 void emu_disk_flush(emu_disk_handle handle) {
   if (!handle) return;
   disk_file* disk = static_cast<disk_file*>(handle);
-  if (disk->fp) fflush(disk->fp);
+  if (disk->packed) disk->packed->flush();
+  else if (disk->journal) disk->journal->commit();
+  else if (disk->fp) fflush(disk->fp);
 }
 
 size_t emu_disk_size(emu_disk_handle handle) {
@@ -566,6 +770,62 @@ size_t emu_disk_size(emu_disk_handle handle) {
   return disk->size;
 }
 
+size_t emu_disk_image_size(const std::string& path) {
+  FILE* f = fopen(path.c_str(), "rb");
+  if (!f) return 0;
+  uint64_t size;
+  if (!PackedDisk::probe(fileno(f), &size)) {
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+  }
+  fclose(f);
+  return size;
+}
+
+size_t emu_disk_image_read(const std::string& path, size_t offset, uint8_t* buf, size_t count) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) return 0;
+  size_t got = 0;
+  if (PackedDisk::probe(fd)) {
+    std::string error;
+    PackedDisk* packed = PackedDisk::open(fd, false, error);
+    if (packed) got = packed->read(offset, buf, count);
+    delete packed;
+  } else {
+    ssize_t n = pread(fd, buf, count, offset);
+    if (n > 0) got = n;
+  }
+  close(fd);
+  return got;
+}
+
+// The worker preads the image file directly. Buffered stdio writes and
+// journaled writes not yet in the file are covered by written(): a
+// sector written while the worker runs is never taken from its reads.
+void emu_disk_prefetch(emu_disk_handle handle,
+                       const std::vector<std::pair<uint64_t, uint32_t>>& ranges) {
+  if (!handle || ranges.empty()) return;
+  disk_file* disk = static_cast<disk_file*>(handle);
+  if (!disk->fp || disk->packed) return;  // Chunks are cached by PackedDisk
+  if (!disk->prefetch) disk->prefetch = new DiskPrefetch(fileno(disk->fp));
+  disk->prefetch->start(ranges);
+}
+
+void emu_disk_prefetch_stats(emu_disk_handle handle, uint64_t* prefetched, uint64_t* used) {
+  disk_file* disk = static_cast<disk_file*>(handle);
+  if (!disk || !disk->prefetch) {
+    *prefetched = *used = 0;
+    return;
+  }
+  *prefetched = disk->prefetch->prefetched();
+  *used = disk->prefetch->used();
+}
+
+void emu_disk_end_boot_trace(emu_disk_handle handle) {
+  disk_file* disk = static_cast<disk_file*>(handle);
+  if (disk && disk->trace) disk->trace->finish();
+}
+
 //=============================================================================
 // Time Implementation
 //=============================================================================
@@ -682,73 +942,95 @@ int emu_dsky_get_key() {
 // Host File Transfer Implementation (CLI - uses direct file I/O)
 //=============================================================================
 
-static FILE* cli_host_read_file = nullptr;
-static FILE* cli_host_write_file = nullptr;
-static std::string cli_host_write_filename;
-static emu_host_file_state cli_host_state = HOST_FILE_IDLE;
+// The process's own files (romwbw_emu), unless a machine's are attached
+static emu_host_files process_host_files;
+static thread_local emu_host_files* attached_host_files = nullptr;
+
+static emu_host_files& host_files() {
+  return attached_host_files ? *attached_host_files : process_host_files;
+}
+
+emu_host_files::~emu_host_files() {
+  if (read_file) fclose(read_file);
+  if (write_file) fclose(write_file);
+  for (FILE* fp : handles) {
+    if (fp) fclose(fp);
+  }
+}
+
+void emu_host_files_attach(emu_host_files* files) {
+  attached_host_files = files;
+}
 
 void emu_console_clear_queue() {
   // Clear any queued input - not much to do in CLI
+  if (console_buffers) console_buffers->input.clear();
 }
 
 emu_host_file_state emu_host_file_get_state() {
-  return cli_host_state;
+  return host_files().state;
 }
 
 bool emu_host_file_open_read(const char* filename) {
-  if (cli_host_read_file) {
-    fclose(cli_host_read_file);
-    cli_host_read_file = nullptr;
+  emu_host_files& hf = host_files();
+  if (hf.read_file) {
+    fclose(hf.read_file);
+    hf.read_file = nullptr;
   }
-  cli_host_read_file = fopen(filename, "rb");
-  if (cli_host_read_file) {
-    cli_host_state = HOST_FILE_READING;
+  hf.read_file = fopen(filename, "rb");
+  if (hf.read_file) {
+    hf.state = HOST_FILE_READING;
     return true;
   }
-  cli_host_state = HOST_FILE_IDLE;
+  hf.state = HOST_FILE_IDLE;
   return false;
 }
 
 bool emu_host_file_open_write(const char* filename) {
-  if (cli_host_write_file) {
-    fclose(cli_host_write_file);
-    cli_host_write_file = nullptr;
-  }
-  cli_host_write_filename = filename ? filename : "output.bin";
-  cli_host_write_file = fopen(cli_host_write_filename.c_str(), "wb");
-  if (cli_host_write_file) {
-    cli_host_state = HOST_FILE_WRITING;
+  emu_host_files& hf = host_files();
+  if (hf.write_file) {
+    fclose(hf.write_file);
+    hf.write_file = nullptr;
+  }
+  hf.write_name = filename ? filename : "output.bin";
+  hf.write_file = fopen(hf.write_name.c_str(), "wb");
+  if (hf.write_file) {
+    hf.state = HOST_FILE_WRITING;
     return true;
   }
-  cli_host_state = HOST_FILE_IDLE;
+  hf.state = HOST_FILE_IDLE;
   return false;
 }
 
 int emu_host_file_read_byte() {
-  if (!cli_host_read_file) return -1;
-  int ch = fgetc(cli_host_read_file);
+  emu_host_files& hf = host_files();
+  if (!hf.read_file) return -1;
+  int ch = fgetc(hf.read_file);
   return (ch == EOF) ? -1 : ch;
 }
 
 bool emu_host_file_write_byte(uint8_t byte) {
-  if (!cli_host_write_file) return false;
-  return fputc(byte, cli_host_write_file) != EOF;
+  emu_host_files& hf = host_files();
+  if (!hf.write_file) return false;
+  return fputc(byte, hf.write_file) != EOF;
 }
 
 void emu_host_file_close_read() {
-  if (cli_host_read_file) {
-    fclose(cli_host_read_file);
-    cli_host_read_file = nullptr;
+  emu_host_files& hf = host_files();
+  if (hf.read_file) {
+    fclose(hf.read_file);
+    hf.read_file = nullptr;
   }
-  cli_host_state = HOST_FILE_IDLE;
+  hf.state = HOST_FILE_IDLE;
 }
 
 void emu_host_file_close_write() {
-  if (cli_host_write_file) {
-    fclose(cli_host_write_file);
-    cli_host_write_file = nullptr;
+  emu_host_files& hf = host_files();
+  if (hf.write_file) {
+    fclose(hf.write_file);
+    hf.write_file = nullptr;
   }
-  cli_host_state = HOST_FILE_IDLE;
+  hf.state = HOST_FILE_IDLE;
 }
 
 void emu_host_file_provide_data(const uint8_t* data, size_t size) {
@@ -766,5 +1048,57 @@ size_t emu_host_file_get_write_size() {
 }
 
 const char* emu_host_file_get_write_name() {
-  return cli_host_write_filename.c_str();
+  return host_files().write_name.c_str();
+}
+
+//=============================================================================
+// Host File Handles (CLI - direct file I/O)
+//=============================================================================
+
+int emu_host_open(const char* path, bool write) {
+  FILE** handles = host_files().handles;
+  for (int h = 0; h < EMU_HOST_MAX_HANDLES; h++) {
+    if (handles[h]) continue;
+    handles[h] = fopen(path, write ? "wb" : "rb");
+    return handles[h] ? h : -1;
+  }
+  return -1;
+}
+
+size_t emu_host_read(int handle, uint8_t* buf, size_t count) {
+  FILE** handles = host_files().handles;
+  if (handle < 0 || handle >= EMU_HOST_MAX_HANDLES || !handles[handle]) return 0;
+  return fread(buf, 1, count, handles[handle]);
+}
+
+size_t emu_host_write(int handle, const uint8_t* buf, size_t count) {
+  FILE** handles = host_files().handles;
+  if (handle < 0 || handle >= EMU_HOST_MAX_HANDLES || !handles[handle]) return 0;
+  return fwrite(buf, 1, count, handles[handle]);
+}
+
+bool emu_host_close(int handle) {
+  FILE** handles = host_files().handles;
+  if (handle < 0 || handle >= EMU_HOST_MAX_HANDLES || !handles[handle]) return false;
+  bool ok = fclose(handles[handle]) == 0;
+  handles[handle] = nullptr;
+  return ok;
+}
+
+void emu_host_close_all() {
+  for (int h = 0; h < EMU_HOST_MAX_HANDLES; h++) emu_host_close(h);
+}
+
+bool emu_host_list_dir(const std::string& dir, std::vector<std::string>& names) {
+  names.clear();
+  std::string base = dir.empty() ? "." : dir;
+  DIR* d = opendir(base.c_str());
+  if (!d) return false;
+  while (struct dirent* e = readdir(d)) {
+    struct stat st;
+    std::string path = base + "/" + e->d_name;
+    if (stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode)) names.push_back(e->d_name);
+  }
+  closedir(d);
+  return true;
 }
@@ -8,6 +8,7 @@
 #ifdef __EMSCRIPTEN__
 
 #include "emu_io.h"
+#include "emu_latency.h"
 #include <emscripten.h>
 #include <cstdio>
 #include <cstdlib>
@@ -17,11 +18,17 @@
 #include <queue>
 #include <random>
 #include <strings.h>
+#include <dirent.h>
+#include <sys/stat.h>
 
 //=============================================================================
 // String Utilities
 //=============================================================================
 
+int emu_strcasecmp(const char* s1, const char* s2) {
+  return strcasecmp(s1, s2);
+}
+
 int emu_strncasecmp(const char* s1, const char* s2, size_t n) {
   return strncasecmp(s1, s2, n);
 }
@@ -143,6 +150,16 @@ bool emu_console_has_input() {
   return !input_queue.empty();
 }
 
+bool emu_console_wait_input(int timeout_ms) {
+  // Input arrives between batches; the browser cannot block here
+  (void)timeout_ms;
+  return emu_console_has_input();
+}
+
+// No signals in the browser, and waits never block
+void emu_console_interrupt_wait() {}
+bool emu_console_wait_interrupted() { return false; }
+
 int emu_console_read_char() {
   if (input_queue.empty()) {
     return -1;  // No input available
@@ -155,6 +172,19 @@ int emu_console_read_char() {
 
 void emu_console_queue_char(int ch) {
   input_queue.push(ch);
+  emu_latency_input_queued();
+}
+
+void emu_console_take_pending(std::vector<int>& out) {
+  while (!input_queue.empty()) {
+    out.push_back(input_queue.front());
+    input_queue.pop();
+    emu_latency_input_dropped();
+  }
+}
+
+void emu_console_attach(emu_console_buffers* buffers) {
+  (void)buffers;  // One machine, one browser console
 }
 
 void emu_console_write_char(uint8_t ch) {
@@ -162,6 +192,7 @@ void emu_console_write_char(uint8_t ch) {
   // Skip CR - browsers only need LF for line endings
   if (ch != '\r') {
     js_console_output(ch);
+    emu_latency_output_echoed();
   }
 }
 
@@ -170,6 +201,7 @@ bool emu_console_check_escape(char escape_char) {
   // Check if escape char is at front of queue
   if (!input_queue.empty() && input_queue.front() == escape_char) {
     input_queue.pop();
+    emu_latency_input_dropped();
     return true;
   }
   return false;
@@ -355,6 +387,15 @@ bool emu_file_save(const std::string& path, const std::vector<uint8_t>& data) {
   return written == data.size();
 }
 
+bool emu_file_writable(const std::string& path) {
+  FILE* f = fopen(path.c_str(), "r+b");
+  if (f) {
+    fclose(f);
+    return true;
+  }
+  return false;
+}
+
 bool emu_file_exists(const std::string& path) {
   FILE* f = fopen(path.c_str(), "rb");
   if (f) {
@@ -455,12 +496,47 @@ void emu_disk_flush(emu_disk_handle handle) {
   if (disk->fp) fflush(disk->fp);
 }
 
+void emu_disk_set_journal(int window_ms) {
+  (void)window_ms;  // Browser storage has no journal
+}
+
+void emu_disk_prefetch(emu_disk_handle handle,
+                       const std::vector<std::pair<uint64_t, uint32_t>>& ranges) {
+  (void)handle;  // Images are already in memory
+  (void)ranges;
+}
+
+void emu_disk_prefetch_stats(emu_disk_handle handle, uint64_t* prefetched, uint64_t* used) {
+  (void)handle;
+  *prefetched = *used = 0;
+}
+
+void emu_disk_set_boot_trace(bool enable) {
+  (void)enable;
+}
+
+void emu_disk_end_boot_trace(emu_disk_handle handle) {
+  (void)handle;
+}
+
 size_t emu_disk_size(emu_disk_handle handle) {
   if (!handle) return 0;
   disk_file* disk = static_cast<disk_file*>(handle);
   return disk->size;
 }
 
+size_t emu_disk_image_size(const std::string& path) {
+  return emu_file_size(path);  // No compressed images in the browser
+}
+
+size_t emu_disk_image_read(const std::string& path, size_t offset, uint8_t* buf, size_t count) {
+  FILE* f = fopen(path.c_str(), "rb");
+  if (!f) return 0;
+  size_t got = fseek(f, (long)offset, SEEK_SET) == 0 ? fread(buf, 1, count, f) : 0;
+  fclose(f);
+  return got;
+}
+
 //=============================================================================
 // Time Implementation
 //=============================================================================
@@ -688,4 +764,86 @@ void emu_host_file_cancel() {
   host_read_pos = 0;
 }
 
+//=============================================================================
+// Host File Handles (Emscripten filesystem)
+//=============================================================================
+
+struct host_handle {
+  FILE* fp;
+  bool write;
+  std::string path;
+};
+
+static host_handle host_handles[EMU_HOST_MAX_HANDLES];
+
+int emu_host_open(const char* path, bool write) {
+  for (int h = 0; h < EMU_HOST_MAX_HANDLES; h++) {
+    if (host_handles[h].fp) continue;
+    host_handles[h].fp = fopen(path, write ? "wb" : "rb");
+    if (!host_handles[h].fp) return -1;
+    host_handles[h].write = write;
+    host_handles[h].path = path;
+    return h;
+  }
+  return -1;
+}
+
+size_t emu_host_read(int handle, uint8_t* buf, size_t count) {
+  if (handle < 0 || handle >= EMU_HOST_MAX_HANDLES || !host_handles[handle].fp) return 0;
+  return fread(buf, 1, count, host_handles[handle].fp);
+}
+
+size_t emu_host_write(int handle, const uint8_t* buf, size_t count) {
+  if (handle < 0 || handle >= EMU_HOST_MAX_HANDLES || !host_handles[handle].fp) return 0;
+  return fwrite(buf, 1, count, host_handles[handle].fp);
+}
+
+bool emu_host_close(int handle) {
+  if (handle < 0 || handle >= EMU_HOST_MAX_HANDLES || !host_handles[handle].fp) return false;
+  host_handle& h = host_handles[handle];
+  bool ok = fclose(h.fp) == 0;
+  h.fp = nullptr;
+  if (ok && h.write) {
+    // Hand the finished file to the page as a download, like W8's single file
+    std::vector<uint8_t> data;
+    if (emu_file_load(h.path, data) && !data.empty()) {
+      size_t slash = h.path.find_last_of('/');
+      std::string name = slash == std::string::npos ? h.path : h.path.substr(slash + 1);
+      js_host_file_download(name.c_str(), data.data(), data.size());
+    }
+  }
+  return ok;
+}
+
+void emu_host_close_all() {
+  for (int h = 0; h < EMU_HOST_MAX_HANDLES; h++) emu_host_close(h);
+}
+
+// One machine per page: its host files are the ones above
+emu_host_files::~emu_host_files() {
+  if (read_file) fclose(read_file);
+  if (write_file) fclose(write_file);
+  for (FILE* fp : handles) {
+    if (fp) fclose(fp);
+  }
+}
+
+void emu_host_files_attach(emu_host_files* files) {
+  (void)files;
+}
+
+bool emu_host_list_dir(const std::string& dir, std::vector<std::string>& names) {
+  names.clear();
+  std::string base = dir.empty() ? "." : dir;
+  DIR* d = opendir(base.c_str());
+  if (!d) return false;
+  while (struct dirent* e = readdir(d)) {
+    struct stat st;
+    std::string path = base + "/" + e->d_name;
+    if (stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode)) names.push_back(e->d_name);
+  }
+  closedir(d);
+  return true;
+}
+
 #endif // __EMSCRIPTEN__
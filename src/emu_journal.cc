@@ -0,0 +1,313 @@
+/*
+ * Disk Journal - Write-ahead log with group commit for disk images
+ */
+
+#include "emu_journal.h"
+#include "emu_io.h"
+#include "host_compute.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const uint32_t BLOCK_MAGIC = 0x424A5752;   // "RWJB"
+const uint32_t COMMIT_MAGIC = 0x434A5752;  // "RWJC"
+const size_t BLOCK_HEADER = 16;            // magic, crc, block number
+const size_t COMMIT_SIZE = 24;             // magic, crc, txn, blocks, zero
+
+uint32_t block_crc(uint64_t block, const uint8_t* data) {
+  uint32_t crc = hc_crc32(0, reinterpret_cast<const uint8_t*>(&block), sizeof(block));
+  return hc_crc32(crc, data, DiskJournal::BLOCK);
+}
+
+uint32_t commit_crc(uint64_t txn, uint32_t blocks) {
+  uint32_t crc = hc_crc32(0, reinterpret_cast<const uint8_t*>(&txn), sizeof(txn));
+  return hc_crc32(crc, reinterpret_cast<const uint8_t*>(&blocks), sizeof(blocks));
+}
+
+void put32(std::vector<uint8_t>& out, uint32_t v) {
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(&v);
+  out.insert(out.end(), p, p + 4);
+}
+
+void put64(std::vector<uint8_t>& out, uint64_t v) {
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(&v);
+  out.insert(out.end(), p, p + 8);
+}
+
+uint32_t get32(const uint8_t* p) { uint32_t v; memcpy(&v, p, 4); return v; }
+uint64_t get64(const uint8_t* p) { uint64_t v; memcpy(&v, p, 8); return v; }
+
+bool write_all(int fd, const uint8_t* data, size_t len, size_t offset) {
+  while (len > 0) {
+    ssize_t n = pwrite(fd, data, len, offset);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    data += n;
+    len -= n;
+    offset += n;
+  }
+  return true;
+}
+
+// Copy the block records of a run of committed transactions into the
+// image. The records are known good (written by this process or checked
+// by replay).
+bool apply_records(int image_fd, const uint8_t* p, size_t len) {
+  const uint8_t* end = p + len;
+  while (p < end) {
+    if (get32(p) == BLOCK_MAGIC) {
+      uint64_t block = get64(p + 8);
+      if (!write_all(image_fd, p + BLOCK_HEADER, DiskJournal::BLOCK, block * DiskJournal::BLOCK)) {
+        return false;
+      }
+      p += BLOCK_HEADER + DiskJournal::BLOCK;
+    } else {
+      p += COMMIT_SIZE;
+    }
+  }
+  return true;
+}
+
+std::mutex registry_lock;
+std::vector<DiskJournal*> registry;
+
+} // namespace
+
+int DiskJournal::replay(int image_fd, const std::string& wal_path, std::string& error) {
+  int fd = ::open(wal_path.c_str(), O_RDWR);
+  if (fd < 0) {
+    if (errno == ENOENT) return 0;
+    error = wal_path + ": " + strerror(errno);
+    return -1;
+  }
+  struct stat st;
+  std::vector<uint8_t> log;
+  if (fstat(fd, &st) == 0 && st.st_size > 0) {
+    log.resize(st.st_size);
+    if (pread(fd, log.data(), log.size(), 0) != (ssize_t)log.size()) {
+      error = wal_path + ": short read";
+      ::close(fd);
+      return -1;
+    }
+  }
+
+  // Find the end of the last complete transaction; anything after it (a
+  // torn record or an unfinished transaction) is dropped
+  size_t pos = 0, committed = 0;
+  uint32_t blocks = 0;
+  int txns = 0;
+  while (pos + BLOCK_HEADER <= log.size()) {
+    const uint8_t* p = log.data() + pos;
+    uint32_t magic = get32(p);
+    if (magic == BLOCK_MAGIC && pos + BLOCK_HEADER + BLOCK <= log.size() &&
+        get32(p + 4) == block_crc(get64(p + 8), p + BLOCK_HEADER)) {
+      pos += BLOCK_HEADER + BLOCK;
+      blocks++;
+    } else if (magic == COMMIT_MAGIC && pos + COMMIT_SIZE <= log.size() &&
+               get32(p + 4) == commit_crc(get64(p + 8), get32(p + 16)) &&
+               get32(p + 16) == blocks) {
+      pos += COMMIT_SIZE;
+      committed = pos;
+      blocks = 0;
+      txns++;
+    } else {
+      break;
+    }
+  }
+
+  if (committed > 0) {
+    if (!apply_records(image_fd, log.data(), committed) || fdatasync(image_fd) != 0) {
+      error = std::string("replaying ") + wal_path + ": " + strerror(errno);
+      ::close(fd);
+      return -1;
+    }
+  }
+  if (!log.empty() && (ftruncate(fd, 0) != 0 || fdatasync(fd) != 0)) {
+    error = wal_path + ": " + strerror(errno);
+    ::close(fd);
+    return -1;
+  }
+  ::close(fd);
+  return txns;
+}
+
+DiskJournal* DiskJournal::open(int image_fd, const std::string& wal_path,
+                               int window_ms, std::string& error) {
+  int wal_fd = ::open(wal_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (wal_fd < 0) {
+    error = wal_path + ": " + strerror(errno);
+    return nullptr;
+  }
+  struct stat st;
+  size_t size = fstat(image_fd, &st) == 0 ? st.st_size : 0;
+  DiskJournal* j = new DiskJournal(image_fd, wal_fd, window_ms, size);
+
+  std::lock_guard<std::mutex> g(registry_lock);
+  static bool registered = false;
+  if (!registered) atexit(closeAll);
+  registered = true;
+  registry.push_back(j);
+  return j;
+}
+
+DiskJournal::DiskJournal(int image_fd, int wal_fd, int window_ms, size_t size)
+  : image_fd(image_fd), wal_fd(wal_fd), window_ms(window_ms), logical_size(size) {
+  if (window_ms > 0) flusher = std::thread(&DiskJournal::flushLoop, this);
+}
+
+DiskJournal::~DiskJournal() {
+  close();
+  ::close(wal_fd);
+  std::lock_guard<std::mutex> g(registry_lock);
+  registry.erase(std::remove(registry.begin(), registry.end(), this), registry.end());
+}
+
+void DiskJournal::closeAll() {
+  std::lock_guard<std::mutex> g(registry_lock);
+  for (DiskJournal* j : registry) j->close();
+}
+
+void DiskJournal::close() {
+  // A fatal error on the flusher thread exits through here; the log still
+  // holds everything it had not applied, for replay at the next open
+  if (flusher.joinable() && flusher.get_id() == std::this_thread::get_id()) return;
+  commit();
+  if (flusher.joinable()) {
+    {
+      std::lock_guard<std::mutex> g(lock);
+      stopping = true;
+    }
+    wake.notify_one();
+    flusher.join();
+  }
+  window_ms = 0;
+  std::unique_lock<std::mutex> held(lock);
+  flushSealed(held);
+  if (wal_end > 0) checkpoint();
+}
+
+size_t DiskJournal::read(size_t offset, uint8_t* buf, size_t count) {
+  if (offset >= logical_size) return 0;
+  count = std::min(count, logical_size - offset);
+
+  std::lock_guard<std::mutex> g(lock);
+  ssize_t n = pread(image_fd, buf, count, offset);
+  if (n < 0) n = 0;
+  if ((size_t)n < count) memset(buf + n, 0, count - n);  // Written, not yet in the image
+  if (pending.empty()) return count;
+
+  for (uint64_t b = offset / BLOCK; b <= (offset + count - 1) / BLOCK; b++) {
+    auto it = pending.find(b);
+    if (it == pending.end()) continue;
+    size_t start = std::max<size_t>(offset, b * BLOCK);
+    size_t end = std::min<size_t>(offset + count, (b + 1) * BLOCK);
+    memcpy(buf + (start - offset), it->second.data + (start - b * BLOCK), end - start);
+  }
+  return count;
+}
+
+size_t DiskJournal::write(size_t offset, const uint8_t* buf, size_t count) {
+  size_t done = 0;
+  while (done < count) {
+    size_t pos = offset + done;
+    uint64_t b = pos / BLOCK;
+    size_t in_block = pos % BLOCK;
+    size_t n = std::min(count - done, BLOCK - in_block);
+    if (n == BLOCK) {
+      writeBlock(b, buf + done);
+    } else {
+      uint8_t block[BLOCK];
+      memset(block, 0, BLOCK);
+      read(b * BLOCK, block, BLOCK);
+      memcpy(block + in_block, buf + done, n);
+      writeBlock(b, block);
+    }
+    done += n;
+  }
+  logical_size = std::max(logical_size, offset + count);
+  return count;
+}
+
+void DiskJournal::writeBlock(uint64_t block, const uint8_t* data) {
+  put32(open_records, BLOCK_MAGIC);
+  put32(open_records, block_crc(block, data));
+  put64(open_records, block);
+  open_records.insert(open_records.end(), data, data + BLOCK);
+  open_blocks++;
+
+  std::lock_guard<std::mutex> g(lock);
+  Pending& p = pending[block];
+  memcpy(p.data, data, BLOCK);
+  p.txn = next_txn;
+}
+
+void DiskJournal::commit() {
+  if (open_blocks == 0) return;
+  put32(open_records, COMMIT_MAGIC);
+  put32(open_records, commit_crc(next_txn, open_blocks));
+  put64(open_records, next_txn);
+  put32(open_records, open_blocks);
+  put32(open_records, 0);
+
+  std::unique_lock<std::mutex> held(lock);
+  sealed.insert(sealed.end(), open_records.begin(), open_records.end());
+  sealed_txn = next_txn++;
+  open_records.clear();
+  open_blocks = 0;
+  if (window_ms == 0) flushSealed(held);
+}
+
+void DiskJournal::flushLoop() {
+  std::unique_lock<std::mutex> held(lock);
+  while (!stopping) {
+    wake.wait_for(held, std::chrono::milliseconds(window_ms));
+    flushSealed(held);
+  }
+}
+
+// Append the sealed transactions to the log with one sync, then copy them
+// into the image. Called with the lock held; drops it for the file I/O.
+void DiskJournal::flushSealed(std::unique_lock<std::mutex>& held) {
+  if (sealed.empty()) return;
+  std::vector<uint8_t> batch;
+  batch.swap(sealed);
+  uint64_t txn = sealed_txn;
+  held.unlock();
+
+  if (!write_all(wal_fd, batch.data(), batch.size(), wal_end) || fdatasync(wal_fd) != 0) {
+    emu_fatal("[JOURNAL] Log write failed: %s", strerror(errno));
+  }
+  wal_end += batch.size();
+  if (!apply_records(image_fd, batch.data(), batch.size())) {
+    emu_fatal("[JOURNAL] Image write failed: %s", strerror(errno));
+  }
+
+  held.lock();
+  // Blocks rewritten since this batch keep their newer pending copy
+  for (const uint8_t* p = batch.data(); p < batch.data() + batch.size(); ) {
+    if (get32(p) == BLOCK_MAGIC) {
+      auto it = pending.find(get64(p + 8));
+      if (it != pending.end() && it->second.txn <= txn) pending.erase(it);
+      p += BLOCK_HEADER + BLOCK;
+    } else {
+      p += COMMIT_SIZE;
+    }
+  }
+  if (wal_end >= CHECKPOINT_BYTES) checkpoint();
+}
+
+// Everything in the log is in the image; make that durable and start the
+// log over
+void DiskJournal::checkpoint() {
+  if (fdatasync(image_fd) != 0 || ftruncate(wal_fd, 0) != 0) {
+    emu_fatal("[JOURNAL] Checkpoint failed: %s", strerror(errno));
+  }
+  wal_end = 0;
+}
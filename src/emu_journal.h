@@ -0,0 +1,104 @@
+/*
+ * Disk Journal - Write-ahead log with group commit for disk images
+ *
+ * Writes to a journaled image go to IMAGE.wal instead of the image, as
+ * 512-byte block records. emu_disk_flush(), which HBIOS calls at the end
+ * of every DIOWRITE, seals the records written since the previous flush
+ * into one transaction. A background thread appends sealed transactions
+ * to the log every window_ms with a single fdatasync, then copies their
+ * blocks into the image. Once the log passes CHECKPOINT_BYTES the image
+ * is synced and the log truncated.
+ *
+ * Reads see the newest data: blocks not yet copied into the image are
+ * served from memory.
+ *
+ * At open, complete transactions found in the log are replayed into the
+ * image and the rest is discarded, so after a host crash the image holds
+ * a prefix of the guest's requests, never part of one. A request is
+ * durable within window_ms of being acknowledged to the guest; with a
+ * window of 0 every flush syncs before returning.
+ *
+ * Log record layout (host byte order):
+ *   block   u32 'RWJB', u32 crc, u64 block number, 512 data bytes
+ *   commit  u32 'RWJC', u32 crc, u64 transaction, u32 blocks, u32 zero
+ */
+
+#ifndef EMU_JOURNAL_H
+#define EMU_JOURNAL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class DiskJournal {
+public:
+  static const size_t BLOCK = 512;
+  static const size_t CHECKPOINT_BYTES = 4 * 1024 * 1024;
+
+  // Replay the complete transactions in wal_path (if it exists) into the
+  // image, open read-write as image_fd, then truncate the log. Returns the
+  // number of transactions applied, or -1 with error set.
+  static int replay(int image_fd, const std::string& wal_path, std::string& error);
+
+  // Journal writes to image_fd (the caller keeps ownership of the fd and
+  // must have replayed the log). Returns nullptr with error set if the
+  // log cannot be opened.
+  static DiskJournal* open(int image_fd, const std::string& wal_path,
+                           int window_ms, std::string& error);
+
+  ~DiskJournal();
+
+  // Commit and checkpoint everything, sync the image and truncate the
+  // log. Later writes still work, committed synchronously.
+  void close();
+
+  size_t read(size_t offset, uint8_t* buf, size_t count);
+  size_t write(size_t offset, const uint8_t* buf, size_t count);
+
+  // End the current transaction
+  void commit();
+
+  size_t size() const { return logical_size; }
+
+  // Close every open journal (registered with atexit, so exit() from
+  // anywhere leaves the images complete)
+  static void closeAll();
+
+private:
+  struct Pending {
+    uint8_t data[BLOCK];
+    uint64_t txn;  // Transaction that last wrote the block
+  };
+
+  int image_fd;
+  int wal_fd;
+  int window_ms;
+  size_t logical_size;
+  size_t wal_end = 0;          // Bytes in the log file
+  uint64_t next_txn = 1;
+
+  std::vector<uint8_t> open_records;    // Current transaction (main thread)
+  uint32_t open_blocks = 0;
+
+  std::mutex lock;                      // Guards everything below
+  std::condition_variable wake;
+  std::unordered_map<uint64_t, Pending> pending;  // Not yet in the image
+  std::vector<uint8_t> sealed;          // Committed, not yet in the log
+  uint64_t sealed_txn = 0;              // Last transaction in sealed
+  bool stopping = false;
+  std::thread flusher;
+
+  DiskJournal(int image_fd, int wal_fd, int window_ms, size_t size);
+
+  void writeBlock(uint64_t block, const uint8_t* data);
+  void flushLoop();
+  void flushSealed(std::unique_lock<std::mutex>& held);
+  void checkpoint();
+};
+
+#endif // EMU_JOURNAL_H
@@ -0,0 +1,168 @@
+/*
+ * Console Latency - Keystroke-to-echo timing per session
+ */
+
+#include "emu_latency.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <vector>
+
+bool emu_latency_active = false;
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+// Log-linear histogram of microsecond values: exact below 16, then eight
+// buckets per power of two (at most 12.5% error), so a session of any
+// length costs the same fixed table
+class Histogram {
+public:
+  static const int EXACT = 16;
+  static const int SUB_BITS = 3;
+  static const int MAX_EXP = 40;
+  static const int BUCKETS = EXACT + (MAX_EXP - 4 + 1) * (1 << SUB_BITS);
+
+  void add(uint64_t us) {
+    counts[index(us)]++;
+    n++;
+    if (us > max_us) max_us = us;
+  }
+
+  void clear() { *this = Histogram(); }
+
+  uint64_t count() const { return n; }
+  uint64_t max() const { return max_us; }
+
+  // Upper bound of the bucket holding the given fraction of samples
+  uint64_t percentile(double q) const {
+    if (n == 0) return 0;
+    uint64_t rank = (uint64_t)(q * n + 0.5);
+    if (rank < 1) rank = 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKETS; i++) {
+      seen += counts[i];
+      if (seen >= rank) return std::min(upper(i), max_us);
+    }
+    return max_us;
+  }
+
+private:
+  uint64_t counts[BUCKETS] = {};
+  uint64_t n = 0;
+  uint64_t max_us = 0;
+
+  static int index(uint64_t v) {
+    if (v < EXACT) return (int)v;
+    int e = 63 - __builtin_clzll(v);
+    if (e > MAX_EXP) return BUCKETS - 1;
+    int sub = (int)(v >> (e - SUB_BITS)) & ((1 << SUB_BITS) - 1);
+    return EXACT + (e - 4) * (1 << SUB_BITS) + sub;
+  }
+
+  static uint64_t upper(int i) {
+    if (i < EXACT) return i;
+    int e = (i - EXACT) / (1 << SUB_BITS) + 4;
+    int sub = (i - EXACT) % (1 << SUB_BITS);
+    uint64_t width = 1ULL << (e - SUB_BITS);
+    return (1ULL << e) + (sub + 1) * width - 1;
+  }
+};
+
+struct Consumed {
+  Clock::time_point queued;
+  Clock::time_point consumed;
+};
+
+// Bound on bytes waiting for the guest; a paste larger than this loses
+// the timestamps of its oldest bytes rather than growing without limit
+const size_t MAX_PENDING = 65536;
+
+std::deque<Clock::time_point> pending;   // Queued, not yet consumed
+std::vector<Consumed> awaiting_echo;     // Consumed, no output since
+Histogram queue_hist, echo_hist, total_hist;
+uint64_t untracked = 0;                  // Consumed with nothing pending
+
+uint64_t micros(Clock::time_point from, Clock::time_point to) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(to - from).count();
+}
+
+} // namespace
+
+void emu_latency_enable(bool on) {
+  emu_latency_active = on;
+  if (!on) {
+    pending.clear();
+    awaiting_echo.clear();
+  }
+}
+
+void emu_latency_reset() {
+  queue_hist.clear();
+  echo_hist.clear();
+  total_hist.clear();
+  untracked = 0;
+}
+
+void emu_latency_note_queued() {
+  if (pending.size() >= MAX_PENDING) pending.pop_front();
+  pending.push_back(Clock::now());
+}
+
+void emu_latency_note_dropped() {
+  if (!pending.empty()) pending.pop_front();
+}
+
+void emu_latency_note_consumed() {
+  if (pending.empty()) {
+    untracked++;
+    return;
+  }
+  Consumed c;
+  c.queued = pending.front();
+  c.consumed = Clock::now();
+  pending.pop_front();
+  queue_hist.add(micros(c.queued, c.consumed));
+  awaiting_echo.push_back(c);
+}
+
+void emu_latency_note_echoed() {
+  if (awaiting_echo.empty()) return;
+  Clock::time_point now = Clock::now();
+  for (const Consumed& c : awaiting_echo) {
+    echo_hist.add(micros(c.consumed, now));
+    total_hist.add(micros(c.queued, now));
+  }
+  awaiting_echo.clear();
+}
+
+std::string emu_latency_report() {
+  std::string out;
+  char line[128];
+  snprintf(line, sizeof(line), "Console latency (us)  %8s %8s %8s %8s %8s\n",
+           "count", "p50", "p90", "p99", "max");
+  out += line;
+  struct { const char* name; const Histogram* h; } rows[] = {
+    {"queue (key->guest)", &queue_hist},
+    {"echo (guest->host)", &echo_hist},
+    {"total (key->echo)", &total_hist},
+  };
+  for (const auto& row : rows) {
+    snprintf(line, sizeof(line), "  %-19s %8llu %8llu %8llu %8llu %8llu\n",
+             row.name, (unsigned long long)row.h->count(),
+             (unsigned long long)row.h->percentile(0.50),
+             (unsigned long long)row.h->percentile(0.90),
+             (unsigned long long)row.h->percentile(0.99),
+             (unsigned long long)row.h->max());
+    out += line;
+  }
+  if (untracked) {
+    snprintf(line, sizeof(line), "  %llu bytes read with no queue timestamp\n",
+             (unsigned long long)untracked);
+    out += line;
+  }
+  return out;
+}
@@ -0,0 +1,64 @@
+/*
+ * Console Latency - Keystroke-to-echo timing per session
+ *
+ * Each input byte is timestamped three times:
+ *   queued    it entered the console input queue (or was read from the
+ *             host terminal)
+ *   consumed  the guest took it through CIOIN, VDAKRD or the console
+ *             data port
+ *   echoed    the first output byte after it reached the host terminal
+ * and the gaps are kept as three histograms:
+ *   queue  queued -> consumed  (guest not asking for input: scheduling,
+ *                               batch size, a busy program)
+ *   echo   consumed -> echoed  (guest processing plus output buffering)
+ *   total  queued -> echoed    (what the user sees)
+ *
+ * The platform layer calls the input hooks, HBIOSDispatch the consume
+ * hook and emu_console_write_char the echo hook. All hooks are a single
+ * flag test until emu_latency_enable(true).
+ */
+
+#ifndef EMU_LATENCY_H
+#define EMU_LATENCY_H
+
+#include <string>
+
+extern bool emu_latency_active;
+
+void emu_latency_enable(bool on);
+
+// Clear all samples (pending bytes are kept)
+void emu_latency_reset();
+
+// Hook bodies; call through the inline wrappers below
+void emu_latency_note_queued();
+void emu_latency_note_dropped();
+void emu_latency_note_consumed();
+void emu_latency_note_echoed();
+
+// A byte entered the input queue
+inline void emu_latency_input_queued() {
+  if (emu_latency_active) emu_latency_note_queued();
+}
+
+// The oldest queued byte was removed without reaching the guest (escape
+// character, checkpoint)
+inline void emu_latency_input_dropped() {
+  if (emu_latency_active) emu_latency_note_dropped();
+}
+
+// The guest read the oldest queued byte
+inline void emu_latency_input_consumed() {
+  if (emu_latency_active) emu_latency_note_consumed();
+}
+
+// Output reached the host terminal
+inline void emu_latency_output_echoed() {
+  if (emu_latency_active) emu_latency_note_echoed();
+}
+
+// Percentile table (count, p50, p90, p99, max in microseconds), one line
+// per stage
+std::string emu_latency_report();
+
+#endif // EMU_LATENCY_H
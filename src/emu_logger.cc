@@ -0,0 +1,495 @@
+/*
+ * Emulator Logger - Per-subsystem debug logging off the emulation thread
+ */
+
+#include "emu_logger.h"
+#include "emu_io.h"
+#include <atomic>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if !defined(__EMSCRIPTEN__)
+#include <chrono>
+#include <mutex>
+#include <thread>
+#endif
+
+uint8_t emu_log_levels[LOG_SUBSYS_COUNT] = { LOG_ERROR, LOG_ERROR, LOG_ERROR, LOG_ERROR, LOG_ERROR };
+
+namespace {
+
+std::atomic<emu_log_sink_fn> sink{nullptr};
+
+const int LOG_MAX_ARGS = 12;
+const size_t LOG_STRING_SPACE = 96;
+
+enum ArgType : uint8_t { ARG_INT, ARG_UINT, ARG_DOUBLE, ARG_STR, ARG_PTR };
+enum ArgLength { LEN_NONE, LEN_HH, LEN_H, LEN_L, LEN_LL, LEN_Z, LEN_J, LEN_T, LEN_BIG_L };
+
+// One conversion in a format string. Width and precision given as '*'
+// take an int argument each, which is captured ahead of the value.
+struct FormatSpec {
+  const char* start;   // The '%'
+  const char* end;     // Past the conversion character
+  char conv;
+  ArgLength length;
+  ArgType type;
+  bool star_width;
+  bool star_precision;
+};
+
+// Parse the conversion at p (just past a '%'). Returns false for "%%" and
+// for conversions that take no argument or are not supported.
+bool parse_spec(const char* p, FormatSpec& s) {
+  s.start = p - 1;
+  s.star_width = s.star_precision = false;
+  while (*p && strchr("-+ #0", *p)) p++;
+  if (*p == '*') { s.star_width = true; p++; }
+  while (*p >= '0' && *p <= '9') p++;
+  if (*p == '.') {
+    p++;
+    if (*p == '*') { s.star_precision = true; p++; }
+    while (*p >= '0' && *p <= '9') p++;
+  }
+  s.length = LEN_NONE;
+  if (p[0] == 'h' && p[1] == 'h') { s.length = LEN_HH; p += 2; }
+  else if (p[0] == 'l' && p[1] == 'l') { s.length = LEN_LL; p += 2; }
+  else if (*p == 'h') { s.length = LEN_H; p++; }
+  else if (*p == 'l') { s.length = LEN_L; p++; }
+  else if (*p == 'z') { s.length = LEN_Z; p++; }
+  else if (*p == 'j') { s.length = LEN_J; p++; }
+  else if (*p == 't') { s.length = LEN_T; p++; }
+  else if (*p == 'L') { s.length = LEN_BIG_L; p++; }
+  s.conv = *p;
+  s.end = *p ? p + 1 : p;
+  switch (s.conv) {
+    case 'd': case 'i': case 'c': s.type = ARG_INT; return true;
+    case 'u': case 'x': case 'X': case 'o': s.type = ARG_UINT; return true;
+    case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+      s.type = ARG_DOUBLE; return true;
+    case 's': s.type = ARG_STR; return true;
+    case 'p': s.type = ARG_PTR; return true;
+    default: return false;
+  }
+}
+
+// Arguments past LOG_MAX_ARGS are dropped; the text stops there with "..."
+struct LogRecord {
+  const char* fmt;
+  uint8_t nargs;
+  uint8_t str_used;
+  uint64_t args[LOG_MAX_ARGS];  // Integers, double bits, or string offsets
+  char strings[LOG_STRING_SPACE];
+};
+
+void add_arg(LogRecord& r, uint64_t v) {
+  r.args[r.nargs++] = v;
+}
+
+// Pull the arguments fmt calls for off the va_list into the record
+void capture(LogRecord& r, const char* fmt, va_list args) {
+  r.fmt = fmt;
+  r.nargs = 0;
+  r.str_used = 0;
+  for (const char* p = fmt; *p; p++) {
+    if (*p != '%') continue;
+    FormatSpec s;
+    bool has_arg = parse_spec(p + 1, s);
+    p = s.end - 1;
+    if (!has_arg) continue;
+    int needed = 1 + s.star_width + s.star_precision;
+    if (r.nargs + needed > LOG_MAX_ARGS) return;
+    if (s.star_width) add_arg(r, (int64_t)va_arg(args, int));
+    if (s.star_precision) add_arg(r, (int64_t)va_arg(args, int));
+    uint64_t v = 0;
+    switch (s.type) {
+      case ARG_INT:
+        switch (s.length) {
+          case LEN_L: v = (int64_t)va_arg(args, long); break;
+          case LEN_LL: v = (int64_t)va_arg(args, long long); break;
+          case LEN_Z: v = (int64_t)va_arg(args, size_t); break;
+          case LEN_J: v = (int64_t)va_arg(args, intmax_t); break;
+          case LEN_T: v = (int64_t)va_arg(args, ptrdiff_t); break;
+          default: v = (int64_t)va_arg(args, int); break;
+        }
+        break;
+      case ARG_UINT:
+        switch (s.length) {
+          case LEN_L: v = va_arg(args, unsigned long); break;
+          case LEN_LL: v = va_arg(args, unsigned long long); break;
+          case LEN_Z: v = va_arg(args, size_t); break;
+          case LEN_J: v = va_arg(args, uintmax_t); break;
+          case LEN_T: v = (uint64_t)va_arg(args, ptrdiff_t); break;
+          case LEN_HH: v = (uint8_t)va_arg(args, unsigned int); break;
+          case LEN_H: v = (uint16_t)va_arg(args, unsigned int); break;
+          default: v = va_arg(args, unsigned int); break;
+        }
+        break;
+      case ARG_DOUBLE: {
+        double d = s.length == LEN_BIG_L ? (double)va_arg(args, long double)
+                                         : va_arg(args, double);
+        memcpy(&v, &d, sizeof(v));
+        break;
+      }
+      case ARG_STR: {
+        const char* str = va_arg(args, const char*);
+        if (!str) str = "(null)";
+        size_t used = r.str_used;
+        if (used >= LOG_STRING_SPACE) {
+          v = LOG_STRING_SPACE - 1;  // The last string's terminator: ""
+          break;
+        }
+        size_t len = strnlen(str, LOG_STRING_SPACE - used - 1);
+        memcpy(r.strings + used, str, len);
+        r.strings[used + len] = '\0';
+        v = used;
+        r.str_used = (uint8_t)(used + len + 1);
+        break;
+      }
+      case ARG_PTR:
+        v = (uintptr_t)va_arg(args, void*);
+        break;
+    }
+    add_arg(r, v);
+  }
+}
+
+// Rebuild one conversion with a length modifier that matches how the
+// value was stored, and append it to out
+void format_one(std::string& out, const FormatSpec& s, const LogRecord& r, int& arg) {
+  char spec[48];
+  size_t n = 0;
+  for (const char* p = s.start; p < s.end - 1 && n < sizeof(spec) - 16; p++) {
+    if (*p == '*') {
+      n += snprintf(spec + n, sizeof(spec) - n, "%d", (int)(int64_t)r.args[arg++]);
+    } else if (!strchr("hlzjtL", *p)) {
+      spec[n++] = *p;
+    }
+  }
+  bool wide_int = (s.type == ARG_INT && s.conv != 'c') || s.type == ARG_UINT;
+  if (wide_int) {
+    spec[n++] = 'l';
+    spec[n++] = 'l';
+  }
+  spec[n++] = s.conv;
+  spec[n] = '\0';
+
+  char buf[256];
+  uint64_t v = r.args[arg++];
+  switch (s.type) {
+    case ARG_INT:
+      if (s.conv == 'c') snprintf(buf, sizeof(buf), spec, (int)v);
+      else snprintf(buf, sizeof(buf), spec, (long long)v);
+      break;
+    case ARG_UINT:
+      snprintf(buf, sizeof(buf), spec, (unsigned long long)v);
+      break;
+    case ARG_DOUBLE: {
+      double d;
+      memcpy(&d, &v, sizeof(d));
+      snprintf(buf, sizeof(buf), spec, d);
+      break;
+    }
+    case ARG_STR:
+      snprintf(buf, sizeof(buf), spec, r.strings + v);
+      break;
+    case ARG_PTR:
+      snprintf(buf, sizeof(buf), spec, (void*)(uintptr_t)v);
+      break;
+  }
+  out += buf;
+}
+
+void format_record(std::string& out, const LogRecord& r) {
+  int arg = 0;
+  for (const char* p = r.fmt; *p; p++) {
+    if (*p != '%') {
+      out += *p;
+      continue;
+    }
+    FormatSpec s;
+    bool has_arg = parse_spec(p + 1, s);
+    p = s.end - 1;
+    if (!has_arg) {
+      if (s.conv == '%') out += '%';
+      continue;
+    }
+    int needed = 1 + s.star_width + s.star_precision;
+    if (arg + needed > r.nargs) {
+      out += "...\n";
+      return;
+    }
+    format_one(out, s, r, arg);
+  }
+}
+
+#if !defined(__EMSCRIPTEN__)
+
+uint32_t ring_size = DEFAULT_RING_RECORDS;  // Records per thread, power of two
+
+// Single producer (the owning thread), single consumer (whoever holds
+// drain_mutex). Set retired when the owning thread exits; once drained the
+// ring goes on the free list for the next thread that logs.
+struct LogRing {
+  uint32_t size = ring_size;
+  LogRecord* records = new LogRecord[size];
+  std::atomic<bool> retired{false};
+  // head/cached_tail and tail on separate cache lines (padded rather than
+  // alignas, which plain new does not honour before C++17)
+  char pad0[64];
+  std::atomic<uint32_t> head{0};
+  uint32_t cached_tail = 0;  // Producer's last look at tail
+  char pad1[64];
+  std::atomic<uint32_t> tail{0};
+
+  ~LogRing() { delete[] records; }
+};
+
+std::mutex registry_mutex;     // Guards rings and free_rings
+std::vector<LogRing*> rings;   // In use, or retired and not yet drained
+std::vector<LogRing*> free_rings;
+std::mutex drain_mutex;        // Held by whoever is consuming
+std::atomic<bool> writer_running{false};
+std::atomic<bool> writer_stop{false};
+std::atomic<unsigned long> dropped{0};
+std::thread writer;
+FILE* writer_out = nullptr;
+
+// Hands the thread's ring back when the thread exits
+struct RingOwner {
+  LogRing* ring = nullptr;
+  ~RingOwner() {
+    if (ring) ring->retired.store(true, std::memory_order_release);
+    ring = nullptr;
+  }
+};
+
+LogRing* thread_ring() {
+  static thread_local RingOwner owner;
+  if (!owner.ring) {
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    while (!free_rings.empty() && !owner.ring) {
+      LogRing* ring = free_rings.back();
+      free_rings.pop_back();
+      if (ring->size == ring_size) {
+        ring->cached_tail = ring->tail.load(std::memory_order_relaxed);
+        ring->retired.store(false, std::memory_order_relaxed);
+        owner.ring = ring;
+      } else {
+        delete ring;  // Made before emu_logger_set_ring_size()
+      }
+    }
+    if (!owner.ring) owner.ring = new LogRing();
+    rings.push_back(owner.ring);
+  }
+  return owner.ring;
+}
+
+// Format and write everything queued. Caller holds drain_mutex.
+bool drain_rings() {
+  std::vector<LogRing*> snapshot;
+  {
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    snapshot = rings;
+  }
+  std::string out;
+  std::vector<LogRing*> drained;  // Retired, now empty
+  for (LogRing* ring : snapshot) {
+    // Retired first: its thread wrote nothing after setting it
+    bool retired = ring->retired.load(std::memory_order_acquire);
+    uint32_t t = ring->tail.load(std::memory_order_relaxed);
+    uint32_t h = ring->head.load(std::memory_order_acquire);
+    for (; t != h; t++) format_record(out, ring->records[t & (ring->size - 1)]);
+    ring->tail.store(t, std::memory_order_release);
+    if (retired) drained.push_back(ring);
+  }
+  if (!drained.empty()) {
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    for (LogRing* ring : drained) {
+      for (size_t i = 0; i < rings.size(); i++) {
+        if (rings[i] == ring) {
+          rings[i] = rings.back();
+          rings.pop_back();
+          break;
+        }
+      }
+      free_rings.push_back(ring);
+    }
+  }
+  if (out.empty()) return false;
+  if (emu_log_sink_fn fn = sink.load()) {
+    fn("%s", out.c_str());
+    return true;
+  }
+  fwrite(out.data(), 1, out.size(), writer_out);
+  fflush(writer_out);
+  return true;
+}
+
+void writer_loop() {
+  while (!writer_stop.load(std::memory_order_acquire)) {
+    bool wrote;
+    {
+      std::lock_guard<std::mutex> lock(drain_mutex);
+      wrote = drain_rings();
+    }
+    if (!wrote) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+#endif  // !__EMSCRIPTEN__
+
+}  // namespace
+
+void emu_logf(int subsys, int level, const char* fmt, ...) {
+  if (!emu_log_on(subsys, level)) return;
+  va_list args;
+  va_start(args, fmt);
+#if !defined(__EMSCRIPTEN__)
+  if (writer_running.load(std::memory_order_acquire)) {
+    LogRing* ring = thread_ring();
+    uint32_t h = ring->head.load(std::memory_order_relaxed);
+    if (h - ring->cached_tail >= ring->size) {
+      ring->cached_tail = ring->tail.load(std::memory_order_acquire);
+    }
+    if (h - ring->cached_tail >= ring->size) {
+      dropped.fetch_add(1, std::memory_order_relaxed);
+    } else {
+      LogRecord& r = ring->records[h & (ring->size - 1)];
+      capture(r, fmt, args);
+      ring->head.store(h + 1, std::memory_order_release);
+    }
+    va_end(args);
+    return;
+  }
+#endif
+  char buf[512];
+  vsnprintf(buf, sizeof(buf), fmt, args);
+  va_end(args);
+  if (emu_log_sink_fn fn = sink.load()) fn("%s", buf);
+  else emu_log("%s", buf);
+}
+
+void emu_logger_set_level(int subsys, int level) {
+  if (subsys >= 0 && subsys < LOG_SUBSYS_COUNT) emu_log_levels[subsys] = (uint8_t)level;
+}
+
+void emu_logger_set_all(int level) {
+  for (int i = 0; i < LOG_SUBSYS_COUNT; i++) emu_log_levels[i] = (uint8_t)level;
+}
+
+bool emu_logger_parse_levels(const char* spec) {
+  static const char* const subsys_names[LOG_SUBSYS_COUNT] = {
+    "BANK", "DIO", "CIO", "SYS", "TRACE"
+  };
+  static const char* const level_names[] = { "off", "error", "info", "debug" };
+
+  uint8_t levels[LOG_SUBSYS_COUNT];
+  memcpy(levels, emu_log_levels, sizeof(levels));
+  std::string s(spec);
+  size_t pos = 0;
+  while (pos <= s.size()) {
+    size_t comma = s.find(',', pos);
+    if (comma == std::string::npos) comma = s.size();
+    std::string item = s.substr(pos, comma - pos);
+    pos = comma + 1;
+    size_t eq = item.find('=');
+    if (eq == std::string::npos) return false;
+    std::string name = item.substr(0, eq);
+    std::string value = item.substr(eq + 1);
+
+    int level = -1;
+    for (int i = 0; i < 4; i++) {
+      if (emu_strcasecmp(value.c_str(), level_names[i]) == 0) level = i;
+    }
+    if (level < 0) return false;
+    if (emu_strcasecmp(name.c_str(), "ALL") == 0) {
+      memset(levels, level, sizeof(levels));
+      continue;
+    }
+    int subsys = -1;
+    for (int i = 0; i < LOG_SUBSYS_COUNT; i++) {
+      if (emu_strcasecmp(name.c_str(), subsys_names[i]) == 0) subsys = i;
+    }
+    if (subsys < 0) return false;
+    levels[subsys] = (uint8_t)level;
+  }
+  memcpy(emu_log_levels, levels, sizeof(levels));
+  return true;
+}
+
+bool emu_logger_set_ring_size(unsigned records) {
+#if defined(__EMSCRIPTEN__)
+  (void)records;
+  return false;
+#else
+  // Rings already made keep their size; idle ones are replaced on reuse
+  if (writer_running.load() || records < MIN_RING_RECORDS || records > MAX_RING_RECORDS) return false;
+  uint32_t size = MIN_RING_RECORDS;
+  while (size < records) size <<= 1;
+  ring_size = size;
+  return true;
+#endif
+}
+
+bool emu_logger_start(FILE* out) {
+#if defined(__EMSCRIPTEN__)
+  (void)out;
+  return false;
+#else
+  if (writer_running.load()) return true;
+  static bool stop_at_exit = false;
+  if (!stop_at_exit) {
+    atexit(emu_logger_stop);  // Join the writer before static destructors
+    stop_at_exit = true;
+  }
+  writer_out = out;
+  writer_stop.store(false);
+  writer = std::thread(writer_loop);
+  writer_running.store(true, std::memory_order_release);
+  return true;
+#endif
+}
+
+void emu_logger_flush() {
+#if !defined(__EMSCRIPTEN__)
+  if (!writer_running.load(std::memory_order_acquire)) return;
+  std::lock_guard<std::mutex> lock(drain_mutex);
+  drain_rings();
+#endif
+}
+
+void emu_logger_stop() {
+#if !defined(__EMSCRIPTEN__)
+  if (!writer_running.load()) return;
+  writer_running.store(false, std::memory_order_release);
+  writer_stop.store(true, std::memory_order_release);
+  writer.join();
+  {
+    std::lock_guard<std::mutex> lock(drain_mutex);
+    drain_rings();
+  }
+  unsigned long n = dropped.load();
+  if (n) emu_log("[LOG] %lu records dropped (ring full)\n", n);
+#endif
+}
+
+void emu_logger_set_sink(emu_log_sink_fn fn) {
+  sink.store(fn);
+}
+
+emu_log_sink_fn emu_logger_sink() {
+  return sink.load();
+}
+
+unsigned long emu_logger_dropped() {
+#if defined(__EMSCRIPTEN__)
+  return 0;
+#else
+  return dropped.load();
+#endif
+}
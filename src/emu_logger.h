@@ -0,0 +1,96 @@
+/*
+ * Emulator Logger - Per-subsystem debug logging off the emulation thread
+ *
+ * Hot paths log through EMU_DLOG/emu_logf, which check the subsystem's
+ * level (one array load) and, when enabled, store a fixed-size binary
+ * record: the format string pointer plus the raw arguments. Records go
+ * into a lock-free ring owned by the logging thread; a background writer
+ * formats and writes them, so the emulation thread never calls printf or
+ * write(). A full ring drops records (counted) rather than blocking.
+ * A record is about 200 bytes; the ring holds DEFAULT_RING_RECORDS of
+ * them unless emu_logger_set_ring_size() says otherwise. When a thread
+ * exits, the writer drains its ring and hands it to the next new thread.
+ *
+ * Until emu_logger_start() is called, or on platforms without threads
+ * (WASM), records are formatted and written immediately through emu_log.
+ *
+ * Format strings must be literals (the pointer is kept, not the text).
+ * %s arguments are copied into the record, up to 96 bytes per record in
+ * total, and at most 12 arguments are kept. Output from different threads
+ * is ordered within each thread only.
+ */
+
+#ifndef EMU_LOGGER_H
+#define EMU_LOGGER_H
+
+#include <cstdint>
+#include <cstdio>
+
+enum emu_log_subsys {
+  LOG_BANK,   // Bank switching and inter-bank copies
+  LOG_DIO,    // Disk I/O and disk tables
+  LOG_CIO,    // Console I/O
+  LOG_SYS,    // HBIOS system, boot, host and the other services
+  LOG_TRACE,  // Instruction trace
+  LOG_SUBSYS_COUNT
+};
+
+enum emu_log_level {
+  LOG_OFF,
+  LOG_ERROR,
+  LOG_INFO,
+  LOG_DEBUG
+};
+
+extern uint8_t emu_log_levels[LOG_SUBSYS_COUNT];
+
+inline bool emu_log_on(int subsys, int level = LOG_DEBUG) {
+  return emu_log_levels[subsys] >= level;
+}
+
+// Log a record if the subsystem is at the given level or above
+void emu_logf(int subsys, int level, const char* fmt, ...)
+#if defined(__GNUC__)
+  __attribute__((format(printf, 3, 4)))
+#endif
+  ;
+
+// Debug-level log with the level check inlined at the call site
+#define EMU_DLOG(subsys, ...) \
+  do { if (emu_log_on(subsys)) emu_logf(subsys, LOG_DEBUG, __VA_ARGS__); } while (0)
+
+// Levels
+void emu_logger_set_level(int subsys, int level);
+void emu_logger_set_all(int level);
+
+// Parse "SUBSYS=LEVEL[,...]" (subsystems BANK, DIO, CIO, SYS, TRACE or
+// ALL; levels off, error, info, debug; case-insensitive). Returns false
+// and changes nothing if the spec is malformed.
+bool emu_logger_parse_levels(const char* spec);
+
+// Records per thread ring, rounded up to a power of two. Only before
+// emu_logger_start(); returns false afterwards or if records is out of
+// range (MIN_RING_RECORDS to MAX_RING_RECORDS).
+const unsigned DEFAULT_RING_RECORDS = 2048;
+const unsigned MIN_RING_RECORDS = 64;
+const unsigned MAX_RING_RECORDS = 1u << 20;
+bool emu_logger_set_ring_size(unsigned records);
+
+// Start the background writer, sending formatted records to out
+bool emu_logger_start(FILE* out);
+
+// Send formatted text to fn instead of emu_log and the writer's FILE;
+// nullptr restores them. fn is called from the writer thread once it runs.
+typedef void (*emu_log_sink_fn)(const char* fmt, ...);
+void emu_logger_set_sink(emu_log_sink_fn fn);
+emu_log_sink_fn emu_logger_sink();
+
+// Write everything recorded so far (from any thread) before returning
+void emu_logger_flush();
+
+// Flush, stop the writer and report dropped records
+void emu_logger_stop();
+
+unsigned long emu_logger_dropped();
+
+#endif // EMU_LOGGER_H
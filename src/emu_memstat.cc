@@ -0,0 +1,149 @@
+/*
+ * Memory Report - Per-session memory and TLB figures for the banked arena
+ */
+
+#include "emu_memstat.h"
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+MemoryReport::MemoryReport(const void* arena_base, size_t len)
+  : arena(arena_base), arena_len(len), tlb_fd(-1) {
+#if defined(__linux__)
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HW_CACHE;
+  attr.config = PERF_COUNT_HW_CACHE_DTLB |
+                (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  tlb_fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+}
+
+MemoryReport::~MemoryReport() {
+#if defined(__linux__)
+  if (tlb_fd >= 0) close(tlb_fd);
+#endif
+}
+
+void MemoryReport::print(FILE* f, const char* label, long long instructions) {
+  char buf[64];
+  fprintf(f, "Memory (%s):\n", label);
+
+  long v = processRssKB();
+  if (v >= 0) fprintf(f, "  process RSS     %ld KB\n", v);
+  else fprintf(f, "  process RSS     n/a\n");
+
+  v = arenaResidentKB();
+  if (v >= 0) fprintf(f, "  arena resident  %ld of %zu KB\n", v, arena_len / 1024);
+  else fprintf(f, "  arena resident  n/a\n");
+
+  v = arenaHugeKB();
+  if (v >= 0) fprintf(f, "  arena huge      %ld KB\n", v);
+  else fprintf(f, "  arena huge      n/a\n");
+
+  v = ksmMergedPages();
+  if (v >= 0) fprintf(f, "  KSM merged      %ld pages\n", v);
+  else fprintf(f, "  KSM merged      n/a\n");
+
+  long long misses = tlbMisses();
+  if (misses < 0) {
+    fprintf(f, "  dTLB misses     n/a\n");
+  } else {
+    buf[0] = '\0';
+    if (instructions > 0) {
+      snprintf(buf, sizeof(buf), " (%.1f per 1M instructions)",
+               misses * 1e6 / instructions);
+    }
+    fprintf(f, "  dTLB misses     %lld%s\n", misses, buf);
+  }
+}
+
+long MemoryReport::processRssKB() const {
+#if defined(__linux__)
+  FILE* f = fopen("/proc/self/status", "r");
+  if (!f) return -1;
+  char line[256];
+  long kb = -1;
+  while (fgets(line, sizeof(line), f)) {
+    if (sscanf(line, "VmRSS: %ld kB", &kb) == 1) break;
+  }
+  fclose(f);
+  return kb;
+#else
+  return -1;
+#endif
+}
+
+long MemoryReport::arenaResidentKB() const {
+#if defined(__linux__)
+  if (!arena) return -1;
+  long page = sysconf(_SC_PAGESIZE);
+  if (page <= 0 || (uintptr_t)arena % page != 0) return -1;
+  std::vector<unsigned char> vec((arena_len + page - 1) / page);
+  if (mincore(const_cast<void*>(arena), arena_len, vec.data()) != 0) return -1;
+  long resident = 0;
+  for (unsigned char c : vec) resident += c & 1;
+  return resident * (page / 1024);
+#else
+  return -1;
+#endif
+}
+
+long MemoryReport::arenaHugeKB() const {
+#if defined(__linux__)
+  FILE* f = fopen("/proc/self/smaps", "r");
+  if (!f) return -1;
+  uintptr_t lo = (uintptr_t)arena;
+  uintptr_t hi = lo + arena_len;
+  bool in_arena = false;
+  long total = 0;
+  char line[512];
+  while (fgets(line, sizeof(line), f)) {
+    unsigned long start, end, kb;
+    if (sscanf(line, "%lx-%lx ", &start, &end) == 2) {
+      in_arena = start < hi && end > lo;
+    } else if (in_arena && sscanf(line, "AnonHugePages: %lu kB", &kb) == 1) {
+      total += kb;
+    }
+  }
+  fclose(f);
+  return total;
+#else
+  return -1;
+#endif
+}
+
+long MemoryReport::ksmMergedPages() const {
+#if defined(__linux__)
+  FILE* f = fopen("/proc/self/ksm_merging_pages", "r");
+  if (!f) return -1;
+  long pages = -1;
+  if (fscanf(f, "%ld", &pages) != 1) pages = -1;
+  fclose(f);
+  return pages;
+#else
+  return -1;
+#endif
+}
+
+long long MemoryReport::tlbMisses() const {
+#if defined(__linux__)
+  if (tlb_fd < 0) return -1;
+  long long count = 0;
+  if (read(tlb_fd, &count, sizeof(count)) != sizeof(count)) return -1;
+  return count;
+#else
+  return -1;
+#endif
+}
@@ -0,0 +1,37 @@
+/*
+ * Memory Report - Per-session memory and TLB figures for the banked arena
+ *
+ * Reports what one emulator process costs: process RSS, how much of the
+ * ROM/RAM arena is resident (mincore), how much of it is backed by huge
+ * pages, how many pages KSM has merged, and data-TLB misses over the run
+ * (perf_event_open). Figures the host cannot supply are printed as n/a.
+ * Linux only; elsewhere every figure is n/a.
+ */
+
+#ifndef EMU_MEMSTAT_H
+#define EMU_MEMSTAT_H
+
+#include <cstddef>
+#include <cstdio>
+
+class MemoryReport {
+public:
+  MemoryReport(const void* arena, size_t arena_len);
+  ~MemoryReport();
+
+  // Print one snapshot; instructions (if nonzero) scales the TLB figure
+  void print(FILE* f, const char* label, long long instructions = 0);
+
+private:
+  const void* arena;
+  size_t arena_len;
+  int tlb_fd;
+
+  long processRssKB() const;
+  long arenaResidentKB() const;
+  long arenaHugeKB() const;
+  long ksmMergedPages() const;
+  long long tlbMisses() const;
+};
+
+#endif // EMU_MEMSTAT_H
@@ -0,0 +1,435 @@
+/*
+ * Packed Disk - Compressed disk images with random access
+ */
+
+#include "emu_packed.h"
+#include "emu_io.h"
+#include "host_compute.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+
+const uint32_t MAGIC = 0x315A5752;  // "RWZ1"
+const size_t HEADER_SIZE = 24;      // magic, chunk size, image size, chunks, crc
+const size_t ENTRY_SIZE = 24;       // offset, length, slot, crc, flags
+const uint32_t FLAG_STORED = 0x01;  // Chunk is not compressed
+const uint32_t MIN_CHUNK = 4096;
+const uint32_t MAX_CHUNK = 1024 * 1024;
+const size_t BATCH_CHUNKS = 16;     // Chunks per worker per pack batch
+
+void put32(uint8_t* p, uint32_t v) {
+  for (int i = 0; i < 4; i++) p[i] = (uint8_t)(v >> (8 * i));
+}
+
+void put64(uint8_t* p, uint64_t v) {
+  for (int i = 0; i < 8; i++) p[i] = (uint8_t)(v >> (8 * i));
+}
+
+uint32_t get32(const uint8_t* p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+uint64_t get64(const uint8_t* p) {
+  return get32(p) | ((uint64_t)get32(p + 4) << 32);
+}
+
+bool read_all(int fd, uint8_t* data, size_t len, uint64_t offset) {
+  while (len > 0) {
+    ssize_t n = pread(fd, data, len, offset);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    data += n;
+    len -= n;
+    offset += n;
+  }
+  return true;
+}
+
+bool write_all(int fd, const uint8_t* data, size_t len, uint64_t offset) {
+  while (len > 0) {
+    ssize_t n = pwrite(fd, data, len, offset);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    data += n;
+    len -= n;
+    offset += n;
+  }
+  return true;
+}
+
+void encode_header(uint8_t* p, uint32_t chunk_size, uint64_t image_size, uint32_t chunks) {
+  put32(p, MAGIC);
+  put32(p + 4, chunk_size);
+  put64(p + 8, image_size);
+  put32(p + 16, chunks);
+  put32(p + 20, hc_crc32(0, p, 20));
+}
+
+// Check a header and return its fields
+bool decode_header(const uint8_t* p, uint32_t* chunk_size, uint64_t* image_size, uint32_t* chunks) {
+  if (get32(p) != MAGIC || get32(p + 20) != hc_crc32(0, p, 20)) return false;
+  *chunk_size = get32(p + 4);
+  *image_size = get64(p + 8);
+  *chunks = get32(p + 16);
+  if (*chunk_size < MIN_CHUNK || *chunk_size > MAX_CHUNK) return false;
+  return *chunks == (*image_size + *chunk_size - 1) / *chunk_size;
+}
+
+// Compress one chunk; falls back to storing it when LZ4 does not help
+void compress_chunk(const uint8_t* data, size_t len, std::vector<uint8_t>& out, uint32_t* flags) {
+  out.resize(len);
+  size_t n = hc_lz4_compress(data, len, out.data(), len - 1);
+  if (n == 0) {
+    memcpy(out.data(), data, len);
+    *flags = FLAG_STORED;
+  } else {
+    out.resize(n);
+    *flags = 0;
+  }
+}
+
+unsigned worker_count(unsigned threads) {
+  if (threads == 0) threads = std::thread::hardware_concurrency();
+  return std::max(1u, threads);
+}
+
+} // namespace
+
+//=============================================================================
+// Opening
+//=============================================================================
+
+bool PackedDisk::probe(int fd, uint64_t* size) {
+  uint8_t header[HEADER_SIZE];
+  uint32_t chunk_size, chunks;
+  uint64_t image_size;
+  if (!read_all(fd, header, sizeof(header), 0)) return false;
+  if (!decode_header(header, &chunk_size, &image_size, &chunks)) return false;
+  if (size) *size = image_size;
+  return true;
+}
+
+PackedDisk* PackedDisk::open(int fd, bool writable, std::string& error) {
+  uint8_t header[HEADER_SIZE];
+  uint32_t chunks;
+  PackedDisk* disk = new PackedDisk(fd, writable);
+  if (!read_all(fd, header, sizeof(header), 0) ||
+      !decode_header(header, &disk->chunk_size, &disk->image_size, &chunks)) {
+    error = "bad packed image header";
+    delete disk;
+    return nullptr;
+  }
+
+  std::vector<uint8_t> raw((size_t)chunks * ENTRY_SIZE);
+  if (!read_all(fd, raw.data(), raw.size(), HEADER_SIZE)) {
+    error = "packed image index is truncated";
+    delete disk;
+    return nullptr;
+  }
+  disk->index.resize(chunks);
+  disk->file_end = HEADER_SIZE + raw.size();
+  for (uint32_t n = 0; n < chunks; n++) {
+    const uint8_t* p = raw.data() + (size_t)n * ENTRY_SIZE;
+    IndexEntry& e = disk->index[n];
+    e.offset = get64(p);
+    e.length = get32(p + 8);
+    e.slot = get32(p + 12);
+    e.crc = get32(p + 16);
+    e.flags = get32(p + 20);
+    if (e.length > e.slot || e.offset < HEADER_SIZE + raw.size()) {
+      error = "packed image index entry " + std::to_string(n) + " is damaged";
+      delete disk;
+      return nullptr;
+    }
+    disk->file_end = std::max(disk->file_end, e.offset + e.slot);
+  }
+  return disk;
+}
+
+PackedDisk::~PackedDisk() {
+  flush();
+}
+
+//=============================================================================
+// Chunk cache
+//=============================================================================
+
+PackedDisk::Cached* PackedDisk::chunk(uint32_t n) {
+  auto it = cache.find(n);
+  if (it != cache.end()) {
+    lru.splice(lru.begin(), lru, it->second.lru_pos);
+    return &it->second;
+  }
+
+  // Make room: the least recently used chunk goes, written back first
+  if (cache.size() >= CACHE_CHUNKS) {
+    uint32_t victim = lru.back();
+    Cached& v = cache[victim];
+    if (v.dirty && !writeBack({victim})) return nullptr;
+    lru.pop_back();
+    cache.erase(victim);
+  }
+
+  const IndexEntry& e = index[n];
+  size_t len = std::min<uint64_t>(chunk_size, image_size - (uint64_t)n * chunk_size);
+  std::vector<uint8_t> packed(e.length);
+  std::vector<uint8_t> data(len);
+  bool ok = read_all(fd, packed.data(), packed.size(), e.offset);
+  if (ok && (e.flags & FLAG_STORED)) {
+    ok = e.length == len;
+    if (ok) data.swap(packed);
+  } else if (ok) {
+    ok = hc_lz4_decompress(packed.data(), packed.size(), data.data(), len) == (long)len;
+  }
+  if (!ok || hc_crc32(0, data.data(), len) != e.crc) {
+    emu_error("[PACKED] Chunk %u is unreadable or damaged\n", n);
+    return nullptr;
+  }
+
+  lru.push_front(n);
+  Cached& c = cache[n];
+  c.data.swap(data);
+  c.dirty = false;
+  c.lru_pos = lru.begin();
+  return &c;
+}
+
+// A free slot of at least length bytes, or a new one at the end of the
+// file with room to grow, so a chunk being filled does not move every time
+void PackedDisk::place(IndexEntry& e) {
+  for (size_t i = 0; i < free_slots.size(); i++) {
+    if (free_slots[i].second >= e.length) {
+      e.offset = free_slots[i].first;
+      e.slot = free_slots[i].second;
+      free_slots.erase(free_slots.begin() + i);
+      return;
+    }
+  }
+  e.offset = file_end;
+  e.slot = std::min<uint32_t>(chunk_size, (e.length + e.length / 4 + 511) & ~511u);
+  file_end += e.slot;
+}
+
+// Recompress the chunks and write each to a slot no index entry on disk
+// points at, sync, then point the index at them and sync again. A crash
+// at any step leaves every entry on a complete chunk, old or new. The
+// slots given up are reused only once the new entries are on disk.
+bool PackedDisk::writeBack(const std::vector<uint32_t>& chunks) {
+  std::vector<IndexEntry> entries;
+  for (uint32_t n : chunks) {
+    Cached& c = cache[n];
+    IndexEntry e = index[n];
+    std::vector<uint8_t> out;
+    compress_chunk(c.data.data(), c.data.size(), out, &e.flags);
+    e.length = out.size();
+    e.crc = hc_crc32(0, c.data.data(), c.data.size());
+    place(e);
+    if (!write_all(fd, out.data(), out.size(), e.offset)) {
+      emu_error("[PACKED] Cannot write chunk %u: %s\n", n, strerror(errno));
+      return false;
+    }
+    entries.push_back(e);
+  }
+  if (fdatasync(fd) != 0) {
+    emu_error("[PACKED] Cannot sync chunks: %s\n", strerror(errno));
+    return false;
+  }
+
+  for (size_t i = 0; i < chunks.size(); i++) {
+    const IndexEntry& e = entries[i];
+    uint8_t entry[ENTRY_SIZE];
+    put64(entry, e.offset);
+    put32(entry + 8, e.length);
+    put32(entry + 12, e.slot);
+    put32(entry + 16, e.crc);
+    put32(entry + 20, e.flags);
+    if (!write_all(fd, entry, sizeof(entry), HEADER_SIZE + (uint64_t)chunks[i] * ENTRY_SIZE)) {
+      emu_error("[PACKED] Cannot write index entry %u: %s\n", chunks[i], strerror(errno));
+      return false;
+    }
+  }
+  if (fdatasync(fd) != 0) {
+    emu_error("[PACKED] Cannot sync index: %s\n", strerror(errno));
+    return false;
+  }
+
+  for (size_t i = 0; i < chunks.size(); i++) {
+    IndexEntry& old = index[chunks[i]];
+    free_slots.push_back({old.offset, old.slot});
+    old = entries[i];
+    cache[chunks[i]].dirty = false;
+  }
+  return true;
+}
+
+//=============================================================================
+// Disk access
+//=============================================================================
+
+size_t PackedDisk::read(size_t offset, uint8_t* buf, size_t count) {
+  size_t done = 0;
+  while (done < count && offset + done < image_size) {
+    uint64_t pos = offset + done;
+    Cached* c = chunk(pos / chunk_size);
+    if (!c) break;
+    size_t in_chunk = pos % chunk_size;
+    size_t n = std::min(count - done, c->data.size() - in_chunk);
+    memcpy(buf + done, c->data.data() + in_chunk, n);
+    done += n;
+  }
+  return done;
+}
+
+size_t PackedDisk::write(size_t offset, const uint8_t* buf, size_t count) {
+  if (!writable) return 0;
+  size_t done = 0;
+  while (done < count && offset + done < image_size) {
+    uint64_t pos = offset + done;
+    Cached* c = chunk(pos / chunk_size);
+    if (!c) break;
+    size_t in_chunk = pos % chunk_size;
+    size_t n = std::min(count - done, c->data.size() - in_chunk);
+    memcpy(c->data.data() + in_chunk, buf + done, n);
+    c->dirty = true;
+    done += n;
+  }
+  return done;
+}
+
+bool PackedDisk::flush() {
+  std::vector<uint32_t> dirty;
+  for (auto& it : cache) {
+    if (it.second.dirty) dirty.push_back(it.first);
+  }
+  return dirty.empty() || writeBack(dirty);
+}
+
+//=============================================================================
+// Converters
+//=============================================================================
+
+bool PackedDisk::pack(int in_fd, int out_fd, uint32_t chunk_size, unsigned threads,
+                      std::string& error) {
+  struct stat st;
+  if (fstat(in_fd, &st) != 0) {
+    error = strerror(errno);
+    return false;
+  }
+  if (chunk_size < MIN_CHUNK || chunk_size > MAX_CHUNK || chunk_size % 512) {
+    error = "chunk size must be a multiple of 512 from 4 KB to 1 MB";
+    return false;
+  }
+  uint64_t image_size = st.st_size;
+  uint32_t chunks = (image_size + chunk_size - 1) / chunk_size;
+  unsigned workers = worker_count(threads);
+
+  std::vector<uint8_t> index((size_t)chunks * ENTRY_SIZE);
+  uint64_t pos = HEADER_SIZE + index.size();
+
+  // Batches: read sequentially, compress in parallel, write in order
+  size_t batch = workers * BATCH_CHUNKS;
+  std::vector<std::vector<uint8_t>> input(batch), output(batch);
+  std::vector<uint32_t> flags(batch);
+  for (uint32_t first = 0; first < chunks; first += batch) {
+    uint32_t count = std::min<uint64_t>(batch, chunks - first);
+    for (uint32_t i = 0; i < count; i++) {
+      uint64_t offset = (uint64_t)(first + i) * chunk_size;
+      input[i].resize(std::min<uint64_t>(chunk_size, image_size - offset));
+      if (!read_all(in_fd, input[i].data(), input[i].size(), offset)) {
+        error = std::string("reading image: ") + strerror(errno);
+        return false;
+      }
+    }
+    std::atomic<uint32_t> next(0);
+    auto work = [&]() {
+      for (uint32_t i; (i = next++) < count;) {
+        compress_chunk(input[i].data(), input[i].size(), output[i], &flags[i]);
+      }
+    };
+    std::vector<std::thread> pool;
+    for (unsigned w = 1; w < workers; w++) pool.emplace_back(work);
+    work();
+    for (auto& t : pool) t.join();
+
+    for (uint32_t i = 0; i < count; i++) {
+      uint8_t* e = index.data() + (size_t)(first + i) * ENTRY_SIZE;
+      put64(e, pos);
+      put32(e + 8, output[i].size());
+      put32(e + 12, output[i].size());
+      put32(e + 16, hc_crc32(0, input[i].data(), input[i].size()));
+      put32(e + 20, flags[i]);
+      if (!write_all(out_fd, output[i].data(), output[i].size(), pos)) {
+        error = std::string("writing packed image: ") + strerror(errno);
+        return false;
+      }
+      pos += output[i].size();
+    }
+  }
+
+  uint8_t header[HEADER_SIZE];
+  encode_header(header, chunk_size, image_size, chunks);
+  if (!write_all(out_fd, index.data(), index.size(), HEADER_SIZE) ||
+      !write_all(out_fd, header, sizeof(header), 0) || ftruncate(out_fd, pos) != 0) {
+    error = std::string("writing packed image: ") + strerror(errno);
+    return false;
+  }
+  return true;
+}
+
+bool PackedDisk::unpack(int in_fd, int out_fd, unsigned threads, std::string& error) {
+  PackedDisk* disk = open(in_fd, false, error);
+  if (!disk) return false;
+
+  // Every chunk has its own place in both files, so workers take chunks
+  // in any order and read and write them independently
+  std::atomic<uint32_t> next(0);
+  std::atomic<bool> failed(false);
+  std::string failure;
+  std::mutex failure_lock;
+  uint32_t chunks = disk->index.size();
+  auto work = [&]() {
+    std::vector<uint8_t> packed, data;
+    for (uint32_t n; !failed && (n = next++) < chunks;) {
+      const IndexEntry& e = disk->index[n];
+      size_t len = std::min<uint64_t>(disk->chunk_size, disk->image_size - (uint64_t)n * disk->chunk_size);
+      packed.resize(e.length);
+      data.resize(len);
+      bool ok = read_all(in_fd, packed.data(), packed.size(), e.offset);
+      if (ok && (e.flags & FLAG_STORED)) {
+        ok = e.length == len;
+        if (ok) memcpy(data.data(), packed.data(), len);
+      } else if (ok) {
+        ok = hc_lz4_decompress(packed.data(), packed.size(), data.data(), len) == (long)len;
+      }
+      std::string why;
+      if (!ok || hc_crc32(0, data.data(), len) != e.crc) {
+        why = "chunk " + std::to_string(n) + " is damaged";
+      } else if (!write_all(out_fd, data.data(), len, (uint64_t)n * disk->chunk_size)) {
+        why = std::string("writing image: ") + strerror(errno);
+      }
+      if (!why.empty()) {
+        std::lock_guard<std::mutex> guard(failure_lock);
+        if (!failed) failure = why;
+        failed = true;
+      }
+    }
+  };
+  unsigned workers = worker_count(threads);
+  std::vector<std::thread> pool;
+  for (unsigned w = 1; w < workers; w++) pool.emplace_back(work);
+  work();
+  for (auto& t : pool) t.join();
+
+  bool ok = !failed && ftruncate(out_fd, disk->image_size) == 0;
+  if (failed) error = failure;
+  else if (!ok) error = std::string("writing image: ") + strerror(errno);
+  delete disk;
+  return ok;
+}
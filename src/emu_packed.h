@@ -0,0 +1,99 @@
+/*
+ * Packed Disk - Compressed disk images with random access
+ *
+ * A packed image holds a disk image as fixed-size chunks, each LZ4
+ * compressed on its own (hc_lz4_compress), behind an index giving every
+ * chunk's place in the file. A read finds its chunk through the index in
+ * O(1) and decompresses it into an LRU cache of CACHE_CHUNKS chunks, so a
+ * session pays only for the chunks it touches.
+ *
+ * emu_disk_open recognizes packed images by their magic, whatever their
+ * name, and they can be attached like any other image. Writes go to the
+ * cached chunk; flush() recompresses the dirty chunks and writes them to
+ * free space, never over the data their index entries point at, and
+ * updates the entries only after the chunks are synced. An image is
+ * therefore crash-safe without a journal (emu_journal.h), which packed
+ * images do not take. Slots given up are reused by later writes; the
+ * file only shrinks by unpacking and packing again (romwbw_pack).
+ *
+ * File layout (little-endian):
+ *   header  u32 'RWZ1', u32 chunk size, u64 image size, u32 chunks,
+ *           u32 crc of the preceding 20 bytes
+ *   index   chunks x (u64 offset, u32 length, u32 slot, u32 crc, u32 flags)
+ *   data    the chunks; flags bit 0 = stored uncompressed, crc is over the
+ *           uncompressed bytes
+ */
+
+#ifndef EMU_PACKED_H
+#define EMU_PACKED_H
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+class PackedDisk {
+public:
+  static const uint32_t DEFAULT_CHUNK = 32 * 1024;
+  static const size_t CACHE_CHUNKS = 64;
+
+  // True if fd holds a packed image; size is set to the image it expands to
+  static bool probe(int fd, uint64_t* size = nullptr);
+
+  // Use the packed image open as fd (the caller keeps ownership of the fd).
+  // Returns nullptr with error set if the header or index is damaged.
+  static PackedDisk* open(int fd, bool writable, std::string& error);
+
+  ~PackedDisk();
+
+  size_t read(size_t offset, uint8_t* buf, size_t count);
+  size_t write(size_t offset, const uint8_t* buf, size_t count);
+
+  // Write back every changed chunk. False if a write failed.
+  bool flush();
+
+  uint64_t size() const { return image_size; }
+
+  // Converters between a plain image and a packed one, compressing or
+  // decompressing on threads workers (0 = one per CPU). False with error
+  // set on failure; out_fd is written from offset 0 and truncated.
+  static bool pack(int in_fd, int out_fd, uint32_t chunk_size, unsigned threads,
+                   std::string& error);
+  static bool unpack(int in_fd, int out_fd, unsigned threads, std::string& error);
+
+private:
+  struct IndexEntry {
+    uint64_t offset;
+    uint32_t length;
+    uint32_t slot;     // Bytes reserved at offset (length or more)
+    uint32_t crc;
+    uint32_t flags;
+  };
+
+  struct Cached {
+    std::vector<uint8_t> data;
+    bool dirty;
+    std::list<uint32_t>::iterator lru_pos;
+  };
+
+  int fd;
+  bool writable;
+  uint32_t chunk_size;
+  uint64_t image_size;
+  uint64_t file_end;                          // Where moved chunks go
+  std::vector<IndexEntry> index;
+  std::unordered_map<uint32_t, Cached> cache;
+  std::list<uint32_t> lru;                    // Most recently used first
+  std::vector<std::pair<uint64_t, uint32_t>> free_slots;  // Offset, bytes
+
+  PackedDisk(int fd, bool writable) : fd(fd), writable(writable) {}
+
+  Cached* chunk(uint32_t n);
+  void place(IndexEntry& e);
+  bool writeBack(const std::vector<uint32_t>& chunks);
+};
+
+#endif // EMU_PACKED_H
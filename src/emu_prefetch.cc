@@ -0,0 +1,231 @@
+/*
+ * Disk Prefetch - Background read-ahead of disk image regions
+ */
+
+#include "emu_prefetch.h"
+#include "host_compute.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const uint32_t TRACE_MAGIC = 0x54425752;  // "RWBT"
+const size_t TRACE_HEADER = 16;           // magic, runs, size
+const size_t TRACE_RUN = 12;              // first sector, count
+const uint32_t TRACE_MAX_RUNS = BootTrace::MAX_SECTORS;
+
+void put32(std::vector<uint8_t>& out, uint32_t v) {
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(&v);
+  out.insert(out.end(), p, p + 4);
+}
+
+void put64(std::vector<uint8_t>& out, uint64_t v) {
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(&v);
+  out.insert(out.end(), p, p + 8);
+}
+
+uint32_t get32(const uint8_t* p) { uint32_t v; memcpy(&v, p, 4); return v; }
+uint64_t get64(const uint8_t* p) { uint64_t v; memcpy(&v, p, 8); return v; }
+
+// Which image a trace belongs to: its size (see emu_prefetch.h)
+void put_identity(std::vector<uint8_t>& out, const struct stat& st) {
+  put64(out, (uint64_t)st.st_size);
+}
+
+} // namespace
+
+//=============================================================================
+// DiskPrefetch
+//=============================================================================
+
+DiskPrefetch::~DiskPrefetch() {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  wake.notify_one();
+  if (worker.joinable()) worker.join();
+}
+
+void DiskPrefetch::start(const Ranges& ranges) {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    queue.insert(queue.end(), ranges.begin(), ranges.end());
+  }
+  if (!worker.joinable()) worker = std::thread(&DiskPrefetch::run, this);
+  wake.notify_one();
+}
+
+void DiskPrefetch::run() {
+  uint8_t buf[SECTOR * 64];
+  std::unique_lock<std::mutex> guard(lock);
+  while (true) {
+    busy = false;
+    if (queue.empty()) dirty.clear();  // Nothing left that a write could race
+    wake.wait(guard, [this] { return stopping || !queue.empty(); });
+    if (stopping) return;
+
+    std::pair<uint64_t, uint32_t> range = queue.front();
+    queue.pop_front();
+    busy = true;
+    uint64_t sector = range.first;
+    uint64_t end = range.first + range.second;
+    while (sector < end && !stopping) {
+      // Skip what is already cached, then read the uncached run after it
+      if (cache.count(sector)) {
+        sector++;
+        continue;
+      }
+      uint64_t run_end = sector + 1;
+      while (run_end < end && run_end - sector < sizeof(buf) / SECTOR && !cache.count(run_end)) run_end++;
+
+      guard.unlock();
+      ssize_t got;
+      do {
+        got = pread(fd, buf, (run_end - sector) * SECTOR, sector * SECTOR);
+      } while (got < 0 && errno == EINTR);
+      guard.lock();
+      size_t n = got > 0 ? got / SECTOR : 0;
+      if (n == 0) break;  // Error, or a partial sector at the end of the image
+
+      for (size_t i = 0; i < n; i++) {
+        uint64_t s = sector + i;
+        // A write since the read makes this copy stale; a cached copy is
+        // already current
+        if (dirty.count(s) || cache.count(s)) continue;
+        Sector& c = cache[s];
+        memcpy(c.data, buf + i * SECTOR, SECTOR);
+        c.used = false;
+        prefetched_count++;
+      }
+      sector += n;
+    }
+  }
+}
+
+bool DiskPrefetch::read(size_t offset, uint8_t* buf, size_t count) {
+  if (count == 0 || offset % SECTOR || count % SECTOR) return false;
+  uint64_t first = offset / SECTOR;
+  size_t n = count / SECTOR;
+
+  std::lock_guard<std::mutex> guard(lock);
+  if (cache.empty()) return false;
+  for (size_t i = 0; i < n; i++) {
+    if (!cache.count(first + i)) return false;
+  }
+  for (size_t i = 0; i < n; i++) {
+    Sector& c = cache[first + i];
+    memcpy(buf + i * SECTOR, c.data, SECTOR);
+    if (!c.used) {
+      c.used = true;
+      used_count++;
+    }
+  }
+  return true;
+}
+
+void DiskPrefetch::written(size_t offset, const uint8_t* buf, size_t count) {
+  if (count == 0) return;
+  uint64_t first = offset / SECTOR;
+  uint64_t last = (offset + count - 1) / SECTOR;
+
+  std::lock_guard<std::mutex> guard(lock);
+  bool racing = busy || !queue.empty();
+  for (uint64_t s = first; s <= last; s++) {
+    auto it = cache.find(s);
+    if (it == cache.end()) {
+      if (racing) dirty.insert(s);
+      continue;
+    }
+    // Patch the part of the sector the write covers
+    size_t start = std::max<size_t>(offset, s * SECTOR);
+    size_t end = std::min<size_t>(offset + count, (s + 1) * SECTOR);
+    memcpy(it->second.data + (start - s * SECTOR), buf + (start - offset), end - start);
+  }
+}
+
+uint64_t DiskPrefetch::prefetched() {
+  std::lock_guard<std::mutex> guard(lock);
+  return prefetched_count;
+}
+
+uint64_t DiskPrefetch::used() {
+  std::lock_guard<std::mutex> guard(lock);
+  return used_count;
+}
+
+//=============================================================================
+// BootTrace
+//=============================================================================
+
+DiskPrefetch::Ranges BootTrace::load() {
+  DiskPrefetch::Ranges ranges;
+  struct stat st;
+  FILE* f = fopen(trace_path.c_str(), "rb");
+  if (!f) return ranges;
+  std::vector<uint8_t> data;
+  uint8_t chunk[4096];
+  size_t got;
+  while ((got = fread(chunk, 1, sizeof(chunk), f)) > 0) data.insert(data.end(), chunk, chunk + got);
+  fclose(f);
+  if (fstat(fd, &st) != 0) return ranges;
+
+  std::vector<uint8_t> identity;
+  put_identity(identity, st);
+  if (data.size() < TRACE_HEADER + 4 || get32(data.data()) != TRACE_MAGIC) return ranges;
+  uint32_t count = get32(data.data() + 4);
+  if (count > TRACE_MAX_RUNS || data.size() != TRACE_HEADER + count * TRACE_RUN + 4) return ranges;
+  if (memcmp(data.data() + 8, identity.data(), identity.size()) != 0) return ranges;  // Other image
+  if (hc_crc32(0, data.data(), data.size() - 4) != get32(data.data() + data.size() - 4)) return ranges;
+
+  const uint8_t* p = data.data() + TRACE_HEADER;
+  for (uint32_t i = 0; i < count; i++, p += TRACE_RUN) {
+    ranges.push_back({get64(p), get32(p + 8)});
+  }
+  done = true;  // Replaying, not recording
+  return ranges;
+}
+
+void BootTrace::read(size_t offset, size_t count) {
+  if (done || count == 0) return;
+  uint64_t first = offset / DiskPrefetch::SECTOR;
+  uint64_t last = (offset + count - 1) / DiskPrefetch::SECTOR;
+  uint32_t n = (uint32_t)(last - first + 1);
+  if (!runs.empty() && runs.back().first + runs.back().second == first) {
+    runs.back().second += n;
+  } else {
+    runs.push_back({first, n});
+  }
+  sectors += n;
+  if (sectors >= MAX_SECTORS) finish();
+}
+
+void BootTrace::finish() {
+  if (done || runs.empty()) return;
+  done = true;
+  struct stat st;
+  if (fstat(fd, &st) != 0) return;
+
+  std::vector<uint8_t> out;
+  put32(out, TRACE_MAGIC);
+  put32(out, (uint32_t)runs.size());
+  put_identity(out, st);
+  for (const auto& r : runs) {
+    put64(out, r.first);
+    put32(out, r.second);
+  }
+  put32(out, hc_crc32(0, out.data(), out.size()));
+
+  // Write a new file and rename it over the old, so a crash leaves one or
+  // the other
+  std::string tmp = trace_path + ".tmp";
+  FILE* f = fopen(tmp.c_str(), "wb");
+  if (!f) return;
+  bool ok = fwrite(out.data(), 1, out.size(), f) == out.size();
+  ok = fclose(f) == 0 && ok;
+  if (!ok || rename(tmp.c_str(), trace_path.c_str()) != 0) remove(tmp.c_str());
+}
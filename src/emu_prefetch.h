@@ -0,0 +1,120 @@
+/*
+ * Disk Prefetch - Background read-ahead of disk image regions
+ *
+ * On boot CBIOS enumerates every slice with EXTSLICE and then reads each
+ * slice's directory, one cold sector at a time. Once a disk's slice layout
+ * is known, HBIOSDispatch asks for those directory regions up front
+ * (emu_disk_prefetch); a thread per image reads them with pread into an
+ * in-memory sector cache, and emu_disk_read serves fully cached requests
+ * from it. Requests queue behind each other in the order given.
+ *
+ * The cache stays coherent with writes: written() updates cached sectors,
+ * and a sector written before the thread gets to it is not cached at all,
+ * so a read never sees data older than the last write. Cached sectors
+ * stay for the life of the image (directories plus one boot trace, a few
+ * MB at most).
+ *
+ * Counters: prefetched = sectors read ahead into the cache; used =
+ * distinct prefetched sectors later read by the guest.
+ *
+ * BootTrace records the sectors a boot reads, in order, to IMAGE.boottrace
+ * (emu_disk_set_boot_trace). A later open of an image of the same size
+ * replays the trace as a prefetch before the guest asks; otherwise the
+ * boot is recorded afresh. The mtime is not part of the key: the guest
+ * writes to the image on every boot, and a trace that no longer matches
+ * the contents only costs reads the boot does not use.
+ *
+ * Trace file layout (host byte order):
+ *   u32 'RWBT', u32 runs, u64 image size,
+ *   runs x (u64 first sector, u32 count), u32 crc of everything before
+ */
+
+#ifndef EMU_PREFETCH_H
+#define EMU_PREFETCH_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+class DiskPrefetch {
+public:
+  static const size_t SECTOR = 512;
+
+  // Sector ranges: first sector, count
+  typedef std::vector<std::pair<uint64_t, uint32_t>> Ranges;
+
+  // Read from fd (owned by the caller; must outlive this object)
+  explicit DiskPrefetch(int fd) : fd(fd) {}
+  ~DiskPrefetch();
+
+  // Queue ranges for the background thread; sectors already cached are
+  // skipped
+  void start(const Ranges& ranges);
+
+  // Fill buf from the cache if every sector of the request is cached
+  bool read(size_t offset, uint8_t* buf, size_t count);
+
+  // Keep cached sectors in step with a write to the image
+  void written(size_t offset, const uint8_t* buf, size_t count);
+
+  uint64_t prefetched();
+  uint64_t used();
+
+private:
+  struct Sector {
+    uint8_t data[SECTOR];
+    bool used;
+  };
+
+  int fd;
+  std::thread worker;
+
+  std::mutex lock;                               // Guards everything below
+  std::condition_variable wake;
+  bool stopping = false;
+  bool busy = false;                             // Reading a range
+  std::deque<std::pair<uint64_t, uint32_t>> queue;
+  std::unordered_map<uint64_t, Sector> cache;
+  std::unordered_set<uint64_t> dirty;            // Written while reads are queued
+  uint64_t prefetched_count = 0;
+  uint64_t used_count = 0;
+
+  void run();
+};
+
+class BootTrace {
+public:
+  // Record up to this many sector reads
+  static const size_t MAX_SECTORS = 8192;
+
+  // The trace for the image at path, open as fd
+  BootTrace(const std::string& path, int fd)
+    : trace_path(path + ".boottrace"), fd(fd) {}
+
+  // Ranges saved by an earlier boot of this exact image, or empty
+  DiskPrefetch::Ranges load();
+
+  // Record a read while recording
+  void read(size_t offset, size_t count);
+  bool recording() const { return !done; }
+
+  // Stop recording and write the trace; does nothing before the first read
+  void finish();
+
+private:
+  std::string trace_path;
+  int fd;
+  bool done = false;
+  size_t sectors = 0;
+  DiskPrefetch::Ranges runs;  // Reads in order, adjacent ones merged
+};
+
+#endif // EMU_PREFETCH_H
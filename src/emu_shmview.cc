@@ -0,0 +1,99 @@
+/*
+ * Shared State View - Live machine state in a POSIX shared-memory segment
+ */
+
+#include "emu_shmview.h"
+#include "hbios_dispatch.h"
+#include "romwbw_mem.h"
+#include "hbios_cpu.h"
+#include <chrono>
+#include <fcntl.h>
+#include <new>
+#include <sys/mman.h>
+#include <unistd.h>
+
+bool SharedStateView::open(const std::string& name, banked_mem* memory) {
+  close();
+  shm_name = name[0] == '/' ? name : "/" + name;
+  size_t len = EMU_SHM_HEADER_SIZE + banked_mem::ROM_SIZE + banked_mem::RAM_SIZE;
+
+  fd = shm_open(shm_name.c_str(), O_RDWR | O_CREAT, 0640);
+  if (fd < 0) return false;
+  // Truncate first so a stale segment from a crashed run starts zeroed
+  if (ftruncate(fd, 0) != 0 || ftruncate(fd, (off_t)len) != 0) {
+    close();
+    return false;
+  }
+  void* p = mmap(nullptr, EMU_SHM_HEADER_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (p == MAP_FAILED) {
+    close();
+    return false;
+  }
+
+  header = new (p) EmuShmHeader();
+  memset(&header->state, 0, sizeof(header->state));
+  header->version = EMU_SHM_VERSION;
+  header->header_size = EMU_SHM_HEADER_SIZE;
+  header->rom_offset = EMU_SHM_HEADER_SIZE;
+  header->rom_size = banked_mem::ROM_SIZE;
+  header->ram_offset = EMU_SHM_HEADER_SIZE + banked_mem::ROM_SIZE;
+  header->ram_size = banked_mem::RAM_SIZE;
+  header->bank_size = banked_mem::BANK_SIZE;
+  header->pid = (uint32_t)getpid();
+  header->seq.store(0, std::memory_order_relaxed);
+  // Magic last: a reader that sees it finds the rest filled in
+  std::atomic_thread_fence(std::memory_order_release);
+  memcpy(header->magic, EMU_SHM_MAGIC, sizeof(header->magic));
+
+  memory->set_arena_file(fd, EMU_SHM_HEADER_SIZE);
+  return true;
+}
+
+void SharedStateView::publish(hbios_cpu& cpu, const banked_mem& memory, const HBIOSDispatch& hbios,
+                              uint64_t instructions, bool waiting_input) {
+  if (!header) return;
+
+  cpu.sync_flags();
+  EmuShmState s;
+  memset(&s, 0, sizeof(s));
+  s.instructions = instructions;
+  s.cycles = cpu.cycles;
+  s.host_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+  memcpy(s.hbios_calls, hbios.getCallCounts(), sizeof(s.hbios_calls));
+  s.pc = cpu.regs.PC.get_pair16();
+  s.sp = cpu.regs.SP.get_pair16();
+  s.af = cpu.regs.AF.get_pair16();
+  s.bc = cpu.regs.BC.get_pair16();
+  s.de = cpu.regs.DE.get_pair16();
+  s.hl = cpu.regs.HL.get_pair16();
+  s.ix = cpu.regs.IX.get_pair16();
+  s.iy = cpu.regs.IY.get_pair16();
+  s.bank = memory.get_current_bank();
+  s.waiting_input = waiting_input;
+  s.dsky_present = 0;
+  int rows, cols, row, col;
+  hbios.getVDAState(rows, cols, row, col, s.vda_attr);
+  s.vda_rows = rows;
+  s.vda_cols = cols;
+  s.vda_row = row;
+  s.vda_col = col;
+
+  uint32_t seq = header->seq.load(std::memory_order_relaxed);
+  header->seq.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  memcpy((void*)&header->state, &s, sizeof(s));
+  header->seq.store(seq + 2, std::memory_order_release);
+}
+
+void SharedStateView::close() {
+  if (header) {
+    munmap(header, EMU_SHM_HEADER_SIZE);
+    header = nullptr;
+  }
+  if (fd >= 0) {
+    ::close(fd);
+    fd = -1;
+    shm_unlink(shm_name.c_str());
+  }
+}
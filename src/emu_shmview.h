@@ -0,0 +1,106 @@
+/*
+ * Shared State View - Live machine state in a POSIX shared-memory segment
+ *
+ * With --shm-view=NAME the emulator creates /dev/shm/NAME and maps its
+ * banked ROM/RAM arena from it, so guest memory in the segment is the
+ * memory the CPU runs on (no copying). A header page in front of the
+ * arena carries a register and status block that the main loop
+ * republishes every few thousand instructions and whenever the guest
+ * blocks for console input.
+ *
+ * Segment layout:
+ *   0x00000  EmuShmHeader (one 4 KB page)
+ *   0x01000  ROM banks 0x00-0x0F (512 KB)
+ *   0x81000  RAM banks 0x80-0x8F (512 KB)
+ *
+ * The state block is guarded by a seqlock: the writer makes seq odd,
+ * updates the block, then makes it even again. A reader copies the block
+ * and retries if seq was odd or changed meanwhile (emu_shm_read_state
+ * does this). Readers never block the emulator and may poll at any rate.
+ * Memory pages are not covered by the seqlock; they are read as-is.
+ */
+
+#ifndef EMU_SHMVIEW_H
+#define EMU_SHMVIEW_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+class hbios_cpu;
+class banked_mem;
+class HBIOSDispatch;
+
+#define EMU_SHM_MAGIC "RWSHMV1"
+static const uint32_t EMU_SHM_VERSION = 1;
+static const size_t EMU_SHM_HEADER_SIZE = 4096;
+
+struct EmuShmState {
+  uint64_t instructions;      // Instructions executed
+  uint64_t cycles;            // CPU T-states
+  uint64_t host_ns;           // Host monotonic clock at publish
+  uint64_t hbios_calls[9];    // Per class: CIO DIO RTC SYS VDA SND DSKY EXT HCS
+  uint16_t pc, sp, af, bc, de, hl, ix, iy;
+  uint8_t bank;               // Bank mapped at 0x0000-0x7FFF
+  uint8_t waiting_input;      // Guest blocked in CIOIN
+  uint8_t dsky_present;       // 0: no DSKY is emulated
+  uint8_t vda_attr;
+  uint16_t vda_rows, vda_cols;
+  uint16_t vda_row, vda_col;  // Cursor
+};
+
+struct EmuShmHeader {
+  char magic[8];              // EMU_SHM_MAGIC
+  uint32_t version;           // EMU_SHM_VERSION
+  uint32_t header_size;       // EMU_SHM_HEADER_SIZE
+  uint32_t rom_offset, rom_size;
+  uint32_t ram_offset, ram_size;
+  uint32_t bank_size;
+  uint32_t pid;               // Emulator process
+  std::atomic<uint32_t> seq;  // Seqlock: odd while the state is updated
+  uint32_t reserved;
+  EmuShmState state;
+};
+
+static_assert(sizeof(EmuShmHeader) <= EMU_SHM_HEADER_SIZE, "header exceeds its page");
+
+// Consistent copy of the state block; false if the writer was busy for
+// every attempt
+inline bool emu_shm_read_state(const EmuShmHeader* h, EmuShmState* out, int attempts = 1000) {
+  while (attempts-- > 0) {
+    uint32_t s1 = h->seq.load(std::memory_order_acquire);
+    if (s1 & 1) continue;
+    memcpy(out, (const void*)&h->state, sizeof(*out));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (h->seq.load(std::memory_order_relaxed) == s1) return true;
+  }
+  return false;
+}
+
+class SharedStateView {
+public:
+  ~SharedStateView() { close(); }
+
+  // Create (or replace) segment /name and point memory's arena at it;
+  // must precede memory.enable_banking()
+  bool open(const std::string& name, banked_mem* memory);
+
+  // Flags are synced first (lazy-flag core) so the AF published is current
+  void publish(hbios_cpu& cpu, const banked_mem& memory, const HBIOSDispatch& hbios,
+               uint64_t instructions, bool waiting_input);
+
+  // Unmap and unlink the segment (the arena mapping keeps it alive until
+  // the memory is freed)
+  void close();
+
+  bool isOpen() const { return header != nullptr; }
+
+private:
+  std::string shm_name;
+  int fd = -1;
+  EmuShmHeader* header = nullptr;
+};
+
+#endif // EMU_SHMVIEW_H
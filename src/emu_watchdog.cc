@@ -0,0 +1,78 @@
+/*
+ * Guest Watchdog - Detects a guest that has stopped making progress
+ */
+
+#include "emu_watchdog.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+bool Watchdog::parse(const char* spec, int& seconds, Action& action) {
+  char* end;
+  long secs = strtol(spec, &end, 10);
+  if (end == spec || secs <= 0 || secs > 86400) return false;
+  seconds = (int)secs;
+  action = ACTION_EXIT;
+  if (*end == '\0') return true;
+  if (*end != ':') return false;
+  const char* name = end + 1;
+  if (strcmp(name, "exit") == 0) action = ACTION_EXIT;
+  else if (strcmp(name, "snapshot") == 0) action = ACTION_SNAPSHOT;
+  else if (strcmp(name, "notify") == 0) action = ACTION_NOTIFY;
+  else return false;
+  return true;
+}
+
+const char* Watchdog::actionName(Action action) {
+  switch (action) {
+    case ACTION_SNAPSHOT: return "snapshot";
+    case ACTION_NOTIFY: return "notify";
+    default: return "exit";
+  }
+}
+
+bool Watchdog::sample(uint32_t phys_pc, uint64_t progress, uint64_t cycles, bool waiting) {
+  if (tripped) return false;
+  ring[ring_pos++ % RING_SIZE] = phys_pc;
+  if (waiting || progress != last_progress || cycles < window_start) {
+    rearm(progress, cycles);
+    return false;
+  }
+  loop_pcs[phys_pc]++;
+  if (loop_pcs.size() > MAX_LOOP_PCS) {
+    // Too many places to be one loop: busy, just quiet
+    rearm(progress, cycles);
+    return false;
+  }
+  if (cycles - window_start < (uint64_t)seconds * CYCLES_PER_SECOND) return false;
+  tripped = true;
+  return true;
+}
+
+void Watchdog::rearm(uint64_t progress, uint64_t cycles) {
+  tripped = false;
+  window_start = cycles;
+  last_progress = progress;
+  loop_pcs.clear();
+}
+
+std::string Watchdog::report() const {
+  char buf[64];
+  std::string out;
+  snprintf(buf, sizeof(buf), "No progress for %d s; sampled PCs:\n", seconds);
+  out += buf;
+  for (const auto& p : loop_pcs) {
+    snprintf(buf, sizeof(buf), "  %02X:%04X  %u\n", p.first >> 16, p.first & 0xFFFF, p.second);
+    out += buf;
+  }
+
+  // Oldest first
+  size_t n = ring_pos < RING_SIZE ? (size_t)ring_pos : RING_SIZE;
+  out += "Last samples:";
+  for (size_t i = 0; i < n; i++) {
+    uint32_t pc = ring[(ring_pos - n + i) % RING_SIZE];
+    snprintf(buf, sizeof(buf), "%s%02X:%04X", i % 8 ? " " : "\n  ", pc >> 16, pc & 0xFFFF);
+    out += buf;
+  }
+  return out + "\n";
+}
@@ -0,0 +1,84 @@
+/*
+ * Guest Watchdog - Detects a guest that has stopped making progress
+ *
+ * A crashed program usually ends up in a small loop: jumping to itself,
+ * polling CIOIST for input that never comes, or walking the same few
+ * routines forever. With --watchdog=SECS the main loop samples the
+ * physical PC (bank and address) every SAMPLE_INTERVAL instructions and
+ * reads HBIOSDispatch's progress count (console bytes in and out, disk
+ * sectors, host file bytes and block compute calls, and the same through
+ * the SIMH devices). The guest is runaway when, for
+ * SECS emulated seconds (cycles at the 4 MHz SYSGET CPUINFO reports):
+ *   - the progress count has not moved, and
+ *   - the samples have landed on at most MAX_LOOP_PCS distinct PCs.
+ * Any progress, or a wider spread of PCs, starts the window again.
+ *
+ * A guest waiting for a keystroke is not stuck. Blocked in CIOIN it runs
+ * no instructions; spinning on CIOIST (HBIOSDispatch::isPollingForInput)
+ * or the SIMH console status port (SimhDevices::inputIdle) the caller
+ * reports it as waiting, which holds the window open. Once
+ * console input is at EOF nothing more can arrive, and that counts. A
+ * long silent computation in a tight loop looks the same as a runaway,
+ * so SECS is set above a job's expected quiet time.
+ *
+ * The last RING_SIZE samples are kept in order for the report, so the
+ * watchdog adds nothing to the instructions between sample points.
+ */
+
+#ifndef EMU_WATCHDOG_H
+#define EMU_WATCHDOG_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+
+class Watchdog {
+public:
+  enum Action {
+    ACTION_EXIT,      // Report and exit with EXIT_CODE
+    ACTION_SNAPSHOT,  // Report, write a checkpoint, exit with EXIT_CODE
+    ACTION_NOTIFY     // Report, pause and send an event to control clients
+  };
+
+  static const int EXIT_CODE = 3;
+  static const long long SAMPLE_INTERVAL = 4096;
+  static const size_t MAX_LOOP_PCS = 32;
+  static const size_t RING_SIZE = 64;
+  static const uint64_t CYCLES_PER_SECOND = 4000000;
+
+  // Physical PC: RAM bank 0x8F above 0x8000, the current bank below
+  static uint32_t physicalPC(uint8_t bank, uint16_t pc) {
+    return pc >= 0x8000 ? (0x8Fu << 16) | pc : ((uint32_t)bank << 16) | pc;
+  }
+
+  // Parse "SECS[:exit|snapshot|notify]"
+  static bool parse(const char* spec, int& seconds, Action& action);
+  static const char* actionName(Action action);
+
+  Watchdog(int seconds, Action action) : seconds(seconds), action(action) {}
+
+  int timeout() const { return seconds; }
+  Action onTrip() const { return action; }
+
+  // Take a sample; true once when the guest is found runaway
+  bool sample(uint32_t phys_pc, uint64_t progress, uint64_t cycles, bool waiting);
+
+  // Start a new window (after a notify, when the machine resumes)
+  void rearm(uint64_t progress, uint64_t cycles);
+
+  // Loop PCs with their sample counts, and the last samples taken
+  std::string report() const;
+
+private:
+  int seconds;
+  Action action;
+  bool tripped = false;
+  uint64_t window_start = 0;                  // Cycles at the last progress
+  uint64_t last_progress = 0;
+  std::map<uint32_t, uint32_t> loop_pcs;      // Sampled PC -> samples
+  uint32_t ring[RING_SIZE] = {};              // Last sampled PCs
+  uint64_t ring_pos = 0;
+};
+
+#endif // EMU_WATCHDOG_H
@@ -0,0 +1,1116 @@
+/*
+ * Guest HLE - Native replacement of hot guest routines
+ *
+ * The built-in routines come from code that ships with RomWBW:
+ *
+ *   - the DRI CP/M 2.2 BDOS, assembled into every ROM and system image
+ *     (see cpm22.asm): block move, shifts, directory checksum and the
+ *     filename compare loop of the directory search
+ *   - XM.COM (XMODEM): the CRC-16 update per byte
+ *   - MBASIC.COM 5.21: the single precision multiply and divide bit loops,
+ *     the alignment shift of add/subtract and normalisation
+ *
+ * T-state counts are the Z80 timings of the original code. MBASIC patches
+ * operands of its multiply and divide loops before running them, so those
+ * bytes are HLE_ANY and are read back from the code when the routine runs.
+ *
+ * Not covered: the rest of the BDOS directory search (FINDNXT reads the
+ * next entry through the BIOS, and matching the extent byte calls SAMEXT,
+ * so only the compare loop between those is native) and CBIOS deblocking.
+ * The RomWBW CBIOS source is not in this tree, and the data movement in
+ * its deblocking already runs natively as the HBIOS DIOREAD/DIOWRITE and
+ * SYSBNKCPY handlers. What is left is per-record bookkeeping.
+ */
+
+#include "guest_hle.h"
+#include "hbios_cpu.h"
+#include "emu_io.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// Z80 flags after "DEC C" from 1 to 0 (Z and N set, carry kept)
+inline uint8_t dec_to_zero_flags(uint8_t carry) {
+  return 0x42 | (carry & 0x01);
+}
+
+// Z80 flag bits
+const uint8_t FLAG_C = 0x01, FLAG_N = 0x02, FLAG_PV = 0x04, FLAG_X = 0x08,
+              FLAG_H = 0x10, FLAG_Y = 0x20, FLAG_Z = 0x40, FLAG_S = 0x80;
+
+// S, Z, Y and X of a result
+inline uint8_t sz53(uint8_t r) {
+  return (r & (FLAG_S | FLAG_Y | FLAG_X)) | (r ? 0 : FLAG_Z);
+}
+
+// S, Z, Y, X and even parity of a result
+inline uint8_t sz53p(uint8_t r) {
+  uint8_t p = r ^ (r >> 4);
+  p ^= p >> 2;
+  p ^= p >> 1;
+  return sz53(r) | ((p & 1) ? 0 : FLAG_PV);
+}
+
+// A and F for routines whose exit flags depend on the data: each call
+// updates both exactly as the Z80 instruction of the same name
+struct Alu {
+  uint8_t a, f;
+
+  bool carry() const { return f & FLAG_C; }
+
+  void add(uint8_t v, bool c) {
+    unsigned r = a + v + c;
+    f = sz53(r) | (r >> 8) | ((a ^ v ^ r) & FLAG_H) |
+        (((a ^ ~v) & (a ^ r) & 0x80) ? FLAG_PV : 0);
+    a = r;
+  }
+  void sub(uint8_t v, bool c) {
+    unsigned r = (a - v - c) & 0x1FF;
+    f = sz53(r) | FLAG_N | (r >> 8) | ((a ^ v ^ r) & FLAG_H) |
+        (((a ^ v) & (a ^ r) & 0x80) ? FLAG_PV : 0);
+    a = r;
+  }
+  void cp(uint8_t v) {
+    uint8_t keep = a;
+    sub(v, false);
+    f = (f & ~(FLAG_Y | FLAG_X)) | (v & (FLAG_Y | FLAG_X));
+    a = keep;
+  }
+  void and_(uint8_t v) { a &= v; f = sz53p(a) | FLAG_H; }
+  void xor_(uint8_t v) { a ^= v; f = sz53p(a); }
+  void or_(uint8_t v) { a |= v; f = sz53p(a); }
+
+  uint8_t inc(uint8_t v) {
+    uint8_t r = v + 1;
+    f = (f & FLAG_C) | sz53(r) | ((r & 0x0F) ? 0 : FLAG_H) |
+        (r == 0x80 ? FLAG_PV : 0);
+    return r;
+  }
+  uint8_t dec(uint8_t v) {
+    uint8_t r = v - 1;
+    f = (f & FLAG_C) | FLAG_N | sz53(r) | ((r & 0x0F) == 0x0F ? FLAG_H : 0) |
+        (r == 0x7F ? FLAG_PV : 0);
+    return r;
+  }
+
+  void rla() {
+    uint8_t r = (a << 1) | carry();
+    f = (f & (FLAG_S | FLAG_Z | FLAG_PV)) | (a >> 7) | (r & (FLAG_Y | FLAG_X));
+    a = r;
+  }
+  void rra() {
+    uint8_t r = (a >> 1) | (carry() ? 0x80 : 0);
+    f = (f & (FLAG_S | FLAG_Z | FLAG_PV)) | (a & FLAG_C) | (r & (FLAG_Y | FLAG_X));
+    a = r;
+  }
+  void rlca() {
+    uint8_t r = (a << 1) | (a >> 7);
+    f = (f & (FLAG_S | FLAG_Z | FLAG_PV)) | (a >> 7) | (r & (FLAG_Y | FLAG_X));
+    a = r;
+  }
+  void scf() { f = (f & (FLAG_S | FLAG_Z | FLAG_PV)) | FLAG_C | (a & (FLAG_Y | FLAG_X)); }
+  void ccf() {
+    f = (f & (FLAG_S | FLAG_Z | FLAG_PV)) | (carry() ? FLAG_H : FLAG_C) |
+        (a & (FLAG_Y | FLAG_X));
+  }
+
+  // ADD HL,rr
+  uint16_t add16(uint16_t hl, uint16_t v) {
+    unsigned r = hl + v;
+    f = (f & (FLAG_S | FLAG_Z | FLAG_PV)) | (r >> 16) |
+        (((hl ^ v ^ r) >> 8) & FLAG_H) | ((r >> 8) & (FLAG_Y | FLAG_X));
+    return r;
+  }
+};
+
+// PUSH rr: the stack bytes are part of the memory the routine leaves
+inline void push16(HLEContext& ctx, uint16_t& sp, uint16_t v) {
+  ctx.wr(--sp, v >> 8);
+  ctx.wr(--sp, v & 0xFF);
+}
+
+//-----------------------------------------------------------------------------
+// DE2HL - block move (DE) to (HL), C bytes
+//   INR C / DE2HL1: DCR C / RZ / LDAX D / MOV M,A / INX D / INX H / JMP DE2HL1
+//-----------------------------------------------------------------------------
+const uint16_t de2hl_pattern[] = {
+  0x0C, 0x0D, 0xC8, 0x1A, 0x77, 0x13, 0x23, 0xC3, HLE_REL | 1, HLE_REL | 1
+};
+
+void de2hl_run(HLEContext& ctx) {
+  unsigned n = ctx.r.bc & 0xFF;
+  for (unsigned i = 0; i < n; i++) {
+    uint8_t v = ctx.rd(ctx.r.de);
+    ctx.wr(ctx.r.hl, v);
+    ctx.set_a(v);
+    ctx.r.de++;
+    ctx.r.hl++;
+  }
+  ctx.r.bc &= 0xFF00;
+  ctx.set_f(dec_to_zero_flags(ctx.f()));
+  ctx.cycles = 19 + 45 * n;
+  ctx.ret();
+}
+
+//-----------------------------------------------------------------------------
+// SHIFTR - HL >>= C
+//   INR C / SHIFTR1: DCR C / RZ / MOV A,H / ORA A / RAR / MOV H,A /
+//   MOV A,L / RAR / MOV L,A / JMP SHIFTR1
+//-----------------------------------------------------------------------------
+const uint16_t shiftr_pattern[] = {
+  0x0C, 0x0D, 0xC8, 0x7C, 0xB7, 0x1F, 0x67, 0x7D, 0x1F, 0x6F, 0xC3,
+  HLE_REL | 1, HLE_REL | 1
+};
+
+void shiftr_run(HLEContext& ctx) {
+  unsigned n = ctx.r.bc & 0xFF;
+  uint8_t carry = ctx.f() & 0x01;
+  for (unsigned i = 0; i < n; i++) {
+    carry = ctx.r.hl & 0x01;
+    ctx.r.hl >>= 1;
+    ctx.set_a(ctx.r.hl & 0xFF);
+  }
+  ctx.r.bc &= 0xFF00;
+  ctx.set_f(dec_to_zero_flags(carry));
+  ctx.cycles = 19 + 47 * n;
+  ctx.ret();
+}
+
+//-----------------------------------------------------------------------------
+// SHIFTL - HL <<= C
+//   INR C / SHIFTL1: DCR C / RZ / DAD H / JMP SHIFTL1
+//-----------------------------------------------------------------------------
+const uint16_t shiftl_pattern[] = {
+  0x0C, 0x0D, 0xC8, 0x29, 0xC3, HLE_REL | 1, HLE_REL | 1
+};
+
+void shiftl_run(HLEContext& ctx) {
+  unsigned n = ctx.r.bc & 0xFF;
+  uint8_t carry = ctx.f() & 0x01;
+  for (unsigned i = 0; i < n; i++) {
+    carry = ctx.r.hl >> 15;
+    ctx.r.hl <<= 1;
+  }
+  ctx.r.bc &= 0xFF00;
+  ctx.set_f(dec_to_zero_flags(carry));
+  ctx.cycles = 19 + 30 * n;
+  ctx.ret();
+}
+
+//-----------------------------------------------------------------------------
+// CHECKSUM - sum of the 128-byte directory buffer at (DIRBUF)
+//   MVI C,128 / LHLD DIRBUF / XRA A /
+//   CHKSUM1: ADD M / INX H / DCR C / JNZ CHKSUM1 / RET
+//-----------------------------------------------------------------------------
+const uint16_t checksum_pattern[] = {
+  0x0E, 0x80, 0x2A, HLE_ANY, HLE_ANY, 0xAF, 0x86, 0x23, 0x0D, 0xC2,
+  HLE_REL | 6, HLE_REL | 6, 0xC9
+};
+
+void checksum_run(HLEContext& ctx) {
+  uint16_t hl = ctx.rd16(ctx.rd16(ctx.r.pc + 3));
+  unsigned sum = 0;
+  uint8_t carry = 0;
+  for (unsigned i = 0; i < 128; i++) {
+    sum += ctx.rd(hl++);
+    carry = sum > 0xFF;
+    sum &= 0xFF;
+  }
+  ctx.r.hl = hl;
+  ctx.r.bc &= 0xFF00;
+  ctx.set_a(sum);
+  ctx.set_f(dec_to_zero_flags(carry));
+  ctx.cycles = 7 + 16 + 4 + 128 * 27 + 10;
+  ctx.ret();
+}
+
+//-----------------------------------------------------------------------------
+// FNDNXT2 - compare the search FCB at (DE) with the directory entry at (HL)
+//   FNDNXT2: MOV A,C / ORA A / JZ FNDNXT5 / LDAX D / CPI '?' / JZ FNDNXT4 /
+//   MOV A,B / CPI 13 / JZ FNDNXT4 / CPI 12 / LDAX D / JZ FNDNXT3 /
+//   SUB M / ANI 7FH / JNZ FINDNXT / JMP FNDNXT4 /
+//   FNDNXT3: PUSH B / MOV C,M / CALL SAMEXT / POP B / JNZ FINDNXT /
+//   FNDNXT4: INX D / INX H / INR B / DCR C / JMP FNDNXT2 / FNDNXT5:
+// Exits at FINDNXT on a mismatch, FNDNXT3 for the extent byte (the guest
+// code calls SAMEXT) or FNDNXT5 once C bytes have matched.
+//-----------------------------------------------------------------------------
+const uint16_t fndnxt_pattern[] = {
+  0x79, 0xB7, 0xCA, HLE_REL | 0x30, HLE_REL | 0x30,
+  0x1A, 0xFE, 0x3F, 0xCA, HLE_REL | 0x29, HLE_REL | 0x29,
+  0x78, 0xFE, 0x0D, 0xCA, HLE_REL | 0x29, HLE_REL | 0x29,
+  0xFE, 0x0C, 0x1A, 0xCA, HLE_REL | 0x20, HLE_REL | 0x20,
+  0x96, 0xE6, 0x7F, 0xC2, HLE_ANY, HLE_ANY, 0xC3, HLE_REL | 0x29, HLE_REL | 0x29,
+  0xC5, 0x4E, 0xCD, HLE_ANY, HLE_ANY, 0xC1, 0xC2, HLE_ANY, HLE_ANY,
+  0x13, 0x23, 0x04, 0x0D, 0xC3, HLE_REL | 0, HLE_REL | 0
+};
+
+void fndnxt_run(HLEContext& ctx) {
+  uint16_t entry = ctx.r.pc;
+  uint8_t b = ctx.r.bc >> 8, c = ctx.r.bc & 0xFF;
+  uint16_t de = ctx.r.de, hl = ctx.r.hl;
+  Alu alu = { ctx.a(), ctx.f() };
+  unsigned long t = 0;
+
+  for (;;) {
+    alu.a = c;
+    alu.or_(c);
+    t += 18;
+    if (c == 0) {
+      ctx.r.pc = entry + 0x30;
+      break;
+    }
+    alu.a = ctx.rd(de);
+    alu.cp('?');
+    t += 24;
+    if (alu.a != '?') {
+      alu.a = b;
+      alu.cp(13);
+      t += 21;
+      if (b != 13) {
+        alu.cp(12);
+        alu.a = ctx.rd(de);
+        t += 24;
+        if (b == 12) {
+          ctx.r.pc = entry + 0x20;
+          break;
+        }
+        alu.sub(ctx.rd(hl), false);
+        alu.and_(0x7F);
+        t += 24;
+        if (alu.a != 0) {
+          ctx.r.pc = ctx.rd16(entry + 27);
+          break;
+        }
+        t += 10;
+      }
+    }
+    de++;
+    hl++;
+    b = alu.inc(b);
+    c = alu.dec(c);
+    t += 30;
+  }
+
+  ctx.r.af = (alu.a << 8) | alu.f;
+  ctx.r.bc = (b << 8) | c;
+  ctx.r.de = de;
+  ctx.r.hl = hl;
+  ctx.cycles = t;
+}
+
+//-----------------------------------------------------------------------------
+// XM UPDCRC - CRC-16 (CCITT, polynomial 1021h) of A into the word at (crc)
+//   PUSH AF / PUSH BC / PUSH HL / LD B,8 / LD C,A / LD HL,(crc) /
+//   loop: LD A,C / RLCA / LD C,A / LD A,L / RLA / LD L,A / LD A,H / RLA /
+//   LD H,A / JP NC,skip / LD A,H / XOR 10H / LD H,A / LD A,L / XOR 21H /
+//   LD L,A / skip: DEC B / JP NZ,loop /
+//   LD (crc),HL / POP HL / POP BC / POP AF / RET
+// Every register is restored; the CRC word and the stack bytes change.
+//-----------------------------------------------------------------------------
+const uint16_t xm_updcrc_pattern[] = {
+  0xF5, 0xC5, 0xE5, 0x06, 0x08, 0x4F, 0x2A, HLE_ANY, HLE_ANY,
+  0x79, 0x07, 0x4F, 0x7D, 0x17, 0x6F, 0x7C, 0x17, 0x67,
+  0xD2, HLE_REL | 0x1D, HLE_REL | 0x1D,
+  0x7C, 0xEE, 0x10, 0x67, 0x7D, 0xEE, 0x21, 0x6F,
+  0x05, 0xC2, HLE_REL | 0x09, HLE_REL | 0x09,
+  0x22, HLE_ANY, HLE_ANY, 0xE1, 0xC1, 0xF1, 0xC9
+};
+
+void xm_updcrc_run(HLEContext& ctx) {
+  uint16_t entry = ctx.r.pc;
+  uint16_t sp = ctx.r.sp;
+  push16(ctx, sp, ctx.r.af);
+  push16(ctx, sp, ctx.r.bc);
+  push16(ctx, sp, ctx.r.hl);
+
+  uint8_t c = ctx.a();
+  uint16_t crc = ctx.rd16(ctx.rd16(entry + 7));
+  unsigned long t = 33 + 7 + 4 + 16;
+  for (int i = 0; i < 8; i++) {
+    bool bit = c & 0x80;
+    c = (c << 1) | bit;
+    bool out = crc & 0x8000;
+    crc = (crc << 1) | bit;
+    t += 46 + 14;
+    if (out) {
+      crc ^= 0x1021;
+      t += 30;
+    }
+  }
+  uint16_t crc_addr = ctx.rd16(entry + 0x22);
+  ctx.wr(crc_addr, crc & 0xFF);
+  ctx.wr(crc_addr + 1, crc >> 8);
+  ctx.cycles = t + 16 + 30 + 10;
+  ctx.ret();
+}
+
+//-----------------------------------------------------------------------------
+// MBASIC FMULT byte - multiply the multiplicand patched into the code by
+// one multiplier byte at (HL), accumulating the product in C,D,E,B
+//   LD A,(HL) / INC HL / OR A / JP Z,zero / PUSH HL / EX DE,HL / LD E,8 /
+//   bit: RRA / LD D,A / LD A,C / JP NC,skip / PUSH DE / LD DE,nn /
+//   ADD HL,DE / POP DE / ADC A,n / skip: RRA / LD C,A / LD A,H / RRA /
+//   LD H,A / LD A,L / RRA / LD L,A / LD A,B / RRA / LD B,A / AND 10H /
+//   JP Z,next / LD A,B / OR 20H / LD B,A / next: DEC E / LD A,D /
+//   JP NZ,bit / EX DE,HL / POP HL / RET /
+//   zero: LD B,E / LD E,D / LD D,C / LD C,A / RET
+// FMULT runs it once per FAC byte by stacking its own address.
+//-----------------------------------------------------------------------------
+const uint16_t mbasic_fmult_pattern[] = {
+  0x7E, 0x23, 0xB7, 0xCA, HLE_REL | 0x34, HLE_REL | 0x34, 0xE5, 0xEB, 0x1E, 0x08,
+  0x1F, 0x57, 0x79, 0xD2, HLE_REL | 0x18, HLE_REL | 0x18,
+  0xD5, 0x11, HLE_ANY, HLE_ANY, 0x19, 0xD1, 0xCE, HLE_ANY,
+  0x1F, 0x4F, 0x7C, 0x1F, 0x67, 0x7D, 0x1F, 0x6F, 0x78, 0x1F, 0x47,
+  0xE6, 0x10, 0xCA, HLE_REL | 0x2C, HLE_REL | 0x2C, 0x78, 0xF6, 0x20, 0x47,
+  0x1D, 0x7A, 0xC2, HLE_REL | 0x0A, HLE_REL | 0x0A, 0xEB, 0xE1, 0xC9,
+  0x43, 0x5A, 0x51, 0x4F, 0xC9
+};
+
+void mbasic_fmult_run(HLEContext& ctx) {
+  uint16_t entry = ctx.r.pc;
+  uint8_t b = ctx.r.bc >> 8, c = ctx.r.bc & 0xFF;
+  uint8_t d = ctx.r.de >> 8, e = ctx.r.de & 0xFF;
+  uint16_t ptr = ctx.r.hl;
+  Alu alu = { ctx.rd(ptr), ctx.f() };
+  ptr++;
+  alu.or_(alu.a);
+  unsigned long t = 7 + 6 + 4 + 10;
+
+  if (alu.a == 0) {
+    // Zero byte: shift the product right by 8
+    b = e;
+    e = d;
+    d = c;
+    c = alu.a;
+    ctx.r.hl = ptr;
+    t += 16 + 10;
+  } else {
+    uint16_t sp = ctx.r.sp;
+    push16(ctx, sp, ptr);
+    uint16_t hl = (d << 8) | e;
+    d = ptr >> 8;
+    e = 8;
+    uint16_t mcand = ctx.rd16(entry + 0x12);
+    uint8_t mcand_hi = ctx.rd(entry + 0x17);
+    t += 11 + 4 + 7;
+    do {
+      alu.rra();
+      d = alu.a;
+      alu.a = c;
+      t += 22;
+      if (alu.carry()) {
+        uint16_t save = sp;
+        push16(ctx, save, (d << 8) | e);
+        hl = alu.add16(hl, mcand);
+        alu.add(mcand_hi, alu.carry());
+        t += 49;
+      }
+      alu.rra();
+      c = alu.a;
+      alu.a = hl >> 8;
+      alu.rra();
+      hl = (alu.a << 8) | (hl & 0xFF);
+      alu.a = hl & 0xFF;
+      alu.rra();
+      hl = (hl & 0xFF00) | alu.a;
+      alu.a = b;
+      alu.rra();
+      b = alu.a;
+      alu.and_(0x10);
+      t += 44 + 17;
+      if (alu.a != 0) {
+        alu.a = b;
+        alu.or_(0x20);
+        b = alu.a;
+        t += 15;
+      }
+      e = alu.dec(e);
+      alu.a = d;
+      t += 18;
+    } while (e != 0);
+    // EX DE,HL / POP HL
+    d = hl >> 8;
+    e = hl & 0xFF;
+    ctx.r.hl = ptr;
+    t += 4 + 10 + 10;
+  }
+
+  ctx.r.af = (alu.a << 8) | alu.f;
+  ctx.r.bc = (b << 8) | c;
+  ctx.r.de = (d << 8) | e;
+  ctx.cycles = t;
+  ctx.ret();
+}
+
+//-----------------------------------------------------------------------------
+// MBASIC FDIV loop - restoring division of B,H,L by the divisor patched into
+// the code, quotient bits into C,D,E; the byte at entry+0Fh is the
+// dividend's top byte. Leaving zeros decrement the FAC exponent.
+//   loop: PUSH HL / PUSH BC / LD A,L / SUB n / LD L,A / LD A,H / SBC A,n /
+//   LD H,A / LD A,B / SBC A,n / LD B,A / LD A,n / SBC A,0 / CCF /
+//   JP NC,restore / LD (loop+0Fh),A / POP AF / POP AF / SCF /
+//   DB 0D2H / restore: POP BC / POP HL /
+//   LD A,C / INC A / DEC A / RRA / JP P,shift /
+//   RLA / LD A,(loop+0Fh) / RRA / AND 0C0H / PUSH AF / LD A,B / OR H / OR L /
+//   JP Z,$+5 / LD A,20H / POP HL / OR H / JP round /
+//   shift: RLA / LD A,E / RLA / LD E,A / LD A,D / RLA / LD D,A / LD A,C / RLA /
+//   LD C,A / ADD HL,HL / LD A,B / RLA / LD B,A / LD A,(loop+0Fh) / RLA /
+//   LD (loop+0Fh),A / LD A,C / OR D / OR E / JP NZ,loop / PUSH HL /
+//   LD HL,exp / DEC (HL) / POP HL / JP NZ,loop / JP underflow
+// The DB 0D2H turns the two POPs into the operand of a JP NC that is never
+// taken, so only the failed subtraction restores HL and BC.
+//-----------------------------------------------------------------------------
+const uint16_t mbasic_fdiv_pattern[] = {
+  0xE5, 0xC5, 0x7D, 0xD6, HLE_ANY, 0x6F, 0x7C, 0xDE, HLE_ANY, 0x67,
+  0x78, 0xDE, HLE_ANY, 0x47, 0x3E, HLE_ANY, 0xDE, 0x00, 0x3F,
+  0xD2, HLE_REL | 0x1D, HLE_REL | 0x1D, 0x32, HLE_REL | 0x0F, HLE_REL | 0x0F,
+  0xF1, 0xF1, 0x37, 0xD2, 0xC1, 0xE1,
+  0x79, 0x3C, 0x3D, 0x1F, 0xF2, HLE_REL | 0x3B, HLE_REL | 0x3B,
+  0x17, 0x3A, HLE_REL | 0x0F, HLE_REL | 0x0F, 0x1F, 0xE6, 0xC0, 0xF5,
+  0x78, 0xB4, 0xB5, 0xCA, HLE_REL | 0x36, HLE_REL | 0x36, 0x3E, 0x20,
+  0xE1, 0xB4, 0xC3, HLE_ANY, HLE_ANY,
+  0x17, 0x7B, 0x17, 0x5F, 0x7A, 0x17, 0x57, 0x79, 0x17, 0x4F, 0x29,
+  0x78, 0x17, 0x47, 0x3A, HLE_REL | 0x0F, HLE_REL | 0x0F, 0x17,
+  0x32, HLE_REL | 0x0F, HLE_REL | 0x0F, 0x79, 0xB2, 0xB3,
+  0xC2, HLE_REL | 0, HLE_REL | 0, 0xE5, 0x21, HLE_ANY, HLE_ANY, 0x35, 0xE1,
+  0xC2, HLE_REL | 0, HLE_REL | 0, 0xC3, HLE_ANY, HLE_ANY
+};
+
+void mbasic_fdiv_run(HLEContext& ctx) {
+  uint16_t entry = ctx.r.pc;
+  uint8_t b = ctx.r.bc >> 8, c = ctx.r.bc & 0xFF;
+  uint8_t d = ctx.r.de >> 8, e = ctx.r.de & 0xFF;
+  uint16_t hl = ctx.r.hl;
+  uint16_t sp = ctx.r.sp;
+  Alu alu = { ctx.a(), ctx.f() };
+  uint16_t top = entry + 0x0F;
+  uint8_t div_l = ctx.rd(entry + 0x04);
+  uint8_t div_h = ctx.rd(entry + 0x08);
+  uint8_t div_b = ctx.rd(entry + 0x0C);
+  uint16_t exp = ctx.rd16(entry + 0x58);
+  unsigned long t = 0;
+
+  for (;;) {
+    uint16_t save = sp;
+    push16(ctx, save, hl);
+    push16(ctx, save, (b << 8) | c);
+    alu.a = hl & 0xFF;
+    alu.sub(div_l, false);
+    uint8_t l = alu.a;
+    alu.a = hl >> 8;
+    alu.sub(div_h, alu.carry());
+    uint8_t h = alu.a;
+    alu.a = b;
+    alu.sub(div_b, alu.carry());
+    uint8_t nb = alu.a;
+    alu.a = ctx.rd(top);
+    alu.sub(0, alu.carry());
+    alu.ccf();
+    t += 22 + 73;
+    if (alu.carry()) {
+      // Subtraction fits: keep it, drop the saved values
+      ctx.wr(top, alu.a);
+      alu.a = hl >> 8;
+      alu.f = hl & 0xFF;
+      alu.scf();
+      hl = (h << 8) | l;
+      b = nb;
+      t += 13 + 20 + 4 + 10;
+    } else {
+      t += 20;
+    }
+
+    alu.a = c;
+    alu.a = alu.inc(alu.a);
+    alu.a = alu.dec(alu.a);
+    alu.rra();
+    t += 26;
+    if (alu.f & FLAG_S) {
+      // 24 quotient bits: build the rounding byte and go round
+      alu.rla();
+      alu.a = ctx.rd(top);
+      alu.rra();
+      alu.and_(0xC0);
+      save = sp;
+      push16(ctx, save, (alu.a << 8) | alu.f);
+      uint16_t af = (alu.a << 8) | alu.f;
+      alu.a = b;
+      alu.or_(hl >> 8);
+      alu.or_(hl & 0xFF);
+      t += 4 + 13 + 4 + 7 + 11 + 12 + 10;
+      if (alu.a != 0) {
+        alu.a = 0x20;
+        t += 7;
+      }
+      hl = af;
+      alu.or_(hl >> 8);
+      t += 10 + 4 + 10;
+      ctx.r.pc = ctx.rd16(entry + 0x39);
+      break;
+    }
+
+    alu.rla();
+    alu.a = e;
+    alu.rla();
+    e = alu.a;
+    alu.a = d;
+    alu.rla();
+    d = alu.a;
+    alu.a = c;
+    alu.rla();
+    c = alu.a;
+    hl = alu.add16(hl, hl);
+    alu.a = b;
+    alu.rla();
+    b = alu.a;
+    alu.a = ctx.rd(top);
+    alu.rla();
+    ctx.wr(top, alu.a);
+    alu.a = c;
+    alu.or_(d);
+    alu.or_(e);
+    t += 40 + 11 + 12 + 13 + 4 + 13 + 12 + 10;
+    if (alu.a != 0) continue;
+
+    // No quotient bit yet: one less in the exponent
+    save = sp;
+    push16(ctx, save, hl);
+    uint8_t x = alu.dec(ctx.rd(exp));
+    ctx.wr(exp, x);
+    t += 11 + 10 + 11 + 10 + 10;
+    if (x == 0) {
+      ctx.r.pc = ctx.rd16(entry + 0x60);
+      t += 10;
+      break;
+    }
+  }
+
+  ctx.r.af = (alu.a << 8) | alu.f;
+  ctx.r.bc = (b << 8) | c;
+  ctx.r.de = (d << 8) | e;
+  ctx.r.hl = hl;
+  ctx.cycles = t;
+}
+
+//-----------------------------------------------------------------------------
+// MBASIC FADD align - shift C,D,E,B right by A bits (A < 256)
+//   LD B,0 / bytes: SUB 8 / JP C,bits / LD B,E / LD E,D / LD D,C / LD C,0 /
+//   JP bytes / bits: ADD A,9 / LD L,A / LD A,D / OR E / OR B / JP NZ,all /
+//   LD A,C / conly: DEC L / RET Z / RRA / LD C,A / JP NC,conly / JP rest /
+//   all: XOR A / DEC L / RET Z / LD A,C / RRA / LD C,A /
+//   rest: LD A,D / RRA / LD D,A / LD A,E / RRA / LD E,A / LD A,B / RRA /
+//   LD B,A / JP all
+//-----------------------------------------------------------------------------
+const uint16_t mbasic_falign_pattern[] = {
+  0x06, 0x00, 0xD6, 0x08, 0xDA, HLE_REL | 0x0F, HLE_REL | 0x0F,
+  0x43, 0x5A, 0x51, 0x0E, 0x00, 0xC3, HLE_REL | 0x02, HLE_REL | 0x02,
+  0xC6, 0x09, 0x6F, 0x7A, 0xB3, 0xB0, 0xC2, HLE_REL | 0x23, HLE_REL | 0x23,
+  0x79, 0x2D, 0xC8, 0x1F, 0x4F, 0xD2, HLE_REL | 0x19, HLE_REL | 0x19,
+  0xC3, HLE_REL | 0x29, HLE_REL | 0x29,
+  0xAF, 0x2D, 0xC8, 0x79, 0x1F, 0x4F, 0x7A, 0x1F, 0x57, 0x7B, 0x1F, 0x5F,
+  0x78, 0x1F, 0x47, 0xC3, HLE_REL | 0x23, HLE_REL | 0x23
+};
+
+void mbasic_falign_run(HLEContext& ctx) {
+  uint8_t b = 0, c = ctx.r.bc & 0xFF;
+  uint8_t d = ctx.r.de >> 8, e = ctx.r.de & 0xFF;
+  uint8_t l;
+  Alu alu = { ctx.a(), ctx.f() };
+  unsigned long t = 7;
+
+  // Whole bytes
+  for (;;) {
+    alu.sub(8, false);
+    t += 17;
+    if (alu.carry()) break;
+    b = e;
+    e = d;
+    d = c;
+    c = 0;
+    t += 29;
+  }
+  alu.add(9, false);
+  l = alu.a;
+  alu.a = d;
+  alu.or_(e);
+  alu.or_(b);
+  t += 7 + 4 + 12 + 10;
+
+  // Remaining bits; while only C is non-zero it is shifted alone until a
+  // bit falls out of it
+  auto shift_deb = [&]() {
+    alu.a = d;
+    alu.rra();
+    d = alu.a;
+    alu.a = e;
+    alu.rra();
+    e = alu.a;
+    alu.a = b;
+    alu.rra();
+    b = alu.a;
+    t += 36 + 10;
+  };
+  bool done = false;
+  if (alu.a == 0) {
+    alu.a = c;
+    t += 4;
+    for (;;) {
+      l = alu.dec(l);
+      t += 4;
+      if (l == 0) {
+        t += 11;
+        done = true;
+        break;
+      }
+      alu.rra();
+      c = alu.a;
+      t += 5 + 8 + 10;
+      if (alu.carry()) {
+        t += 10;
+        shift_deb();
+        break;
+      }
+    }
+  }
+  while (!done) {
+    alu.xor_(alu.a);
+    l = alu.dec(l);
+    t += 8;
+    if (l == 0) {
+      t += 11;
+      break;
+    }
+    alu.a = c;
+    alu.rra();
+    c = alu.a;
+    t += 5 + 12;
+    shift_deb();
+  }
+
+  ctx.r.af = (alu.a << 8) | alu.f;
+  ctx.r.bc = (b << 8) | c;
+  ctx.r.de = (d << 8) | e;
+  ctx.r.hl = (ctx.r.hl & 0xFF00) | l;
+  ctx.cycles = t;
+  ctx.ret();
+}
+
+//-----------------------------------------------------------------------------
+// MBASIC FNORM - normalise the mantissa C,D,E,B (sign in FAC+1) and adjust
+// the FAC exponent; ends at the rounding code that follows, or returns
+// with a zero exponent on underflow
+//   LD L,B / LD H,E / XOR A / bytes: LD B,A / LD A,C / OR A / JP NZ,test /
+//   LD C,D / LD D,H / LD H,L / LD L,A / LD A,B / SUB 8 / CP 0E0H /
+//   JP NZ,bytes / under: XOR A / LD (exp),A / RET /
+//   last: LD A,H / OR L / OR D / JP NZ,bit / LD A,C / find: DEC B / RLA /
+//   JP NC,find / INC B / RRA / LD C,A / JP done /
+//   bit: DEC B / ADD HL,HL / LD A,D / RLA / LD D,A / LD A,C / ADC A,A /
+//   LD C,A / test: JP P,last / done: LD A,B / LD E,H / LD B,L / OR A /
+//   JP Z,round / LD HL,exp / ADD A,(HL) / LD (HL),A / JP NC,under /
+//   JP Z,under / round:
+//-----------------------------------------------------------------------------
+const uint16_t mbasic_fnorm_pattern[] = {
+  0x68, 0x63, 0xAF, 0x47, 0x79, 0xB7, 0xC2, HLE_REL | 0x34, HLE_REL | 0x34,
+  0x4A, 0x54, 0x65, 0x6F, 0x78, 0xD6, 0x08, 0xFE, 0xE0,
+  0xC2, HLE_REL | 0x03, HLE_REL | 0x03,
+  0xAF, 0x32, HLE_ANY, HLE_ANY, 0xC9,
+  0x7C, 0xB5, 0xB2, 0xC2, HLE_REL | 0x2C, HLE_REL | 0x2C,
+  0x79, 0x05, 0x17, 0xD2, HLE_REL | 0x21, HLE_REL | 0x21,
+  0x04, 0x1F, 0x4F, 0xC3, HLE_REL | 0x37, HLE_REL | 0x37,
+  0x05, 0x29, 0x7A, 0x17, 0x57, 0x79, 0x8F, 0x4F,
+  0xF2, HLE_REL | 0x1A, HLE_REL | 0x1A,
+  0x78, 0x5C, 0x45, 0xB7, 0xCA, HLE_REL | 0x49, HLE_REL | 0x49,
+  0x21, HLE_ANY, HLE_ANY, 0x86, 0x77, 0xD2, HLE_REL | 0x15, HLE_REL | 0x15,
+  0xCA, HLE_REL | 0x15, HLE_REL | 0x15
+};
+
+void mbasic_fnorm_run(HLEContext& ctx) {
+  uint16_t entry = ctx.r.pc;
+  uint8_t b = ctx.r.bc >> 8, c = ctx.r.bc & 0xFF;
+  uint8_t d = ctx.r.de >> 8, e = ctx.r.de & 0xFF;
+  uint8_t h = e, l = b;
+  Alu alu = { ctx.a(), ctx.f() };
+  alu.xor_(alu.a);
+  unsigned long t = 12;
+  bool under = false;
+
+  // Whole bytes while C is zero, at most 32 bits
+  for (;;) {
+    b = alu.a;
+    alu.a = c;
+    alu.or_(c);
+    t += 22;
+    if (alu.a != 0) break;
+    c = d;
+    d = h;
+    h = l;
+    l = alu.a;
+    alu.a = b;
+    alu.sub(8, false);
+    alu.cp(0xE0);
+    t += 20 + 14 + 10;
+    if (alu.a == 0xE0) {
+      under = true;
+      break;
+    }
+  }
+
+  if (!under) {
+    // Single bits until C bit 7 is set
+    for (;;) {
+      t += 10;
+      if (alu.f & FLAG_S) break;
+      alu.a = h;
+      alu.or_(l);
+      alu.or_(d);
+      t += 22;
+      if (alu.a == 0) {
+        // Only C is left: find its top bit
+        alu.a = c;
+        t += 4;
+        if (c == 0 && !alu.carry()) {
+          // Never terminates in the guest either; leave it there
+          ctx.r.af = (alu.a << 8) | alu.f;
+          ctx.r.bc = (b << 8) | c;
+          ctx.r.de = (d << 8) | e;
+          ctx.r.hl = (h << 8) | l;
+          ctx.r.pc = entry + 0x21;
+          ctx.cycles = t;
+          return;
+        }
+        do {
+          b = alu.dec(b);
+          alu.rla();
+          t += 18;
+        } while (!alu.carry());
+        b = alu.inc(b);
+        alu.rra();
+        c = alu.a;
+        t += 22;
+        break;
+      }
+      b = alu.dec(b);
+      uint16_t hl = alu.add16((h << 8) | l, (h << 8) | l);
+      h = hl >> 8;
+      l = hl & 0xFF;
+      alu.a = d;
+      alu.rla();
+      d = alu.a;
+      alu.a = c;
+      alu.add(alu.a, alu.carry());
+      c = alu.a;
+      t += 4 + 11 + 24;
+    }
+
+    alu.a = b;
+    e = h;
+    b = l;
+    alu.or_(alu.a);
+    t += 26;
+    if (alu.a == 0) {
+      ctx.r.pc = entry + 0x49;
+    } else {
+      uint16_t exp = ctx.rd16(entry + 0x3F);
+      h = exp >> 8;
+      l = exp & 0xFF;
+      alu.add(ctx.rd(exp), false);
+      ctx.wr(exp, alu.a);
+      t += 10 + 7 + 7 + 10;
+      if (!alu.carry() || alu.a == 0) {
+        under = true;
+        if (alu.carry()) t += 10;
+      } else {
+        t += 10;
+        ctx.r.pc = entry + 0x49;
+      }
+    }
+  }
+
+  if (under) {
+    alu.xor_(alu.a);
+    ctx.wr(ctx.rd16(entry + 0x17), 0);
+    t += 4 + 13;
+  }
+
+  ctx.r.af = (alu.a << 8) | alu.f;
+  ctx.r.bc = (b << 8) | c;
+  ctx.r.de = (d << 8) | e;
+  ctx.r.hl = (h << 8) | l;
+  ctx.cycles = t;
+  if (under) {
+    ctx.cycles += 10;
+    ctx.ret();
+  }
+}
+
+const HLERoutine builtin_routines[] = {
+  { "BDOS DE2HL",    de2hl_pattern,    sizeof(de2hl_pattern) / 2,    de2hl_run },
+  { "BDOS SHIFTR",   shiftr_pattern,   sizeof(shiftr_pattern) / 2,   shiftr_run },
+  { "BDOS SHIFTL",   shiftl_pattern,   sizeof(shiftl_pattern) / 2,   shiftl_run },
+  { "BDOS CHECKSUM", checksum_pattern, sizeof(checksum_pattern) / 2, checksum_run },
+  { "BDOS FNDNXT",   fndnxt_pattern,   sizeof(fndnxt_pattern) / 2,   fndnxt_run },
+  { "XM UPDCRC",     xm_updcrc_pattern, sizeof(xm_updcrc_pattern) / 2, xm_updcrc_run },
+  { "MBASIC FMULT",  mbasic_fmult_pattern, sizeof(mbasic_fmult_pattern) / 2, mbasic_fmult_run },
+  { "MBASIC FDIV",   mbasic_fdiv_pattern, sizeof(mbasic_fdiv_pattern) / 2, mbasic_fdiv_run },
+  { "MBASIC FALIGN", mbasic_falign_pattern, sizeof(mbasic_falign_pattern) / 2, mbasic_falign_run },
+  { "MBASIC FNORM",  mbasic_fnorm_pattern, sizeof(mbasic_fnorm_pattern) / 2, mbasic_fnorm_run },
+};
+
+// FNV-1a
+inline uint32_t hash_byte(uint32_t h, uint8_t b) {
+  return (h ^ b) * 16777619u;
+}
+
+const uint32_t HASH_SEED = 2166136261u;
+
+}  // namespace
+
+//=============================================================================
+// HLEContext
+//=============================================================================
+
+uint8_t HLEContext::rd(uint16_t addr) const {
+  // Later journal entries win
+  for (size_t i = log.size(); i-- > 0; ) {
+    if (log[i].first == addr) return log[i].second;
+  }
+  return mem->fetch_mem(addr);
+}
+
+void HLEContext::wr(uint16_t addr, uint8_t v) {
+  if (journal_writes) log.emplace_back(addr, v);
+  else mem->store_mem(addr, v);
+}
+
+//=============================================================================
+// Registry
+//=============================================================================
+
+GuestHLE::GuestHLE() {
+  memset(first_byte, 0, sizeof(first_byte));
+  for (const HLERoutine& r : builtin_routines) {
+    registerRoutine(r);
+  }
+}
+
+void GuestHLE::registerRoutine(const HLERoutine& routine) {
+  if (routines.size() >= 255) {
+    emu_fatal("[HLE] Too many routines registered (%s)", routine.name);
+  }
+  if (routine.length == 0 || routine.pattern[0] > 0xFF) {
+    emu_fatal("[HLE] Routine %s must start with a literal byte", routine.name);
+  }
+  if (routine.length > HLE_MAX_PATTERN) {
+    emu_fatal("[HLE] Routine %s pattern is longer than %u bytes", routine.name, HLE_MAX_PATTERN);
+  }
+
+  // The pattern as it appears at entry 0: relocated words are stored as
+  // their offset from the entry point
+  Entry e = {};
+  e.routine = routine;
+  for (uint16_t i = 0; i < routine.length; i++) {
+    uint16_t p = routine.pattern[i];
+    if (p <= 0xFF) {
+      e.bytes.push_back(p);
+    } else if (p == HLE_ANY) {
+      e.bytes.push_back(0);
+    } else {
+      e.bytes.push_back(p & 0xFF);
+      e.bytes.push_back(0);
+      i++;
+    }
+  }
+  uint32_t h = HASH_SEED;
+  for (uint8_t b : e.bytes) h = hash_byte(h, b);
+  e.hash = h;
+  routines.push_back(e);
+  first_byte[routine.pattern[0]] = true;
+
+  // Invalidate cached misses
+  std::fill(pc_cache.begin(), pc_cache.end(), 0);
+}
+
+void GuestHLE::setMode(Mode m) {
+  mode = m;
+  if (mode != HLE_OFF && pc_cache.empty()) pc_cache.assign(65536, 0);
+}
+
+uint32_t GuestHLE::hashAt(const Entry& e, qkz80_cpu_mem* mem, uint16_t entry,
+                          uint8_t* bytes) const {
+  const HLERoutine& r = e.routine;
+  for (uint16_t i = 0; i < r.length; i++) {
+    uint16_t p = r.pattern[i];
+    uint16_t addr = entry + i;
+    if (p <= 0xFF) {
+      bytes[i] = mem->fetch_mem(addr);
+    } else if (p == HLE_ANY) {
+      bytes[i] = 0;
+    } else {
+      uint16_t rel = (mem->fetch_mem(addr) | (mem->fetch_mem(addr + 1) << 8)) - entry;
+      bytes[i] = rel & 0xFF;
+      bytes[i + 1] = rel >> 8;
+      i++;
+    }
+  }
+  uint32_t h = HASH_SEED;
+  for (uint16_t i = 0; i < r.length; i++) h = hash_byte(h, bytes[i]);
+  return h;
+}
+
+bool GuestHLE::matchesAt(const Entry& e, qkz80_cpu_mem* mem, uint16_t entry) const {
+  uint8_t bytes[HLE_MAX_PATTERN];
+  return hashAt(e, mem, entry, bytes) == e.hash &&
+         memcmp(bytes, e.bytes.data(), e.bytes.size()) == 0;
+}
+
+unsigned GuestHLE::lookup(qkz80_cpu_mem* mem, uint16_t pc) const {
+  uint8_t op = mem->fetch_mem(pc);
+  if (!first_byte[op]) return 0;
+  for (size_t i = 0; i < routines.size(); i++) {
+    const Entry& e = routines[i];
+    if (e.routine.pattern[0] == op && matchesAt(e, mem, pc)) {
+      return i + 1;
+    }
+  }
+  return 0;
+}
+
+//=============================================================================
+// Dispatch
+//=============================================================================
+
+bool GuestHLE::dispatch(hbios_cpu& cpu) {
+  if (mode == HLE_OFF) return false;
+
+  if (++epoch_steps >= HLE_EPOCH_STEPS) {
+    epoch_steps = 0;
+    if (++epoch == 0) {
+      std::fill(pc_cache.begin(), pc_cache.end(), 0);
+      epoch = 1;
+    }
+  }
+
+  qkz80_cpu_mem* mem = cpu.cpu_mem;
+  uint16_t pc = cpu.regs.PC.get_pair16();
+  uint16_t cached = pc_cache[pc];
+  if ((cached >> 8) != epoch) {
+    cached = (epoch << 8) | lookup(mem, pc);
+    pc_cache[pc] = cached;
+  }
+  unsigned idx = cached & 0xFF;
+  if (idx == 0) return false;
+
+  // Code at PC may have been overwritten or banked out since the lookup
+  Entry& e = routines[idx - 1];
+  if (!matchesAt(e, mem, pc)) {
+    pc_cache[pc] = (epoch << 8) | lookup(mem, pc);
+    return false;
+  }
+
+  cpu.sync_flags();
+  HLEContext ctx(mem, mode == HLE_VERIFY);
+  ctx.r.af = cpu.regs.AF.get_pair16();
+  ctx.r.bc = cpu.regs.BC.get_pair16();
+  ctx.r.de = cpu.regs.DE.get_pair16();
+  ctx.r.hl = cpu.regs.HL.get_pair16();
+  ctx.r.sp = cpu.regs.SP.get_pair16();
+  ctx.r.pc = pc;
+  ctx.r.ix = cpu.regs.IX.get_pair16();
+  ctx.r.iy = cpu.regs.IY.get_pair16();
+  e.routine.run(ctx);
+  e.hits++;
+  e.cycles += ctx.cycles;
+
+  if (mode == HLE_VERIFY) {
+    verify(cpu, e, ctx);
+    return true;
+  }
+
+  cpu.regs.AF.set_pair16(ctx.r.af);
+  cpu.regs.BC.set_pair16(ctx.r.bc);
+  cpu.regs.DE.set_pair16(ctx.r.de);
+  cpu.regs.HL.set_pair16(ctx.r.hl);
+  cpu.regs.SP.set_pair16(ctx.r.sp);
+  cpu.regs.PC.set_pair16(ctx.r.pc);
+  cpu.regs.IX.set_pair16(ctx.r.ix);
+  cpu.regs.IY.set_pair16(ctx.r.iy);
+  cpu.cycles += ctx.cycles;
+  return true;
+}
+
+// Run the guest code from the entry point until it reaches the native
+// routine's exit, then compare with the native result (the guest result is
+// kept)
+void GuestHLE::verify(hbios_cpu& cpu, Entry& e, const HLEContext& ctx) {
+  static const unsigned MAX_GUEST_STEPS = 1000000;
+
+  qkz80_cpu_mem* mem = cpu.cpu_mem;
+  uint16_t entry = cpu.regs.PC.get_pair16();
+  unsigned long long start_cycles = cpu.cycles;
+
+  // Memory as the native routine left it. Comparing the whole address
+  // space covers bytes written by either side only.
+  verify_mem.resize(65536);
+  for (unsigned addr = 0; addr < 65536; addr++) {
+    verify_mem[addr] = mem->fetch_mem(addr);
+  }
+  for (const auto& w : ctx.writes()) verify_mem[w.first] = w.second;
+
+  unsigned steps = 0;
+  do {
+    cpu.step_core();
+  } while (++steps < MAX_GUEST_STEPS &&
+           !(cpu.regs.PC.get_pair16() == ctx.r.pc &&
+             cpu.regs.SP.get_pair16() == ctx.r.sp));
+  cpu.sync_flags();
+
+  char mem_what[32];
+  const char* what = nullptr;
+  if (steps >= MAX_GUEST_STEPS) what = "no return";
+  else if (cpu.regs.AF.get_pair16() != ctx.r.af) what = "AF";
+  else if (cpu.regs.BC.get_pair16() != ctx.r.bc) what = "BC";
+  else if (cpu.regs.DE.get_pair16() != ctx.r.de) what = "DE";
+  else if (cpu.regs.HL.get_pair16() != ctx.r.hl) what = "HL";
+  else if (cpu.regs.SP.get_pair16() != ctx.r.sp) what = "SP";
+  else if (cpu.regs.IX.get_pair16() != ctx.r.ix) what = "IX";
+  else if (cpu.regs.IY.get_pair16() != ctx.r.iy) what = "IY";
+  else if (cpu.cycles - start_cycles != ctx.cycles) what = "T-states";
+  else {
+    for (unsigned addr = 0; addr < 65536; addr++) {
+      if (mem->fetch_mem(addr) != verify_mem[addr]) {
+        snprintf(mem_what, sizeof(mem_what), "memory at 0x%04X", addr);
+        what = mem_what;
+        break;
+      }
+    }
+  }
+
+  if (!what) {
+    e.verified++;
+    return;
+  }
+  if (e.mismatches++ < 10) {
+    emu_error("[HLE] %s at 0x%04X: %s mismatch (guest AF=%04X BC=%04X DE=%04X "
+              "HL=%04X T=%llu, native AF=%04X BC=%04X DE=%04X HL=%04X T=%lu)\n",
+              e.routine.name, entry, what,
+              cpu.regs.AF.get_pair16(), cpu.regs.BC.get_pair16(),
+              cpu.regs.DE.get_pair16(), cpu.regs.HL.get_pair16(),
+              cpu.cycles - start_cycles,
+              ctx.r.af, ctx.r.bc, ctx.r.de, ctx.r.hl, ctx.cycles);
+  }
+}
+
+//=============================================================================
+// Statistics
+//=============================================================================
+
+void GuestHLE::printStats(FILE* out) const {
+  fprintf(out, "%-16s %10s %14s %10s %10s\n",
+          "HLE routine", "hits", "T-states", "verified", "mismatches");
+  for (const Entry& e : routines) {
+    fprintf(out, "%-16s %10llu %14llu %10llu %10llu\n", e.routine.name,
+            (unsigned long long)e.hits, (unsigned long long)e.cycles,
+            (unsigned long long)e.verified, (unsigned long long)e.mismatches);
+  }
+}
@@ -0,0 +1,140 @@
+/*
+ * Guest HLE - Native replacement of hot guest routines
+ *
+ * Small, heavily used guest code (BDOS block move, directory checksum,
+ * shifts and search compare, the XMODEM CRC update, MBASIC floating point
+ * inner loops) is recognised by a signature over its code bytes at the
+ * entry point and run natively instead. A native routine must leave
+ * exactly the registers, flags, memory and T-state count the guest code
+ * would at the point where it hands control back: usually its final RET,
+ * otherwise the PC it would jump to.
+ *
+ * Signatures are checked against the bytes currently mapped at PC, so bank
+ * switches and newly loaded programs are picked up without any hooks in
+ * the memory system: a cached hit is re-checked before every use (hash,
+ * then the bytes themselves, so a hash collision cannot run the wrong
+ * code), and the per-PC "no routine here" cache is aged out every
+ * HLE_EPOCH_STEPS steps.
+ *
+ * Verify mode runs the native routine against a write journal, then lets
+ * the guest code execute until it reaches the native exit (PC and SP) and
+ * compares registers, T-states and the whole 64 KB address space, so a
+ * byte written by only one of the two is caught as well.
+ */
+
+#ifndef GUEST_HLE_H
+#define GUEST_HLE_H
+
+#include "qkz80_mem.h"
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+class hbios_cpu;
+
+// Signature pattern entries (values 0x00-0xFF are literal code bytes)
+static const uint16_t HLE_ANY = 0x100;  // Any byte (absolute address, patched operand)
+static const uint16_t HLE_REL = 0x200;  // Word = entry + (low 8 bits); covers 2 bytes
+
+// Register file seen by a native routine
+struct HLERegs {
+  uint16_t af, bc, de, hl, sp, pc, ix, iy;
+};
+
+// Execution context for one native routine call
+class HLEContext {
+public:
+  HLERegs r;
+  unsigned long cycles = 0;  // T-states the guest code would have taken
+
+  HLEContext(qkz80_cpu_mem* memory, bool journal)
+    : mem(memory), journal_writes(journal) {}
+
+  uint8_t rd(uint16_t addr) const;
+  uint16_t rd16(uint16_t addr) const { return rd(addr) | (rd(addr + 1) << 8); }
+  void wr(uint16_t addr, uint8_t v);
+
+  // Byte accessors for the register pairs
+  uint8_t a() const { return r.af >> 8; }
+  uint8_t f() const { return r.af & 0xFF; }
+  void set_a(uint8_t v) { r.af = (r.af & 0x00FF) | (v << 8); }
+  void set_f(uint8_t v) { r.af = (r.af & 0xFF00) | v; }
+
+  // RET: pop PC
+  void ret() { r.pc = rd16(r.sp); r.sp += 2; }
+
+  // Journal of writes (verify mode only)
+  const std::vector<std::pair<uint16_t, uint8_t>>& writes() const { return log; }
+
+private:
+  qkz80_cpu_mem* mem;
+  bool journal_writes;
+  std::vector<std::pair<uint16_t, uint8_t>> log;
+};
+
+// One replaceable routine
+struct HLERoutine {
+  const char* name;
+  const uint16_t* pattern;      // HLE_ANY/HLE_REL or literal bytes
+  uint16_t length;              // Pattern length in bytes
+  void (*run)(HLEContext& ctx); // Native body, entered with r.pc = entry;
+                                // leaves r.pc/r.sp at the guest's exit
+};
+
+class GuestHLE {
+public:
+  enum Mode { HLE_OFF, HLE_ON, HLE_VERIFY };
+
+  static const unsigned HLE_EPOCH_STEPS = 1u << 20;
+  static const uint16_t HLE_MAX_PATTERN = 256;
+
+  // Registers the built-in routine table
+  GuestHLE();
+
+  void setMode(Mode m);
+  Mode getMode() const { return mode; }
+
+  // Add a routine to the registry (up to 255 routines, patterns of up to
+  // HLE_MAX_PATTERN bytes)
+  void registerRoutine(const HLERoutine& routine);
+
+  // Called before each instruction. Runs the routine at PC natively and
+  // returns true, or returns false to let the CPU core execute normally.
+  bool dispatch(hbios_cpu& cpu);
+
+  // Per-routine hit counters
+  void printStats(FILE* out) const;
+
+private:
+  struct Entry {
+    HLERoutine routine;
+    std::vector<uint8_t> bytes; // Pattern as it appears at entry 0
+    uint32_t hash;              // FNV-1a of bytes
+    uint64_t hits;
+    uint64_t verified;
+    uint64_t mismatches;
+    uint64_t cycles;            // Guest T-states covered natively
+  };
+
+  Mode mode = HLE_OFF;
+  std::vector<Entry> routines;
+  bool first_byte[256];         // Literal opcode bytes that start a routine
+
+  // Per-PC lookup cache: (epoch << 8) | (routine index + 1), 0 = none.
+  // Allocated when HLE is first enabled.
+  std::vector<uint16_t> pc_cache;
+  uint8_t epoch = 1;
+  unsigned epoch_steps = 0;
+
+  // Memory as a native routine left it (verify mode only)
+  std::vector<uint8_t> verify_mem;
+
+  // Bytes at entry in pattern form (HLE_ANY as 0, HLE_REL as the offset
+  // from entry); returns their hash
+  uint32_t hashAt(const Entry& e, qkz80_cpu_mem* mem, uint16_t entry, uint8_t* bytes) const;
+  bool matchesAt(const Entry& e, qkz80_cpu_mem* mem, uint16_t entry) const;
+  unsigned lookup(qkz80_cpu_mem* mem, uint16_t pc) const;
+  void verify(hbios_cpu& cpu, Entry& e, const HLEContext& ctx);
+};
+
+#endif // GUEST_HLE_H
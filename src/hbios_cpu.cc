@@ -6,9 +6,111 @@
 
 #include "hbios_cpu.h"
 #include "emu_io.h"
+#include "emu_checkpoint.h"
 #include <cstdio>
 #include <cstdarg>
 
+//=============================================================================
+// Core selection
+//=============================================================================
+
+void hbios_cpu::set_lazy_core(bool enable) {
+  if (enable && !lazy) {
+    lazy.reset(new z80_lazy(this, cpu_mem));
+  } else if (!enable && lazy) {
+    lazy->sync_flags();
+    lazy.reset();
+  }
+}
+
+void hbios_cpu::step() {
+  if (hle.dispatch(*this)) return;
+  step_core();
+}
+
+void hbios_cpu::step_core() {
+  if (lazy) lazy->execute();
+  else execute();
+}
+
+void hbios_cpu::raise_int(qkz80_uint8 data) {
+  if (lazy) lazy->request_int(data);
+  else request_int(data);
+}
+
+void hbios_cpu::raise_rst(unsigned n) {
+  if (lazy) lazy->request_rst(n);
+  else request_rst(n);
+}
+
+void hbios_cpu::raise_nmi() {
+  if (lazy) lazy->request_nmi();
+  else request_nmi();
+}
+
+void hbios_cpu::service_interrupts() {
+  if (lazy) lazy->check_interrupts();
+  else check_interrupts();
+}
+
+bool hbios_cpu::interrupt_pending() const {
+  return lazy ? lazy->int_pending() : int_pending;
+}
+
+//=============================================================================
+// Checkpoint
+//=============================================================================
+
+// The main registers are stored by name. State the qkz80 API does not
+// expose (alternate set, I, R, IFF, IM) is stored as the register set's
+// raw image, which only a build with the same qkz80 layout can take back.
+void hbios_cpu::save_state(StateWriter& w) {
+  sync_flags();
+  w.u16(regs.AF.get_pair16()); w.u16(regs.BC.get_pair16());
+  w.u16(regs.DE.get_pair16()); w.u16(regs.HL.get_pair16());
+  w.u16(regs.IX.get_pair16()); w.u16(regs.IY.get_pair16());
+  w.u16(regs.SP.get_pair16()); w.u16(regs.PC.get_pair16());
+  w.u64(cycles);
+  w.flag(lazy != nullptr);
+  if (lazy) {
+    lazy->save_state(w);
+  } else {
+    w.u32(sizeof(regs));
+    w.bytes(&regs, sizeof(regs));
+    w.flag(int_pending);
+  }
+}
+
+bool hbios_cpu::load_state(StateReader& r) {
+  uint16_t af = r.u16(), bc = r.u16(), de = r.u16(), hl = r.u16();
+  uint16_t ix = r.u16(), iy = r.u16(), sp = r.u16(), pc = r.u16();
+  cycles = r.u64();
+  bool saved_lazy = r.flag();
+  if (saved_lazy && lazy) {
+    lazy->load_state(r);
+  } else if (!saved_lazy && !lazy) {
+    uint32_t size = r.u32();
+    if (size == sizeof(regs)) {
+      r.bytes(&regs, sizeof(regs));
+    } else {
+      std::vector<uint8_t> skip(size);
+      r.bytes(skip.data(), size);
+      emu_error("[CHECKPOINT] CPU register layout changed; alternate registers and "
+                "interrupt mode not restored\n");
+    }
+    int_pending = r.flag();
+  } else {
+    emu_error("[CHECKPOINT] Saved with the %s core; alternate registers and "
+              "interrupt mode not restored\n", saved_lazy ? "lazy" : "qkz80");
+  }
+  regs.AF.set_pair16(af); regs.BC.set_pair16(bc);
+  regs.DE.set_pair16(de); regs.HL.set_pair16(hl);
+  regs.IX.set_pair16(ix); regs.IY.set_pair16(iy);
+  regs.SP.set_pair16(sp); regs.PC.set_pair16(pc);
+  simh.reset();  // SIMH device commands are not checkpointed
+  return r.ok();
+}
+
 //=============================================================================
 // Port IN handler
 //=============================================================================
@@ -16,6 +118,7 @@
 qkz80_uint8 hbios_cpu::port_in(qkz80_uint8 port) {
   if (!delegate) return 0xFF;
 
+  HBIOSDispatch* hbios = delegate->getHBIOS();
   banked_mem* memory = delegate->getMemory();
 
   switch (port) {
@@ -23,6 +126,18 @@ qkz80_uint8 hbios_cpu::port_in(qkz80_uint8 port) {
     case 0x7C:  // Bank register (ROM)
       return memory ? memory->get_current_bank() : 0xFF;
 
+    case 0xEA:  // EMU console input pending (read by HBX_INT)
+      return hbios->handleConsoleStatusPort();
+
+    case 0xEB:  // EMU console input data (read by HBX_INT)
+      return hbios->handleConsoleDataPort();
+
+    case SimhDevices::SSER_DATA:
+    case SimhDevices::SSER_STATUS:
+    case SimhDevices::HDSK_PORT:
+    case SimhDevices::PSEUDO_PORT:
+      return simh.portIn(port, cycles, memory, hbios);
+
     default:
       return 0xFF;  // Floating bus
   }
@@ -100,11 +215,16 @@ void hbios_cpu::port_out(qkz80_uint8 port, qkz80_uint8 value) {
       break;
 
     case 0xEF:
-      // HBIOS dispatch trigger port
-      // Set skip_ret since Z80 proxy has its own RET
-      hbios->setSkipRet(true);
+      // HBIOS dispatch trigger port (skips the synthetic RET, the Z80
+      // proxy has its own)
       hbios->handlePortDispatch();
-      hbios->setSkipRet(false);
+      break;
+
+    case SimhDevices::SSER_DATA:
+    case SimhDevices::SSER_STATUS:
+    case SimhDevices::HDSK_PORT:
+    case SimhDevices::PSEUDO_PORT:
+      simh.portOut(port, value, memory, hbios);
       break;
 
     default:
@@ -2,7 +2,8 @@
  * HBIOS CPU - Shared Z80 CPU subclass for RomWBW emulation
  *
  * This class provides the port I/O handlers for RomWBW HBIOS.
- * It delegates HBIOS function handling to HBIOSDispatch.
+ * It delegates HBIOS function handling to HBIOSDispatch, and the SIMH
+ * device ports used by the stock SIMH ROMs to SimhDevices.
  */
 
 #ifndef HBIOS_CPU_H
@@ -11,6 +12,10 @@
 #include "qkz80.h"
 #include "romwbw_mem.h"
 #include "hbios_dispatch.h"
+#include "z80_lazy.h"
+#include "guest_hle.h"
+#include "simh_dev.h"
+#include <memory>
 
 // Interface that emulator must implement to receive callbacks
 class HBIOSCPUDelegate {
@@ -42,7 +47,35 @@ public:
   HBIOSCPUDelegate* delegate;
 
   hbios_cpu(qkz80_cpu_mem* memory, HBIOSCPUDelegate* del = nullptr)
-    : qkz80(memory), delegate(del) {}
+    : qkz80(memory), delegate(del), cpu_mem(memory) {}
+
+  // Select the in-tree lazy-flag core (z80_lazy.h) instead of qkz80's.
+  // Choose before execution starts; core state is not carried across.
+  void set_lazy_core(bool enable);
+  bool has_lazy_core() const { return lazy != nullptr; }
+
+  // Native replacement of known guest routines (guest_hle.h)
+  GuestHLE& get_hle() { return hle; }
+
+  // SIMH console, HDSK and pseudo device ports for stock SIMH ROMs
+  SimhDevices& get_simh() { return simh; }
+
+  // Execution and interrupt requests, routed to the selected core
+  void step();
+  void raise_int(qkz80_uint8 data);
+  void raise_rst(unsigned n);
+  void raise_nmi();
+  void service_interrupts();
+  bool interrupt_pending() const;
+
+  // Bring regs.AF up to date before inspecting it between instructions
+  // (no-op for the qkz80 core)
+  void sync_flags() { if (lazy) lazy->sync_flags(); }
+
+  // Checkpoint registers, cycle count and core-private state
+  // (emu_checkpoint.h). Returns false if the data is truncated.
+  void save_state(StateWriter& w);
+  bool load_state(StateReader& r);
 
   // Override port I/O
   qkz80_uint8 port_in(qkz80_uint8 port) override;
@@ -53,6 +86,16 @@ public:
 
   // Override unimplemented opcode handler
   void unimplemented_opcode(qkz80_uint8 opcode, qkz80_uint16 pc) override;
+
+private:
+  friend class GuestHLE;  // Verify mode steps the core directly
+
+  qkz80_cpu_mem* cpu_mem;
+  std::unique_ptr<z80_lazy> lazy;  // Null = qkz80 core
+  GuestHLE hle;
+  SimhDevices simh;
+
+  void step_core();
 };
 
 #endif // HBIOS_CPU_H
@@ -9,23 +9,16 @@
 #include "qkz80.h"
 #include "qkz80_cpu_flags.h"
 #include "romwbw_mem.h"
+#include "host_compute.h"
+#include "emu_checkpoint.h"
+#include "emu_latency.h"
+#include "emu_logger.h"
+#include <algorithm>
+#include <chrono>
 #include <cstring>
 #include <cctype>
 #include <cmath>
 #include <cstdio>
-#include <cstdarg>
-
-// Optional debug log file - defined in platform-specific code, nullptr for CLI
-static FILE* debug_log_file = nullptr;
-
-// Log to debug file if available (deep debugging, file only)
-static void dlog(const char* fmt, ...) {
-  if (!debug_log_file) return;
-  va_list args;
-  va_start(args, fmt);
-  vfprintf(debug_log_file, fmt, args);
-  va_end(args);
-}
 
 //=============================================================================
 // Constructor/Destructor
@@ -48,6 +41,7 @@ HBIOSDispatch::~HBIOSDispatch() {
 void HBIOSDispatch::reset() {
   trapping_enabled = false;
   waiting_for_input = false;
+  status_polls = 0;
   emu_state = HBIOS_RUNNING;
   output_buffer.clear();
   input_buffer.clear();
@@ -55,6 +49,7 @@ void HBIOSDispatch::reset() {
 
   signal_state = 0;
   signal_addr = 0;
+  console_ring_active = false;
   cur_bank = 0;
   bnkcpy_src_bank = 0x8E;
   bnkcpy_dst_bank = 0x8E;
@@ -79,8 +74,11 @@ void HBIOSDispatch::reset() {
   // Close any open host files (managed by emu_io)
   emu_host_file_close_read();
   emu_host_file_close_write();
+  emu_host_close_all();
   host_transfer_mode = 0;  // Auto mode
   host_cmd_line.clear();
+  host_find_paths.clear();
+  host_find_pos = 0;
 
   // Reset memory disks
   for (int i = 0; i < 2; i++) {
@@ -94,7 +92,191 @@ void HBIOSDispatch::reset() {
 
 // Legacy setDebug interface - uses emu_log as the debug function
 void HBIOSDispatch::setDebug(bool enable) {
-  debug_log = enable ? emu_log : nullptr;
+  int level = enable ? LOG_DEBUG : LOG_ERROR;
+  emu_logger_set_level(LOG_BANK, level);
+  emu_logger_set_level(LOG_DIO, level);
+  emu_logger_set_level(LOG_CIO, level);
+  emu_logger_set_level(LOG_SYS, level);
+}
+
+bool HBIOSDispatch::getDebug() const {
+  return emu_log_on(LOG_SYS);
+}
+
+void HBIOSDispatch::setDebugLog(DebugLogFn fn) {
+  emu_logger_set_sink(fn);
+  setDebug(fn != nullptr);
+}
+
+DebugLogFn HBIOSDispatch::getDebugLog() const {
+  return emu_logger_sink();
+}
+
+//=============================================================================
+// Checkpoint
+//=============================================================================
+
+void HBIOSDispatch::saveState(StateWriter& w) {
+  w.u8(emu_state);
+  w.u32(output_buffer.size());
+  w.bytes(output_buffer.data(), output_buffer.size());
+  w.u32(input_buffer.size());
+  for (int ch : input_buffer) w.u16((uint16_t)ch);
+
+  w.flag(trapping_enabled);
+  w.flag(waiting_for_input);
+  w.flag(skip_ret);
+  w.u16(main_entry);
+  w.u8(signal_state);
+  w.u16(signal_addr);
+  w.flag(console_ring_active);
+  w.u8(cur_bank);
+  w.u8(bnkcpy_src_bank);
+  w.u8(bnkcpy_dst_bank);
+  w.u16(bnkcpy_count);
+  w.u16(heap_ptr);
+  w.u16(initialized_ram_banks);
+  w.u16(vda_rows); w.u16(vda_cols);
+  w.u16(vda_cursor_row); w.u16(vda_cursor_col);
+  w.u8(vda_attr);
+  for (int i = 0; i < 4; i++) {
+    w.u8(snd_volume[i]);
+    w.u16(snd_period[i]);
+  }
+  w.u16(snd_duration);
+  w.u8(host_transfer_mode);
+  w.u8(saved_boot_unit);
+  w.u8(saved_boot_slice);
+  w.flag(boot_in_progress);
+
+  for (int i = 0; i < 2; i++) {
+    const MemDiskState& md = md_disks[i];
+    w.u32(md.current_lba);
+    w.u8(md.start_bank);
+    w.u8(md.num_banks);
+    w.flag(md.is_rom);
+    w.flag(md.is_enabled);
+  }
+
+  for (int i = 0; i < 16; i++) {
+    HBDisk& d = disks[i];
+    w.flag(d.is_open);
+    if (!d.is_open) continue;
+    // Backing: 0 = image in memory, 1 = file, 2 = host RAM disk
+    w.u8(d.file_backed ? 1 : d.ram_backed ? 2 : 0);
+    if (d.file_backed) {
+      if (d.handle) emu_disk_flush((emu_disk_handle)d.handle);
+      w.str(d.path);
+    } else if (d.ram_backed) {
+      // Only the chunks that were written
+      w.u8(d.size / RAM_DISK_SLICE);
+      uint32_t used = 0;
+      for (const auto& chunk : d.ram_chunks) used += !chunk.empty();
+      w.u32(used);
+      for (size_t c = 0; c < d.ram_chunks.size(); c++) {
+        if (d.ram_chunks[c].empty()) continue;
+        w.u32(c);
+        w.bytes(d.ram_chunks[c].data(), HBDisk::RAM_CHUNK);
+      }
+    } else {
+      w.u32(d.data.size());
+      w.bytes(d.data.data(), d.data.size());
+    }
+    w.u32(d.current_lba);
+    w.u8(d.max_slices);
+    w.flag(d.partition_probed);
+    w.u32(d.partition_base_lba);
+    w.u32(d.slice_size);
+    w.flag(d.is_hd1k);
+  }
+}
+
+bool HBIOSDispatch::loadState(StateReader& r) {
+  emu_state = (HBIOSState)r.u8();
+  uint32_t count = r.u32();
+  if (count > r.remaining()) return false;
+  output_buffer.resize(count);
+  r.bytes(output_buffer.data(), output_buffer.size());
+  count = r.u32();
+  if (count > r.remaining() / 2) return false;
+  input_buffer.resize(count);
+  for (int& ch : input_buffer) ch = (int16_t)r.u16();
+
+  trapping_enabled = r.flag();
+  waiting_for_input = r.flag();
+  skip_ret = r.flag();
+  main_entry = r.u16();
+  signal_state = r.u8();
+  signal_addr = r.u16();
+  console_ring_active = r.flag();
+  cur_bank = r.u8();
+  bnkcpy_src_bank = r.u8();
+  bnkcpy_dst_bank = r.u8();
+  bnkcpy_count = r.u16();
+  heap_ptr = r.u16();
+  initialized_ram_banks = r.u16();
+  vda_rows = r.u16(); vda_cols = r.u16();
+  vda_cursor_row = r.u16(); vda_cursor_col = r.u16();
+  vda_attr = r.u8();
+  for (int i = 0; i < 4; i++) {
+    snd_volume[i] = r.u8();
+    snd_period[i] = r.u16();
+  }
+  snd_duration = r.u16();
+  host_transfer_mode = r.u8();
+  saved_boot_unit = r.u8();
+  saved_boot_slice = r.u8();
+  boot_in_progress = r.flag();
+
+  for (int i = 0; i < 2; i++) {
+    MemDiskState& md = md_disks[i];
+    md.current_lba = r.u32();
+    md.start_bank = r.u8();
+    md.num_banks = r.u8();
+    md.is_rom = r.flag();
+    md.is_enabled = r.flag();
+  }
+
+  for (int i = 0; i < 16 && r.ok(); i++) {
+    if (!r.flag()) {
+      closeDisk(i);
+      continue;
+    }
+    uint8_t backing = r.u8();
+    if (backing == 1) {
+      std::string path = r.str();
+      if (!disks[i].file_backed || disks[i].path != path) {
+        emu_log("[CHECKPOINT] Reattaching disk %d: %s\n", i, path.c_str());
+        if (!loadDiskFromFile(i, path)) {
+          emu_error("[CHECKPOINT] Cannot open disk %d: %s\n", i, path.c_str());
+          return false;
+        }
+      }
+    } else if (backing == 2) {
+      if (!createRamDisk(i, r.u8())) return false;
+      uint32_t used = r.u32();
+      for (uint32_t n = 0; n < used && r.ok(); n++) {
+        uint32_t c = r.u32();
+        if (c >= disks[i].ram_chunks.size() || HBDisk::RAM_CHUNK > r.remaining()) return false;
+        disks[i].ram_chunks[c].resize(HBDisk::RAM_CHUNK);
+        r.bytes(disks[i].ram_chunks[c].data(), HBDisk::RAM_CHUNK);
+      }
+    } else {
+      uint32_t size = r.u32();
+      if (size > r.remaining()) return false;
+      std::vector<uint8_t> data(size);
+      r.bytes(data.data(), data.size());
+      loadDisk(i, data.data(), data.size());
+    }
+    HBDisk& d = disks[i];
+    d.current_lba = r.u32();
+    d.max_slices = r.u8();
+    d.partition_probed = r.flag();
+    d.partition_base_lba = r.u32();
+    d.slice_size = r.u32();
+    d.is_hd1k = r.flag();
+  }
+  return r.ok();
 }
 
 //=============================================================================
@@ -171,16 +353,17 @@ bool HBIOSDispatch::loadDisk(int unit, const uint8_t* data, size_t size) {
 bool HBIOSDispatch::loadDiskFromFile(int unit, const std::string& path) {
   if (unit < 0 || unit >= 16) return false;
 
-  closeDisk(unit);
-
+  // Open before closing, so a unit being replaced keeps its old image if
+  // the new one cannot be opened
   emu_disk_handle handle = emu_disk_open(path, "rw");
   if (!handle) {
-    // Try read-only
+    // Read-only only if the file cannot be written: an image refused for
+    // other reasons (damaged, cannot be journaled) stays refused
+    if (emu_file_writable(path)) return false;
     handle = emu_disk_open(path, "r");
-    if (!handle) {
-      emu_fatal("[HBIOS] Cannot open disk file: %s\n", path.c_str());
-    }
+    if (!handle) return false;
   }
+  closeDisk(unit);
 
   disks[unit].handle = handle;
   disks[unit].path = path;
@@ -188,9 +371,25 @@ bool HBIOSDispatch::loadDiskFromFile(int unit, const std::string& path) {
   disks[unit].is_open = true;
   disks[unit].file_backed = true;
 
-  if (debug_log) {
-    debug_log("[HBIOS] Loaded disk %d: %s (%zu bytes)\n", unit, path.c_str(), disks[unit].size);
-  }
+  EMU_DLOG(LOG_DIO, "[HBIOS] Loaded disk %d: %s (%zu bytes)\n", unit, path.c_str(), disks[unit].size);
+  return true;
+}
+
+bool HBIOSDispatch::createRamDisk(int unit, int slices) {
+  if (unit < 0 || unit >= 16 || slices < 1 || slices > 8) return false;
+
+  closeDisk(unit);
+
+  HBDisk& d = disks[unit];
+  d.size = (size_t)slices * RAM_DISK_SLICE;
+  d.ram_chunks.assign((d.size + HBDisk::RAM_CHUNK - 1) / HBDisk::RAM_CHUNK, std::vector<uint8_t>());
+  d.is_open = true;
+  d.ram_backed = true;
+  d.path = "ram:" + std::to_string(d.size >> 20) + "M";
+  // hd512 layout with no MBR: nothing to probe
+  d.partition_probed = true;
+
+  emu_status("[HBIOS] Created host RAM disk %d: %d slice(s), %zu bytes\n", unit, slices, d.size);
   return true;
 }
 
@@ -204,6 +403,8 @@ void HBIOSDispatch::closeDisk(int unit) {
   disks[unit].data.clear();
   disks[unit].is_open = false;
   disks[unit].file_backed = false;
+  disks[unit].ram_backed = false;
+  disks[unit].ram_chunks.clear();
   disks[unit].size = 0;
   disks[unit].path.clear();
   // Reset partition detection state so new disk will be probed correctly
@@ -225,18 +426,178 @@ bool HBIOSDispatch::isDiskLoaded(int unit) const {
   return disks[unit].is_open;
 }
 
+// Host RAM disk sectors. Unwritten sectors read as 0xE5, an empty CP/M
+// directory, so each slice starts out formatted; the first write to a
+// chunk allocates it.
+static bool ram_disk_read(const HBDisk& d, uint32_t lba, uint8_t* buf) {
+  size_t offset = (size_t)lba * 512;
+  if (offset + 512 > d.size) return false;
+  const std::vector<uint8_t>& chunk = d.ram_chunks[offset / HBDisk::RAM_CHUNK];
+  if (chunk.empty()) memset(buf, 0xE5, 512);
+  else memcpy(buf, chunk.data() + offset % HBDisk::RAM_CHUNK, 512);
+  return true;
+}
+
+static bool ram_disk_write(HBDisk& d, uint32_t lba, const uint8_t* buf) {
+  size_t offset = (size_t)lba * 512;
+  if (offset + 512 > d.size) return false;
+  std::vector<uint8_t>& chunk = d.ram_chunks[offset / HBDisk::RAM_CHUNK];
+  if (chunk.empty()) chunk.assign(HBDisk::RAM_CHUNK, 0xE5);
+  memcpy(chunk.data() + offset % HBDisk::RAM_CHUNK, buf, 512);
+  return true;
+}
+
+int HBIOSDispatch::readDiskBlocks(int unit, uint32_t lba, uint8_t* buf, int count) {
+  if (!isDiskLoaded(unit) || count <= 0) return 0;
+  HBDisk& d = disks[unit];
+  size_t offset = (size_t)lba * 512;
+  size_t len = (size_t)count * 512;
+  if (d.file_backed && d.handle) {
+    return (int)(emu_disk_read((emu_disk_handle)d.handle, offset, buf, len) / 512);
+  }
+  if (d.ram_backed) {
+    int n = 0;
+    while (n < count && ram_disk_read(d, lba + n, buf + n * 512)) n++;
+    return n;
+  }
+  if (offset >= d.data.size()) return 0;
+  if (len > d.data.size() - offset) len = (d.data.size() - offset) & ~(size_t)511;
+  memcpy(buf, d.data.data() + offset, len);
+  return (int)(len / 512);
+}
+
+int HBIOSDispatch::writeDiskBlocks(int unit, uint32_t lba, const uint8_t* buf, int count) {
+  if (!isDiskLoaded(unit) || count <= 0) return 0;
+  HBDisk& d = disks[unit];
+  size_t offset = (size_t)lba * 512;
+  size_t len = (size_t)count * 512;
+  if (d.file_backed && d.handle) {
+    size_t written = emu_disk_write((emu_disk_handle)d.handle, offset, buf, len);
+    emu_disk_flush((emu_disk_handle)d.handle);
+    return (int)(written / 512);
+  }
+  if (d.ram_backed) {
+    int n = 0;
+    while (n < count && ram_disk_write(d, lba + n, buf + n * 512)) n++;
+    return n;
+  }
+  if (offset + len > d.data.size()) d.data.resize(offset + len);
+  memcpy(d.data.data() + offset, buf, len);
+  return count;
+}
+
 const HBDisk& HBIOSDispatch::getDisk(int unit) const {
   static HBDisk empty;
   if (unit < 0 || unit >= 16) return empty;
   return disks[unit];
 }
 
+// Find the slice layout from the MBR: a type 0x2E partition or an 8 MB
+// image is hd1k, anything else hd512. Done once per attached image.
+void HBIOSDispatch::probeDiskLayout(HBDisk& disk) {
+  if (disk.partition_probed) return;
+  disk.partition_probed = true;
+  disk.partition_base_lba = 0;
+  disk.slice_size = 16640;  // Default: hd512 format
+  disk.is_hd1k = false;
+
+  bool detected_format = false;
+  uint8_t mbr[512];
+  bool mbr_valid = false;
+  size_t disk_size = disk.size;
+
+  // Read MBR - try file-backed first, then in-memory
+  if (disk.file_backed && disk.handle) {
+    // File-backed disk - read MBR via portable I/O
+    size_t read = emu_disk_read((emu_disk_handle)disk.handle, 0, mbr, 512);
+    mbr_valid = (read == 512);
+    if (disk_size == 0) {
+      disk_size = emu_disk_size((emu_disk_handle)disk.handle);
+    }
+  } else if (!disk.data.empty() && disk.data.size() >= 512) {
+    // In-memory disk
+    memcpy(mbr, disk.data.data(), 512);
+    mbr_valid = true;
+    if (disk_size == 0) {
+      disk_size = disk.data.size();
+    }
+  }
+
+  if (mbr_valid) {
+    // Check for valid MBR signature
+    if (mbr[510] == 0x55 && mbr[511] == 0xAA) {
+      // Check partition table for type 0x2E (RomWBW hd1k partition)
+      for (int p = 0; p < 4; p++) {
+        int offset = 0x1BE + (p * 16);
+        uint8_t ptype = mbr[offset + 4];
+        if (ptype == 0x2E) {
+          // Found RomWBW partition (hd1k format)
+          uint32_t part_lba = mbr[offset + 8] |
+                              (mbr[offset + 9] << 8) |
+                              (mbr[offset + 10] << 16) |
+                              (mbr[offset + 11] << 24);
+          disk.partition_base_lba = part_lba;
+          disk.slice_size = 16384;  // hd1k: 8MB slices
+          disk.is_hd1k = true;
+          detected_format = true;
+          EMU_DLOG(LOG_DIO, "[HBIOS EXTSLICE] Detected hd1k format (0x2E partition), LBA %u\n", part_lba);
+          break;
+        }
+      }
+    }
+
+    // If no 0x2E partition, check if single-slice hd1k image (exactly 8MB)
+    if (!detected_format && disk_size == 8388608) {
+      disk.partition_base_lba = 0;
+      disk.slice_size = 16384;
+      disk.is_hd1k = true;
+      detected_format = true;
+      EMU_DLOG(LOG_DIO, "[HBIOS EXTSLICE] Detected hd1k format (8MB single slice)\n");
+    }
+
+    if (!detected_format) {
+      EMU_DLOG(LOG_DIO, "[HBIOS EXTSLICE] Using hd512 format (size=%zu)\n", disk_size);
+    }
+  }
+}
+
 void HBIOSDispatch::setDiskSliceCount(int unit, int slices) {
   if (unit < 0 || unit >= 16) return;
   if (slices < 1) slices = 1;
   if (slices > 8) slices = 8;
   emu_log("[HBIOS] setDiskSliceCount: unit=%d slices=%d (was %d)\n", unit, slices, disks[unit].max_slices);
   disks[unit].max_slices = slices;
+  prefetchDirectories(unit);
+}
+
+// CBIOS reads the directory of every slice it maps at boot. Start reading
+// those areas ahead now that the layout and slice count are known: a
+// slice's directory follows its system tracks (hd1k: 32 sectors reserved,
+// 1024 entries in 64 sectors; hd512: 256 reserved, 512 entries in 32).
+void HBIOSDispatch::prefetchDirectories(int unit) {
+  HBDisk& disk = disks[unit];
+  if (!disk.is_open || !disk.file_backed || !disk.handle) return;
+  probeDiskLayout(disk);
+
+  uint32_t dir_start = disk.is_hd1k ? 32 : 256;
+  uint32_t dir_sectors = disk.is_hd1k ? 64 : 32;
+  uint64_t disk_sectors = disk.size / 512;
+  std::vector<std::pair<uint64_t, uint32_t>> ranges;
+  for (int slice = 0; slice < disk.max_slices; slice++) {
+    uint64_t lba = disk.partition_base_lba + (uint64_t)slice * disk.slice_size + dir_start;
+    if (lba >= disk_sectors) break;
+    ranges.push_back({lba, (uint32_t)std::min<uint64_t>(dir_sectors, disk_sectors - lba)});
+  }
+  EMU_DLOG(LOG_DIO, "[HBIOS] Prefetching directories of %zu slice(s) on disk %d\n", ranges.size(), unit);
+  emu_disk_prefetch((emu_disk_handle)disk.handle, ranges);
+}
+
+void HBIOSDispatch::endBootTraces() {
+  for (int i = 0; i < 16; i++) {
+    if (disks[i].file_backed && disks[i].handle) {
+      emu_disk_end_boot_trace((emu_disk_handle)disks[i].handle);
+    }
+  }
 }
 
 //=============================================================================
@@ -244,7 +605,7 @@ void HBIOSDispatch::setDiskSliceCount(int unit, int slices) {
 //=============================================================================
 
 void HBIOSDispatch::initMemoryDisks() {
-  if (debug_log) debug_log("[MD] initMemoryDisks called\n");
+  EMU_DLOG(LOG_DIO, "[MD] initMemoryDisks called\n");
   if (!memory) {
     emu_error("[MD] Warning: memory not available, memory disks disabled\n");
     return;
@@ -266,8 +627,8 @@ void HBIOSDispatch::initMemoryDisks() {
   uint8_t ramd_banks = memory->read_bank(0x00, HCB_BASE + 0xDD);
   uint8_t romd_start = memory->read_bank(0x00, HCB_BASE + 0xDE);
   uint8_t romd_banks = memory->read_bank(0x00, HCB_BASE + 0xDF);
-  if (debug_log) debug_log("[MD] HCB config: ramd_start=0x%02X ramd_banks=%d romd_start=0x%02X romd_banks=%d\n",
-          ramd_start, ramd_banks, romd_start, romd_banks);
+  EMU_DLOG(LOG_DIO, "[MD] HCB config: ramd_start=0x%02X ramd_banks=%d romd_start=0x%02X romd_banks=%d\n",
+           ramd_start, ramd_banks, romd_start, romd_banks);
 
   // MD0 = RAM disk
   if (ramd_banks > 0) {
@@ -302,7 +663,7 @@ void HBIOSDispatch::initMemoryDisks() {
 //=============================================================================
 
 void HBIOSDispatch::populateDiskUnitTable() {
-  if (debug_log) debug_log("[DISKUT] populateDiskUnitTable called\n");
+  EMU_DLOG(LOG_DIO, "[DISKUT] populateDiskUnitTable called\n");
   if (!memory) {
     emu_error("[DISKUT] Warning: memory not available\n");
     return;
@@ -334,9 +695,9 @@ void HBIOSDispatch::populateDiskUnitTable() {
   int disk_idx = 0;
 
   // Add hard disks FIRST so boot disk is at the start of the unit table
-  if (debug_log) debug_log("[DISKUT] Scanning disks array for loaded disks...\n");
+  EMU_DLOG(LOG_DIO, "[DISKUT] Scanning disks array for loaded disks...\n");
   for (int i = 0; i < 16 && disk_idx < 16; i++) {
-    if (debug_log) debug_log("[DISKUT] disks[%d].is_open = %d, size = %zu\n", i, disks[i].is_open ? 1 : 0, disks[i].size);
+    EMU_DLOG(LOG_DIO, "[DISKUT] disks[%d].is_open = %d, size = %zu\n", i, disks[i].is_open ? 1 : 0, disks[i].size);
     if (disks[i].is_open) {
       rom[DISKUT_BASE + disk_idx * 4 + 0] = 0x09;  // DIODEV_HDSK
       rom[DISKUT_BASE + disk_idx * 4 + 1] = i;     // HDSK unit number
@@ -346,7 +707,7 @@ void HBIOSDispatch::populateDiskUnitTable() {
       memory->write_bank(0x80, DISKUT_BASE + disk_idx * 4 + 1, i);
       memory->write_bank(0x80, DISKUT_BASE + disk_idx * 4 + 2, 0x00);
       memory->write_bank(0x80, DISKUT_BASE + disk_idx * 4 + 3, 0x00);
-      if (debug_log) debug_log("[DISKUT] Entry %d: HD%d (hard disk, %zu bytes)\n", disk_idx, i, disks[i].size);
+      EMU_DLOG(LOG_DIO, "[DISKUT] Entry %d: HD%d (hard disk, %zu bytes)\n", disk_idx, i, disks[i].size);
       disk_idx++;
     }
   }
@@ -470,6 +831,7 @@ void HBIOSDispatch::handleSignalPort(uint8_t value) {
   //
   // Protocol 1 (simple status):
   //   0x01 = HBIOS starting
+  //   0x03 = Console input ring offered (emu_hbios HBX_CONRING)
   //   0xFE = PREINIT point
   //   0xFF = Init complete, enable trapping
   //
@@ -486,6 +848,15 @@ void HBIOSDispatch::handleSignalPort(uint8_t value) {
     // Check for special signals
     switch (value) {
       case 0x01:  // HBIOS starting
+        console_ring_active = false;
+        return;
+
+      case 0x03:  // Console ring offered - accept if interrupts requested
+        if (console_int_enabled && memory) {
+          memory->write_bank(0x8F, CONRING_INT - 0x8000, 1);
+          console_ring_active = true;
+          EMU_DLOG(LOG_SYS, "[HBIOS] Interrupt-driven console input enabled\n");
+        }
         return;
 
       case 0x02:  // Protocol 2: Start sequential registration (accept but ignore)
@@ -534,6 +905,36 @@ void HBIOSDispatch::handleSignalPort(uint8_t value) {
   }
 }
 
+//=============================================================================
+// Interrupt-Driven Console Input
+//=============================================================================
+
+bool HBIOSDispatch::consoleInterruptPending() {
+  if (!console_ring_active || !memory) return false;
+
+  // Leave input on the host while the guest ring is full, otherwise the
+  // handler would return immediately and the interrupt would fire again
+  uint8_t head = memory->read_bank(0x8F, CONRING_HEAD - 0x8000);
+  uint8_t tail = memory->read_bank(0x8F, CONRING_TAIL - 0x8000);
+  if (((head + 1) & CONRING_MASK) == (tail & CONRING_MASK)) return false;
+
+  return emu_console_has_input();
+}
+
+uint8_t HBIOSDispatch::handleConsoleStatusPort() {
+  if (!console_ring_active) return 0;
+  return emu_console_has_input() ? 0xFF : 0;
+}
+
+uint8_t HBIOSDispatch::handleConsoleDataPort() {
+  if (!console_ring_active || !emu_console_has_input()) return 0;
+  int ch = emu_console_read_char();
+  if (ch >= 0) emu_latency_input_consumed();
+  if (ch < 0) ch = 0x1A;  // EOF - same ^Z marker as CIOIN
+  progress_count++;
+  return ch & 0xFF;
+}
+
 //=============================================================================
 // Function Dispatch
 //=============================================================================
@@ -546,7 +947,9 @@ int HBIOSDispatch::getTrapTypeFromFunc(uint8_t func) {
   if (func <= 0x3F) return 6;        // DSKY (0x30-0x3F)
   if (func <= 0x4F) return 4;        // VDA (0x40-0x4F)
   if (func <= 0x5F) return 5;        // SND (0x50-0x5F)
+  if (func >= 0xD8 && func <= 0xDF) return 7;  // EXT (0xD8-0xDF, host file handles)
   if (func >= 0xE0 && func <= 0xE7) return 7;  // EXT (0xE0-0xE7, includes host file)
+  if (func >= 0xE8 && func <= 0xEF) return 8;  // HCS (0xE8-0xEF, host compute)
   if (func >= 0xF0) return 3;        // SYS (0xF0-0xFF)
   return -1;
 }
@@ -556,6 +959,19 @@ bool HBIOSDispatch::handleMainEntry() {
 
   uint8_t func = cpu->regs.BC.get_high();
   int trap_type = getTrapTypeFromFunc(func);
+  if (trap_type >= 0) call_counts[trap_type]++;
+  switch (func) {
+    case HBF_CIOIN: case HBF_CIOOUT: case HBF_DIOREAD: case HBF_DIOWRITE:
+    case HBF_VDAWRC: case HBF_VDAFIL: case HBF_VDAKRD:
+    case HBF_HCS_MOVE: case HBF_HCS_FILL: case HBF_HCS_CRC: case HBF_HCS_UNLZ:
+    case HBF_HCS_SORT:
+      progress_count++;
+      break;
+    default:
+      // Host file transfers count in handleEXT once bytes have moved;
+      // opens, closes, directory scans and timer or info reads do not
+      break;
+  }
 
   switch (trap_type) {
     case 0: handleCIO(); return true;
@@ -566,6 +982,7 @@ bool HBIOSDispatch::handleMainEntry() {
     case 5: handleSND(); return true;
     case 6: handleDSKY(); return true;
     case 7: handleEXT(); return true;
+    case 8: handleHCS(); return true;
     default:
       // Unknown function - return error and RET
       emu_log("[HBIOS] Unknown function 0x%02X (trap_type=%d)\n", func, trap_type);
@@ -653,10 +1070,8 @@ void HBIOSDispatch::doRet() {
   cpu->regs.SP.set_pair16(sp + 2);
   cpu->regs.PC.set_pair16(ret_addr);
 
-  if (debug_log) {
-    emu_log("[HBIOS RET] SP=0x%04X -> PC=0x%04X A=0x%02X\n",
-            sp, ret_addr, cpu->regs.AF.get_high());
-  }
+  EMU_DLOG(LOG_SYS, "[HBIOS RET] SP=0x%04X -> PC=0x%04X A=0x%02X\n",
+           sp, ret_addr, cpu->regs.AF.get_high());
 }
 
 void HBIOSDispatch::writeConsoleString(const char* str) {
@@ -676,10 +1091,13 @@ void HBIOSDispatch::handleCIO() {
   uint8_t func = cpu->regs.BC.get_high();  // B = function
   uint8_t unit = cpu->regs.BC.get_low();   // C = unit
   uint8_t result = HBR_SUCCESS;
+  if (func != HBF_CIOIST) status_polls = 0;
 
   switch (func) {
     case HBF_CIOIN: {
       // Read character - behavior depends on dispatch mode and platform
+      // Waiting for a keystroke ends a boot: save what the disks read
+      if (!emu_console_has_input()) endBootTraces();
       if (!blocking_allowed && !emu_console_has_input()) {
         // Non-blocking mode (web/WASM) - no input available
         // Rewind PC to re-execute OUT instruction when input arrives
@@ -695,14 +1113,17 @@ void HBIOSDispatch::handleCIO() {
         emu_console_write_char(output_buffer.front());
         output_buffer.erase(output_buffer.begin());
       }
+      if (idle_callback && !emu_console_has_input()) {
+        idle_callback();
+      }
       // Now read char (blocks if needed)
       int ch = emu_console_read_char();
-      if (debug_log) {
-        debug_log("[CIOIN] read char: %d (0x%02X) '%c'\n", ch, ch & 0xFF, (ch >= 32 && ch < 127) ? ch : '?');
-      }
+      EMU_DLOG(LOG_CIO, "[CIOIN] read char: %d (0x%02X) '%c'\n", ch, ch & 0xFF, (ch >= 32 && ch < 127) ? ch : '?');
       if (ch < 0) {
         // EOF - return 0x1A (^Z) as end-of-file marker
         ch = 0x1A;
+      } else {
+        emu_latency_input_consumed();
       }
       cpu->regs.DE.set_low(ch & 0xFF);
       waiting_for_input = false;
@@ -722,6 +1143,12 @@ void HBIOSDispatch::handleCIO() {
       // Returns: A = status (0=no data, non-zero=data ready)
       //          E = pending byte count (0xFF if unknown)
       bool has_input = emu_console_has_input();
+      if (has_input || cpu->cycles - last_status_poll > STATUS_POLL_GAP) {
+        status_polls = 0;
+      } else if (status_polls < IDLE_STATUS_POLLS) {
+        status_polls++;
+      }
+      last_status_poll = cpu->cycles;
       result = has_input ? 0xFF : 0;  // Non-zero if input ready
       cpu->regs.DE.set_low(has_input ? 0xFF : 0);  // E = pending count
       break;
@@ -826,11 +1253,11 @@ void HBIOSDispatch::handleDIO() {
 
   // DEBUG: Unconditional logging for DIO calls
   static int dio_log_count = 0;
-  if (debug_log && dio_log_count < 100) {
+  if (emu_log_on(LOG_DIO) && dio_log_count < 100) {
     dio_log_count++;
-    debug_log("[DIO #%d] func=0x%02X unit=%d hd_unit=%d is_md=%d is_hd=%d disk_open=%d\n",
-            dio_log_count, func, raw_unit, hd_unit, is_memdisk ? 1 : 0, is_harddisk ? 1 : 0,
-            (hd_unit < 16) ? (disks[hd_unit].is_open ? 1 : 0) : -1);
+    emu_logf(LOG_DIO, LOG_DEBUG, "[DIO #%d] func=0x%02X unit=%d hd_unit=%d is_md=%d is_hd=%d disk_open=%d\n",
+             dio_log_count, func, raw_unit, hd_unit, is_memdisk ? 1 : 0, is_harddisk ? 1 : 0,
+             (hd_unit < 16) ? (disks[hd_unit].is_open ? 1 : 0) : -1);
   }
 
   switch (func) {
@@ -886,11 +1313,11 @@ void HBIOSDispatch::handleDIO() {
 
       // Trace DIOREAD calls during CP/M 3 boot investigation
       static int dioread_trace_count = 0;
-      if (debug_log && is_harddisk && dioread_trace_count < 50) {
+      if (emu_log_on(LOG_DIO) && is_harddisk && dioread_trace_count < 50) {
         dioread_trace_count++;
-        debug_log("[DIOREAD #%d] unit=%d LBA=%u bank=0x%02X addr=0x%04X count=%d\n",
-                dioread_trace_count, raw_unit, disks[hd_unit].current_lba,
-                cpu->regs.DE.get_high(), cpu->regs.HL.get_pair16(), cpu->regs.DE.get_low());
+        emu_logf(LOG_DIO, LOG_DEBUG, "[DIOREAD #%d] unit=%d LBA=%u bank=0x%02X addr=0x%04X count=%d\n",
+                 dioread_trace_count, raw_unit, disks[hd_unit].current_lba,
+                 cpu->regs.DE.get_high(), cpu->regs.HL.get_pair16(), cpu->regs.DE.get_low());
       }
 
       if (!is_memdisk && !is_harddisk) {
@@ -974,6 +1401,15 @@ void HBIOSDispatch::handleDIO() {
             }
             blocks_read++;
           }
+        } else if (disks[hd_unit].ram_backed) {
+          uint8_t sector_buf[512];
+          for (int s = 0; s < count; s++) {
+            if (!ram_disk_read(disks[hd_unit], lba + s, sector_buf)) break;
+            for (size_t i = 0; i < 512; i++) {
+              write_to_bank(buffer + s * 512 + i, sector_buf[i]);
+            }
+            blocks_read++;
+          }
         } else if (!disks[hd_unit].data.empty()) {
           // Read from memory buffer
           for (int s = 0; s < count; s++) {
@@ -1081,6 +1517,15 @@ void HBIOSDispatch::handleDIO() {
             blocks_written++;
           }
           emu_disk_flush((emu_disk_handle)disks[hd_unit].handle);
+        } else if (disks[hd_unit].ram_backed) {
+          uint8_t sector_buf[512];
+          for (int s = 0; s < count; s++) {
+            for (size_t i = 0; i < 512; i++) {
+              sector_buf[i] = read_from_bank(buffer + s * 512 + i);
+            }
+            if (!ram_disk_write(disks[hd_unit], lba + s, sector_buf)) break;
+            blocks_written++;
+          }
         } else if (!disks[hd_unit].data.empty()) {
           for (int s = 0; s < count; s++) {
             size_t offset = (lba + s) * 512;
@@ -1129,16 +1574,12 @@ void HBIOSDispatch::handleDIO() {
         cpu->regs.DE.set_high(0xFF);  // No device
         cpu->regs.DE.set_low(0xFF);
         result = HBR_NOUNIT;
-        if (debug_log) {
-          emu_log("[HBIOS DIODEVICE] Unit %d: no device found\n", raw_unit);
-        }
+        EMU_DLOG(LOG_DIO, "[HBIOS DIODEVICE] Unit %d: no device found\n", raw_unit);
         break;
       }
       cpu->regs.BC.set_low(dev_attr);  // C = device attributes
-      if (debug_log) {
-        emu_log("[HBIOS DIODEVICE] Unit %d: type=0x%02X num=%d attr=0x%02X\n",
-                raw_unit, cpu->regs.DE.get_high(), cpu->regs.DE.get_low(), dev_attr);
-      }
+      EMU_DLOG(LOG_DIO, "[HBIOS DIODEVICE] Unit %d: type=0x%02X num=%d attr=0x%02X\n",
+               raw_unit, cpu->regs.DE.get_high(), cpu->regs.DE.get_low(), dev_attr);
       break;
     }
 
@@ -1180,8 +1621,8 @@ void HBIOSDispatch::handleDIO() {
         uint32_t max_sectors = (uint32_t)disks[hd_unit].max_slices * slice_size;
 
         if (sectors > max_sectors) {
-          if (debug_log) debug_log("[DIOCAP] HD%d limiting: %u -> %u (max_slices=%d)\n",
-                  hd_unit, actual_sectors, max_sectors, disks[hd_unit].max_slices);
+          EMU_DLOG(LOG_DIO, "[DIOCAP] HD%d limiting: %u -> %u (max_slices=%d)\n",
+                   hd_unit, actual_sectors, max_sectors, disks[hd_unit].max_slices);
           sectors = max_sectors;
         }
 
@@ -1274,7 +1715,7 @@ void HBIOSDispatch::handleSYS() {
       // System reset - C register: 0x01 = warm boot, 0x02 = cold boot
       uint8_t reset_type = subfunc;  // subfunc is C register
       // Always log SYSRESET since it causes reboot
-      if (debug_log) debug_log("[HBIOS SYSRESET] reset_type=0x%02X\n", reset_type);
+      EMU_DLOG(LOG_SYS, "[HBIOS SYSRESET] reset_type=0x%02X\n", reset_type);
       if (reset_type == 0x01 || reset_type == 0x02) {
         // Call the reset callback if set
         if (reset_callback) {
@@ -1308,9 +1749,7 @@ void HBIOSDispatch::handleSYS() {
         uint8_t bank_idx = new_bank & 0x0F;
         if (!(initialized_ram_banks & (1 << bank_idx))) {
           // First time accessing this RAM bank - copy page zero and HCB
-          if (debug_log) {
-            emu_log("[HBIOS] SYSSETBNK initializing RAM bank 0x%02X\n", new_bank);
-          }
+          EMU_DLOG(LOG_BANK, "[HBIOS] SYSSETBNK initializing RAM bank 0x%02X\n", new_bank);
           // Copy page zero (0x0000-0x0100) - contains RST vectors
           for (uint16_t addr = 0x0000; addr < 0x0100; addr++) {
             uint8_t byte = memory->read_bank(0x00, addr);
@@ -1338,9 +1777,7 @@ void HBIOSDispatch::handleSYS() {
 
       cur_bank = new_bank;
       cpu->regs.BC.set_low(prev_bank);  // Return previous bank in C
-      if (debug_log) {
-        emu_log("[HBIOS] SYSSETBNK bank=0x%02X (prev=0x%02X)\n", new_bank, prev_bank);
-      }
+      EMU_DLOG(LOG_BANK, "[HBIOS] SYSSETBNK bank=0x%02X (prev=0x%02X)\n", new_bank, prev_bank);
       break;
     }
 
@@ -1358,9 +1795,8 @@ void HBIOSDispatch::handleSYS() {
       bnkcpy_dst_bank = cpu->regs.DE.get_high();
       bnkcpy_src_bank = cpu->regs.DE.get_low();
       bnkcpy_count = cpu->regs.HL.get_pair16();
-      // DEBUG: Always log SYSSETCPY calls
-      dlog("[HBIOS SYSSETCPY] src=0x%02X dst=0x%02X count=%u\n",
-           bnkcpy_src_bank, bnkcpy_dst_bank, bnkcpy_count);
+      EMU_DLOG(LOG_BANK, "[HBIOS SYSSETCPY] src=0x%02X dst=0x%02X count=%u\n",
+               bnkcpy_src_bank, bnkcpy_dst_bank, bnkcpy_count);
       break;
     }
 
@@ -1372,9 +1808,8 @@ void HBIOSDispatch::handleSYS() {
       uint16_t dst_addr = cpu->regs.DE.get_pair16();
       uint16_t count = bnkcpy_count;
 
-      // DEBUG: Always log SYSBNKCPY calls
-      dlog("[HBIOS SYSBNKCPY] src=%02X:%04X dst=%02X:%04X count=%u\n",
-           bnkcpy_src_bank, src_addr, bnkcpy_dst_bank, dst_addr, count);
+      EMU_DLOG(LOG_BANK, "[HBIOS SYSBNKCPY] src=%02X:%04X dst=%02X:%04X count=%u\n",
+               bnkcpy_src_bank, src_addr, bnkcpy_dst_bank, dst_addr, count);
 
       if (count > 0) {
         for (uint16_t i = 0; i < count; i++) {
@@ -1413,9 +1848,9 @@ void HBIOSDispatch::handleSYS() {
       alloc_count++;
 
       // Log first allocations and failures to debug heap issues
-      if (debug_log && (alloc_count <= 20)) {
-        debug_log("[HBIOS SYSALLOC #%d] REQUEST: size=0x%04X (%u) heap_ptr=0x%04X free=0x%04X\n",
-                alloc_count, size, size, heap_ptr, heap_end - heap_ptr);
+      if (emu_log_on(LOG_SYS) && (alloc_count <= 20)) {
+        emu_logf(LOG_SYS, LOG_DEBUG, "[HBIOS SYSALLOC #%d] REQUEST: size=0x%04X (%u) heap_ptr=0x%04X free=0x%04X\n",
+                 alloc_count, size, size, heap_ptr, heap_end - heap_ptr);
       }
 
       if (heap_ptr + size <= heap_end) {
@@ -1424,7 +1859,7 @@ void HBIOSDispatch::handleSYS() {
         cpu->regs.HL.set_pair16(addr);
         // Set flags: Z=1 (success), C=0 (no error)
         cpu->regs.AF.set_low(qkz80_cpu_flags::Z);
-        if (debug_log) debug_log("[HBIOS SYSALLOC] SUCCESS: allocated 0x%04X, new heap_ptr=0x%04X\n", addr, heap_ptr);
+        EMU_DLOG(LOG_SYS, "[HBIOS SYSALLOC] SUCCESS: allocated 0x%04X, new heap_ptr=0x%04X\n", addr, heap_ptr);
       } else {
         // Out of heap memory - always log failures
         emu_log("[HBIOS SYSALLOC] FAILED: size=%u (0x%04X) exceeds available heap (ptr=0x%04X end=0x%04X)\n",
@@ -1441,9 +1876,7 @@ void HBIOSDispatch::handleSYS() {
       // Free memory from HBIOS heap
       // Input: HL = address of block to free
       // We don't actually track allocations, so just succeed
-      if (debug_log) {
-        emu_log("[HBIOS SYSFREE] addr=0x%04X (no-op)\n", cpu->regs.HL.get_pair16());
-      }
+      EMU_DLOG(LOG_SYS, "[HBIOS SYSFREE] addr=0x%04X (no-op)\n", cpu->regs.HL.get_pair16());
       break;
     }
 
@@ -1466,11 +1899,11 @@ void HBIOSDispatch::handleSYS() {
           for (int i = 0; i < 16; i++) {
             if (disks[i].is_open) count++;
           }
-          if (debug_log) debug_log("[DIOCNT] md_disks: %d,%d hd_disks: %d total=%d\n",
-                  md_disks[0].is_enabled ? 1 : 0,
-                  md_disks[1].is_enabled ? 1 : 0,
-                  disks[0].is_open ? 1 : 0,
-                  count);
+          EMU_DLOG(LOG_DIO, "[DIOCNT] md_disks: %d,%d hd_disks: %d total=%d\n",
+                   md_disks[0].is_enabled ? 1 : 0,
+                   md_disks[1].is_enabled ? 1 : 0,
+                   disks[0].is_open ? 1 : 0,
+                   count);
           cpu->regs.DE.set_low(count);
           break;
         }
@@ -1495,10 +1928,8 @@ void HBIOSDispatch::handleSYS() {
           // Boot info: D = boot unit, E = boot slice (saved during SYSBOOT)
           cpu->regs.DE.set_high(saved_boot_unit);
           cpu->regs.DE.set_low(saved_boot_slice);
-          if (debug_log) {
-            emu_log("[SYSGET BOOTINFO] Returning D=%d (unit), E=%d (slice)\n",
-                    saved_boot_unit, saved_boot_slice);
-          }
+          EMU_DLOG(LOG_SYS, "[SYSGET BOOTINFO] Returning D=%d (unit), E=%d (slice)\n",
+                   saved_boot_unit, saved_boot_slice);
           break;
 
         case SYSGET_SWITCH:
@@ -1542,9 +1973,7 @@ void HBIOSDispatch::handleSYS() {
           uint8_t app_bank_count = memory->read_bank(0x80, 0x1E1);
           cpu->regs.DE.set_high(app_bank_start);
           cpu->regs.DE.set_low(app_bank_count);
-          if (debug_log) {
-            emu_log("[HBIOS APPBNKS] first=0x%02X count=%d\n", app_bank_start, app_bank_count);
-          }
+          EMU_DLOG(LOG_SYS, "[HBIOS APPBNKS] first=0x%02X count=%d\n", app_bank_start, app_bank_count);
           break;
         }
 
@@ -1595,9 +2024,7 @@ void HBIOSDispatch::handleSYS() {
         byte = memory->fetch_mem(addr);
       }
       cpu->regs.DE.set_low(byte);
-      if (debug_log) {
-        emu_log("[SYSPEEK] bank=0x%02X addr=0x%04X -> 0x%02X\n", bank, addr, byte);
-      }
+      EMU_DLOG(LOG_BANK, "[SYSPEEK] bank=0x%02X addr=0x%04X -> 0x%02X\n", bank, addr, byte);
       break;
     }
 
@@ -1626,15 +2053,11 @@ void HBIOSDispatch::handleSYS() {
           // D = boot unit, E = boot slice, L = bank (always 0)
           saved_boot_unit = cpu->regs.DE.get_high();
           saved_boot_slice = cpu->regs.DE.get_low();
-          if (debug_log) {
-            emu_log("[SYSSET BOOTINFO] unit=%d slice=%d (bank=0x%02X ignored)\n",
-                    saved_boot_unit, saved_boot_slice, cpu->regs.HL.get_low());
-          }
+          EMU_DLOG(LOG_SYS, "[SYSSET BOOTINFO] unit=%d slice=%d (bank=0x%02X ignored)\n",
+                   saved_boot_unit, saved_boot_slice, cpu->regs.HL.get_low());
           break;
         default:
-          if (debug_log) {
-            emu_log("[HBIOS SYSSET] Unhandled subfunction 0x%02X\n", subfunc);
-          }
+          EMU_DLOG(LOG_SYS, "[HBIOS SYSSET] Unhandled subfunction 0x%02X\n", subfunc);
           break;
       }
       break;
@@ -1660,9 +2083,7 @@ void HBIOSDispatch::handleSYS() {
       }
       cmd_str[i] = '\0';
 
-      if (debug_log) {
-        emu_log("[SYSBOOT] Command string: '%s'\n", cmd_str);
-      }
+      EMU_DLOG(LOG_SYS, "[SYSBOOT] Command string: '%s'\n", cmd_str);
 
       // Skip leading whitespace
       char* p = cmd_str;
@@ -1813,6 +2234,7 @@ void HBIOSDispatch::handleVDA() {
         return;  // Don't fall through to doRet()
       }
       int ch = emu_console_read_char();
+      if (ch >= 0) emu_latency_input_consumed();
       cpu->regs.DE.set_low(ch & 0xFF);
       break;
     }
@@ -1824,9 +2246,7 @@ void HBIOSDispatch::handleVDA() {
     }
 
     default:
-      if (debug_log) {
-        emu_log("[HBIOS VDA] Unhandled function 0x%02X\n", func);
-      }
+      EMU_DLOG(LOG_SYS, "[HBIOS VDA] Unhandled function 0x%02X\n", func);
       break;
   }
 
@@ -1901,9 +2321,7 @@ void HBIOSDispatch::handleSND() {
       break;
 
     default:
-      if (debug_log) {
-        emu_log("[HBIOS SND] Unhandled function 0x%02X\n", func);
-      }
+      EMU_DLOG(LOG_SYS, "[HBIOS SND] Unhandled function 0x%02X\n", func);
       break;
   }
 
@@ -1939,9 +2357,7 @@ void HBIOSDispatch::handleDSKY() {
       break;
 
     default:
-      if (debug_log) {
-        emu_log("[HBIOS DSKY] Unhandled function 0x%02X\n", func);
-      }
+      EMU_DLOG(LOG_SYS, "[HBIOS DSKY] Unhandled function 0x%02X\n", func);
       break;
   }
 
@@ -1980,76 +2396,11 @@ void HBIOSDispatch::handleEXT() {
         // Memory disks don't have slices - return LBA 0
         slice_lba = 0;
         media_id = (disk_unit == 0 || (disk_unit >= 0x80 && disk_unit < 0x82)) ? 0x01 : 0x02;
-        if (debug_log) debug_log("[HBIOS EXTSLICE] Memory disk unit 0x%02X, no slices\n", disk_unit);
+        EMU_DLOG(LOG_DIO, "[HBIOS EXTSLICE] Memory disk unit 0x%02X, no slices\n", disk_unit);
       } else if (hd_idx != 0xFF && hd_idx < 16 && disks[hd_idx].is_open) {
         HBDisk& disk = disks[hd_idx];
 
-        // Probe MBR if not yet done
-        if (!disk.partition_probed) {
-          disk.partition_probed = true;
-          disk.partition_base_lba = 0;
-          disk.slice_size = 16640;  // Default: hd512 format
-          disk.is_hd1k = false;
-
-          bool detected_format = false;
-          uint8_t mbr[512];
-          bool mbr_valid = false;
-          size_t disk_size = disk.size;
-
-          // Read MBR - try file-backed first, then in-memory
-          if (disk.file_backed && disk.handle) {
-            // File-backed disk - read MBR via portable I/O
-            size_t read = emu_disk_read((emu_disk_handle)disk.handle, 0, mbr, 512);
-            mbr_valid = (read == 512);
-            if (disk_size == 0) {
-              disk_size = emu_disk_size((emu_disk_handle)disk.handle);
-            }
-          } else if (!disk.data.empty() && disk.data.size() >= 512) {
-            // In-memory disk
-            memcpy(mbr, disk.data.data(), 512);
-            mbr_valid = true;
-            if (disk_size == 0) {
-              disk_size = disk.data.size();
-            }
-          }
-
-          if (mbr_valid) {
-            // Check for valid MBR signature
-            if (mbr[510] == 0x55 && mbr[511] == 0xAA) {
-              // Check partition table for type 0x2E (RomWBW hd1k partition)
-              for (int p = 0; p < 4; p++) {
-                int offset = 0x1BE + (p * 16);
-                uint8_t ptype = mbr[offset + 4];
-                if (ptype == 0x2E) {
-                  // Found RomWBW partition (hd1k format)
-                  uint32_t part_lba = mbr[offset + 8] |
-                                      (mbr[offset + 9] << 8) |
-                                      (mbr[offset + 10] << 16) |
-                                      (mbr[offset + 11] << 24);
-                  disk.partition_base_lba = part_lba;
-                  disk.slice_size = 16384;  // hd1k: 8MB slices
-                  disk.is_hd1k = true;
-                  detected_format = true;
-                  if (debug_log) debug_log("[HBIOS EXTSLICE] Detected hd1k format (0x2E partition), LBA %u\n", part_lba);
-                  break;
-                }
-              }
-            }
-
-            // If no 0x2E partition, check if single-slice hd1k image (exactly 8MB)
-            if (!detected_format && disk_size == 8388608) {
-              disk.partition_base_lba = 0;
-              disk.slice_size = 16384;
-              disk.is_hd1k = true;
-              detected_format = true;
-              if (debug_log) debug_log("[HBIOS EXTSLICE] Detected hd1k format (8MB single slice)\n");
-            }
-
-            if (!detected_format) {
-              if (debug_log) debug_log("[HBIOS EXTSLICE] Using hd512 format (size=%zu)\n", disk_size);
-            }
-          }
-        }
+        probeDiskLayout(disk);
 
         // Check if slice exceeds configured max_slices limit
         if (slice >= disk.max_slices) {
@@ -2097,10 +2448,10 @@ void HBIOSDispatch::handleEXT() {
       }
 
       if (emu_host_file_open_read(path.c_str())) {
-        if (debug_log) debug_log("[HOST] Opened for read: %s\n", path.c_str());
+        EMU_DLOG(LOG_SYS, "[HOST] Opened for read: %s\n", path.c_str());
         result = HBR_SUCCESS;
       } else {
-        if (debug_log) debug_log("[HOST] Failed to open for read: %s\n", path.c_str());
+        EMU_DLOG(LOG_SYS, "[HOST] Failed to open for read: %s\n", path.c_str());
         result = HBR_FAILED;
       }
       break;
@@ -2119,10 +2470,10 @@ void HBIOSDispatch::handleEXT() {
       }
 
       if (emu_host_file_open_write(path.c_str())) {
-        if (debug_log) debug_log("[HOST] Opened for write: %s\n", path.c_str());
+        EMU_DLOG(LOG_SYS, "[HOST] Opened for write: %s\n", path.c_str());
         result = HBR_SUCCESS;
       } else {
-        if (debug_log) debug_log("[HOST] Failed to open for write: %s\n", path.c_str());
+        EMU_DLOG(LOG_SYS, "[HOST] Failed to open for write: %s\n", path.c_str());
         result = HBR_FAILED;
       }
       break;
@@ -2137,6 +2488,7 @@ void HBIOSDispatch::handleEXT() {
       } else {
         cpu->regs.DE.set_low((uint8_t)ch);
         result = HBR_SUCCESS;
+        progress_count++;
       }
       break;
     }
@@ -2148,6 +2500,7 @@ void HBIOSDispatch::handleEXT() {
       uint8_t byte = cpu->regs.DE.get_low();
       if (emu_host_file_write_byte(byte)) {
         result = HBR_SUCCESS;
+        progress_count++;
       } else {
         result = HBR_FAILED;
       }
@@ -2233,6 +2586,90 @@ void HBIOSDispatch::handleEXT() {
       break;
     }
 
+    case HBF_HOST_HOPEN: {
+      // Open a host file on a free handle
+      // Input: C = 0 read, 1 write; DE = address of null-terminated path
+      // Output: A = 0 success (E = handle), A = 0xFF failure
+      uint16_t path_addr = cpu->regs.DE.get_pair16();
+      std::string path;
+      for (int i = 0; i < 256; i++) {
+        uint8_t ch = memory->fetch_mem(path_addr + i);
+        if (ch == 0) break;
+        path += (char)ch;
+      }
+
+      bool write = cpu->regs.BC.get_low() != 0;
+      int handle = emu_host_open(path.c_str(), write);
+      if (handle >= 0) {
+        EMU_DLOG(LOG_SYS, "[HOST] Handle %d opened for %s: %s\n",
+                 handle, write ? "write" : "read", path.c_str());
+        cpu->regs.DE.set_low((uint8_t)handle);
+        result = HBR_SUCCESS;
+      } else {
+        EMU_DLOG(LOG_SYS, "[HOST] Failed to open: %s\n", path.c_str());
+        result = HBR_FAILED;
+      }
+      break;
+    }
+
+    case HBF_HOST_HREAD:
+    case HBF_HOST_HWRITE: {
+      // Move a block between a host file and the caller's memory
+      // Input: C = handle, DE = buffer address, HL = byte count
+      // Output: HL = bytes moved (read: 0 at EOF or bad handle),
+      //         A = 0 success, 0xFF short write
+      int handle = cpu->regs.BC.get_low();
+      uint16_t buf_addr = cpu->regs.DE.get_pair16();
+      size_t count = cpu->regs.HL.get_pair16();
+      uint8_t bank = memory->get_current_bank();
+      std::vector<uint8_t> buf(count);
+      size_t done;
+      if (func == HBF_HOST_HREAD) {
+        done = emu_host_read(handle, buf.data(), count);
+        writeGuest(bank, buf_addr, buf.data(), done);
+      } else {
+        readGuest(bank, buf_addr, buf.data(), count);
+        done = emu_host_write(handle, buf.data(), count);
+      }
+      cpu->regs.HL.set_pair16((uint16_t)done);
+      if (done) progress_count++;
+      if (func == HBF_HOST_HWRITE && done < count) result = HBR_FAILED;
+      break;
+    }
+
+    case HBF_HOST_HCLOSE: {
+      // Close a handle
+      // Input: C = handle
+      // Output: A = 0 success, 0xFF handle not open or final write failed
+      result = emu_host_close(cpu->regs.BC.get_low()) ? HBR_SUCCESS : HBR_FAILED;
+      break;
+    }
+
+    case HBF_HOST_FFIRST:
+    case HBF_HOST_FNEXT: {
+      // Enumerate host files matching a pattern
+      // Input: DE = pattern (FFIRST only), HL = buffer for the path (128 bytes)
+      // Output: A = 0 success (buffer filled), A = 0xFF no (more) matches
+      if (func == HBF_HOST_FFIRST) {
+        uint16_t pat_addr = cpu->regs.DE.get_pair16();
+        std::string pattern;
+        for (int i = 0; i < 256; i++) {
+          uint8_t ch = memory->fetch_mem(pat_addr + i);
+          if (ch == 0) break;
+          pattern += (char)ch;
+        }
+        findHostFiles(pattern);
+      }
+      if (host_find_pos >= host_find_paths.size()) {
+        result = HBR_FAILED;
+        break;
+      }
+      const std::string& path = host_find_paths[host_find_pos++];
+      writeGuest(memory->get_current_bank(), cpu->regs.HL.get_pair16(),
+                 (const uint8_t*)path.c_str(), path.size() + 1);
+      break;
+    }
+
     default:
       emu_log("[HBIOS EXT] Unhandled function 0x%02X\n", func);
       result = HBR_NOFUNC;
@@ -2243,6 +2680,249 @@ void HBIOSDispatch::handleEXT() {
   doRet();
 }
 
+// Match a host file name against a pattern with * and ?, ignoring case
+// (CP/M upper-cases the command line)
+static bool host_name_match(const char* pat, const char* name) {
+  for (; *pat; pat++, name++) {
+    if (*pat == '*') {
+      for (const char* rest = name; ; rest++) {
+        if (host_name_match(pat + 1, rest)) return true;
+        if (!*rest) return false;
+      }
+    }
+    if (!*name) return false;
+    if (*pat != '?' && tolower((unsigned char)*pat) != tolower((unsigned char)*name)) return false;
+  }
+  return *name == 0;
+}
+
+void HBIOSDispatch::findHostFiles(const std::string& pattern) {
+  // Maximum path length HOST_FFIRST/FNEXT return, with the NUL
+  static const size_t HOST_PATH_MAX = 128;
+
+  host_find_paths.clear();
+  host_find_pos = 0;
+
+  // Split into directory prefix (with its trailing /) and name pattern
+  size_t slash = pattern.find_last_of('/');
+  std::string prefix = slash == std::string::npos ? "" : pattern.substr(0, slash + 1);
+  std::string name = pattern.substr(prefix.size());
+  auto dir_of = [](const std::string& p) {
+    return p.size() <= 1 ? p : p.substr(0, p.size() - 1);
+  };
+
+  std::vector<std::string> names;
+  if (!emu_host_list_dir(dir_of(prefix), names)) {
+    // A directory typed at the CCP arrives upper-cased; try it in lower case
+    for (char& c : prefix) c = tolower((unsigned char)c);
+    if (!emu_host_list_dir(dir_of(prefix), names)) return;
+  }
+
+  for (const std::string& n : names) {
+    if (!host_name_match(name.c_str(), n.c_str())) continue;
+    if (prefix.size() + n.size() >= HOST_PATH_MAX) continue;
+    host_find_paths.push_back(prefix + n);
+  }
+  std::sort(host_find_paths.begin(), host_find_paths.end());
+  EMU_DLOG(LOG_SYS, "[HOST] %zu files match %s\n", host_find_paths.size(), pattern.c_str());
+}
+
+//=============================================================================
+// Host Compute Services (HCS) - EMU extension 0xE8-0xEF
+//=============================================================================
+
+// Time base for HCS_TIMER and HCS_CLOCK
+static const std::chrono::steady_clock::time_point hcs_epoch =
+    std::chrono::steady_clock::now();
+
+void HBIOSDispatch::readGuest(uint8_t bank, uint16_t addr, uint8_t* out, size_t len) {
+  while (len > 0) {
+    uint8_t b = bank;
+    uint16_t offset = addr;
+    size_t chunk;
+    if (addr >= 0x8000) {
+      b = banked_mem::COMMON_BANK;
+      offset = addr - 0x8000;
+      chunk = 0x10000 - addr;
+    } else {
+      chunk = 0x8000 - addr;
+    }
+    if (chunk > len) chunk = len;
+
+    const uint8_t* src = memory->bank_span(b, offset, false);
+    if (src) memcpy(out, src, chunk);
+    else memset(out, 0xFF, chunk);
+
+    out += chunk;
+    len -= chunk;
+    addr += chunk;
+  }
+}
+
+void HBIOSDispatch::writeGuest(uint8_t bank, uint16_t addr, const uint8_t* in, size_t len) {
+  while (len > 0) {
+    uint8_t b = bank;
+    uint16_t offset = addr;
+    size_t chunk;
+    if (addr >= 0x8000) {
+      b = banked_mem::COMMON_BANK;
+      offset = addr - 0x8000;
+      chunk = 0x10000 - addr;
+    } else {
+      chunk = 0x8000 - addr;
+    }
+    if (chunk > len) chunk = len;
+
+    uint8_t* dst = memory->bank_span(b, offset, true);
+    if (dst) memcpy(dst, in, chunk);  // ROM writes ignored
+
+    in += chunk;
+    len -= chunk;
+    addr += chunk;
+  }
+}
+
+void HBIOSDispatch::handleHCS() {
+  if (!cpu || !memory) return;
+
+  uint8_t func = cpu->regs.BC.get_high();
+  uint8_t result = HBR_SUCCESS;
+
+  // Parameter block (in the caller's address space)
+  uint16_t blk = cpu->regs.HL.get_pair16();
+  auto p8 = [&](int off) -> uint8_t { return memory->fetch_mem(blk + off); };
+  auto p16 = [&](int off) -> uint16_t { return p8(off) | (p8(off + 1) << 8); };
+
+  switch (func) {
+    case HBF_HCS_MOVE: {
+      // Block: +0 src bank, +1 src addr, +3 dst bank, +4 dst addr, +6 count
+      // Overlapping ranges are handled like memmove
+      uint8_t src_bank = p8(0);
+      uint16_t src = p16(1);
+      uint8_t dst_bank = p8(3);
+      uint16_t dst = p16(4);
+      uint16_t count = p16(6);
+      std::vector<uint8_t> buf(count);
+      readGuest(src_bank, src, buf.data(), count);
+      writeGuest(dst_bank, dst, buf.data(), count);
+      break;
+    }
+
+    case HBF_HCS_FILL: {
+      // Block: +0 bank, +1 addr, +3 count; E = fill byte
+      std::vector<uint8_t> buf(p16(3), cpu->regs.DE.get_low());
+      writeGuest(p8(0), p16(1), buf.data(), buf.size());
+      break;
+    }
+
+    case HBF_HCS_CRC: {
+      // Block: +0 bank, +1 addr, +3 count, +5 running CRC (32-bit, updated)
+      // C = 0 CRC-16/XMODEM, 1 CRC-32. Output: DE:HL = CRC
+      uint8_t kind = cpu->regs.BC.get_low();
+      if (kind > 1) {
+        result = HBR_RANGE;
+        break;
+      }
+      std::vector<uint8_t> buf(p16(3));
+      readGuest(p8(0), p16(1), buf.data(), buf.size());
+      uint32_t crc = p16(5) | ((uint32_t)p16(7) << 16);
+      if (kind == 0) crc = hc_crc16_xmodem(crc, buf.data(), buf.size());
+      else crc = hc_crc32(crc, buf.data(), buf.size());
+      for (int i = 0; i < 4; i++) {
+        memory->store_mem(blk + 5 + i, (crc >> (8 * i)) & 0xFF);
+      }
+      cpu->regs.DE.set_pair16(crc >> 16);
+      cpu->regs.HL.set_pair16(crc & 0xFFFF);
+      break;
+    }
+
+    case HBF_HCS_UNLZ: {
+      // Block: +0 src bank, +1 src addr, +3 src length,
+      //        +5 dst bank, +6 dst addr, +8 dst capacity
+      // Output: HL = decompressed length (A = HBR_RANGE if corrupt or too big)
+      std::vector<uint8_t> src(p16(3));
+      std::vector<uint8_t> dst(p16(8));
+      readGuest(p8(0), p16(1), src.data(), src.size());
+      long len = hc_lz4_decompress(src.data(), src.size(), dst.data(), dst.size());
+      if (len < 0) {
+        cpu->regs.HL.set_pair16(0);
+        result = HBR_RANGE;
+        break;
+      }
+      writeGuest(p8(5), p16(6), dst.data(), len);
+      cpu->regs.HL.set_pair16(len);
+      break;
+    }
+
+    case HBF_HCS_SORT: {
+      // Block: +0 bank, +1 addr, +3 record count, +5 record size,
+      //        +6 key offset, +7 key length (0 = rest of record),
+      //        +8 flags (bit 0 = descending)
+      uint16_t count = p16(3);
+      uint8_t rec_size = p8(5);
+      uint8_t key_off = p8(6);
+      uint8_t key_len = p8(7);
+      bool descending = p8(8) & 0x01;
+      if (key_len == 0) key_len = rec_size - key_off;
+      if (rec_size == 0 || key_off + key_len > rec_size ||
+          (uint32_t)count * rec_size > 0x10000) {
+        result = HBR_RANGE;
+        break;
+      }
+      std::vector<uint8_t> buf((size_t)count * rec_size);
+      readGuest(p8(0), p16(1), buf.data(), buf.size());
+      hc_sort_records(buf.data(), count, rec_size, key_off, key_len, descending);
+      writeGuest(p8(0), p16(1), buf.data(), buf.size());
+      break;
+    }
+
+    case HBF_HCS_TIMER: {
+      // C = 0: DE:HL = microseconds, C = 1: DE:HL = milliseconds
+      // (host monotonic clock since emulator start, 32-bit wrap)
+      auto elapsed = std::chrono::steady_clock::now() - hcs_epoch;
+      uint64_t ticks;
+      if (cpu->regs.BC.get_low() == 0) {
+        ticks = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+      } else {
+        ticks = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+      }
+      cpu->regs.DE.set_pair16((ticks >> 16) & 0xFFFF);
+      cpu->regs.HL.set_pair16(ticks & 0xFFFF);
+      break;
+    }
+
+    case HBF_HCS_CLOCK: {
+      // Block: +0 host nanoseconds since emulator start, +8 T-states
+      // executed (both 64-bit). Read together so a guest benchmark can
+      // compare host time against emulated time for the same interval.
+      uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now() - hcs_epoch).count();
+      uint64_t tstates = cpu->cycles;
+      for (int i = 0; i < 8; i++) {
+        memory->store_mem(blk + i, (ns >> (8 * i)) & 0xFF);
+        memory->store_mem(blk + 8 + i, (tstates >> (8 * i)) & 0xFF);
+      }
+      break;
+    }
+
+    case HBF_HCS_INFO:
+      // D = version, HL = bitmap of services (bit n = function 0xE8+n)
+      cpu->regs.DE.set_high(2);
+      cpu->regs.HL.set_pair16(0x00FF);
+      break;
+
+    default:
+      emu_log("[HBIOS HCS] Unhandled function 0x%02X\n", func);
+      result = HBR_NOFUNC;
+      break;
+  }
+
+  EMU_DLOG(LOG_SYS, "[HCS] func=0x%02X block=0x%04X result=0x%02X\n", func, blk, result);
+
+  setResult(result);
+  doRet();
+}
+
 //=============================================================================
 // Boot Helper
 //=============================================================================
@@ -2274,10 +2954,8 @@ bool HBIOSDispatch::bootFromDevice(const char* cmd_str) {
       uint16_t end_addr = app_data[0x5EC] | (app_data[0x5ED] << 8);
       uint16_t entry_addr = app_data[0x5EE] | (app_data[0x5EF] << 8);
 
-      if (debug_log) {
-        emu_log("[SYSBOOT] ROM app load: 0x%04X-0x%04X entry: 0x%04X\n",
-                load_addr, end_addr, entry_addr);
-      }
+      EMU_DLOG(LOG_SYS, "[SYSBOOT] ROM app load: 0x%04X-0x%04X entry: 0x%04X\n",
+               load_addr, end_addr, entry_addr);
 
       // Load sectors starting from sector 3 (offset 0x600)
       size_t load_size = end_addr - load_addr;
@@ -2319,11 +2997,12 @@ bool HBIOSDispatch::bootFromDevice(const char* cmd_str) {
     emu_fatal("[SYSBOOT] Invalid disk unit %d (is_open=%d)\n", boot_unit,
               (boot_unit >= 0 && boot_unit < 16) ? disks[boot_unit].is_open : -1);
   }
-
-  if (debug_log) {
-    emu_log("[SYSBOOT] Booting from disk %d slice %d\n", boot_unit, boot_slice);
+  if (disks[boot_unit].ram_backed) {
+    emu_fatal("[SYSBOOT] Disk unit %d is a host RAM disk and holds no system\n", boot_unit);
   }
 
+  EMU_DLOG(LOG_SYS, "[SYSBOOT] Booting from disk %d slice %d\n", boot_unit, boot_slice);
+
   // Save boot info for SYSGET_BOOTINFO
   saved_boot_unit = boot_unit;
   saved_boot_slice = boot_slice;
@@ -2351,10 +3030,8 @@ bool HBIOSDispatch::bootFromDevice(const char* cmd_str) {
   uint16_t end_addr = meta_buf[28] | (meta_buf[29] << 8);
   uint16_t entry_addr = meta_buf[30] | (meta_buf[31] << 8);
 
-  if (debug_log) {
-    emu_log("[SYSBOOT] Load: 0x%04X-0x%04X Entry: 0x%04X\n",
-            load_addr, end_addr, entry_addr);
-  }
+  EMU_DLOG(LOG_SYS, "[SYSBOOT] Load: 0x%04X-0x%04X Entry: 0x%04X\n",
+           load_addr, end_addr, entry_addr);
 
   // Load sectors starting from sector 3 (offset 0x600)
   size_t load_size = end_addr - load_addr;
@@ -2381,10 +3058,8 @@ bool HBIOSDispatch::bootFromDevice(const char* cmd_str) {
     }
   }
 
-  if (debug_log) {
-    emu_log("[SYSBOOT] Loaded %d bytes, jumping to 0x%04X\n",
-            (int)(addr - load_addr), entry_addr);
-  }
+  EMU_DLOG(LOG_SYS, "[SYSBOOT] Loaded %d bytes, jumping to 0x%04X\n",
+           (int)(addr - load_addr), entry_addr);
 
   // Set up boot registers
   cpu->regs.DE.set_high(boot_unit);
@@ -126,6 +126,15 @@ enum HBiosFunc {
   HBF_SNDDEVICE = 0x57,  // Sound device info request
   HBF_SNDBEEP   = 0x58,  // Play beep sound
 
+  // Host File Handles - 0xD8-0xDD (EMU custom extension, dispatched with EXT)
+  // Buffers are in the caller's memory view; names are NUL-terminated.
+  HBF_HOST_HOPEN  = 0xD8,  // Open handle (C=0 read, C=1 write; DE=path; returns E=handle)
+  HBF_HOST_HREAD  = 0xD9,  // Read block (C=handle, DE=buf, HL=count; returns HL=bytes, 0 at EOF)
+  HBF_HOST_HWRITE = 0xDA,  // Write block (C=handle, DE=buf, HL=count; returns HL=bytes)
+  HBF_HOST_HCLOSE = 0xDB,  // Close handle (C=handle)
+  HBF_HOST_FFIRST = 0xDC,  // Find first host file matching DE=pattern (* and ?), path to HL
+  HBF_HOST_FNEXT  = 0xDD,  // Find next match, path to HL (A=0xFF when none left)
+
   // Extension Functions - 0xE0-0xE7
   HBF_EXT       = 0xE0,
   HBF_EXTSLICE  = 0xE0,  // Slice calculation
@@ -139,6 +148,19 @@ enum HBiosFunc {
   HBF_HOST_MODE   = 0xE6,  // Get/set mode (C=0 get, C=1 set; E=mode)
   HBF_HOST_GETARG = 0xE7,  // Get cmd arg by index (E=index, DE=buf addr)
 
+  // Host Compute Services - 0xE8-0xEF (EMU custom extension)
+  // HL points to a parameter block; buffers are (bank, address) pairs where
+  // addresses 0x8000-0xFFFF always refer to the common bank.
+  HBF_HCS         = 0xE8,
+  HBF_HCS_MOVE    = 0xE8,  // Bank memmove (HL=block: sbnk,src,dbnk,dst,count)
+  HBF_HCS_FILL    = 0xE9,  // Bank memset (HL=block: bnk,addr,count; E=byte)
+  HBF_HCS_CRC     = 0xEA,  // CRC (C=0 CRC-16/XMODEM, C=1 CRC-32; HL=block: bnk,addr,count,crc32)
+  HBF_HCS_UNLZ    = 0xEB,  // LZ4 block decompress (HL=block: sbnk,src,slen,dbnk,dst,dmax)
+  HBF_HCS_SORT    = 0xEC,  // Sort records (HL=block: bnk,addr,count,recsz,keyoff,keylen,flags)
+  HBF_HCS_TIMER   = 0xED,  // Host timer (C=0 microseconds, C=1 milliseconds in DE:HL)
+  HBF_HCS_CLOCK   = 0xEE,  // Benchmark clock (HL=block: host ns, T-states, 64-bit each)
+  HBF_HCS_INFO    = 0xEF,  // Services present (D=version, HL=bitmap of 0xE8+n)
+
   // System Functions - 0xF0-0xFC
   HBF_SYS       = 0xF0,
   HBF_SYSRESET  = 0xF0,  // Soft reset HBIOS
@@ -255,6 +277,8 @@ struct HBDisk {
   std::vector<uint8_t> data;  // For in-memory disks
   void* handle = nullptr;     // For file-backed disks (emu_disk_handle)
   bool file_backed = false;
+  bool ram_backed = false;    // Host RAM disk (createRamDisk)
+  std::vector<std::vector<uint8_t>> ram_chunks;  // RAM_CHUNK bytes each, empty until written
   size_t size = 0;
   uint32_t current_lba = 0;   // Current LBA position (set by DIOSEEK)
   int max_slices = 8;         // Max slices to expose (configurable via --disk0=file:N)
@@ -264,6 +288,8 @@ struct HBDisk {
   uint32_t partition_base_lba = 0;   // Start of RomWBW partition (2048 for hd1k, 0 for hd512)
   uint32_t slice_size = 16640;       // Sectors per slice (16384 for hd1k, 16640 for hd512)
   bool is_hd1k = false;              // True for hd1k format (MID_HDNEW=10), false for hd512 (MID_HD=4)
+
+  static constexpr size_t RAM_CHUNK = 64 * 1024;
 };
 
 //=============================================================================
@@ -284,10 +310,10 @@ struct HBRomApp {
 // Forward declarations for memory/CPU interfaces
 class qkz80;
 class banked_mem;
+class StateWriter;
+class StateReader;
 
-// Debug log function pointer type - set to enable debug logging
-// When non-null, called with printf-style arguments for debug output
-// Platforms provide their own implementation (emu_log, NSLog wrapper, etc.)
+// Debug log function for setDebugLog, printf-style
 typedef void (*DebugLogFn)(const char* fmt, ...);
 
 class HBIOSDispatch {
@@ -298,28 +324,49 @@ public:
   // Initialize/reset state
   void reset();
 
+  // Checkpoint dispatcher state, disk positions and pending console I/O
+  // (emu_checkpoint.h). File-backed disks are flushed and stored by path;
+  // on load they are reopened unless already attached from that path.
+  // Open host transfer files are not part of the checkpoint.
+  void saveState(StateWriter& w);
+  bool loadState(StateReader& r);
+
   // Set CPU and memory references (must be called before use)
   void setCPU(qkz80* cpu) { this->cpu = cpu; }
   void setMemory(banked_mem* mem) { this->memory = mem; }
 
-  // Debug output - set function pointer to enable, nullptr to disable
-  // Example: hbios.setDebugLog(emu_log);  // use emu_log for debug output
-  void setDebugLog(DebugLogFn fn) { debug_log = fn; }
-  DebugLogFn getDebugLog() const { return debug_log; }
-
-  // Legacy interface - calls setDebugLog with emu_log or nullptr
+  // Debug output goes through emu_logger.h (subsystems DIO, CIO, SYS and
+  // BANK). setDebug sets all four to debug level, or back to errors only.
   void setDebug(bool enable);
-  bool getDebug() const { return debug_log != nullptr; }
+  bool getDebug() const;
+
+  // Older hook, kept for ports: setDebug(fn != nullptr), with the logger's
+  // formatted output going to fn (emu_logger_set_sink). The logger is
+  // process-wide, so this affects every HBIOSDispatch.
+  void setDebugLog(DebugLogFn fn);
+  DebugLogFn getDebugLog() const;
   bool getBootInProgress() const { return boot_in_progress; }
 
   // Disk management
   bool loadDisk(int unit, const uint8_t* data, size_t size);
+  // Opens path (read-write, else read-only) before releasing the unit;
+  // false, with the unit unchanged, if it cannot be opened
   bool loadDiskFromFile(int unit, const std::string& path);
+  // Scratch disk held in host memory, never stored: hd512 slices that read
+  // as freshly formatted until written
+  static constexpr size_t RAM_DISK_SLICE = 16640 * 512;
+  bool createRamDisk(int unit, int slices);
   void closeDisk(int unit);
   void closeAllDisks();  // Close all disks (call before reconfiguring)
   bool isDiskLoaded(int unit) const;
   const HBDisk& getDisk(int unit) const;
+
+  // Raw 512-byte block access for device emulations below HBIOS (SIMH
+  // HDSK); return the number of whole blocks transferred
+  int readDiskBlocks(int unit, uint32_t lba, uint8_t* buf, int count);
+  int writeDiskBlocks(int unit, uint32_t lba, const uint8_t* buf, int count);
   void setDiskSliceCount(int unit, int slices);  // Set max slices for a disk (1-8)
+                                                 // and prefetch their directories
 
   // Memory disk initialization (call after ROM is loaded)
   void initMemoryDisks();
@@ -338,13 +385,27 @@ public:
 
   // Signal port handler (port 0xEE)
   // Supports two protocols:
-  // 1. Simple status: 0x01=starting, 0xFE=preinit, 0xFF=init complete
+  // 1. Simple status: 0x01=starting, 0x03=console ring offered,
+  //    0xFE=preinit, 0xFF=init complete
   // 2. Address registration: state machine for per-handler dispatch addresses
   void handleSignalPort(uint8_t value);
 
   // Get handler type from function code in B register
-  // Returns: 0=CIO, 1=DIO, 2=RTC, 3=SYS, 4=VDA, 5=SND, -1=unknown
+  // Returns: 0=CIO, 1=DIO, 2=RTC, 3=SYS, 4=VDA, 5=SND, 6=DSKY, 7=EXT,
+  // 8=HCS, -1=unknown
   static int getTrapTypeFromFunc(uint8_t func);
+  static constexpr int NUM_TRAP_TYPES = 9;
+
+  // Calls dispatched per handler type (indexed like getTrapTypeFromFunc)
+  const uint64_t* getCallCounts() const { return call_counts; }
+
+  // Calls that moved data: console bytes in or out, disk transfers, host
+  // file reads and writes that moved bytes, and the block host compute
+  // calls; SIMH console bytes and HDSK transfers count too (status polls,
+  // opens, timer and info reads and the like do not). Read by the watchdog
+  // (emu_watchdog.h).
+  uint64_t getProgressCount() const { return progress_count; }
+  void countProgress() { progress_count++; }  // For SimhDevices
 
   // Handle HBIOS call - dispatches based on function code in B register
   bool handleMainEntry();
@@ -365,6 +426,33 @@ public:
   bool isWaitingForInput() const { return waiting_for_input; }
   void clearWaitingForInput() { waiting_for_input = false; }
 
+  // True while the guest spins on CIOIST with no input (the boot menu
+  // waits this way rather than in CIOIN): IDLE_STATUS_POLLS empty polls
+  // in a row, each within STATUS_POLL_GAP T-states of the last, with no
+  // other CIO call between. Same rule as the SIMH console status port.
+  static constexpr unsigned IDLE_STATUS_POLLS = 1000;
+  static constexpr uint64_t STATUS_POLL_GAP = 4096;
+  bool isPollingForInput() const { return status_polls == IDLE_STATUS_POLLS; }
+
+  // Interrupt-driven console input (see emu_hbios.asm HBX_INT)
+  // When enabled and the ROM offers its console ring (signal 0x03), the
+  // emulator raises an interrupt whenever host input is pending and the
+  // guest answers CIOIST/CIOIN from the ring without trapping.
+  void setConsoleInterrupts(bool enable) { console_int_enabled = enable; }
+  bool getConsoleInterrupts() const { return console_int_enabled; }
+  bool isConsoleRingActive() const { return console_ring_active; }
+
+  // True if the caller should raise a maskable interrupt for console input
+  // (ring active, host input pending, and room in the guest ring)
+  bool consoleInterruptPending();
+
+  // Data bus byte for the console interrupt (IM2 vector low byte)
+  static constexpr uint8_t CONSOLE_INT_VECTOR = 0xD4;
+
+  // Console ports read by the guest interrupt handler
+  uint8_t handleConsoleStatusPort();  // Port 0xEA: non-zero if input pending
+  uint8_t handleConsoleDataPort();    // Port 0xEB: next input character
+
   //==========================================================================
   // State Machine I/O Interface
   // The emulator is a pure state machine. Instead of calling external functions,
@@ -415,6 +503,19 @@ public:
   using ResetCallback = std::function<void(uint8_t reset_type)>;
   void setResetCallback(ResetCallback cb) { reset_callback = cb; }
 
+  // Set idle callback, called when CIOIN is about to block for console
+  // input (blocking mode only). It may wait for input itself, e.g. to
+  // hibernate the session; CIOIN then reads the character as usual.
+  using IdleCallback = std::function<void()>;
+  void setIdleCallback(IdleCallback cb) { idle_callback = cb; }
+
+  // VDA geometry, cursor and current attribute
+  void getVDAState(int& rows, int& cols, int& row, int& col, uint8_t& attr) const {
+    rows = vda_rows; cols = vda_cols;
+    row = vda_cursor_row; col = vda_cursor_col;
+    attr = vda_attr;
+  }
+
   // Main entry point address (default 0xFFF0)
   void setMainEntry(uint16_t addr) { main_entry = addr; }
   uint16_t getMainEntry() const { return main_entry; }
@@ -428,12 +529,12 @@ public:
   void handleSND();   // Sound
   void handleDSKY();  // Display/Keypad
   void handleEXT();   // Extension functions (slice calc)
+  void handleHCS();   // Host compute services
 
 private:
   // CPU and memory references (not owned)
   qkz80* cpu = nullptr;
   banked_mem* memory = nullptr;
-  DebugLogFn debug_log = nullptr;  // Debug function pointer (null = disabled)
 
   // State machine
   HBIOSState emu_state = HBIOS_RUNNING;
@@ -443,14 +544,28 @@ private:
   // Dispatch control
   bool trapping_enabled = false;
   bool waiting_for_input = false;  // Set when CIOIN/VDAKRD needs input
+  unsigned status_polls = 0;       // Dense empty CIOIST calls (isPollingForInput)
+  uint64_t last_status_poll = 0;   // Cycle count at the last one
   bool skip_ret = false;           // Skip synthetic RET (for I/O port dispatch)
   bool blocking_allowed = true;    // Can we block for I/O? (false for web/WASM)
   uint16_t main_entry = 0xFFF0;    // Main HBIOS entry point
+  uint64_t call_counts[NUM_TRAP_TYPES] = {};
+  uint64_t progress_count = 0;
 
   // Signal port state machine
   uint8_t signal_state = 0;
   uint16_t signal_addr = 0;
 
+  // Interrupt-driven console input
+  bool console_int_enabled = false;  // Requested by the platform
+  bool console_ring_active = false;  // ROM offered its ring and we accepted
+
+  // Console ring layout in the common bank proxy (emu_hbios.asm HBX_CON*)
+  static constexpr uint16_t CONRING_INT = 0xFFD0;
+  static constexpr uint16_t CONRING_HEAD = 0xFFD1;
+  static constexpr uint16_t CONRING_TAIL = 0xFFD2;
+  static constexpr uint8_t CONRING_MASK = 0x0F;
+
   // Bank for PEEK/POKE
   uint8_t cur_bank = 0;
 
@@ -483,10 +598,15 @@ private:
   // File handles are now managed by emu_io abstraction
   uint8_t host_transfer_mode = 0;   // 0=auto, 1=text, 2=binary
   std::string host_cmd_line;        // Original command line for GETARG
+  std::vector<std::string> host_find_paths;  // HOST_FFIRST matches, sorted
+  size_t host_find_pos = 0;         // Next match for HOST_FNEXT
 
   // Reset callback for SYSRESET
   ResetCallback reset_callback = nullptr;
 
+  // Idle callback for blocking CIOIN
+  IdleCallback idle_callback = nullptr;
+
   // Boot info (saved during SYSBOOT, returned by SYSGET_BOOTINFO)
   int saved_boot_unit = 0;
   int saved_boot_slice = 0;
@@ -507,6 +627,22 @@ private:
   // Helper: perform RET instruction (pop PC from stack)
   void doRet();
 
+  // Helpers: copy between a host buffer and guest (bank, address) memory,
+  // 0x8000-0xFFFF mapping to the common bank (as in SYSBNKCPY)
+  void readGuest(uint8_t bank, uint16_t addr, uint8_t* out, size_t len);
+  void writeGuest(uint8_t bank, uint16_t addr, const uint8_t* in, size_t len);
+
+  // Helper: list the host files matching a HOST_FFIRST pattern
+  void findHostFiles(const std::string& pattern);
+
+  // Helpers: detect a disk's slice layout (once), and read the directory
+  // areas of its slices ahead (setDiskSliceCount)
+  void probeDiskLayout(HBDisk& disk);
+  void prefetchDirectories(int unit);
+
+  // Helper: save the boot traces of the attached disks (emu_disk_end_boot_trace)
+  void endBootTraces();
+
   // Helper: write string to console
   void writeConsoleString(const char* str);
 
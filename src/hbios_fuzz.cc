@@ -0,0 +1,320 @@
+/*
+ * HBIOS Fuzz Harness - Snapshot-reset fuzzing of HBIOS handlers and guests
+ *
+ * libFuzzer entry points (LLVMFuzzerInitialize/LLVMFuzzerTestOneInput).
+ * The machine is booted once to the CP/M prompt and snapshotted; each input
+ * then starts from that snapshot. Memory is rolled back by copying only the
+ * pages the previous input dirtied (banked_mem::snapshot_restore), and the
+ * CPU and HBIOS state from their checkpoint blobs, so a reset costs a few
+ * microseconds rather than a process start and a boot.
+ *
+ * Input layout: byte 0 selects the mode, the rest is mode specific.
+ *   0  HBIOS calls: byte 1 = call count (1-8), then 7 bytes per call
+ *      (function selector, C, D, E, H, L, A); what follows is copied to
+ *      FUZZ_BUFFER first so calls that take a buffer address see it.
+ *      Only DIO, SYS and EXT functions are called, excluding SYSBOOT and
+ *      the host file functions, which reach the host filesystem.
+ *   1  Console input: the rest is typed at the prompt, then the guest runs
+ *      for at most ROMWBW_FUZZ_STEPS instructions.
+ *   2  Disk sector: bytes 1-2 = LBA, then 512 bytes written to the RAM
+ *      disk (MD0) through DIOSEEK/DIOWRITE; the rest is typed at the prompt
+ *      as in mode 1, so the guest reads the damaged disk.
+ *
+ * Environment:
+ *   ROMWBW_FUZZ_ROM    ROM image (default roms/emu_avw.rom)
+ *   ROMWBW_FUZZ_CORE   "lazy" for the in-tree core, else qkz80
+ *   ROMWBW_FUZZ_BOOT   boot menu input (default "C\r")
+ *   ROMWBW_FUZZ_STEPS  instruction budget per input (default 100000)
+ *   ROMWBW_FUZZ_ECHO   set to copy guest output to stderr
+ *
+ * Build with "make romwbw_fuzz" (clang, libFuzzer). "make romwbw_fuzz_replay"
+ * builds a standalone binary that runs the given inputs instead, for
+ * replaying crashes under a debugger and for timing resets.
+ */
+
+#include "hbios_cpu.h"
+#include "emu_checkpoint.h"
+#include "emu_init.h"
+#include "emu_io.h"
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+namespace {
+
+const uint16_t FUZZ_BUFFER = 0x9000;  // Common area, above the TPA programs
+const size_t FUZZ_BUFFER_MAX = 0x1000;
+const size_t SECTOR_SIZE = 512;
+const int BOOT_STEP_LIMIT = 50000000;
+
+// HBIOS functions a fuzzed call may select
+const uint8_t fuzz_functions[] = {
+  // DIO
+  0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1A, 0x1B,
+  // SYS (not SYSBOOT, which loads host files)
+  0xF0, 0xF1, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8, 0xF9, 0xFA, 0xFB, 0xFC,
+  // EXT (EXTSLICE; the rest are host file functions)
+  0xE0,
+};
+
+struct FuzzMachine : public HBIOSCPUDelegate {
+  banked_mem memory;
+  hbios_cpu cpu;
+  HBIOSDispatch hbios;
+
+  bool halted = false;
+  bool echo = false;
+  long steps = 100000;
+  uint16_t initialized_ram_banks = 0;
+
+  // Base snapshot (memory keeps its own)
+  std::vector<uint8_t> base_cpu;
+  std::vector<uint8_t> base_hbios;
+  uint16_t base_ram_banks = 0;
+
+  unsigned long resets = 0;
+  unsigned long pages_restored = 0;
+
+  FuzzMachine() : cpu(&memory, this) {
+    memory.enable_banking();
+    hbios.setCPU(&cpu);
+    hbios.setMemory(&memory);
+    hbios.setBlockingAllowed(false);  // Inputs must not wait for the host
+  }
+
+  banked_mem* getMemory() override { return &memory; }
+  HBIOSDispatch* getHBIOS() override { return &hbios; }
+
+  void initializeRamBankIfNeeded(uint8_t bank) override {
+    emu_init_ram_bank(&memory, bank, &initialized_ram_banks);
+  }
+  void onHalt() override { halted = true; }
+  void onUnimplementedOpcode(uint8_t, uint16_t) override { halted = true; }
+  void logDebug(const char*, ...) override {}
+
+  void drainOutput() {
+    if (!hbios.hasOutputChars()) return;
+    std::vector<uint8_t> out = hbios.getOutputChars();
+    if (echo) fwrite(out.data(), 1, out.size(), stderr);
+  }
+
+  // Run until the guest waits for input with none queued, halts, or the
+  // budget runs out
+  void run(long budget) {
+    for (long i = 0; i < budget && !halted; i++) {
+      if (hbios.isWaitingForInput()) {
+        if (!emu_console_has_input()) break;
+        hbios.clearWaitingForInput();
+      }
+      cpu.step();
+      if ((i & 0xFFF) == 0) drainOutput();
+    }
+    drainOutput();
+  }
+
+  void type(const uint8_t* data, size_t len) {
+    for (size_t i = 0; i < len; i++) emu_console_queue_char(data[i]);
+  }
+
+  void takeSnapshot() {
+    StateWriter c;
+    cpu.save_state(c);
+    base_cpu = c.data();
+    StateWriter h;
+    hbios.saveState(h);
+    base_hbios = h.data();
+    base_ram_banks = initialized_ram_banks;
+    memory.snapshot_take();
+  }
+
+  void reset() {
+    pages_restored += memory.snapshot_restore();
+    StateReader c(base_cpu.data(), base_cpu.size());
+    StateReader h(base_hbios.data(), base_hbios.size());
+    if (!cpu.load_state(c) || !hbios.loadState(h)) {
+      emu_fatal("[FUZZ] Base snapshot does not restore");
+    }
+    initialized_ram_banks = base_ram_banks;
+    halted = false;
+    std::vector<int> pending;
+    emu_console_take_pending(pending);
+    resets++;
+  }
+
+  void copyToBuffer(const uint8_t* data, size_t len) {
+    if (len > FUZZ_BUFFER_MAX) len = FUZZ_BUFFER_MAX;
+    for (size_t i = 0; i < len; i++) memory.store_mem(FUZZ_BUFFER + i, data[i]);
+  }
+
+  void call(uint8_t b, uint8_t c, uint16_t de, uint16_t hl, uint8_t a) {
+    cpu.regs.BC.set_pair16((b << 8) | c);
+    cpu.regs.DE.set_pair16(de);
+    cpu.regs.HL.set_pair16(hl);
+    cpu.regs.AF.set_high(a);
+    hbios.handlePortDispatch();
+  }
+
+  void fuzzCalls(const uint8_t* data, size_t len) {
+    if (len < 1) return;
+    size_t count = (data[0] & 7) + 1;
+    data++, len--;
+    size_t records = count * 7 <= len ? count * 7 : len - len % 7;
+    copyToBuffer(data + records, len - records);
+    // Calls run with the guest's stack and bank, as from the proxy
+    cpu.sync_flags();
+    for (size_t i = 0; i + 7 <= records; i += 7) {
+      const uint8_t* r = data + i;
+      uint8_t func = fuzz_functions[r[0] % sizeof(fuzz_functions)];
+      call(func, r[1], (r[2] << 8) | r[3], (r[4] << 8) | r[5], r[6]);
+      drainOutput();
+    }
+  }
+
+  void fuzzSector(const uint8_t* data, size_t len) {
+    if (len < 2 + SECTOR_SIZE) return;
+    uint16_t lba = data[0] | (data[1] << 8);
+    copyToBuffer(data + 2, SECTOR_SIZE);
+    cpu.sync_flags();
+    call(0x12, 0x00, 0x8000, lba, 0);                  // DIOSEEK MD0, LBA mode
+    call(0x14, 0x00, 0x8F01, FUZZ_BUFFER, 0);          // DIOWRITE 1 block from common
+    restoreCpu();
+    type(data + 2 + SECTOR_SIZE, len - 2 - SECTOR_SIZE);
+    run(steps);
+  }
+
+  // The dispatcher calls leave their results in the registers; reload the
+  // base ones so the guest resumes at the prompt's CIOIN retry
+  void restoreCpu() {
+    StateReader c(base_cpu.data(), base_cpu.size());
+    cpu.load_state(c);
+  }
+};
+
+FuzzMachine* machine = nullptr;
+
+const char* env_or(const char* name, const char* fallback) {
+  const char* v = getenv(name);
+  return (v && *v) ? v : fallback;
+}
+
+std::string unescape(const char* s) {
+  std::string out;
+  for (; *s; s++) {
+    if (s[0] == '\\' && s[1] == 'r') { out += '\r'; s++; }
+    else if (s[0] == '\\' && s[1] == 'n') { out += '\n'; s++; }
+    else out += *s;
+  }
+  return out;
+}
+
+void boot_machine() {
+  // Guest reads must never see the host's stdin. CIOIN writes pending
+  // output straight to stdout, which goes with the rest of the echo.
+  bool echo = getenv("ROMWBW_FUZZ_ECHO") != nullptr;
+  if (!freopen("/dev/null", "r", stdin) ||
+      (echo ? dup2(STDERR_FILENO, STDOUT_FILENO) < 0 : !freopen("/dev/null", "w", stdout))) {
+    emu_fatal("[FUZZ] Cannot redirect stdin/stdout");
+  }
+  emu_io_init();
+
+  machine = new FuzzMachine();
+  FuzzMachine& m = *machine;
+  m.echo = echo;
+  m.steps = atol(env_or("ROMWBW_FUZZ_STEPS", "100000"));
+  if (m.steps <= 0) m.steps = 100000;
+  if (strcmp(env_or("ROMWBW_FUZZ_CORE", ""), "lazy") == 0) {
+    m.cpu.set_lazy_core(true);
+  }
+
+  const char* rom = env_or("ROMWBW_FUZZ_ROM", "roms/emu_avw.rom");
+  if (!emu_load_rom(&m.memory, rom)) {
+    emu_fatal("[FUZZ] Cannot load ROM %s (set ROMWBW_FUZZ_ROM)", rom);
+  }
+  emu_complete_init(&m.memory, &m.hbios, nullptr);
+  m.cpu.regs.PC.set_pair16(0x0000);
+  m.cpu.regs.SP.set_pair16(0x0000);
+
+  // Boot menu, then the boot command, then on to the CP/M prompt
+  m.run(BOOT_STEP_LIMIT);
+  std::string boot = unescape(env_or("ROMWBW_FUZZ_BOOT", "C\\r"));
+  m.type(reinterpret_cast<const uint8_t*>(boot.data()), boot.size());
+  m.run(BOOT_STEP_LIMIT);
+  if (m.halted || !m.hbios.isWaitingForInput()) {
+    emu_fatal("[FUZZ] Guest did not reach an input prompt after boot");
+  }
+
+  m.takeSnapshot();
+  emu_log("[FUZZ] Booted %s to PC=0x%04X, snapshot taken\n",
+          rom, m.cpu.regs.PC.get_pair16());
+}
+
+}  // namespace
+
+extern "C" int LLVMFuzzerInitialize(int*, char***) {
+  boot_machine();
+  return 0;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  if (!machine) boot_machine();
+  FuzzMachine& m = *machine;
+  m.reset();
+  if (size < 1) return 0;
+
+  switch (data[0] % 3) {
+    case 0:
+      m.fuzzCalls(data + 1, size - 1);
+      break;
+    case 1:
+      m.type(data + 1, size - 1);
+      m.run(m.steps);
+      break;
+    case 2:
+      m.fuzzSector(data + 1, size - 1);
+      break;
+  }
+  return 0;
+}
+
+#ifdef FUZZ_STANDALONE
+// Replay inputs without libFuzzer: romwbw_fuzz_replay [-n N] FILE...
+// Each file is run N times (default 1); resets per second are reported.
+int main(int argc, char** argv) {
+  long repeat = 1;
+  std::vector<std::vector<uint8_t>> inputs;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+      repeat = atol(argv[++i]);
+      continue;
+    }
+    std::vector<uint8_t> data;
+    if (!emu_file_load(argv[i], data)) {
+      emu_error("Cannot read %s\n", argv[i]);
+      return 1;
+    }
+    inputs.push_back(data);
+  }
+  if (inputs.empty()) {
+    fprintf(stderr, "Usage: %s [-n N] FILE...\n", argv[0]);
+    return 1;
+  }
+
+  LLVMFuzzerInitialize(&argc, &argv);
+  auto t0 = std::chrono::steady_clock::now();
+  for (long r = 0; r < repeat; r++) {
+    for (const auto& in : inputs) LLVMFuzzerTestOneInput(in.data(), in.size());
+  }
+  double secs = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - t0).count();
+  unsigned long runs = machine->resets;
+  fprintf(stderr, "%lu inputs in %.3f s (%.0f/s), %.1f pages restored per reset\n",
+          runs, secs, secs > 0 ? runs / secs : 0.0,
+          runs ? (double)machine->pages_restored / runs : 0.0);
+  return 0;
+}
+#endif
@@ -0,0 +1,224 @@
+/*
+ * Host Compute - Native kernels behind the HBIOS compute extension
+ */
+
+#include "host_compute.h"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+struct CrcTables {
+  uint16_t crc16[256];
+  uint32_t crc32[8][256];  // Slice-by-8
+
+  CrcTables() {
+    for (int i = 0; i < 256; i++) {
+      uint16_t c16 = i << 8;
+      for (int b = 0; b < 8; b++) {
+        c16 = (c16 & 0x8000) ? (c16 << 1) ^ 0x1021 : (c16 << 1);
+      }
+      crc16[i] = c16;
+
+      uint32_t c32 = i;
+      for (int b = 0; b < 8; b++) {
+        c32 = (c32 & 1) ? (c32 >> 1) ^ 0xEDB88320u : (c32 >> 1);
+      }
+      crc32[0][i] = c32;
+    }
+    for (int i = 0; i < 256; i++) {
+      for (int t = 1; t < 8; t++) {
+        uint32_t prev = crc32[t - 1][i];
+        crc32[t][i] = (prev >> 8) ^ crc32[0][prev & 0xFF];
+      }
+    }
+  }
+};
+
+const CrcTables tables;
+
+// LZ4 length extension: 255-valued bytes continue the count
+bool lz4_length(const uint8_t* src, size_t src_len, size_t& ip, size_t& len) {
+  uint8_t b;
+  do {
+    if (ip >= src_len) return false;
+    b = src[ip++];
+    len += b;
+  } while (b == 255);
+  return true;
+}
+
+// LZ4 length extension on output; false if dst is full
+bool lz4_put_length(uint8_t* dst, size_t dst_cap, size_t& op, size_t len) {
+  while (len >= 255) {
+    if (op >= dst_cap) return false;
+    dst[op++] = 255;
+    len -= 255;
+  }
+  if (op >= dst_cap) return false;
+  dst[op++] = (uint8_t)len;
+  return true;
+}
+
+// Emit one sequence: literals src[0..lit), then an optional match
+bool lz4_put_sequence(uint8_t* dst, size_t dst_cap, size_t& op,
+                      const uint8_t* lit_src, size_t lit,
+                      size_t offset, size_t match) {
+  if (op >= dst_cap) return false;
+  size_t token_pos = op++;
+  uint8_t token = (uint8_t)((lit < 15 ? lit : 15) << 4);
+  if (lit >= 15 && !lz4_put_length(dst, dst_cap, op, lit - 15)) return false;
+  if (lit > dst_cap - op) return false;
+  memcpy(dst + op, lit_src, lit);
+  op += lit;
+  if (match) {
+    if (dst_cap - op < 2) return false;
+    dst[op++] = (uint8_t)offset;
+    dst[op++] = (uint8_t)(offset >> 8);
+    size_t m = match - 4;
+    token |= (uint8_t)(m < 15 ? m : 15);
+    if (m >= 15 && !lz4_put_length(dst, dst_cap, op, m - 15)) return false;
+  }
+  dst[token_pos] = token;
+  return true;
+}
+
+inline uint32_t lz4_read32(const uint8_t* p) {
+  uint32_t v;
+  memcpy(&v, p, 4);
+  return v;
+}
+
+}  // namespace
+
+uint16_t hc_crc16_xmodem(uint16_t crc, const uint8_t* data, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    crc = (crc << 8) ^ tables.crc16[((crc >> 8) ^ data[i]) & 0xFF];
+  }
+  return crc;
+}
+
+uint32_t hc_crc32(uint32_t crc, const uint8_t* data, size_t len) {
+  crc = ~crc;
+  while (len >= 8) {
+    uint32_t lo = crc ^ (data[0] | (data[1] << 8) | (data[2] << 16) |
+                         ((uint32_t)data[3] << 24));
+    uint32_t hi = data[4] | (data[5] << 8) | (data[6] << 16) |
+                  ((uint32_t)data[7] << 24);
+    crc = tables.crc32[7][lo & 0xFF] ^ tables.crc32[6][(lo >> 8) & 0xFF] ^
+          tables.crc32[5][(lo >> 16) & 0xFF] ^ tables.crc32[4][lo >> 24] ^
+          tables.crc32[3][hi & 0xFF] ^ tables.crc32[2][(hi >> 8) & 0xFF] ^
+          tables.crc32[1][(hi >> 16) & 0xFF] ^ tables.crc32[0][hi >> 24];
+    data += 8;
+    len -= 8;
+  }
+  while (len--) {
+    crc = (crc >> 8) ^ tables.crc32[0][(crc ^ *data++) & 0xFF];
+  }
+  return ~crc;
+}
+
+size_t hc_lz4_compress(const uint8_t* src, size_t src_len,
+                       uint8_t* dst, size_t dst_cap) {
+  // Block format rules: the last 5 bytes are literals and the last match
+  // starts at least 12 bytes before the end
+  const size_t HASH_BITS = 12;
+  const size_t MIN_TAIL = 12;
+  uint32_t table[1 << HASH_BITS];
+  memset(table, 0xFF, sizeof(table));
+
+  size_t op = 0;
+  size_t anchor = 0;
+  size_t ip = 0;
+  size_t limit = src_len > MIN_TAIL ? src_len - MIN_TAIL : 0;
+  size_t match_end_limit = src_len > 5 ? src_len - 5 : 0;
+
+  while (ip < limit) {
+    uint32_t seq = lz4_read32(src + ip);
+    uint32_t h = (seq * 2654435761u) >> (32 - HASH_BITS);
+    uint32_t cand = table[h];
+    table[h] = (uint32_t)ip;
+    if (cand == 0xFFFFFFFFu || ip - cand > 0xFFFF || lz4_read32(src + cand) != seq) {
+      ip++;
+      continue;
+    }
+
+    size_t len = 4;
+    while (ip + len < match_end_limit && src[cand + len] == src[ip + len]) len++;
+    if (!lz4_put_sequence(dst, dst_cap, op, src + anchor, ip - anchor, ip - cand, len)) {
+      return 0;
+    }
+    ip += len;
+    anchor = ip;
+  }
+
+  if (!lz4_put_sequence(dst, dst_cap, op, src + anchor, src_len - anchor, 0, 0)) {
+    return 0;
+  }
+  return op;
+}
+
+long hc_lz4_decompress(const uint8_t* src, size_t src_len,
+                       uint8_t* dst, size_t dst_cap) {
+  size_t ip = 0;
+  size_t op = 0;
+
+  while (ip < src_len) {
+    uint8_t token = src[ip++];
+
+    // Literals
+    size_t lit = token >> 4;
+    if (lit == 15 && !lz4_length(src, src_len, ip, lit)) return -1;
+    if (lit > src_len - ip || lit > dst_cap - op) return -1;
+    memcpy(dst + op, src + ip, lit);
+    ip += lit;
+    op += lit;
+
+    // The last sequence has literals only
+    if (ip == src_len) break;
+
+    // Match
+    if (src_len - ip < 2) return -1;
+    size_t offset = src[ip] | (src[ip + 1] << 8);
+    ip += 2;
+    if (offset == 0 || offset > op) return -1;
+
+    size_t match = token & 0x0F;
+    if (match == 15 && !lz4_length(src, src_len, ip, match)) return -1;
+    match += 4;
+    if (match > dst_cap - op) return -1;
+
+    if (offset >= match) {
+      memcpy(dst + op, dst + op - offset, match);
+    } else {
+      // Overlapping copy repeats the last offset bytes
+      for (size_t i = 0; i < match; i++) {
+        dst[op + i] = dst[op - offset + i];
+      }
+    }
+    op += match;
+  }
+
+  return (long)op;
+}
+
+void hc_sort_records(uint8_t* base, size_t count, size_t rec_size,
+                     size_t key_off, size_t key_len, bool descending) {
+  if (count < 2 || rec_size == 0) return;
+
+  std::vector<uint32_t> order(count);
+  for (size_t i = 0; i < count; i++) order[i] = i;
+
+  std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+    int c = memcmp(base + a * rec_size + key_off,
+                   base + b * rec_size + key_off, key_len);
+    return descending ? c > 0 : c < 0;
+  });
+
+  std::vector<uint8_t> sorted(count * rec_size);
+  for (size_t i = 0; i < count; i++) {
+    memcpy(&sorted[i * rec_size], base + order[i] * rec_size, rec_size);
+  }
+  memcpy(base, sorted.data(), sorted.size());
+}
@@ -0,0 +1,38 @@
+/*
+ * Host Compute - Native kernels behind the HBIOS compute extension
+ *
+ * Plain functions over host byte buffers, used by HBIOSDispatch::handleHCS()
+ * (HBIOS functions 0xE8-0xEF). The dispatcher gathers guest memory into
+ * contiguous spans, runs the kernel and scatters the result back.
+ */
+
+#ifndef HOST_COMPUTE_H
+#define HOST_COMPUTE_H
+
+#include <cstdint>
+#include <cstddef>
+
+// CRC-16/XMODEM (poly 0x1021, MSB first). Pass the previous result to
+// continue a running CRC; start with 0.
+uint16_t hc_crc16_xmodem(uint16_t crc, const uint8_t* data, size_t len);
+
+// CRC-32 (IEEE 802.3, as used by zip/gzip). Pass the previous result to
+// continue a running CRC; start with 0.
+uint32_t hc_crc32(uint32_t crc, const uint8_t* data, size_t len);
+
+// Compress src into one LZ4 block (greedy, single hash probe). Returns the
+// compressed length, or 0 if the result would not fit in dst_cap.
+size_t hc_lz4_compress(const uint8_t* src, size_t src_len,
+                       uint8_t* dst, size_t dst_cap);
+
+// Decompress one LZ4 block (no frame header). Returns the number of bytes
+// written to dst, or -1 if the input is malformed or dst_cap is too small.
+long hc_lz4_decompress(const uint8_t* src, size_t src_len,
+                       uint8_t* dst, size_t dst_cap);
+
+// Stable sort of count fixed-size records by an unsigned byte-wise key
+// (key_len bytes starting key_off bytes into each record).
+void hc_sort_records(uint8_t* base, size_t count, size_t rec_size,
+                     size_t key_off, size_t key_len, bool descending);
+
+#endif // HOST_COMPUTE_H
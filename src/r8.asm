@@ -1,7 +1,9 @@
-; R8.COM - Read host file to CP/M filesystem (RomWBW/HBIOS version)
+; R8.COM - Read host files to CP/M filesystem (RomWBW/HBIOS version)
 ;
 ; Usage: R8 <hostpath>
-;   Imports host file to CP/M with uppercase filename
+;   Imports each host file matching hostpath to CP/M with uppercase
+;   filename. The last path component may contain * and ?, matched
+;   without regard to case (R8 src/*.MAC).
 ;
 ; Uses HBIOS extension functions for host file access
 
@@ -23,9 +25,11 @@ F_MAKE	equ	22
 F_DMA	equ	26
 
 ; HBIOS extension functions for host file transfer
-H_OPEN_R equ	0E1h	; Open host file for reading (DE=path)
-H_READ	equ	0E3h	; Read byte (returns E=byte, A=status)
-H_CLOSE	equ	0E5h	; Close file (C=0 read, C=1 write)
+H_HOPEN	equ	0D8h	; Open handle (C=0 read; DE=path; returns E=handle)
+H_HREAD	equ	0D9h	; Read block (C=handle, DE=buf, HL=count; returns HL=bytes)
+H_HCLOSE equ	0DBh	; Close handle (C=handle)
+H_FFIRST equ	0DCh	; Find first match (DE=pattern, HL=path buffer)
+H_FNEXT	equ	0DDh	; Find next match (HL=path buffer)
 
 	org	TPA
 
@@ -77,11 +81,46 @@ path_done:
 	or	a
 	jp	z,no_args
 
+	; Find the first matching host file
+	ld	de,hostpath
+	ld	hl,curpath
+	ld	b,H_FFIRST
+	rst	8
+	or	a
+	jp	nz,no_match
+
+	ld	hl,0
+	ld	(file_count),hl
+
+next_file:
+	call	copy_file
+	ld	hl,(file_count)
+	inc	hl
+	ld	(file_count),hl
+
+	; Next match, if any
+	ld	hl,curpath
+	ld	b,H_FNEXT
+	rst	8
+	or	a
+	jr	z,next_file
+
+	; Print file count
+	ld	hl,(file_count)
+	call	print_dec16
+	ld	de,msg_files
+	ld	c,C_PRINT
+	call	BDOS
+
+	rst	0
+
+; Copy the host file named in curpath to a CP/M file of the same name
+copy_file:
 	; Display host path
 	ld	de,msg_reading
 	ld	c,C_PRINT
 	call	BDOS
-	ld	de,hostpath
+	ld	de,curpath
 	call	print_string
 	ld	de,msg_crlf
 	ld	c,C_PRINT
@@ -100,11 +139,14 @@ path_done:
 	call	BDOS
 
 	; Open host file for reading
-	ld	de,hostpath
-	ld	b,H_OPEN_R
+	ld	de,curpath
+	ld	c,0
+	ld	b,H_HOPEN
 	rst	8
 	or	a
 	jp	nz,host_open_error
+	ld	a,e
+	ld	(handle),a
 
 	; Delete existing CP/M file (if any)
 	ld	de,cpm_fcb
@@ -128,96 +170,63 @@ path_done:
 	ld	(byte_count),hl
 	ld	(byte_count+2),hl
 
-	; Initialize buffer position
-	ld	hl,dma_buffer
-	ld	b,0		; Byte count in buffer
-
 read_loop:
-	; Read byte from host
-	ld	a,b
-	push	af
-	push	hl
-
-	ld	b,H_READ
+	; Read the next record from the host
+	ld	a,(handle)
+	ld	c,a
+	ld	de,dma_buffer
+	ld	hl,128
+	ld	b,H_HREAD
 	rst	8
-	or	a
-	jr	nz,read_done_pop
-
-	; Got byte in E
-	pop	hl
-	pop	af
-	ld	b,a
-
-	; Store byte in buffer
-	ld	(hl),e
-	inc	hl
-	inc	b
+	ld	a,h
+	or	l
+	jr	z,close_files	; End of file
 
-	; Increment byte count
-	push	hl
-	push	bc
+	; Add to byte count
+	ld	(rec_len),hl
+	ex	de,hl
 	ld	hl,(byte_count)
-	inc	hl
+	add	hl,de
 	ld	(byte_count),hl
-	ld	a,h
-	or	l
-	jr	nz,no_high_inc
+	jr	nc,no_high_inc
 	ld	hl,(byte_count+2)
 	inc	hl
 	ld	(byte_count+2),hl
 no_high_inc:
-	pop	bc
-	pop	hl
 
-	; Buffer full?
-	ld	a,b
+	; Pad a short last record with ^Z
+	ld	a,(rec_len)
 	cp	128
-	jr	nz,read_loop
-
-	; Write buffer to CP/M file
-	push	hl
-	ld	de,cpm_fcb
-	ld	c,F_WRITE
-	call	BDOS
-	pop	hl
-	or	a
-	jp	nz,cpm_write_error
-
-	; Reset buffer
+	jr	z,write_rec
 	ld	hl,dma_buffer
-	ld	b,0
-	jr	read_loop
-
-read_done_pop:
-	pop	hl
-	pop	af
-	ld	b,a
-
-read_done:
-	; Write any remaining bytes in buffer
-	ld	a,b
-	or	a
-	jr	z,close_files
-
-	; Pad buffer with ^Z to 128 bytes
-	ld	a,b
+	ld	e,a
+	ld	d,0
+	add	hl,de
 pad_loop:
-	cp	128
-	jr	nc,write_final
 	ld	(hl),1Ah
 	inc	hl
 	inc	a
-	jr	pad_loop
+	cp	128
+	jr	nz,pad_loop
 
-write_final:
+write_rec:
+	; Write record to CP/M file
 	ld	de,cpm_fcb
 	ld	c,F_WRITE
 	call	BDOS
+	or	a
+	jp	nz,cpm_write_error
+
+	; A short record was the last
+	ld	a,(rec_len)
+	cp	128
+	jr	z,read_loop
 
 close_files:
 	; Close host file
-	ld	b,H_CLOSE
-	ld	c,0
+	ld	a,(handle)
+	ld	c,a
+	ld	b,H_HCLOSE
 	rst	8
 
 	; Close CP/M file
@@ -236,9 +245,7 @@ close_files:
 
 	ld	de,msg_bytes
 	ld	c,C_PRINT
-	call	BDOS
-
-	rst	0
+	jp	BDOS
 
 ; Extract filename from host path and convert to FCB format
 ; Finds text after last / or \, converts to uppercase 8.3
@@ -260,9 +267,9 @@ clear_rest:
 	inc	hl
 	djnz	clear_rest
 
-	; Find last separator in hostpath
-	ld	hl,hostpath
-	ld	de,hostpath	; DE = start of filename part
+	; Find last separator in curpath
+	ld	hl,curpath
+	ld	de,curpath	; DE = start of filename part
 find_sep:
 	ld	a,(hl)
 	or	a
@@ -448,15 +455,22 @@ no_args:
 	call	BDOS
 	rst	0
 
-host_open_error:
-	ld	de,msg_host_err
+no_match:
+	ld	de,msg_no_match
 	ld	c,C_PRINT
 	call	BDOS
 	rst	0
 
+host_open_error:
+	; Report and go on with the next file
+	ld	de,msg_host_err
+	ld	c,C_PRINT
+	jp	BDOS
+
 cpm_create_error:
-	ld	b,H_CLOSE
-	ld	c,0
+	ld	a,(handle)
+	ld	c,a
+	ld	b,H_HCLOSE
 	rst	8
 	ld	de,msg_cpm_err
 	ld	c,C_PRINT
@@ -464,8 +478,9 @@ cpm_create_error:
 	rst	0
 
 cpm_write_error:
-	ld	b,H_CLOSE
-	ld	c,0
+	ld	a,(handle)
+	ld	c,a
+	ld	b,H_HCLOSE
 	rst	8
 	ld	de,cpm_fcb
 	ld	c,F_CLOSE
@@ -490,6 +505,10 @@ msg_done:
 	db	'Done: $'
 msg_bytes:
 	db	' bytes',0Dh,0Ah,'$'
+msg_files:
+	db	' file(s) read',0Dh,0Ah,'$'
+msg_no_match:
+	db	'Error: No matching host files',0Dh,0Ah,'$'
 msg_host_err:
 	db	'Error: Cannot open host file',0Dh,0Ah,'$'
 msg_cpm_err:
@@ -500,12 +519,20 @@ msg_write_err:
 ; Data areas
 hostpath:
 	ds	128
+curpath:
+	ds	128
 cpm_fcb:
 	ds	36
 dma_buffer:
 	ds	128
 byte_count:
 	dw	0,0
+rec_len:
+	dw	0
+file_count:
+	dw	0
+handle:
+	db	0
 print_flag:
 	db	0
 
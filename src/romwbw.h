@@ -0,0 +1,126 @@
+/*
+ * libromwbw - Embeddable RomWBW machine with a C API
+ *
+ * Runs RomWBW machines in-process: the same banked memory, CPU and HBIOS
+ * dispatch as romwbw_emu, with the console connected to buffers the host
+ * application reads and fills instead of the terminal.
+ *
+ *   romwbw_machine* m = romwbw_create(ROMWBW_LAZY_CORE);
+ *   romwbw_load_rom_file(m, "roms/emu_avw.rom");
+ *   romwbw_attach_disk_file(m, 0, "hd1k_combo.img", 0);
+ *   romwbw_start(m);
+ *   romwbw_run(m, 0, "Boot [H=Help]: ", 5000);
+ *   romwbw_write_input(m, "C\r", 2);
+ *   romwbw_run(m, 0, "C>", 5000);
+ *
+ * Functions returning int return 0 on success and -1 on failure, with
+ * romwbw_last_error() saying why. A machine may be used from any thread,
+ * one thread at a time; different machines run in parallel, each with its
+ * own console buffers and host files. Some failures inside the emulator
+ * core (an unreadable disk mid-run) still end the process, as they do in
+ * romwbw_emu.
+ *
+ * Link with `pkg-config --cflags --libs romwbw` (add --static for
+ * libromwbw.a).
+ */
+
+#ifndef ROMWBW_H
+#define ROMWBW_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct romwbw_machine romwbw_machine;
+
+/* romwbw_create flags */
+#define ROMWBW_LAZY_CORE  0x01   /* In-tree Z80 core with lazy flags */
+
+/* Why romwbw_run returned */
+enum romwbw_stop {
+  ROMWBW_STOP_COUNT = 0,    /* Ran max_instructions */
+  ROMWBW_STOP_MATCH,        /* until_output appeared */
+  ROMWBW_STOP_INPUT,        /* Guest is waiting for input and none is queued */
+  ROMWBW_STOP_DEADLINE,     /* timeout_ms passed */
+  ROMWBW_STOP_HALT,         /* HALT or an unimplemented opcode; the machine is stopped */
+  ROMWBW_STOP_ERROR = -1    /* Not started (see romwbw_last_error) */
+};
+
+/* Library version, "MAJOR.MINOR.PATCH" (the makefile reads romwbw.pc's
+ * version from this line) */
+#define ROMWBW_VERSION "1.1.0"
+const char* romwbw_version(void);
+
+romwbw_machine* romwbw_create(unsigned flags);
+void romwbw_destroy(romwbw_machine* m);
+
+/* Message for the last failed call on m */
+const char* romwbw_last_error(const romwbw_machine* m);
+
+/* ROM image (up to 512 KB), before romwbw_start */
+int romwbw_load_rom_file(romwbw_machine* m, const char* path);
+int romwbw_load_rom(romwbw_machine* m, const void* data, size_t size);
+
+/* Attach a disk image to unit 0-15 with slices 1-8, or 0 for the
+ * romwbw_emu rule (1 disk: 8 slices, 2: 4 each, 3 or more: 2 each,
+ * applied at romwbw_start). A file is opened read-write and written in
+ * place; a buffer is copied and changes stay in memory (romwbw_disk_data).
+ * Attaching to a started machine makes the unit visible to the next
+ * HBIOS device scan, as with romwbw_emu's control socket. */
+int romwbw_attach_disk_file(romwbw_machine* m, int unit, const char* path, int slices);
+int romwbw_attach_disk(romwbw_machine* m, int unit, const void* data, size_t size, int slices);
+
+/* Attach a blank scratch disk held in host memory: size bytes rounded up
+ * to whole 8.125 MB hd512 slices (at most 8). Memory is allocated as the
+ * guest writes, and the contents are lost on detach or destroy (they are
+ * kept in snapshots). */
+int romwbw_attach_ram_disk(romwbw_machine* m, int unit, size_t size);
+
+int romwbw_detach_disk(romwbw_machine* m, int unit);
+
+/* Contents of a unit attached from a buffer, or NULL */
+const uint8_t* romwbw_disk_data(romwbw_machine* m, int unit, size_t* size);
+
+/* Finish initialization (HCB, drive map, memory disks) and reset the CPU
+ * to ROM address 0 */
+int romwbw_start(romwbw_machine* m);
+
+/* Run until one of:
+ *   max_instructions executed (0 = no limit),
+ *   until_output (if not NULL) appears in output written during this call,
+ *   the guest waits for console input and none is queued,
+ *   timeout_ms of wall time pass (-1 = no limit), or the machine halts.
+ * Returns an enum romwbw_stop. Call again to continue. */
+int romwbw_run(romwbw_machine* m, uint64_t max_instructions,
+               const char* until_output, int timeout_ms);
+
+/* Queue console input (LF is given to the guest as CR) */
+int romwbw_write_input(romwbw_machine* m, const void* data, size_t size);
+
+/* Console output not yet read, and taking up to size bytes of it. Output
+ * is what romwbw_emu writes to stdout: 7-bit, CR dropped. */
+size_t romwbw_output_size(const romwbw_machine* m);
+size_t romwbw_read_output(romwbw_machine* m, char* buf, size_t size);
+
+/* Counters and registers */
+uint64_t romwbw_instruction_count(const romwbw_machine* m);
+uint16_t romwbw_pc(const romwbw_machine* m);
+
+/* Snapshots: the whole machine (CPU, memory, HBIOS and disk state,
+ * pending input). Restore only into a machine set up with the same ROM
+ * and disks. A file snapshot is romwbw_emu's checkpoint format, so
+ * romwbw-ID.ckpt can be resumed with --session=ID. romwbw_save_snapshot
+ * returns a malloc'd buffer (free it with free) or NULL. */
+int romwbw_save_snapshot_file(romwbw_machine* m, const char* path);
+int romwbw_load_snapshot_file(romwbw_machine* m, const char* path);
+uint8_t* romwbw_save_snapshot(romwbw_machine* m, size_t* size);
+int romwbw_load_snapshot(romwbw_machine* m, const void* data, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ROMWBW_H */
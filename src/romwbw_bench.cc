@@ -0,0 +1,306 @@
+/*
+ * Micro-benchmarks - ns/op for the emulator's core primitives
+ *
+ * Times one primitive at a time on a machine set up the way romwbw_emu
+ * sets it up (ROM loaded, HBIOS initialized), but without running guest
+ * code, so a change to one primitive can be judged in seconds:
+ *   mem.*     banked_mem fetch_mem/store_mem per bank type, called through
+ *             the qkz80_cpu_mem interface as the CPU cores call them
+ *   bank.*    select_bank with emu_init_ram_bank, as port 0x78 does
+ *   hbios.*   HBIOSDispatch round trip (handlePortDispatch) per class
+ *   dio.*     DIOSEEK + DIOREAD of one sector per disk backend
+ *   output.*  getOutputChars after a line of CIOOUT
+ *   port.*    port 0xEC inter-bank copy
+ *
+ * Each benchmark runs once to warm up, then REPS times; the report gives
+ * the mean ns/op over the repetitions, their standard deviation and the
+ * fastest one. The process is pinned to one CPU (Linux) so the figures
+ * do not move with the scheduler.
+ *
+ * Usage: romwbw_bench [--romwbw=FILE] [-n OPS] [-r REPS] [-c CPU] [NAME...]
+ * NAME selects benchmarks by prefix (e.g. "mem." or "dio.read.file").
+ */
+
+#include "hbios_cpu.h"
+#include "emu_init.h"
+#include "emu_io.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+#include <unistd.h>
+
+namespace {
+
+const uint16_t BUFFER = 0x9000;         // Common area scratch
+const size_t DISK_SIZE = 8 * 1024 * 1024;  // One hd1k slice
+const uint32_t DISK_LBAS = 4096;        // LBAs cycled through by dio.*
+
+struct BenchMachine : public HBIOSCPUDelegate {
+  banked_mem memory;
+  hbios_cpu cpu;
+  HBIOSDispatch hbios;
+  uint16_t initialized_ram_banks = 0;
+
+  BenchMachine() : cpu(&memory, this) {
+    memory.enable_banking();
+    hbios.setCPU(&cpu);
+    hbios.setMemory(&memory);
+    hbios.setBlockingAllowed(false);
+  }
+
+  banked_mem* getMemory() override { return &memory; }
+  HBIOSDispatch* getHBIOS() override { return &hbios; }
+
+  void initializeRamBankIfNeeded(uint8_t bank) override {
+    emu_init_ram_bank(&memory, bank, &initialized_ram_banks);
+  }
+  void onHalt() override {}
+  void onUnimplementedOpcode(uint8_t, uint16_t) override {}
+  void logDebug(const char*, ...) override {}
+
+  void call(uint8_t b, uint8_t c, uint16_t de, uint16_t hl) {
+    cpu.regs.BC.set_pair16((b << 8) | c);
+    cpu.regs.DE.set_pair16(de);
+    cpu.regs.HL.set_pair16(hl);
+    hbios.handlePortDispatch();
+  }
+};
+
+BenchMachine* m = nullptr;
+volatile uint32_t sink;  // Keeps loads from being optimized away
+
+// The CPU cores reach memory through the base class; go the same way
+qkz80_cpu_mem* mem_interface() {
+  qkz80_cpu_mem* volatile p = &m->memory;
+  return p;
+}
+
+void fetch_loop(long ops, uint8_t bank, uint16_t base, uint16_t mask) {
+  m->memory.select_bank(bank);
+  qkz80_cpu_mem* mem = mem_interface();
+  uint32_t sum = 0;
+  for (long i = 0; i < ops; i++) sum += mem->fetch_mem(base + (i & mask));
+  sink = sum;
+}
+
+void store_loop(long ops, uint8_t bank, uint16_t base, uint16_t mask) {
+  m->memory.select_bank(bank);
+  qkz80_cpu_mem* mem = mem_interface();
+  for (long i = 0; i < ops; i++) mem->store_mem(base + (i & mask), (uint8_t)i);
+}
+
+void bench_fetch_ram(long ops) { fetch_loop(ops, 0x81, 0x0000, 0x3FFF); }
+void bench_fetch_rom(long ops) { fetch_loop(ops, 0x01, 0x0000, 0x3FFF); }
+void bench_fetch_shadow(long ops) { fetch_loop(ops, 0x00, 0x0000, 0x0FFF); }
+void bench_fetch_common(long ops) { fetch_loop(ops, 0x81, 0x8000, 0x3FFF); }
+void bench_store_ram(long ops) { store_loop(ops, 0x81, 0x0000, 0x3FFF); }
+void bench_store_shadow(long ops) { store_loop(ops, 0x00, 0x0000, 0x0FFF); }
+void bench_store_common(long ops) { store_loop(ops, 0x81, 0xA000, 0x3FFF); }
+
+void bench_select_bank(long ops) {
+  for (long i = 0; i < ops; i++) {
+    uint8_t bank = (i & 1) ? 0x82 : 0x81;
+    m->initializeRamBankIfNeeded(bank);
+    m->memory.select_bank(bank);
+  }
+}
+
+// One representative, side-effect-free function per class
+void bench_hbios_cio(long ops) {
+  for (long i = 0; i < ops; i++) {
+    m->call(HBF_CIOOUT, 0, 'x', 0);
+    if ((i & 1023) == 1023) m->hbios.getOutputChars();
+  }
+  m->hbios.getOutputChars();
+}
+void bench_hbios_dio(long ops) {
+  for (long i = 0; i < ops; i++) m->call(HBF_DIOSTATUS, 0, 0, 0);
+}
+void bench_hbios_rtc(long ops) {
+  for (long i = 0; i < ops; i++) m->call(HBF_RTCGETTIM, 0, 0, BUFFER);
+}
+void bench_hbios_sys(long ops) {
+  for (long i = 0; i < ops; i++) m->call(HBF_SYSGETBNK, 0, 0, 0);
+}
+void bench_hbios_hcs(long ops) {
+  for (long i = 0; i < ops; i++) m->call(HBF_HCS_INFO, 0, 0, 0);
+}
+
+void dio_loop(long ops, uint8_t unit) {
+  for (long i = 0; i < ops; i++) {
+    m->call(HBF_DIOSEEK, unit, 0x8000, i % DISK_LBAS);
+    m->call(HBF_DIOREAD, unit, (banked_mem::COMMON_BANK << 8) | 1, BUFFER);
+  }
+}
+
+void bench_dio_md(long ops) { dio_loop(ops, 0); }      // MD0, RAM banks
+void bench_dio_mem(long ops) { dio_loop(ops, 2); }     // Slot 0, vector
+void bench_dio_file(long ops) { dio_loop(ops, 3); }    // Slot 1, file
+
+void bench_output(long ops) {
+  for (long i = 0; i < ops; i++) {
+    for (int c = 0; c < 80; c++) m->hbios.queueOutputChar('x');
+    sink = m->hbios.getOutputChars().size();
+  }
+}
+
+void bench_port_bnkcpy(long ops) {
+  m->memory.store_mem(0xFFE4, 0x81);  // Source bank
+  m->memory.store_mem(0xFFE7, 0x82);  // Destination bank
+  for (long i = 0; i < ops; i++) {
+    m->cpu.regs.HL.set_pair16(0x1000);
+    m->cpu.regs.DE.set_pair16(0x2000);
+    m->cpu.regs.BC.set_pair16(256);
+    m->cpu.port_out(0xEC, 0);
+  }
+}
+
+struct Bench {
+  const char* name;
+  void (*run)(long ops);
+  long cost;  // Relative cost; ops per repetition are divided by it
+};
+
+const Bench benches[] = {
+  {"mem.fetch.ram", bench_fetch_ram, 1},
+  {"mem.fetch.rom", bench_fetch_rom, 1},
+  {"mem.fetch.shadow", bench_fetch_shadow, 1},
+  {"mem.fetch.common", bench_fetch_common, 1},
+  {"mem.store.ram", bench_store_ram, 1},
+  {"mem.store.shadow", bench_store_shadow, 1},
+  {"mem.store.common", bench_store_common, 1},
+  {"bank.select", bench_select_bank, 1},
+  {"hbios.cio", bench_hbios_cio, 10},
+  {"hbios.dio", bench_hbios_dio, 10},
+  {"hbios.rtc", bench_hbios_rtc, 10},
+  {"hbios.sys", bench_hbios_sys, 10},
+  {"hbios.hcs", bench_hbios_hcs, 10},
+  {"dio.read.md", bench_dio_md, 100},
+  {"dio.read.mem", bench_dio_mem, 100},
+  {"dio.read.file", bench_dio_file, 100},
+  {"output.getchars.80", bench_output, 100},
+  {"port.bnkcpy.256", bench_port_bnkcpy, 100},
+};
+
+bool selected(const char* name, const std::vector<std::string>& filters) {
+  if (filters.empty()) return true;
+  for (const std::string& f : filters) {
+    if (strncmp(name, f.c_str(), f.size()) == 0) return true;
+  }
+  return false;
+}
+
+int pin_cpu(int cpu) {
+#if defined(__linux__)
+  if (cpu < 0) cpu = sched_getcpu();
+  if (cpu < 0) return -1;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  if (sched_setaffinity(0, sizeof(set), &set) != 0) return -1;
+  return cpu;
+#else
+  (void)cpu;
+  return -1;
+#endif
+}
+
+// Two hd1k-sized disks: slot 0 in memory, slot 1 backed by a temp file
+std::string attach_disks() {
+  std::vector<uint8_t> image(DISK_SIZE, 0xE5);
+  m->hbios.loadDisk(0, image.data(), image.size());
+
+  char path[] = "/tmp/romwbw_bench_XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0 || ftruncate(fd, DISK_SIZE) != 0) {
+    emu_fatal("Cannot create temporary disk file %s", path);
+  }
+  close(fd);
+  m->hbios.loadDiskFromFile(1, path);
+  return path;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  const char* rom = "roms/emu_avw.rom";
+  long ops = 1000000;
+  int reps = 11;
+  int cpu = -1;
+  std::vector<std::string> filters;
+
+  for (int i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "--romwbw=", 9) == 0) {
+      rom = argv[i] + 9;
+    } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+      ops = atol(argv[++i]);
+    } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+      reps = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+      cpu = atoi(argv[++i]);
+    } else if (argv[i][0] == '-') {
+      fprintf(stderr, "Usage: %s [--romwbw=FILE] [-n OPS] [-r REPS] [-c CPU] [NAME...]\n", argv[0]);
+      return 1;
+    } else {
+      filters.push_back(argv[i]);
+    }
+  }
+  if (ops < 100) ops = 100;
+  if (reps < 2) reps = 2;
+
+  emu_io_init();
+  m = new BenchMachine();
+  if (!emu_load_rom(&m->memory, rom)) {
+    emu_fatal("Cannot load ROM %s (use --romwbw=FILE)", rom);
+  }
+  emu_complete_init(&m->memory, &m->hbios, nullptr);
+  std::string disk_file = attach_disks();
+
+  // Shadowed ROM: writes to ROM bank 0 land in shadow RAM and later reads
+  // of those addresses come from there
+  m->memory.select_bank(0x00);
+  for (uint16_t a = 0; a < 0x1000; a++) m->memory.store_mem(a, 0);
+
+  int pinned = pin_cpu(cpu);
+  if (pinned >= 0) printf("Pinned to CPU %d; ", pinned);
+  else printf("Not pinned; ");
+  printf("%d repetitions of %ld ops (divided by the cost column)\n\n", reps, ops);
+  printf("%-20s %10s %10s %10s %8s\n", "benchmark", "ns/op", "stddev", "min", "cost");
+
+  for (const Bench& b : benches) {
+    if (!selected(b.name, filters)) continue;
+    long n = ops / b.cost;
+    b.run(n);  // Warm up caches and lazily built state
+
+    std::vector<double> ns(reps);
+    for (int r = 0; r < reps; r++) {
+      auto t0 = std::chrono::steady_clock::now();
+      b.run(n);
+      ns[r] = std::chrono::duration<double, std::nano>(
+                  std::chrono::steady_clock::now() - t0).count() / n;
+    }
+    double mean = 0, best = ns[0];
+    for (double v : ns) {
+      mean += v;
+      if (v < best) best = v;
+    }
+    mean /= reps;
+    double var = 0;
+    for (double v : ns) var += (v - mean) * (v - mean);
+    double sd = std::sqrt(var / (reps - 1));
+    printf("%-20s %10.2f %10.2f %10.2f %8ld\n", b.name, mean, sd, best, b.cost);
+    fflush(stdout);
+  }
+
+  m->hbios.closeDisk(1);
+  remove(disk_file.c_str());
+  return 0;
+}
@@ -18,6 +18,14 @@
 #include "hbios_cpu.h"       // Shared CPU with HBIOS port I/O
 #include "emu_io.h"
 #include "emu_init.h"        // Shared initialization functions
+#include "emu_hibernate.h"   // Idle session hibernation
+#include "emu_memstat.h"     // Memory/TLB report
+#include "emu_checkpoint.h"  // Session checkpoint/resume
+#include "emu_logger.h"      // Per-subsystem async debug logging
+#include "emu_latency.h"     // Keystroke-to-echo latency
+#include "emu_shmview.h"     // Shared-memory state view
+#include "emu_control.h"     // Runtime control socket
+#include "emu_watchdog.h"    // Runaway guest detection
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
@@ -37,10 +45,22 @@
 #include <vector>
 #include <string>
 #include <random>
+#include <memory>
+#include <chrono>
 
 // Global for signal handler to request stop
 static volatile bool stop_requested = false;
 
+// Session mode (--session): SIGTERM also requests a checkpoint
+static bool session_mode = false;
+static volatile bool checkpoint_requested = false;
+
+// --latency-report: printed from atexit, since a piped session ends with
+// exit() from the console read at EOF
+static void print_latency_report() {
+  fprintf(stderr, "\n%s", emu_latency_report().c_str());
+}
+
 // Interrupt configuration for scheduled interrupts
 struct InterruptConfig {
   bool enabled;
@@ -70,6 +90,27 @@ static unsigned long long get_next_trigger(const InterruptConfig& cfg, unsigned
   return current_cycles + dist(interrupt_rng);
 }
 
+// Instructions between host input checks for interrupt-driven console input
+static const long long CONSOLE_INT_POLL = 2000;
+
+// Instructions between cold bank sweeps (--cold-banks)
+static const long long COLD_BANK_SWEEP = 1 << 20;
+
+// Instructions between state publishes to the shared view (--shm-view)
+static const long long SHM_PUBLISH = 4096;
+
+// Static so exit() still unlinks the segment
+static SharedStateView shm_view;
+
+// Instructions between control socket polls (--control)
+static const long long CONTROL_POLL = 16384;
+
+// Static so exit() still unlinks the socket
+static ControlSocket control;
+static bool control_paused = false;   // Stopped by a pause request or breakpoint
+static int control_break_pc = -1;     // Breakpoint the machine is stopped at
+static int control_resume_pc = -1;    // Breakpoint to run past once on resume
+
 // Track if we're waiting for a maskable interrupt to be delivered
 // (used when IFF1=0 delays delivery)
 static bool waiting_for_int_delivery = false;
@@ -712,6 +753,18 @@ public:
   bool has_next_pc() { return next_pc_valid; }
   uint16_t get_next_pc() { next_pc_valid = false; return next_pc; }
 
+  // Checkpoint state kept here rather than in HBIOSDispatch
+  void save_state(StateWriter& w) const {
+    w.u16(initialized_ram_banks);
+    w.flag(next_pc_valid);
+    w.u16(next_pc);
+  }
+  void load_state(StateReader& r) {
+    initialized_ram_banks = r.u16();
+    next_pc_valid = r.flag();
+    next_pc = r.u16();
+  }
+
   // Set romldr path (for loading RomWBW boot menu instead of emu_hbios menu)
   void set_romldr_path(const std::string& path) {
     romldr_path = path;
@@ -827,12 +880,18 @@ void print_usage(const char* prog) {
   fprintf(stderr, "  --romwbw=FILE     Enable RomWBW mode with ROM file (512KB ROM+RAM, Z80)\n");
   fprintf(stderr, "  --strict-io       Halt on unexpected I/O ports (for debugging)\n");
   fprintf(stderr, "  --debug           Enable debug output\n");
+  fprintf(stderr, "  --log=SUB=LEVEL[,...]  Debug log levels per subsystem (BANK, DIO, CIO, SYS,\n");
+  fprintf(stderr, "                    TRACE or ALL; off, error, info, debug), e.g. --log=DIO=debug\n");
+  fprintf(stderr, "  --log-ring=N      Log records buffered per thread (default %u, ~200 bytes each)\n",
+          DEFAULT_RING_RECORDS);
   fprintf(stderr, "\n");
   fprintf(stderr, "Disk options:\n");
   fprintf(stderr, "  --disk0=FILE[:N]  Attach disk image to slot 0\n");
   fprintf(stderr, "  --disk1=FILE[:N]  Attach disk image to slot 1\n");
   fprintf(stderr, "    N = number of slices (1-8), or omit for auto (1 disk=8, 2 disks=4 each)\n");
   fprintf(stderr, "    Example: --disk0=disk.img:1 uses only 1 slice\n");
+  fprintf(stderr, "  --diskN=ram:SIZE  Scratch disk in host memory, never saved (e.g. ram:32M =\n");
+  fprintf(stderr, "                    4 blank hd512 slices; memory is taken as it is written)\n");
   fprintf(stderr, "\n");
   fprintf(stderr, "  Supported disk formats (auto-detected):\n");
   fprintf(stderr, "    hd1k  - Modern RomWBW format, 8MB per slice, 1024 dir entries\n");
@@ -844,6 +903,24 @@ void print_usage(const char* prog) {
   fprintf(stderr, "  --escape=CHAR     Console escape char (default ^E)\n");
   fprintf(stderr, "  --trace=FILE      Write execution trace to FILE\n");
   fprintf(stderr, "  --symbols=FILE    Load symbol table from FILE (.sym)\n");
+  fprintf(stderr, "  --console-int     Interrupt-driven console input (guest-side ring)\n");
+  fprintf(stderr, "  --lazy-core       Use the in-tree Z80 core with lazy flag evaluation\n");
+  fprintf(stderr, "  --hle[=verify]    Run known guest routines natively (verify: run both, compare)\n");
+  fprintf(stderr, "  --hibernate=SECS[:FILE]  Spool memory to FILE after SECS idle at console input\n");
+  fprintf(stderr, "  --cold-banks=SECS Compress memory banks not accessed for SECS seconds\n");
+  fprintf(stderr, "  --ksm             Mark ROM/RAM mergeable so KSM can share pages across sessions\n");
+  fprintf(stderr, "  --huge-page       Back ROM/RAM with one transparent huge page\n");
+  fprintf(stderr, "  --mem-report      Report memory per session and dTLB misses at start and exit\n");
+  fprintf(stderr, "  --latency-report  Report keystroke-to-echo latency percentiles at exit\n");
+  fprintf(stderr, "  --shm-view=NAME   Share RAM, registers and HBIOS state in /dev/shm/NAME\n");
+  fprintf(stderr, "  --control=PATH    Accept JSON control requests on Unix socket PATH\n");
+  fprintf(stderr, "  --watchdog=SECS[:ACTION]  After SECS emulated seconds looping without I/O,\n");
+  fprintf(stderr, "                    exit (default, status %d), snapshot (checkpoint, then exit)\n",
+          Watchdog::EXIT_CODE);
+  fprintf(stderr, "                    or notify (pause, send a control socket event)\n");
+  fprintf(stderr, "  --journal[=MS]    Journal disk writes; sync them to IMAGE.wal every MS ms (default 10)\n");
+  fprintf(stderr, "  --boot-trace      Record each boot's disk reads to IMAGE.boottrace; prefetch them next boot\n");
+  fprintf(stderr, "  --session=ID[:DIR]  Checkpoint to DIR on SIGTERM; resume from it on next start\n");
   fprintf(stderr, "\n");
   fprintf(stderr, "Console mode:\n");
   fprintf(stderr, "  Press the escape char (default Ctrl+E) to enter console mode.\n");
@@ -875,6 +952,21 @@ int main(int argc, char** argv) {
   std::string trace_file;
   std::string symbols_file;
   std::string romldr_path;  // RomWBW romldr boot menu
+  bool console_int = false;  // Interrupt-driven console input
+  bool lazy_core = false;    // In-tree Z80 core (z80_lazy) instead of qkz80
+  GuestHLE::Mode hle_mode = GuestHLE::HLE_OFF;  // Native guest routines
+  int hibernate_secs = 0;            // Idle seconds before hibernating (0 = never)
+  std::string hibernate_spool;       // Hibernation spool file
+  int cold_bank_secs = 0;            // Idle seconds before packing a bank (0 = never)
+  unsigned arena_flags = 0;          // banked_mem::ARENA_* options
+  bool mem_report = false;           // Print memory/TLB report
+  std::string session_id;            // Checkpoint/resume session (--session)
+  std::string session_dir;           // Directory holding session checkpoints
+  std::string log_spec;              // Per-subsystem log levels (--log)
+  std::string shm_name;              // Shared-memory state view (--shm-view)
+  std::string control_path;          // Control socket (--control)
+  int watchdog_secs = 0;             // Runaway guest timeout (0 = no watchdog)
+  Watchdog::Action watchdog_action = Watchdog::ACTION_EXIT;
 
   // ROM application definitions: key=name:path
   struct RomAppDef {
@@ -894,6 +986,18 @@ int main(int argc, char** argv) {
       return 0;
     } else if (strcmp(argv[i], "--debug") == 0) {
       debug = true;
+    } else if (strncmp(argv[i], "--log=", 6) == 0) {
+      log_spec = argv[i] + 6;
+    } else if (strncmp(argv[i], "--log-ring=", 11) == 0) {
+      const char* arg = argv[i] + 11;
+      char* end;
+      unsigned long records = strtoul(arg, &end, 10);
+      if (end == arg || *end != '\0' || records > MAX_RING_RECORDS ||
+          !emu_logger_set_ring_size((unsigned)records)) {
+        fprintf(stderr, "Invalid log ring size: %s (%u to %u records)\n", arg,
+                MIN_RING_RECORDS, MAX_RING_RECORDS);
+        return 1;
+      }
     } else if (strncmp(argv[i], "--romwbw=", 9) == 0) {
       binary = argv[i] + 9;
     } else if (strcmp(argv[i], "--strict-io") == 0) {
@@ -907,7 +1011,8 @@ int main(int argc, char** argv) {
       start_addr_set = true;
     } else if (strncmp(argv[i], "--disk", 6) == 0) {
       // Parse --disk0=file[:slices], --disk1=file[:slices] (preferred form)
-      // slices is optional, 1-8, defaults to 4
+      // slices is optional, 1-8, defaults to 4; --diskN=ram:SIZE is a host
+      // RAM disk of SIZE bytes (K/M suffix), rounded up to whole slices
       const char* opt = argv[i] + 6;
       int unit = -1;
       const char* path_start = nullptr;
@@ -918,7 +1023,20 @@ int main(int argc, char** argv) {
         unit = (opt[0] - '0') * 10 + (opt[1] - '0');
         path_start = opt + 3;
       }
-      if (unit >= 0 && unit < 16 && path_start) {
+      if (unit >= 0 && unit < 16 && path_start && strncmp(path_start, "ram:", 4) == 0) {
+        char* end;
+        double size = strtod(path_start + 4, &end);
+        if (toupper(*end) == 'K') size *= 1024, end++;
+        else if (toupper(*end) == 'M') size *= 1024 * 1024, end++;
+        int slices = (int)((size + HBIOSDispatch::RAM_DISK_SLICE - 1) / HBIOSDispatch::RAM_DISK_SLICE);
+        if (end == path_start + 4 || *end != '\0' || size <= 0 || slices > 8) {
+          fprintf(stderr, "Invalid RAM disk size: %s (use up to 8 slices of %zu bytes, e.g. ram:32M)\n",
+                  path_start + 4, (size_t)HBIOSDispatch::RAM_DISK_SLICE);
+          return 1;
+        }
+        hbios_disks[unit] = path_start;
+        hbios_disk_slices[unit] = slices;
+      } else if (unit >= 0 && unit < 16 && path_start) {
         // Check for :N slice count suffix (must be at end after the file path)
         std::string path_str(path_start);
         int slice_count = 4;  // Default
@@ -945,7 +1063,7 @@ int main(int argc, char** argv) {
         hbios_disk_slices[unit] = slice_count;
         fprintf(stderr, "[DISK] Validated disk%d: %s (%zu bytes, %d slices)\n", unit, path_str.c_str(), disk_size, slice_count);
       } else {
-        fprintf(stderr, "Invalid --disk option: %s (use --disk0=file[:slices] or --disk1=file[:slices])\n", argv[i]);
+        fprintf(stderr, "Invalid --disk option: %s (use --disk0=file[:slices], --disk1=file[:slices] or --diskN=ram:SIZE)\n", argv[i]);
         return 1;
       }
     } else if (strncmp(argv[i], "--romapp=", 9) == 0) {
@@ -1008,6 +1126,81 @@ int main(int argc, char** argv) {
         // Literal character
         console_escape_char = esc[0];
       }
+    } else if (strcmp(argv[i], "--console-int") == 0) {
+      console_int = true;
+    } else if (strcmp(argv[i], "--lazy-core") == 0) {
+      lazy_core = true;
+    } else if (strcmp(argv[i], "--hle") == 0) {
+      hle_mode = GuestHLE::HLE_ON;
+    } else if (strcmp(argv[i], "--hle=verify") == 0) {
+      hle_mode = GuestHLE::HLE_VERIFY;
+    } else if (strncmp(argv[i], "--hibernate=", 12) == 0) {
+      const char* arg = argv[i] + 12;
+      char* end;
+      hibernate_secs = (int)strtol(arg, &end, 10);
+      if (end == arg || hibernate_secs <= 0 || (*end != '\0' && *end != ':')) {
+        fprintf(stderr, "Invalid hibernate option: %s (use SECS or SECS:FILE)\n", arg);
+        return 1;
+      }
+      if (*end == ':') hibernate_spool = end + 1;
+    } else if (strcmp(argv[i], "--ksm") == 0) {
+      arena_flags |= banked_mem::ARENA_MERGEABLE;
+    } else if (strcmp(argv[i], "--huge-page") == 0) {
+      arena_flags |= banked_mem::ARENA_HUGEPAGE;
+    } else if (strcmp(argv[i], "--mem-report") == 0) {
+      mem_report = true;
+    } else if (strcmp(argv[i], "--latency-report") == 0) {
+      emu_latency_enable(true);
+      atexit(print_latency_report);
+    } else if (strncmp(argv[i], "--shm-view=", 11) == 0) {
+      shm_name = argv[i] + 11;
+      if (shm_name.empty() || shm_name.find('/', 1) != std::string::npos) {
+        fprintf(stderr, "Invalid shared-memory name: %s\n", argv[i] + 11);
+        return 1;
+      }
+    } else if (strncmp(argv[i], "--control=", 10) == 0) {
+      control_path = argv[i] + 10;
+      if (control_path.empty()) {
+        fprintf(stderr, "Invalid control socket path\n");
+        return 1;
+      }
+    } else if (strncmp(argv[i], "--watchdog=", 11) == 0) {
+      if (!Watchdog::parse(argv[i] + 11, watchdog_secs, watchdog_action)) {
+        fprintf(stderr, "Invalid watchdog option: %s (use SECS or SECS:exit|snapshot|notify)\n",
+                argv[i] + 11);
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--boot-trace") == 0) {
+      emu_disk_set_boot_trace(true);
+    } else if (strcmp(argv[i], "--journal") == 0) {
+      emu_disk_set_journal(10);
+    } else if (strncmp(argv[i], "--journal=", 10) == 0) {
+      char* end;
+      long ms = strtol(argv[i] + 10, &end, 10);
+      if (end == argv[i] + 10 || *end != '\0' || ms < 0 || ms > 10000) {
+        fprintf(stderr, "Invalid journal window: %s (use 0-10000 ms)\n", argv[i] + 10);
+        return 1;
+      }
+      emu_disk_set_journal((int)ms);
+    } else if (strncmp(argv[i], "--session=", 10) == 0) {
+      const char* arg = argv[i] + 10;
+      const char* colon = strchr(arg, ':');
+      session_id.assign(arg, colon ? colon - arg : strlen(arg));
+      if (colon) session_dir = colon + 1;
+      bool valid = !session_id.empty();
+      for (char c : session_id) {
+        if (!isalnum((unsigned char)c) && c != '-' && c != '_') valid = false;
+      }
+      if (!valid) {
+        fprintf(stderr, "Invalid session ID: %s (use letters, digits, - and _)\n", arg);
+        return 1;
+      }
+    } else if (strncmp(argv[i], "--cold-banks=", 13) == 0) {
+      cold_bank_secs = atoi(argv[i] + 13);
+      if (cold_bank_secs <= 0) {
+        fprintf(stderr, "Invalid cold bank time: %s\n", argv[i] + 13);
+        return 1;
+      }
     } else if (strcmp(argv[i], "--mask-interrupt") == 0) {
       // Parse: --mask-interrupt 4000-4500 rst 7
       //    or: --mask-interrupt 5000-6000 call 0x0100
@@ -1101,23 +1294,153 @@ int main(int argc, char** argv) {
   // Set Z80 mode and enable banking
   cpu.set_cpu_mode(qkz80::MODE_Z80);
   fprintf(stderr, "CPU mode: Z80\n");
+  if (lazy_core) {
+    cpu.set_lazy_core(true);
+    fprintf(stderr, "CPU core: in-tree lazy-flag core\n");
+  }
+  if (hle_mode != GuestHLE::HLE_OFF) {
+    cpu.get_hle().setMode(hle_mode);
+    fprintf(stderr, "HLE: native guest routines%s\n",
+            hle_mode == GuestHLE::HLE_VERIFY ? " (verify)" : "");
+  }
+  if ((arena_flags & banked_mem::ARENA_MERGEABLE) && (arena_flags & banked_mem::ARENA_HUGEPAGE)) {
+    // KSM splits huge pages to merge them, so the two defeat each other
+    fprintf(stderr, "Error: --ksm and --huge-page cannot be combined\n");
+    return 1;
+  }
+  if (!shm_name.empty()) {
+    // The segment must hold the live bytes: cold-bank packing, hibernation,
+    // KSM and huge pages all assume private anonymous memory
+    if (arena_flags || cold_bank_secs > 0 || hibernate_secs > 0) {
+      fprintf(stderr, "Error: --shm-view cannot be combined with --ksm, --huge-page, "
+                      "--cold-banks or --hibernate\n");
+      return 1;
+    }
+    if (!shm_view.open(shm_name, &memory)) {
+      fprintf(stderr, "Error: cannot create shared memory %s: %s\n",
+              shm_name.c_str(), strerror(errno));
+      return 1;
+    }
+    fprintf(stderr, "Shared view: /dev/shm/%s\n", shm_name.c_str() + (shm_name[0] == '/'));
+  }
+  if (!control_path.empty()) {
+    std::string error;
+    if (!control.open(control_path, error)) {
+      fprintf(stderr, "Error: cannot listen on %s: %s\n", control_path.c_str(), error.c_str());
+      return 1;
+    }
+    fprintf(stderr, "Control socket: %s\n", control_path.c_str());
+  }
+  if (watchdog_action == Watchdog::ACTION_NOTIFY && !control.isOpen()) {
+    fprintf(stderr, "Error: --watchdog=SECS:notify needs --control\n");
+    return 1;
+  }
+  memory.set_arena_flags(arena_flags);
   memory.enable_banking();
-  memory.set_debug(debug);
+
+  // --debug turns every subsystem up; --log then adjusts individual ones.
+  // Records are formatted and written by a background thread.
+  if (debug) emu_logger_set_all(LOG_DEBUG);
+  if (!log_spec.empty() && !emu_logger_parse_levels(log_spec.c_str())) {
+    fprintf(stderr, "Invalid log levels: %s\n", log_spec.c_str());
+    return 1;
+  }
+  emu_logger_start(stderr);
   fprintf(stderr, "RomWBW mode: 512KB ROM + 512KB RAM, bank switching enabled\n");
 
   // Create emulator (sets cpu.delegate in constructor)
   AltairEmulator emu(&cpu, &memory, debug);
   emu.set_strict_io_mode(strict_io_mode);
-  emu.getHBIOS()->setDebug(debug);  // Enable HBIOS debug output
+  emu.getHBIOS()->setConsoleInterrupts(console_int);
+
+  long long instruction_count = 0;
+
+  // What CIOIN does while it waits for console input (none = just block)
+  HBIOSDispatch::IdleCallback idle_wait;
+
+  // How the hibernator and cold-bank sweeper wait for console input. With
+  // a control socket a request also ends the wait, so that the control
+  // loop below answers it with the machine resident.
+  std::function<bool(int)> wait_input = emu_console_wait_input;
+  if (control.isOpen()) {
+    wait_input = [&](int timeout_ms) {
+      return emu_console_wait_input(0) || control.wait(timeout_ms, STDIN_FILENO);
+    };
+  }
+
+  std::unique_ptr<SessionHibernator> hibernator;
+  if (hibernate_secs > 0) {
+    if (hibernate_spool.empty()) {
+      const char* tmp = getenv("TMPDIR");
+      hibernate_spool = std::string(tmp && *tmp ? tmp : "/tmp") +
+                        "/romwbw-" + std::to_string(getpid()) + ".hib";
+    }
+    hibernator.reset(new SessionHibernator(&memory, hibernate_secs, hibernate_spool));
+    SessionHibernator* hib = hibernator.get();
+    hib->setWait(wait_input);
+    idle_wait = [hib]() { hib->waitForInput(); };
+    fprintf(stderr, "Hibernate: after %d s idle, spool %s\n",
+            hibernate_secs, hibernate_spool.c_str());
+  }
+
+  if (cold_bank_secs > 0) {
+    memory.set_cold_bank_seconds(cold_bank_secs);
+    if (!hibernator) {
+      // Keep sweeping while the guest waits for console input
+      int slice_ms = cold_bank_secs * 500;
+      idle_wait = [&memory, wait_input, slice_ms]() {
+        while (!wait_input(slice_ms) && !emu_console_wait_interrupted()) {
+          memory.sweep_cold_banks();
+        }
+      };
+    }
+    fprintf(stderr, "Cold banks: compressed after %d s unused\n", cold_bank_secs);
+  }
+  // Control requests are answered by control_handler (set up with the main
+  // loop below); while the guest waits for input they are served here,
+  // between rounds of the hibernator or sweeper when there is one
+  ControlSocket::Handler control_handler;
+  bool control_in_idle = false;
+  if (control.isOpen()) {
+    HBIOSDispatch::IdleCallback inner = idle_wait;
+    idle_wait = [&, inner]() {
+      control_in_idle = true;
+      while (control_paused || !emu_console_wait_input(0)) {
+        if (stop_requested || emu_console_wait_interrupted()) break;
+        if (inner && !control_paused) {
+          inner();  // Returns on console input or a pending request
+          control.service(control_handler, 0);
+        } else {
+          control.service(control_handler, -1, control_paused ? -1 : STDIN_FILENO);
+        }
+      }
+      control_in_idle = false;
+    };
+  }
+  if (shm_view.isOpen()) {
+    // Show the guest as blocked before waiting
+    HBIOSDispatch::IdleCallback inner = idle_wait;
+    idle_wait = [&, inner]() {
+      shm_view.publish(cpu, memory, *emu.getHBIOS(), instruction_count, true);
+      if (inner) inner();
+    };
+  }
+  if (idle_wait) emu.getHBIOS()->setIdleCallback(idle_wait);
 
   // Set up HBIOS disk images
   // NOTE: Memory disks are initialized later, after ROM is loaded
   // Attach any file-backed hard disk images (HBIOS dispatch protocol)
   int disk_count = 0;
   for (int i = 0; i < 16; i++) {
-    if (!hbios_disks[i].empty()) {
+    if (hbios_disks[i].compare(0, 4, "ram:") == 0) {
+      emu.getHBIOS()->createRamDisk(i, hbios_disk_slices[i]);
+      disk_count++;
+    } else if (!hbios_disks[i].empty()) {
       if (!emu.getHBIOS()->loadDiskFromFile(i, hbios_disks[i])) {
-        fprintf(stderr, "Warning: Could not attach disk %d: %s\n", i, hbios_disks[i].c_str());
+        // A disk named on the command line that cannot be opened (or
+        // journaled) stops the run rather than booting without it
+        fprintf(stderr, "Error: Could not attach disk %d: %s\n", i, hbios_disks[i].c_str());
+        return 1;
       } else {
         disk_count++;
       }
@@ -1217,7 +1540,10 @@ int main(int argc, char** argv) {
 
   // Signal handler for graceful stop
   auto signal_handler = [](int sig) {
-    (void)sig;
+    if (sig == SIGTERM && session_mode) {
+      checkpoint_requested = true;
+      emu_console_interrupt_wait();  // Wake an idle wait to write it
+    }
     stop_requested = true;
   };
   signal(SIGINT, signal_handler);
@@ -1237,20 +1563,217 @@ int main(int argc, char** argv) {
             nmi_config.cycle_min, nmi_config.cycle_max);
   }
 
+  std::unique_ptr<MemoryReport> mem_stats;
+  if (mem_report) {
+    mem_stats.reset(new MemoryReport(memory.get_arena(), memory.get_arena_size()));
+    mem_stats->print(stderr, "start");
+  }
+
+  std::unique_ptr<Watchdog> watchdog;
+  if (watchdog_secs > 0) {
+    watchdog.reset(new Watchdog(watchdog_secs, watchdog_action));
+    fprintf(stderr, "Watchdog: %s after %d s without progress\n",
+            Watchdog::actionName(watchdog_action), watchdog_secs);
+  }
+
   // Main execution loop
-  long long instruction_count = 0;
+
+  // Session checkpoint: SIGTERM writes the machine state to the session
+  // file and exits; the next start with the same ID resumes from it. A
+  // checkpoint taken while CIOIN waits for input records that the HBIOS
+  // call is still outstanding, and the resumed process dispatches it again.
+  std::string session_file;
+  auto save_machine = [&](const std::string& path, bool in_dispatch) {
+    StateWriter plat;
+    plat.u64(instruction_count);
+    plat.flag(in_dispatch);
+    emu.save_state(plat);
+    return emu_checkpoint_save(path, cpu, memory, *emu.getHBIOS(), plat);
+  };
+  auto write_checkpoint = [&](bool in_dispatch) {
+    auto t0 = std::chrono::steady_clock::now();
+    bool ok = save_machine(session_file, in_dispatch);
+    if (ok) {
+      emu_log("\n[CHECKPOINT] Session %s saved in %.1f ms\n", session_id.c_str(),
+              std::chrono::duration<double, std::milli>(
+                  std::chrono::steady_clock::now() - t0).count());
+    }
+    return ok;
+  };
+  if (!session_id.empty()) {
+    if (session_dir.empty()) {
+      const char* tmp = getenv("TMPDIR");
+      session_dir = tmp && *tmp ? tmp : "/tmp";
+    }
+    session_file = session_dir + "/romwbw-" + session_id + ".ckpt";
+    session_mode = true;
+
+    HBIOSDispatch::IdleCallback inner = idle_wait;
+    emu.getHBIOS()->setIdleCallback([&, inner]() {
+      if (inner) {
+        inner();
+      } else {
+        emu_console_wait_input(-1);  // Interrupted by SIGTERM
+      }
+      if (checkpoint_requested) {
+        bool ok = write_checkpoint(true);
+        emu_io_cleanup();
+        exit(ok ? 0 : 1);
+      }
+    });
+
+    bool resume_dispatch = false;
+    if (emu_file_exists(session_file)) {
+      auto t0 = std::chrono::steady_clock::now();
+      std::vector<uint8_t> plat;
+      if (!emu_checkpoint_load(session_file, cpu, memory, *emu.getHBIOS(), plat)) {
+        emu_fatal("Cannot resume session %s from %s", session_id.c_str(), session_file.c_str());
+      }
+      StateReader r(plat.data(), plat.size());
+      instruction_count = r.u64();
+      resume_dispatch = r.flag();
+      emu.load_state(r);
+      remove(session_file.c_str());
+      emu_log("[CHECKPOINT] Session %s resumed in %.1f ms\n", session_id.c_str(),
+              std::chrono::duration<double, std::milli>(
+                  std::chrono::steady_clock::now() - t0).count());
+    }
+    fprintf(stderr, "Session %s: checkpoint on SIGTERM to %s\n",
+            session_id.c_str(), session_file.c_str());
+    if (resume_dispatch) {
+      emu.getHBIOS()->handlePortDispatch();
+    }
+  }
+
+  // Control socket requests (--control). A snapshot is a session
+  // checkpoint: name it romwbw-ID.ckpt to resume it with --session=ID.
+  control_handler = [&](const ControlRequest& req, ControlReply& reply) {
+    HBIOSDispatch* hbios = emu.getHBIOS();
+    std::string cmd = req.str("cmd");
+    auto address = [&](int& addr) {
+      addr = req.isString("addr") ? parse_address(req.str("addr").c_str())
+                                  : (int)req.num("addr", -1);
+      if (addr >= 0 && addr <= 0xFFFF) return true;
+      reply.error("bad or missing \"addr\"");
+      return false;
+    };
+
+    if (cmd == "attach" || cmd == "replace") {
+      int unit = (int)req.num("unit", -1);
+      std::string path = req.str("path");
+      if (unit < 0 || unit >= 16 || path.empty()) {
+        reply.error("need \"unit\" (0-15) and \"path\"");
+      } else if (hbios->isDiskLoaded(unit) != (cmd == "replace")) {
+        reply.error(cmd == "attach" ? "unit in use (use replace)" : "unit not attached");
+      } else if (const char* err = validate_disk_image(path.c_str())) {
+        reply.error(err);
+      } else if (!hbios->loadDiskFromFile(unit, path)) {
+        reply.error("cannot open " + path);
+      } else {
+        hbios->setDiskSliceCount(unit, (int)req.num("slices", 8));
+        hbios->populateDiskUnitTable();
+      }
+    } else if (cmd == "detach") {
+      int unit = (int)req.num("unit", -1);
+      if (unit < 0 || unit >= 16 || !hbios->isDiskLoaded(unit)) {
+        reply.error("unit not attached");
+      } else {
+        hbios->closeDisk(unit);
+        hbios->populateDiskUnitTable();
+      }
+    } else if (cmd == "input") {
+      for (unsigned char c : req.str("text")) emu_console_queue_char(c);
+    } else if (cmd == "pause") {
+      control_paused = true;
+    } else if (cmd == "resume") {
+      control_resume_pc = control_break_pc;
+      control_break_pc = -1;
+      control_paused = false;
+      if (watchdog) watchdog->rearm(hbios->getProgressCount(), cpu.cycles);
+    } else if (cmd == "snapshot") {
+      std::string path = req.str("path");
+      auto t0 = std::chrono::steady_clock::now();
+      if (path.empty()) {
+        reply.error("need \"path\"");
+      } else if (!save_machine(path, control_in_idle)) {
+        reply.error("cannot write " + path);
+      } else {
+        reply.add("ms", (long long)std::chrono::duration_cast<std::chrono::milliseconds>(
+                            std::chrono::steady_clock::now() - t0).count());
+      }
+    } else if (cmd == "stats") {
+      static const char* const classes[HBIOSDispatch::NUM_TRAP_TYPES] = {
+        "CIO", "DIO", "RTC", "SYS", "VDA", "SND", "DSKY", "EXT", "HCS"};
+      std::string calls = "{";
+      for (int i = 0; i < HBIOSDispatch::NUM_TRAP_TYPES; i++) {
+        calls += std::string(i ? "," : "") + ControlReply::quote(classes[i]) + ":" +
+                 std::to_string(hbios->getCallCounts()[i]);
+      }
+      std::string disks = "[";
+      for (int i = 0; i < 16; i++) {
+        if (!hbios->isDiskLoaded(i)) continue;
+        uint64_t prefetched, used;
+        emu_disk_prefetch_stats((emu_disk_handle)hbios->getDisk(i).handle, &prefetched, &used);
+        disks += std::string(disks.size() > 1 ? "," : "") + "{\"unit\":" + std::to_string(i) +
+                 ",\"path\":" + ControlReply::quote(hbios->getDisk(i).path) +
+                 ",\"prefetched\":" + std::to_string(prefetched) +
+                 ",\"prefetch_used\":" + std::to_string(used) + "}";
+      }
+      char pc[8];
+      snprintf(pc, sizeof(pc), "0x%04X", cpu.regs.PC.get_pair16());
+      reply.add("instructions", instruction_count);
+      reply.add("cycles", (long long)cpu.cycles);
+      reply.add("pc", pc);
+      reply.add("bank", (long long)memory.get_current_bank());
+      reply.add("paused", control_paused);
+      reply.add("waiting_input", control_in_idle);
+      if (control_break_pc >= 0) reply.add("breakpoint", format_address(control_break_pc));
+      reply.addRaw("hbios_calls", calls + "}");
+      reply.addRaw("disks", disks + "]");
+    } else if (cmd == "break") {
+      int addr;
+      if (address(addr)) breakpoints.insert((uint16_t)addr);
+    } else if (cmd == "unbreak") {
+      int addr;
+      if (req.str("addr") == "all") breakpoints.clear();
+      else if (address(addr)) breakpoints.erase((uint16_t)addr);
+    } else if (cmd == "breaks") {
+      std::string list = "[";
+      for (uint16_t a : breakpoints) {
+        list += std::string(list.size() > 1 ? "," : "") + ControlReply::quote(format_address(a));
+      }
+      reply.addRaw("breakpoints", list + "]");
+    } else {
+      reply.error("unknown command: " + cmd);
+    }
+  };
+
   long long max_instructions = 10000000000LL;  // 10 billion max
   bool in_step_mode = false;  // True if stepping from console
+  int exit_code = 0;
+
+  // The watchdog window starts here (cycles carry over a resumed session)
+  if (watchdog) watchdog->rearm(emu.getHBIOS()->getProgressCount(), cpu.cycles);
 
   while (!stop_requested) {
+    // Paused from the control socket: serve requests until resumed
+    while (control_paused && !stop_requested) control.service(control_handler, -1);
+
     uint16_t pc = cpu.regs.PC.get_pair16();
     uint8_t opcode = memory.fetch_mem(pc, true) & 0xFF;
 
-    // Check for breakpoint hit
-    if (breakpoints.count(pc) && !in_step_mode) {
+    // Check for breakpoint hit (with a control socket, the machine pauses
+    // for its client instead of entering console mode)
+    if (breakpoints.count(pc) && !in_step_mode && pc != control_resume_pc) {
       fprintf(stderr, "\n[Breakpoint hit at %s]\n", format_address(pc).c_str());
+      if (control.isOpen()) {
+        control_paused = true;
+        control_break_pc = pc;
+        continue;
+      }
       console_mode_requested = true;
     }
+    control_resume_pc = -1;
 
     // Check if stepping is complete
     if (in_step_mode && step_count <= 0) {
@@ -1264,6 +1787,7 @@ int main(int argc, char** argv) {
     // Handle console mode
     if (console_mode_requested) {
       console_mode_requested = false;
+      cpu.sync_flags();  // Console shows and edits regs.AF
       ConsoleResult result = handle_console_mode(&cpu, &memory);
       switch (result) {
         case CONSOLE_QUIT:
@@ -1289,11 +1813,11 @@ int main(int argc, char** argv) {
 
     // Debug: track first 50000 instructions after boot to see where we go
     static long debug_count = 0;
-    if (debug && debug_count < 50000 && instruction_count > 1) {
+    if (emu_log_on(LOG_TRACE) && debug_count < 50000 && instruction_count > 1) {
       debug_count++;
       if (debug_count % 1000 == 0 || (pc >= 0xF600 && pc < 0xF700) ||
           pc == 0xEB59 || pc == 0xEB5C || pc == 0xE806 || pc == 0xF483) {
-        fprintf(stderr, "[TRACE %ld: PC=0x%04X, op=0x%02X]\n", debug_count, pc, opcode);
+        emu_logf(LOG_TRACE, LOG_DEBUG, "[TRACE %ld: PC=0x%04X, op=0x%02X]\n", debug_count, pc, opcode);
       }
     }
 
@@ -1301,7 +1825,7 @@ int main(int argc, char** argv) {
     // emu.trace_after_cioin(pc, opcode);
 
     // Execute one instruction (I/O is handled via hbios_cpu port_in/port_out)
-    cpu.execute();
+    cpu.step();
     instruction_count++;
     if (in_step_mode) step_count--;
 
@@ -1324,7 +1848,7 @@ int main(int argc, char** argv) {
 
     // Check for scheduled interrupts (using upstream qkz80 interrupt API)
     if (nmi_config.enabled && cpu.cycles >= nmi_config.next_trigger) {
-      cpu.request_nmi();
+      cpu.raise_nmi();
       nmi_config.next_trigger = get_next_trigger(nmi_config, cpu.cycles);
     }
     if (maskable_int_config.enabled &&
@@ -1332,23 +1856,82 @@ int main(int argc, char** argv) {
         !waiting_for_int_delivery) {
       // Request interrupt using upstream API
       if (maskable_int_config.use_rst) {
-        cpu.request_rst(maskable_int_config.rst_num);
+        cpu.raise_rst(maskable_int_config.rst_num);
       } else {
         // CALL mode: use IM0 with RST 38H vector (0xFF)
-        cpu.request_int(0xFF);
+        cpu.raise_int(0xFF);
       }
       waiting_for_int_delivery = true;
     }
 
+    // Interrupt-driven console input: raise an interrupt when host input is
+    // pending so the guest handler can fill its ring (polled periodically,
+    // the check costs a select() call)
+    if (console_int && instruction_count % CONSOLE_INT_POLL == 0 &&
+        !cpu.interrupt_pending() && emu.getHBIOS()->consoleInterruptPending()) {
+      cpu.raise_int(HBIOSDispatch::CONSOLE_INT_VECTOR);
+    }
+
     // Deliver pending interrupts
-    cpu.check_interrupts();
+    cpu.service_interrupts();
 
     // If we were waiting for INT delivery and it completed, schedule next
-    if (waiting_for_int_delivery && !cpu.int_pending) {
+    if (waiting_for_int_delivery && !cpu.interrupt_pending()) {
       maskable_int_config.next_trigger = get_next_trigger(maskable_int_config, cpu.cycles);
       waiting_for_int_delivery = false;
     }
 
+    if (cold_bank_secs > 0 && instruction_count % COLD_BANK_SWEEP == 0) {
+      memory.sweep_cold_banks();
+    }
+
+    if (shm_view.isOpen() && instruction_count % SHM_PUBLISH == 0) {
+      shm_view.publish(cpu, memory, *emu.getHBIOS(), instruction_count, false);
+    }
+
+    if (control.isOpen() && instruction_count % CONTROL_POLL == 0) {
+      control.service(control_handler, 0);
+    }
+
+    // Runaway guest: report, then exit, snapshot and exit, or pause for
+    // the control socket's clients. Polling for input that can still
+    // arrive (wait_input is also true at EOF), through CIOIST or the SIMH
+    // console status port, is waiting, not stuck.
+    if (watchdog && instruction_count % Watchdog::SAMPLE_INTERVAL == 0 &&
+        watchdog->sample(Watchdog::physicalPC(memory.get_current_bank(), cpu.regs.PC.get_pair16()),
+                         emu.getHBIOS()->getProgressCount(), cpu.cycles,
+                         (emu.getHBIOS()->isPollingForInput() || cpu.get_simh().inputIdle()) &&
+                         !emu_console_wait_input(0))) {
+      char where[16];
+      snprintf(where, sizeof(where), "%02X:%04X", memory.get_current_bank(),
+               cpu.regs.PC.get_pair16());
+      fprintf(stderr, "\n[Watchdog] Runaway guest at %s after %lld instructions\n%s",
+              where, instruction_count, watchdog->report().c_str());
+      if (watchdog->onTrip() == Watchdog::ACTION_NOTIFY) {
+        ControlReply event;
+        event.add("pc", where);
+        event.add("instructions", instruction_count);
+        event.add("seconds", (long long)watchdog->timeout());
+        control.notify("watchdog", event);
+        control_paused = true;
+        continue;
+      }
+      if (watchdog->onTrip() == Watchdog::ACTION_SNAPSHOT) {
+        // Named like a session checkpoint: resume it with --session=watchdog-PID
+        const char* tmp = getenv("TMPDIR");
+        std::string path = (session_dir.empty() ? std::string(tmp && *tmp ? tmp : "/tmp")
+                                                : session_dir) +
+                           "/romwbw-watchdog-" + std::to_string(getpid()) + ".ckpt";
+        if (save_machine(path, false)) {
+          fprintf(stderr, "[Watchdog] Snapshot written to %s\n", path.c_str());
+        } else {
+          fprintf(stderr, "[Watchdog] Cannot write snapshot %s\n", path.c_str());
+        }
+      }
+      exit_code = Watchdog::EXIT_CODE;
+      break;
+    }
+
     // Periodically check for console escape (every 10000 instructions)
     // This allows ^E to work even in tight loops that don't do I/O
     if (instruction_count % 10000 == 0) {
@@ -1388,10 +1971,25 @@ int main(int argc, char** argv) {
     }
   }
 
+  if (checkpoint_requested && !write_checkpoint(false)) {
+    exit_code = 1;
+  }
+
+  if (hle_mode != GuestHLE::HLE_OFF) {
+    cpu.get_hle().printStats(stderr);
+  }
+  if (cold_bank_secs > 0) {
+    memory.print_cold_bank_stats(stderr);
+  }
+  if (mem_stats) {
+    mem_stats->print(stderr, "exit", instruction_count);
+  }
+
   // Write trace file if tracing was enabled
   if (!trace_file.empty()) {
     memory.write_trace_script(trace_file.c_str(), load_addr);
   }
 
-  return 0;
+  emu_logger_stop();
+  return exit_code;
 }
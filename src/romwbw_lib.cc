@@ -0,0 +1,374 @@
+/*
+ * libromwbw - Embeddable RomWBW machine with a C API (romwbw.h)
+ *
+ * Each machine owns its memory, CPU, HBIOS dispatch, console buffers and
+ * host files.
+ * HBIOS runs non-blocking, as in the browser build: a CIOIN with no input
+ * rewinds to its OUT and flags the wait, and romwbw_run returns so the
+ * application can supply input.
+ */
+
+#include "romwbw.h"
+#include "hbios_cpu.h"
+#include "emu_io.h"
+#include "emu_init.h"
+#include "emu_checkpoint.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdarg>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+namespace {
+
+// Instructions between deadline and output-match checks
+const uint64_t RUN_CHECK = 4096;
+
+}  // namespace
+
+struct romwbw_machine : public HBIOSCPUDelegate {
+  emu_host_files host_files;        // Outlives hbios, which closes files
+  banked_mem memory;
+  hbios_cpu cpu;
+  HBIOSDispatch hbios;
+  emu_console_buffers console;
+
+  int disk_slices[16];              // Requested slices, 0 = auto
+  uint16_t initialized_ram_banks = 0;
+  uint64_t instruction_count = 0;
+  bool rom_loaded = false;
+  bool started = false;
+  bool halted = false;
+  std::string error;
+
+  explicit romwbw_machine(unsigned flags) : cpu(&memory, this) {
+    for (int& s : disk_slices) s = 0;
+    memory.enable_banking();
+    cpu.set_cpu_mode(qkz80::MODE_Z80);
+    if (flags & ROMWBW_LAZY_CORE) cpu.set_lazy_core(true);
+    hbios.setCPU(&cpu);
+    hbios.setMemory(&memory);
+    hbios.setBlockingAllowed(false);  // romwbw_run returns instead
+  }
+
+  // HBIOSCPUDelegate implementation
+  banked_mem* getMemory() override { return &memory; }
+  HBIOSDispatch* getHBIOS() override { return &hbios; }
+  void initializeRamBankIfNeeded(uint8_t bank) override {
+    emu_init_ram_bank(&memory, bank, &initialized_ram_banks);
+  }
+  void onHalt() override { halted = true; }
+  void onUnimplementedOpcode(uint8_t opcode, uint16_t pc) override {
+    emu_log("[UNIMPLEMENTED] opcode 0x%02X at PC=0x%04X\n", opcode, pc);
+    halted = true;
+  }
+  void logDebug(const char* fmt, ...) override { (void)fmt; }
+
+  // Routes the calling thread's console and host files to the machine
+  // for the life of the guard
+  struct Attach {
+    explicit Attach(romwbw_machine* m) {
+      emu_console_attach(&m->console);
+      emu_host_files_attach(&m->host_files);
+    }
+    ~Attach() {
+      emu_console_attach(nullptr);
+      emu_host_files_attach(nullptr);
+    }
+  };
+
+  int fail(const char* fmt, ...) {
+    char buf[512];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    error = buf;
+    return -1;
+  }
+
+  // Slice count for unit under the romwbw_emu auto rule
+  int slicesFor(int unit) const {
+    if (disk_slices[unit] > 0) return disk_slices[unit];
+    int count = 0;
+    for (int i = 0; i < 16; i++) {
+      if (hbios.isDiskLoaded(i)) count++;
+    }
+    return (count <= 1) ? 8 : (count == 2) ? 4 : 2;
+  }
+
+  // A disk attached after start shows up at the next device scan
+  void diskAttached(int unit, int slices) {
+    disk_slices[unit] = slices;
+    if (!started) return;
+    hbios.setDiskSliceCount(unit, slicesFor(unit));
+    hbios.populateDiskUnitTable();
+  }
+
+  // Platform section, laid out as romwbw_emu writes it so snapshots and
+  // session checkpoints are interchangeable
+  StateWriter platformState() const {
+    StateWriter w;
+    w.u64(instruction_count);
+    w.flag(false);  // Never inside a dispatch between runs
+    w.u16(initialized_ram_banks);
+    w.flag(false);  // romldr PC redirect, unused here
+    w.u16(0);
+    return w;
+  }
+
+  void loadPlatformState(const std::vector<uint8_t>& plat) {
+    StateReader r(plat.data(), plat.size());
+    instruction_count = r.u64();
+    bool in_dispatch = r.flag();
+    initialized_ram_banks = r.u16();
+    halted = false;
+    started = true;
+    // A romwbw_emu checkpoint taken in a blocked CIOIN: dispatch it again,
+    // which here rewinds to the OUT until input is queued
+    if (in_dispatch) hbios.handlePortDispatch();
+  }
+};
+
+//=============================================================================
+// Exported Functions
+//=============================================================================
+
+extern "C" {
+
+const char* romwbw_version(void) {
+  return ROMWBW_VERSION;
+}
+
+romwbw_machine* romwbw_create(unsigned flags) {
+  // HBIOSDispatch's constructor resets the host files; give it a fresh set
+  // rather than the caller's
+  emu_host_files scratch;
+  emu_host_files_attach(&scratch);
+  romwbw_machine* m = new romwbw_machine(flags);
+  emu_host_files_attach(nullptr);
+  return m;
+}
+
+void romwbw_destroy(romwbw_machine* m) {
+  if (!m) return;
+  romwbw_machine::Attach attach(m);
+  delete m;  // HBIOSDispatch closes (and flushes) the disks and host files
+}
+
+const char* romwbw_last_error(const romwbw_machine* m) {
+  return m ? m->error.c_str() : "no machine";
+}
+
+int romwbw_load_rom_file(romwbw_machine* m, const char* path) {
+  if (m->started) return m->fail("machine already started");
+  if (!emu_load_rom(&m->memory, path)) return m->fail("cannot load ROM %s", path);
+  m->rom_loaded = true;
+  return 0;
+}
+
+int romwbw_load_rom(romwbw_machine* m, const void* data, size_t size) {
+  if (m->started) return m->fail("machine already started");
+  if (!emu_load_rom_from_buffer(&m->memory, static_cast<const uint8_t*>(data), size)) {
+    return m->fail("bad ROM image (%zu bytes)", size);
+  }
+  m->rom_loaded = true;
+  return 0;
+}
+
+int romwbw_attach_disk_file(romwbw_machine* m, int unit, const char* path, int slices) {
+  if (unit < 0 || unit >= 16) return m->fail("bad disk unit %d", unit);
+  if (slices < 0 || slices > 8) return m->fail("bad slice count %d", slices);
+  if (const char* err = emu_validate_disk_image(path)) return m->fail("%s", err);
+  if (!m->hbios.loadDiskFromFile(unit, path)) return m->fail("cannot open %s", path);
+  m->diskAttached(unit, slices);
+  return 0;
+}
+
+int romwbw_attach_disk(romwbw_machine* m, int unit, const void* data, size_t size, int slices) {
+  if (unit < 0 || unit >= 16) return m->fail("bad disk unit %d", unit);
+  if (slices < 0 || slices > 8) return m->fail("bad slice count %d", slices);
+  if (!m->hbios.loadDisk(unit, static_cast<const uint8_t*>(data), size)) {
+    return m->fail("cannot attach %zu-byte image", size);
+  }
+  m->diskAttached(unit, slices);
+  return 0;
+}
+
+int romwbw_attach_ram_disk(romwbw_machine* m, int unit, size_t size) {
+  if (unit < 0 || unit >= 16) return m->fail("bad disk unit %d", unit);
+  size_t slices = (size + HBIOSDispatch::RAM_DISK_SLICE - 1) / HBIOSDispatch::RAM_DISK_SLICE;
+  if (slices < 1 || slices > 8) return m->fail("bad RAM disk size %zu", size);
+  m->hbios.createRamDisk(unit, (int)slices);
+  m->diskAttached(unit, (int)slices);
+  return 0;
+}
+
+int romwbw_detach_disk(romwbw_machine* m, int unit) {
+  if (unit < 0 || unit >= 16 || !m->hbios.isDiskLoaded(unit)) {
+    return m->fail("unit %d not attached", unit);
+  }
+  m->hbios.closeDisk(unit);
+  m->disk_slices[unit] = 0;
+  if (m->started) m->hbios.populateDiskUnitTable();
+  return 0;
+}
+
+const uint8_t* romwbw_disk_data(romwbw_machine* m, int unit, size_t* size) {
+  if (unit < 0 || unit >= 16 || !m->hbios.isDiskLoaded(unit)) return nullptr;
+  const HBDisk& disk = m->hbios.getDisk(unit);
+  if (disk.file_backed || disk.ram_backed) return nullptr;
+  if (size) *size = disk.data.size();
+  return disk.data.data();
+}
+
+int romwbw_start(romwbw_machine* m) {
+  if (!m->rom_loaded) return m->fail("no ROM loaded");
+
+  // Same sequence as romwbw_emu: slice counts, then the shared init
+  int slices[16];
+  for (int i = 0; i < 16; i++) {
+    slices[i] = m->hbios.isDiskLoaded(i) ? m->slicesFor(i) : 0;
+    if (slices[i]) m->hbios.setDiskSliceCount(i, slices[i]);
+  }
+  romwbw_machine::Attach attach(m);
+  emu_complete_init(&m->memory, &m->hbios, slices);
+
+  m->cpu.regs.AF.set_pair16(0);
+  m->cpu.regs.BC.set_pair16(0);
+  m->cpu.regs.DE.set_pair16(0);
+  m->cpu.regs.HL.set_pair16(0);
+  m->cpu.regs.PC.set_pair16(0x0000);
+  m->cpu.regs.SP.set_pair16(0x0000);
+  m->memory.select_bank(0);
+  m->instruction_count = 0;
+  m->halted = false;
+  m->started = true;
+  return 0;
+}
+
+int romwbw_run(romwbw_machine* m, uint64_t max_instructions,
+               const char* until_output, int timeout_ms) {
+  if (!m->started) {
+    m->fail("machine not started");
+    return ROMWBW_STOP_ERROR;
+  }
+  if (m->halted) return ROMWBW_STOP_HALT;
+
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+  size_t match_len = until_output ? strlen(until_output) : 0;
+  size_t search_from = m->console.output.size();
+  size_t output_seen = search_from;
+
+  romwbw_machine::Attach attach(m);
+  m->hbios.clearWaitingForInput();
+  int reason = -1;
+  uint64_t done = 0;
+
+  while (reason < 0) {
+    m->cpu.step();
+    m->instruction_count++;
+    done++;
+
+    if (m->hbios.hasOutputChars()) {
+      for (uint8_t ch : m->hbios.getOutputChars()) emu_console_write_char(ch);
+    }
+    m->cpu.service_interrupts();
+
+    if (m->halted) {
+      reason = ROMWBW_STOP_HALT;
+    } else if (m->console.input.empty() &&
+               (m->hbios.isWaitingForInput() || m->hbios.isPollingForInput() ||
+                m->cpu.get_simh().inputIdle())) {
+      reason = ROMWBW_STOP_INPUT;
+    } else if (done == max_instructions) {
+      reason = ROMWBW_STOP_COUNT;
+    }
+
+    // Output is checked as it grows; the clock only every RUN_CHECK
+    if (match_len && m->console.output.size() != output_seen) {
+      output_seen = m->console.output.size();
+      if (m->console.output.find(until_output, search_from) != std::string::npos) {
+        reason = ROMWBW_STOP_MATCH;
+      } else if (output_seen >= search_from + match_len) {
+        search_from = output_seen - match_len + 1;
+      }
+    }
+    if (reason < 0 && timeout_ms >= 0 && done % RUN_CHECK == 0 &&
+        std::chrono::steady_clock::now() >= deadline) {
+      reason = ROMWBW_STOP_DEADLINE;
+    }
+  }
+
+  return reason;
+}
+
+int romwbw_write_input(romwbw_machine* m, const void* data, size_t size) {
+  const uint8_t* p = static_cast<const uint8_t*>(data);
+  m->console.input.insert(m->console.input.end(), p, p + size);
+  return 0;
+}
+
+size_t romwbw_output_size(const romwbw_machine* m) {
+  return m->console.output.size();
+}
+
+size_t romwbw_read_output(romwbw_machine* m, char* buf, size_t size) {
+  size_t n = std::min(size, m->console.output.size());
+  memcpy(buf, m->console.output.data(), n);
+  m->console.output.erase(0, n);
+  return n;
+}
+
+uint64_t romwbw_instruction_count(const romwbw_machine* m) {
+  return m->instruction_count;
+}
+
+uint16_t romwbw_pc(const romwbw_machine* m) {
+  return m->cpu.regs.PC.get_pair16();
+}
+
+int romwbw_save_snapshot_file(romwbw_machine* m, const char* path) {
+  if (!m->started) return m->fail("machine not started");
+  romwbw_machine::Attach attach(m);
+  bool ok = emu_checkpoint_save(path, m->cpu, m->memory, m->hbios, m->platformState());
+  return ok ? 0 : m->fail("cannot write snapshot %s", path);
+}
+
+int romwbw_load_snapshot_file(romwbw_machine* m, const char* path) {
+  std::vector<uint8_t> plat;
+  romwbw_machine::Attach attach(m);
+  bool ok = emu_checkpoint_load(path, m->cpu, m->memory, m->hbios, plat);
+  if (ok) m->loadPlatformState(plat);
+  return ok ? 0 : m->fail("cannot restore snapshot %s", path);
+}
+
+uint8_t* romwbw_save_snapshot(romwbw_machine* m, size_t* size) {
+  if (!m->started) {
+    m->fail("machine not started");
+    return nullptr;
+  }
+  romwbw_machine::Attach attach(m);
+  std::vector<uint8_t> data =
+      emu_checkpoint_encode(m->cpu, m->memory, m->hbios, m->platformState());
+  uint8_t* out = static_cast<uint8_t*>(malloc(data.size()));
+  if (!out) {
+    m->fail("out of memory");
+    return nullptr;
+  }
+  memcpy(out, data.data(), data.size());
+  *size = data.size();
+  return out;
+}
+
+int romwbw_load_snapshot(romwbw_machine* m, const void* data, size_t size) {
+  std::vector<uint8_t> plat;
+  romwbw_machine::Attach attach(m);
+  bool ok = emu_checkpoint_decode(static_cast<const uint8_t*>(data), size, "snapshot",
+                                  m->cpu, m->memory, m->hbios, plat);
+  if (ok) m->loadPlatformState(plat);
+  return ok ? 0 : m->fail("bad snapshot");
+}
+
+}  // extern "C"
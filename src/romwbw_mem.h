@@ -2,9 +2,17 @@
 #define ROMWBW_MEM_H
 
 #include "qkz80_mem.h"
+#include "host_compute.h"
+#include "emu_checkpoint.h"
+#include "emu_logger.h"
+#include <chrono>
 #include <cstdint>
 #include <cstring>
 #include <cstdio>
+#include <vector>
+#if !defined(__EMSCRIPTEN__)
+#include <sys/mman.h>
+#endif
 
 /*
  * RomWBW Banked Memory
@@ -26,6 +34,27 @@
  * I/O ports (MM_SBC style, directly wired to select_bank):
  *   - Port 0x78: Bank selector (ROM or RAM based on bit 7)
  *   - Port 0x7C: Same (both ports do the same thing in SBC)
+ *
+ * Cold bank compression (optional, set_cold_bank_seconds):
+ *   Banks not reached through select_bank/read_bank/write_bank/bank_span
+ *   for the configured time are LZ4-packed by sweep_cold_banks() and their
+ *   host pages handed back to the OS. Uniform banks (erased ROM, unused
+ *   RAM) keep only the fill byte. A packed bank is unpacked on its next
+ *   access. The common bank and shadow RAM bank 0x80 (the target of
+ *   writes through any ROM bank) are never packed.
+ *   While neither this nor snapshot dirty tracking is on, stores and bank
+ *   selects skip the bookkeeping behind a single features_active test.
+ *
+ * Host layout: ROM and RAM share one page-aligned mmap arena (ROM first).
+ * set_arena_flags() can mark it MADV_MERGEABLE so KSM dedupes identical
+ * banks across emulator processes, or place it in a single 2 MB aligned
+ * transparent huge page. set_arena_file() maps it MAP_SHARED from a file
+ * or shared-memory object instead, so another process can watch guest
+ * memory live (see emu_shmview.h).
+ *
+ * Snapshot/rollback (snapshot_take/snapshot_restore): for fuzzing, the
+ * arena is copied once and every write then marks its 4 KB page dirty, so
+ * a rollback copies back only the pages the run touched.
  */
 class banked_mem : public qkz80_cpu_mem {
 public:
@@ -35,12 +64,22 @@ public:
     static const uint16_t BANK_BOUNDARY = 0x8000;
     static const uint8_t COMMON_BANK = 0x8F;
 
+    // Arena options (set_arena_flags, before enable_banking)
+    static const unsigned ARENA_MERGEABLE = 0x01;  // madvise(MADV_MERGEABLE)
+    static const unsigned ARENA_HUGEPAGE = 0x02;   // 2 MB aligned, MADV_HUGEPAGE
+    static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
 private:
     uint8_t* rom;
     uint8_t* ram;
+    uint8_t* arena;
+    size_t arena_len;
+    bool arena_mapped;
+    unsigned arena_flags;
+    int arena_fd;
+    size_t arena_fd_offset;
     uint8_t current_bank;
     bool banking_enabled;
-    bool debug;
 
     // Optional write protection
     uint16_t rom_protect_start;
@@ -49,6 +88,30 @@ private:
     uint16_t bios_trap_start;
     uint16_t bios_trap_end;
 
+    // Cold bank compression: index 0-15 = ROM banks, 16-31 = RAM banks
+    static const int NUM_BANKS = 32;
+    enum BankState : uint8_t { BANK_RESIDENT, BANK_FILLED, BANK_PACKED };
+    uint8_t bank_state[NUM_BANKS];
+    uint8_t bank_fill[NUM_BANKS];
+    uint8_t bank_touched[NUM_BANKS];
+    std::chrono::steady_clock::time_point bank_last_use[NUM_BANKS];
+    std::vector<uint8_t> bank_packed[NUM_BANKS];
+    int cold_seconds;
+    unsigned long bank_packs;
+    unsigned long bank_unpacks;
+
+    // Snapshot/rollback: dirty page tracking is off until snapshot_take
+    static const size_t SNAP_PAGE = 4096;
+    bool dirty_tracking;
+    std::vector<uint8_t> snap_image;
+    std::vector<uint8_t> page_dirty;
+    std::vector<uint32_t> dirty_pages;
+    uint8_t snap_bank;
+
+    // Cold banks or dirty tracking on: the only case in which stores and
+    // bank selects need bookkeeping, so the hot paths test this alone
+    bool features_active;
+
     // Optional tracing (compatible with altair_emu's cpm_mem)
     uint8_t* code_bitmap;
     uint8_t* data_read_bitmap;
@@ -58,17 +121,22 @@ private:
 public:
     banked_mem() :
         rom(nullptr), ram(nullptr),
-        current_bank(0x00), banking_enabled(false), debug(false),
+        arena(nullptr), arena_len(0), arena_mapped(false), arena_flags(0),
+        arena_fd(-1), arena_fd_offset(0),
+        current_bank(0x00), banking_enabled(false),
         rom_protect_start(0),
         bios_trap_start(0), bios_trap_end(0),
+        cold_seconds(0), bank_packs(0), bank_unpacks(0),
+        dirty_tracking(false), snap_bank(0), features_active(false),
         code_bitmap(nullptr), data_read_bitmap(nullptr), data_write_bitmap(nullptr),
         tracing_enabled(false)
     {
+        memset(bank_state, BANK_RESIDENT, sizeof(bank_state));
+        memset(bank_touched, 0, sizeof(bank_touched));
     }
 
     ~banked_mem() override {
-        delete[] rom;
-        delete[] ram;
+        free_arena();
         delete[] code_bitmap;
         delete[] data_read_bitmap;
         delete[] data_write_bitmap;
@@ -78,8 +146,7 @@ public:
     void enable_banking() {
         if (banking_enabled) return;
 
-        rom = new uint8_t[ROM_SIZE];
-        ram = new uint8_t[RAM_SIZE];
+        alloc_arena();
         memset(rom, 0xFF, ROM_SIZE);  // ROM erased state
         memset(ram, 0x00, RAM_SIZE);
         banking_enabled = true;
@@ -88,12 +155,61 @@ public:
 
     bool is_banking_enabled() const { return banking_enabled; }
 
-    void set_debug(bool enable) { debug = enable; }
+    void set_arena_flags(unsigned flags) { arena_flags = flags; }
+
+    // Back the arena with a shared mapping of fd at offset (page aligned,
+    // at least ROM_SIZE + RAM_SIZE bytes); before enable_banking. Arena
+    // flags are ignored, and release_banks() does not return the pages.
+    void set_arena_file(int fd, size_t offset) {
+        arena_fd = fd;
+        arena_fd_offset = offset;
+    }
+    const uint8_t* get_arena() const { return arena; }
+    size_t get_arena_size() const { return arena_len; }
+
+    // Hibernation: free the ROM/RAM buffers once their contents have been
+    // saved, and reallocate them (erased/zeroed) before restoring. Memory
+    // must not be accessed while released.
+    void release_banks() {
+        free_arena();
+        for (int i = 0; i < NUM_BANKS; i++) drop_packed(i);
+    }
+
+    void reacquire_banks() {
+        if (rom) return;
+        alloc_arena();
+        memset(rom, 0xFF, ROM_SIZE);
+        memset(ram, 0x00, RAM_SIZE);
+    }
+
+    bool banks_resident() const { return rom != nullptr; }
+
+    // Checkpoint: bank register, shadow map and full ROM/RAM contents
+    void save_state(StateWriter& w) {
+        w.u8(current_bank);
+        w.bytes(shadow_bitmap, SHADOW_BITMAP_SIZE);
+        w.bytes(get_rom(), ROM_SIZE);
+        w.bytes(get_ram(), RAM_SIZE);
+    }
+
+    bool load_state(StateReader& r) {
+        if (!banking_enabled) return false;
+        reacquire_banks();
+        current_bank = r.u8();
+        r.bytes(shadow_bitmap, SHADOW_BITMAP_SIZE);
+        r.bytes(get_rom(), ROM_SIZE);
+        r.bytes(get_ram(), RAM_SIZE);
+        return r.ok();
+    }
+
+    // Bank switch logging (emu_logger.h subsystem BANK)
+    void set_debug(bool enable) { emu_logger_set_level(LOG_BANK, enable ? LOG_DEBUG : LOG_ERROR); }
 
     // Clear RAM for clean state when loading a new ROM
     // (following porting notes: reset state when loading a new ROM)
     void clear_ram() {
         if (!banking_enabled || !ram) return;
+        for (int i = 16; i < NUM_BANKS; i++) drop_packed(i);
         memset(ram, 0x00, RAM_SIZE);
         // Also clear shadow bitmap
         memset(shadow_bitmap, 0, SHADOW_BITMAP_SIZE);
@@ -102,13 +218,17 @@ public:
     // Bank selection - called from I/O handler
     void select_bank(uint8_t bank_id) {
         if (!banking_enabled) return;
-        if (debug && bank_id != current_bank) {
-            fprintf(stderr, "[BANK] 0x%02X -> 0x%02X (%s %d)\n",
-                    current_bank, bank_id,
-                    (bank_id & 0x80) ? "RAM" : "ROM",
-                    bank_id & 0x0F);
+        if (bank_id != current_bank) {
+            EMU_DLOG(LOG_BANK, "[BANK] 0x%02X -> 0x%02X (%s %d)\n",
+                     current_bank, bank_id,
+                     (bank_id & 0x80) ? "RAM" : "ROM",
+                     bank_id & 0x0F);
         }
         current_bank = bank_id;
+        if (features_active) {
+            touch_bank(bank_id);
+            if (bank_id == 0x00) touch_bank(0x80);  // Shadow RAM for ROM bank 0
+        }
     }
 
     uint8_t get_current_bank() const { return current_bank; }
@@ -188,6 +308,7 @@ public:
             // from 0x0500 to 0xFE00-0xFFFF via LDIR at startup.
 
             uint32_t phys = ((COMMON_BANK & 0x0F) * BANK_SIZE) + (addr - BANK_BOUNDARY);
+            if (features_active) note_ram_store(COMMON_BANK, phys);
             ram[phys] = byte;
         }
     }
@@ -215,6 +336,7 @@ public:
             return false;
         }
 
+        for (int i = 0; i < 16; i++) unpack_bank(i);
         size_t read = fread(rom, 1, size, fp);
         fclose(fp);
 
@@ -228,8 +350,9 @@ public:
     }
 
     // Direct bank access (for disk DMA)
-    uint8_t read_bank(uint8_t bank_id, uint16_t offset) const {
+    uint8_t read_bank(uint8_t bank_id, uint16_t offset) {
         if (!banking_enabled || offset >= BANK_SIZE) return 0xFF;
+        if (features_active) touch_bank(bank_id);
         if (bank_id & 0x80) {
             return ram[((bank_id & 0x0F) * BANK_SIZE) + offset];
         } else {
@@ -244,14 +367,118 @@ public:
             // RAM bank - write directly, no protection needed
             // The ROM's emu_hbios.asm handles all HBIOS setup
             uint32_t phys = ((bank_id & 0x0F) * BANK_SIZE) + offset;
+            if (features_active) note_ram_store(bank_id, phys);
             ram[phys] = value;
         }
         // ROM writes ignored
     }
 
-    // Raw access for initialization
-    uint8_t* get_rom() { return rom; }
-    uint8_t* get_ram() { return ram; }
+    // Span access: host pointer to bank storage, valid for BANK_SIZE - offset
+    // bytes. Returns nullptr for an invalid offset, or for a ROM bank when
+    // writable is requested (ROM writes are ignored, as in write_bank).
+    uint8_t* bank_span(uint8_t bank_id, uint16_t offset, bool writable) {
+        if (!banking_enabled || offset >= BANK_SIZE) return nullptr;
+        if (writable && !(bank_id & 0x80)) return nullptr;
+        if (features_active) touch_bank(bank_id);
+        if (bank_id & 0x80) {
+            size_t base = ((bank_id & 0x0F) * BANK_SIZE) + offset;
+            if (writable && dirty_tracking) {
+                mark_dirty_range(ROM_SIZE + base, BANK_SIZE - offset);
+            }
+            return ram + base;
+        }
+        return rom + ((bank_id & 0x0F) * BANK_SIZE) + offset;
+    }
+
+    // Raw access for initialization (unpacks every bank of the region)
+    uint8_t* get_rom() {
+        for (int i = 0; i < 16; i++) unpack_bank(i);
+        if (dirty_tracking) mark_dirty_range(0, ROM_SIZE);
+        return rom;
+    }
+    uint8_t* get_ram() {
+        for (int i = 16; i < NUM_BANKS; i++) unpack_bank(i);
+        if (dirty_tracking) mark_dirty_range(ROM_SIZE, RAM_SIZE);
+        return ram;
+    }
+
+    // Snapshot/rollback. snapshot_take records ROM, RAM, the bank register
+    // and the shadow map; snapshot_restore returns to that state and
+    // reports how many pages it copied. Cold bank packing must be off.
+    void snapshot_take() {
+        if (!banking_enabled) return;
+        dirty_tracking = false;
+        uint8_t* r = get_rom();
+        uint8_t* w = get_ram();
+        snap_image.resize(ROM_SIZE + RAM_SIZE + SHADOW_BITMAP_SIZE);
+        memcpy(snap_image.data(), r, ROM_SIZE);
+        memcpy(snap_image.data() + ROM_SIZE, w, RAM_SIZE);
+        memcpy(snap_image.data() + ROM_SIZE + RAM_SIZE, shadow_bitmap, SHADOW_BITMAP_SIZE);
+        snap_bank = current_bank;
+        page_dirty.assign((ROM_SIZE + RAM_SIZE) / SNAP_PAGE, 0);
+        dirty_pages.clear();
+        dirty_tracking = true;
+        features_active = true;
+    }
+
+    size_t snapshot_restore() {
+        if (!dirty_tracking) return 0;
+        size_t copied = dirty_pages.size();
+        for (uint32_t page : dirty_pages) {
+            size_t off = page * SNAP_PAGE;
+            memcpy(arena + off, snap_image.data() + off, SNAP_PAGE);
+            page_dirty[page] = 0;
+        }
+        dirty_pages.clear();
+        memcpy(shadow_bitmap, snap_image.data() + ROM_SIZE + RAM_SIZE, SHADOW_BITMAP_SIZE);
+        current_bank = snap_bank;
+        return copied;
+    }
+
+    // Cold bank compression: banks idle for secs are packed by
+    // sweep_cold_banks(), which the run loop calls periodically (0 = off)
+    void set_cold_bank_seconds(int secs) {
+        cold_seconds = secs;
+        auto now = std::chrono::steady_clock::now();
+        for (int i = 0; i < NUM_BANKS; i++) bank_last_use[i] = now;
+        if (secs > 0) {
+            features_active = true;
+        } else {
+            // Nothing will unpack on access any more
+            if (rom) for (int i = 0; i < NUM_BANKS; i++) unpack_bank(i);
+            features_active = dirty_tracking;
+        }
+    }
+
+    void sweep_cold_banks() {
+        if (!banking_enabled || !rom || cold_seconds <= 0) return;
+        auto now = std::chrono::steady_clock::now();
+        auto cold = std::chrono::seconds(cold_seconds);
+        for (int i = 0; i < NUM_BANKS; i++) {
+            if (bank_touched[i] || is_pinned(i)) {
+                bank_touched[i] = 0;
+                bank_last_use[i] = now;
+            } else if (bank_state[i] == BANK_RESIDENT && now - bank_last_use[i] >= cold) {
+                pack_bank(i);
+            }
+        }
+    }
+
+    void print_cold_bank_stats(FILE* f) const {
+        int filled = 0, packed = 0;
+        size_t packed_bytes = 0;
+        for (int i = 0; i < NUM_BANKS; i++) {
+            if (bank_state[i] == BANK_FILLED) filled++;
+            if (bank_state[i] == BANK_PACKED) {
+                packed++;
+                packed_bytes += bank_packed[i].size();
+            }
+        }
+        fprintf(f, "Cold banks: %d filled, %d packed (%zu KB for %zu KB), "
+                   "%lu packs, %lu unpacks\n",
+                filled, packed, packed_bytes / 1024, packed * BANK_SIZE / 1024,
+                bank_packs, bank_unpacks);
+    }
 
     // Tracing queries (compatible with altair_emu)
     bool was_executed(uint16_t addr) const {
@@ -316,6 +543,164 @@ public:
     }
 
 private:
+    // Page-aligned so packed banks can be returned with madvise and
+    // identical pages merged; falls back to the heap without mmap
+    void alloc_arena() {
+        arena_len = ROM_SIZE + RAM_SIZE;
+        arena_mapped = false;
+#if !defined(__EMSCRIPTEN__)
+        if (arena_fd >= 0) {
+            void* p = mmap(nullptr, arena_len, PROT_READ | PROT_WRITE,
+                           MAP_SHARED, arena_fd, (off_t)arena_fd_offset);
+            if (p != MAP_FAILED) {
+                arena = static_cast<uint8_t*>(p);
+                arena_mapped = true;
+            } else {
+                fprintf(stderr, "[MEM] Shared arena mapping failed, using private memory\n");
+            }
+        } else if (arena_flags & ARENA_HUGEPAGE) {
+            // Over-map, then trim to one aligned huge page
+            arena_len = HUGE_PAGE_SIZE;
+            size_t span = 2 * HUGE_PAGE_SIZE;
+            void* p = mmap(nullptr, span, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (p != MAP_FAILED) {
+                uintptr_t base = reinterpret_cast<uintptr_t>(p);
+                uintptr_t aligned = (base + HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1);
+                if (aligned > base) munmap(p, aligned - base);
+                if (aligned + HUGE_PAGE_SIZE < base + span) {
+                    munmap(reinterpret_cast<void*>(aligned + HUGE_PAGE_SIZE),
+                           base + span - aligned - HUGE_PAGE_SIZE);
+                }
+                arena = reinterpret_cast<uint8_t*>(aligned);
+                arena_mapped = true;
+#ifdef MADV_HUGEPAGE
+                if (madvise(arena, arena_len, MADV_HUGEPAGE) != 0) {
+                    fprintf(stderr, "[MEM] MADV_HUGEPAGE failed, using small pages\n");
+                }
+#endif
+            }
+        } else {
+            void* p = mmap(nullptr, arena_len, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (p != MAP_FAILED) {
+                arena = static_cast<uint8_t*>(p);
+                arena_mapped = true;
+            }
+        }
+#ifdef MADV_MERGEABLE
+        if (arena_mapped && arena_fd < 0 && (arena_flags & ARENA_MERGEABLE) &&
+            madvise(arena, arena_len, MADV_MERGEABLE) != 0) {
+            fprintf(stderr, "[MEM] MADV_MERGEABLE failed (kernel without KSM?)\n");
+        }
+#endif
+#endif
+        if (!arena_mapped) {
+            arena_len = ROM_SIZE + RAM_SIZE;
+            arena = new uint8_t[arena_len];
+        }
+        rom = arena;
+        ram = arena + ROM_SIZE;
+    }
+
+    void free_arena() {
+        if (!arena) return;
+#if !defined(__EMSCRIPTEN__)
+        if (arena_mapped) munmap(arena, arena_len);
+#endif
+        if (!arena_mapped) delete[] arena;
+        arena = nullptr;
+        rom = nullptr;
+        ram = nullptr;
+    }
+
+    void mark_dirty(size_t arena_off) {
+        uint32_t page = arena_off / SNAP_PAGE;
+        if (!page_dirty[page]) {
+            page_dirty[page] = 1;
+            dirty_pages.push_back(page);
+        }
+    }
+
+    void mark_dirty_range(size_t arena_off, size_t len) {
+        for (size_t off = arena_off & ~(SNAP_PAGE - 1); off < arena_off + len; off += SNAP_PAGE) {
+            mark_dirty(off);
+        }
+    }
+
+    static int bank_index(uint8_t bank_id) {
+        return ((bank_id & 0x80) ? 16 : 0) + (bank_id & 0x0F);
+    }
+
+    uint8_t* bank_base(int idx) {
+        return idx < 16 ? rom + idx * BANK_SIZE : ram + (idx - 16) * BANK_SIZE;
+    }
+
+    // Current bank, the common bank and shadow RAM bank 0x80 are live
+    // through fetch_mem/store_mem. Stores also touch the bank they write,
+    // but 0x80 is written through every ROM bank, so it is always pinned.
+    bool is_pinned(int idx) const {
+        return idx == bank_index(current_bank) || idx == bank_index(COMMON_BANK) ||
+               idx == bank_index(0x80);
+    }
+
+    void touch_bank(uint8_t bank_id) {
+        int idx = bank_index(bank_id);
+        bank_touched[idx] = 1;
+        if (bank_state[idx] != BANK_RESIDENT) unpack_bank(idx);
+    }
+
+    // Bookkeeping before a store to RAM at phys (features_active only)
+    void note_ram_store(uint8_t bank_id, uint32_t phys) {
+        touch_bank(bank_id);
+        if (dirty_tracking) mark_dirty(ROM_SIZE + phys);
+    }
+
+    void pack_bank(int idx) {
+        uint8_t* base = bank_base(idx);
+        if (base[0] == base[BANK_SIZE - 1] &&
+            memcmp(base, base + 1, BANK_SIZE - 1) == 0) {
+            bank_fill[idx] = base[0];
+            bank_state[idx] = BANK_FILLED;
+        } else {
+            std::vector<uint8_t> buf(BANK_SIZE / 2);
+            size_t len = hc_lz4_compress(base, BANK_SIZE, buf.data(), buf.size());
+            if (len == 0) {
+                bank_last_use[idx] = std::chrono::steady_clock::now();
+                return;  // Does not compress to half size; leave resident
+            }
+            buf.resize(len);
+            buf.shrink_to_fit();
+            bank_packed[idx].swap(buf);
+            bank_state[idx] = BANK_PACKED;
+        }
+        bank_packs++;
+#if defined(__linux__)
+        // Private anonymous pages read back as zero after MADV_DONTNEED;
+        // unpack_bank rewrites the whole bank either way
+        madvise(base, BANK_SIZE, MADV_DONTNEED);
+#endif
+    }
+
+    void unpack_bank(int idx) {
+        if (bank_state[idx] == BANK_RESIDENT) return;
+        uint8_t* base = bank_base(idx);
+        if (bank_state[idx] == BANK_FILLED) {
+            memset(base, bank_fill[idx], BANK_SIZE);
+        } else if (hc_lz4_decompress(bank_packed[idx].data(), bank_packed[idx].size(),
+                                     base, BANK_SIZE) != (long)BANK_SIZE) {
+            fprintf(stderr, "[BANK] Packed bank %d is corrupt\n", idx);
+        }
+        drop_packed(idx);
+        bank_last_use[idx] = std::chrono::steady_clock::now();
+        bank_unpacks++;
+    }
+
+    void drop_packed(int idx) {
+        bank_state[idx] = BANK_RESIDENT;
+        std::vector<uint8_t>().swap(bank_packed[idx]);
+    }
+
     // Shadow RAM: tracks which addresses have been written to when in ROM mode
     // When ROM is selected and we write to lower 32KB, it goes to RAM bank 0x80
     // When reading, if the address was written to, read from RAM instead of ROM
@@ -355,12 +740,14 @@ private:
         if (current_bank & 0x80) {
             // Current bank is RAM - write directly
             uint32_t phys = ((current_bank & 0x0F) * BANK_SIZE) + addr;
+            if (features_active) note_ram_store(current_bank, phys);
             ram[phys] = byte;
         } else {
             // Current bank is ROM - write to shadow RAM (bank 0x80)
             // This is how real MM_SBC hardware works: when executing from ROM,
             // writes go to the corresponding RAM bank (shadow RAM / ROM overlay)
             uint32_t phys = (0 * BANK_SIZE) + addr;  // Bank 0x80 index 0
+            if (features_active) note_ram_store(0x80, phys);
             ram[phys] = byte;
             set_shadow_bit(addr);  // Mark this address as shadowed
         }
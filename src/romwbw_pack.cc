@@ -0,0 +1,116 @@
+/*
+ * Packed image converter - between plain and compressed disk images
+ *
+ * Packs a disk image into the compressed chunked format of emu_packed.h,
+ * which romwbw_emu attaches like a plain image, or unpacks one back. The
+ * direction follows the input: a packed input is unpacked.
+ *
+ * Usage: romwbw_pack [-j THREADS] [-c CHUNK_KB] IN OUT
+ *   -j  worker threads, 1-256 (default: one per CPU)
+ *   -c  chunk size in KB when packing, 4-1024 (default 32)
+ * IN and OUT must be different files.
+ */
+
+#include "emu_packed.h"
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const unsigned MAX_THREADS = 256;
+
+// A whole decimal number from lo to hi, or false
+static bool parse_count(const char* arg, unsigned lo, unsigned hi, unsigned& value) {
+  char* end;
+  errno = 0;
+  unsigned long v = strtoul(arg, &end, 10);
+  if (end == arg || *end != '\0' || errno != 0 || arg[0] == '-' || v < lo || v > hi) return false;
+  value = (unsigned)v;
+  return true;
+}
+
+static void usage(const char* prog) {
+  fprintf(stderr, "Usage: %s [-j THREADS] [-c CHUNK_KB] IN OUT\n", prog);
+  fprintf(stderr, "  Packs a disk image, or unpacks IN if it is already packed.\n");
+  fprintf(stderr, "  -j THREADS   Worker threads, 1-%u (default: one per CPU)\n", MAX_THREADS);
+  fprintf(stderr, "  -c CHUNK_KB  Chunk size when packing, 4-1024 KB (default %u)\n",
+          PackedDisk::DEFAULT_CHUNK / 1024);
+}
+
+int main(int argc, char** argv) {
+  unsigned threads = 0;
+  uint32_t chunk_size = PackedDisk::DEFAULT_CHUNK;
+  int i = 1;
+  for (; i < argc && argv[i][0] == '-'; i++) {
+    unsigned kb;
+    if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+      if (!parse_count(argv[++i], 1, MAX_THREADS, threads)) {
+        fprintf(stderr, "Invalid thread count: %s (1-%u)\n", argv[i], MAX_THREADS);
+        return 1;
+      }
+    } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+      if (!parse_count(argv[++i], 4, 1024, kb)) {
+        fprintf(stderr, "Invalid chunk size: %s (4-1024 KB)\n", argv[i]);
+        return 1;
+      }
+      chunk_size = kb * 1024;
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (argc - i != 2) {
+    usage(argv[0]);
+    return 1;
+  }
+  const char* in_path = argv[i];
+  const char* out_path = argv[i + 1];
+
+  int in_fd = open(in_path, O_RDONLY);
+  if (in_fd < 0) {
+    fprintf(stderr, "%s: %s\n", in_path, strerror(errno));
+    return 1;
+  }
+  // OUT is truncated on open, so it must not be IN under any name
+  struct stat in_st, out_st;
+  if (fstat(in_fd, &in_st) == 0 && stat(out_path, &out_st) == 0 &&
+      in_st.st_dev == out_st.st_dev && in_st.st_ino == out_st.st_ino) {
+    fprintf(stderr, "%s: input and output are the same file\n", out_path);
+    close(in_fd);
+    return 1;
+  }
+  int out_fd = open(out_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (out_fd < 0) {
+    fprintf(stderr, "%s: %s\n", out_path, strerror(errno));
+    close(in_fd);
+    return 1;
+  }
+
+  auto t0 = std::chrono::steady_clock::now();
+  bool unpacking = PackedDisk::probe(in_fd);
+  std::string error;
+  bool ok = unpacking ? PackedDisk::unpack(in_fd, out_fd, threads, error)
+                      : PackedDisk::pack(in_fd, out_fd, chunk_size, threads, error);
+  ok = fsync(out_fd) == 0 && ok;
+  double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+  fstat(in_fd, &in_st);
+  fstat(out_fd, &out_st);
+  close(in_fd);
+  close(out_fd);
+  if (!ok) {
+    fprintf(stderr, "%s: %s\n", in_path, error.empty() ? strerror(errno) : error.c_str());
+    unlink(out_path);
+    return 1;
+  }
+  printf("%s %s -> %s: %lld -> %lld bytes (%.1f%%) in %.2f s\n",
+         unpacking ? "Unpacked" : "Packed", in_path, out_path,
+         (long long)in_st.st_size, (long long)out_st.st_size,
+         in_st.st_size ? 100.0 * out_st.st_size / in_st.st_size : 0.0, secs);
+  return 0;
+}
@@ -0,0 +1,165 @@
+/*
+ * Z80 Exerciser Harness - ZEXDOC/ZEXALL under either CPU core
+ *
+ * Runs a CP/M .COM program on hbios_cpu in flat 64 KB memory, with the
+ * qkz80 core, the in-tree lazy-flag core (z80_lazy.h) or both in turn.
+ * Only the CP/M services the exercisers use are provided: BDOS function 2
+ * (console output) and 9 (print string), trapped when PC reaches 0x0005,
+ * and warm boot (PC reaching 0x0000), which ends the run. Program output
+ * goes to stdout. The report on stderr gives the instructions executed,
+ * the time and MIPS per core, whether the output contained "ERROR", and
+ * the speed of the lazy core relative to qkz80 when both ran.
+ *
+ * ZEXDOC.COM and ZEXALL.COM are in user area 2 of disks/hd1k_combo.img.
+ *
+ * Usage: romwbw_zex [--core=lazy|qkz80|both] [-n MAX] FILE.COM
+ * MAX stops a run after that many instructions (0, the default, = none).
+ * Exit status is 0 only if every run reached warm boot without "ERROR".
+ */
+
+#include "hbios_cpu.h"
+#include "emu_io.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+const uint16_t TPA = 0x0100;
+const uint16_t BDOS = 0x0005;
+const uint16_t BDOS_TOP = 0xFE00;       // Top of TPA, read from 0x0006
+
+struct ZexRun {
+  const char* core;
+  uint64_t instructions = 0;
+  double seconds = 0;
+  bool finished = false;                // Reached warm boot
+  bool error = false;                   // Output contained "ERROR"
+};
+
+void bdos_out(char c, std::string& line, ZexRun& run) {
+  putchar(c);
+  if (c == '\n') {
+    fflush(stdout);
+    line.clear();
+    return;
+  }
+  line += c;
+  if (line.find("ERROR") != std::string::npos) run.error = true;
+}
+
+bool run_program(const std::vector<uint8_t>& image, bool lazy, uint64_t max, ZexRun& run) {
+  banked_mem memory;                    // Banking off: flat 64 KB
+  hbios_cpu cpu(&memory);
+  cpu.set_cpu_mode(qkz80::MODE_Z80);
+  cpu.set_lazy_core(lazy);
+
+  for (uint32_t a = 0; a < 0x10000; a++) memory.store_mem(a, 0);
+  for (size_t i = 0; i < image.size(); i++) memory.store_mem(TPA + i, image[i]);
+  memory.store_mem(BDOS, 0xC3);         // JP BDOS_TOP
+  memory.store_mem(BDOS + 1, BDOS_TOP & 0xFF);
+  memory.store_mem(BDOS + 2, BDOS_TOP >> 8);
+  memory.store_mem(BDOS_TOP, 0xC9);     // RET
+  cpu.regs.SP.set_pair16(BDOS_TOP);
+  cpu.regs.PC.set_pair16(TPA);
+
+  std::string line;
+  auto start = std::chrono::steady_clock::now();
+  for (;;) {
+    uint16_t pc = cpu.regs.PC.get_pair16();
+    if (pc == 0x0000) {
+      run.finished = true;
+      break;
+    }
+    if (pc == BDOS) {
+      uint8_t fn = cpu.regs.BC.get_pair16() & 0xFF;
+      if (fn == 2) {
+        bdos_out(cpu.regs.DE.get_pair16() & 0xFF, line, run);
+      } else if (fn == 9) {
+        uint16_t addr = cpu.regs.DE.get_pair16();
+        for (int n = 0; n < 0x10000; n++) {
+          char c = memory.fetch_mem(addr++);
+          if (c == '$') break;
+          bdos_out(c, line, run);
+        }
+      }
+    }
+    if (max && run.instructions >= max) break;
+    cpu.step();
+    run.instructions++;
+  }
+  run.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  fflush(stdout);
+  return run.finished && !run.error;
+}
+
+double mips(const ZexRun& run) {
+  return run.seconds > 0 ? run.instructions / run.seconds / 1e6 : 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const char* core = "both";
+  uint64_t max = 0;
+  const char* path = nullptr;
+
+  for (int i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "--core=", 7) == 0) {
+      core = argv[i] + 7;
+    } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+      max = strtoull(argv[++i], nullptr, 10);
+    } else if (argv[i][0] != '-' && !path) {
+      path = argv[i];
+    } else {
+      path = nullptr;
+      break;
+    }
+  }
+  bool want_qkz80 = strcmp(core, "qkz80") == 0 || strcmp(core, "both") == 0;
+  bool want_lazy = strcmp(core, "lazy") == 0 || strcmp(core, "both") == 0;
+  if (!path || (!want_qkz80 && !want_lazy)) {
+    fprintf(stderr, "Usage: %s [--core=lazy|qkz80|both] [-n MAX] FILE.COM\n", argv[0]);
+    return 1;
+  }
+
+  emu_io_init();
+  std::vector<uint8_t> image;
+  FILE* f = fopen(path, "rb");
+  if (!f) emu_fatal("Cannot open %s", path);
+  int c;
+  while ((c = fgetc(f)) != EOF) image.push_back((uint8_t)c);
+  fclose(f);
+  if (image.empty() || image.size() > BDOS_TOP - TPA) {
+    emu_fatal("%s: not a CP/M program (%zu bytes)", path, image.size());
+  }
+
+  std::vector<ZexRun> runs;
+  bool ok = true;
+  if (want_qkz80) {
+    ZexRun run;
+    run.core = "qkz80";
+    ok &= run_program(image, false, max, run);
+    runs.push_back(run);
+  }
+  if (want_lazy) {
+    ZexRun run;
+    run.core = "lazy";
+    ok &= run_program(image, true, max, run);
+    runs.push_back(run);
+  }
+
+  fprintf(stderr, "\n%-6s %14s %10s %10s  %s\n", "core", "instructions", "seconds", "MIPS", "result");
+  for (const ZexRun& run : runs) {
+    fprintf(stderr, "%-6s %14llu %10.2f %10.2f  %s\n", run.core,
+            (unsigned long long)run.instructions, run.seconds, mips(run),
+            run.error ? "ERROR" : run.finished ? "ok" : "stopped");
+  }
+  if (runs.size() == 2 && mips(runs[0]) > 0) {
+    fprintf(stderr, "lazy/qkz80: %.2fx\n", mips(runs[1]) / mips(runs[0]));
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,298 @@
+/*
+ * SIMH Devices - AltairZ80 I/O devices used by the stock RomWBW SIMH ROMs
+ */
+
+#include "simh_dev.h"
+#include "romwbw_mem.h"
+#include "hbios_dispatch.h"
+#include "emu_io.h"
+#include "emu_latency.h"
+#include "emu_logger.h"
+#include <cstring>
+
+namespace {
+
+// SIMH pseudo device commands (altairz80_sio.c numbering)
+enum {
+  SIMH_ATTACH_PTR = 4,
+  SIMH_GET_VERSION = 6,
+  SIMH_GET_CLOCK_ZSDOS = 7,
+  SIMH_SET_CLOCK_ZSDOS = 8,
+  SIMH_GET_CLOCK_CPM3 = 9,
+  SIMH_SET_CLOCK_CPM3 = 10,
+  SIMH_GET_BANK = 11,
+  SIMH_SET_BANK = 12,
+  SIMH_GET_COMMON = 13,
+  SIMH_RESET = 14,
+  SIMH_ATTACH_PTP = 16,
+  SIMH_HAS_BANKED_MEMORY = 18,
+  SIMH_SET_TIMER_DELTA = 23,
+  SIMH_SET_TIMER_ADDR = 24,
+  SIMH_GET_PATH_SEPARATOR = 28,
+};
+
+const char SIMH_VERSION[] = "SIMH004";
+
+// A guest idle at a prompt spins on the SSER status port (RomWBW's CP/M
+// prompt polls every ~130 T-states, its boot menu every ~1300). After
+// SimhDevices::SSER_IDLE_POLLS empty status reads, each within
+// SSER_IDLE_GAP T-states of the last, every further empty read waits up
+// to 1 ms for input, until input or other device traffic arrives. A
+// program checking for ^C between real work polls far less densely and
+// is not slowed.
+const uint64_t SSER_IDLE_GAP = 4096;
+const int SSER_IDLE_WAIT_MS = 1;
+
+uint8_t bcd(int v) { return (uint8_t)(((v / 10) << 4) | (v % 10)); }
+
+// Days since 1977-12-31 (CP/M 3 date)
+int cpm3_days(int year, int month, int day) {
+  static const int before[] = {0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334};
+  int days = 0;
+  for (int y = 1978; y < year; y++) {
+    days += (y % 4 == 0 && (y % 100 != 0 || y % 400 == 0)) ? 366 : 365;
+  }
+  days += before[month - 1] + day;
+  if (month > 2 && year % 4 == 0 && (year % 100 != 0 || year % 400 == 0)) days++;
+  return days;
+}
+
+// Copy between buf and the CPU's current view of memory at addr (as a
+// DMA controller sees it), one memcpy per bank span. ROM spans and the
+// address wrap take the per-byte path.
+void dma_copy(banked_mem* memory, uint16_t addr, uint8_t* buf, size_t len, bool to_memory) {
+  while (len > 0) {
+    uint8_t bank = addr < banked_mem::BANK_BOUNDARY ? memory->get_current_bank()
+                                                     : banked_mem::COMMON_BANK;
+    uint16_t offset = addr & (banked_mem::BANK_SIZE - 1);
+    size_t chunk = banked_mem::BANK_SIZE - offset;
+    if (chunk > len) chunk = len;
+    uint8_t* span = memory->bank_span(bank, offset, to_memory);
+    if (span) {
+      if (to_memory) memcpy(span, buf, chunk);
+      else memcpy(buf, span, chunk);
+    } else {
+      for (size_t i = 0; i < chunk; i++) {
+        if (to_memory) memory->store_mem((uint16_t)(addr + i), buf[i]);
+        else buf[i] = memory->fetch_mem((uint16_t)(addr + i));
+      }
+    }
+    addr += chunk;
+    buf += chunk;
+    len -= chunk;
+  }
+}
+
+} // namespace
+
+void SimhDevices::reset() {
+  hdsk_cmd = HDSK_NONE;
+  hdsk_pos = 0;
+  pseudo_cmd = -1;
+  pseudo_need = 0;
+  pseudo_out_len = pseudo_out_pos = 0;
+  idle_polls = 0;
+}
+
+uint8_t SimhDevices::portIn(uint8_t port, uint64_t cycles, banked_mem* memory,
+                            HBIOSDispatch* hbios) {
+  switch (port) {
+    case SSER_STATUS:
+      if (emu_console_has_input()) {
+        idle_polls = 0;
+        return 0x21;
+      }
+      if (idle_polls > 0 && cycles - last_poll > SSER_IDLE_GAP) idle_polls = 0;
+      last_poll = cycles;
+      if (idle_polls == SSER_IDLE_POLLS) {
+        emu_console_wait_input(SSER_IDLE_WAIT_MS);  // Returns at once where it cannot block
+      } else {
+        idle_polls++;
+      }
+      return 0x20;
+
+    case SSER_DATA: {
+      idle_polls = 0;
+      if (!emu_console_has_input()) return 0;
+      int ch = emu_console_read_char();
+      if (ch >= 0) emu_latency_input_consumed();
+      if (ch < 0) ch = 0x1A;  // EOF - same ^Z marker as CIOIN
+      hbios->countProgress();
+      return ch & 0xFF;
+    }
+
+    case HDSK_PORT: {
+      uint8_t result = 0;
+      if ((hdsk_cmd == HDSK_READ || hdsk_cmd == HDSK_WRITE) && hdsk_pos == 6) {
+        result = hdskTransfer(memory, hbios);
+      }
+      hdsk_cmd = HDSK_NONE;
+      hdsk_pos = 0;
+      return result;
+    }
+
+    case PSEUDO_PORT:
+      if (pseudo_out_pos < pseudo_out_len) return pseudo_out[pseudo_out_pos++];
+      return 0;
+
+    default:
+      return 0xFF;
+  }
+}
+
+void SimhDevices::portOut(uint8_t port, uint8_t value, banked_mem* memory, HBIOSDispatch* hbios) {
+  switch (port) {
+    case SSER_DATA:
+      idle_polls = 0;
+      hbios->queueOutputChar(value);
+      hbios->countProgress();
+      break;
+
+    case HDSK_PORT:
+      idle_polls = 0;
+      if (hdsk_cmd == HDSK_READ || hdsk_cmd == HDSK_WRITE) {
+        if (hdsk_pos < 6) hdsk_args[hdsk_pos++] = value;
+      } else if (value == HDSK_READ || value == HDSK_WRITE) {
+        hdsk_cmd = value;
+        hdsk_pos = 0;
+      } else {
+        // RESET and PARAM complete at once (PARAM results are not used by
+        // RomWBW, which knows the geometry)
+        hdsk_cmd = HDSK_NONE;
+        hdsk_pos = 0;
+      }
+      break;
+
+    case PSEUDO_PORT:
+      if (pseudo_need > 0) {
+        pseudo_args[pseudo_pos++] = value;
+        if (--pseudo_need == 0) pseudoExecute();
+      } else {
+        pseudoCommand(value);
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+uint8_t SimhDevices::hdskTransfer(banked_mem* memory, HBIOSDispatch* hbios) {
+  int unit = hdsk_args[0];
+  uint32_t track = hdsk_args[2] | (hdsk_args[3] << 8);
+  uint32_t lba = (track << 8) | hdsk_args[1];
+  uint16_t dma = hdsk_args[4] | (hdsk_args[5] << 8);
+  bool write = hdsk_cmd == HDSK_WRITE;
+
+  EMU_DLOG(LOG_DIO, "[HDSK] %s unit=%d LBA=%u DMA=0x%04X\n",
+           write ? "write" : "read", unit, lba, dma);
+  if (!memory || unit >= 16 || !hbios->isDiskLoaded(unit)) return 1;
+
+  uint8_t block[HDSK_BLOCK];
+  if (write) {
+    dma_copy(memory, dma, block, HDSK_BLOCK, false);
+    if (hbios->writeDiskBlocks(unit, lba, block, 1) != 1) return 1;
+  } else {
+    if (hbios->readDiskBlocks(unit, lba, block, 1) != 1) return 1;
+    dma_copy(memory, dma, block, HDSK_BLOCK, true);
+  }
+  hbios->countProgress();
+  return 0;
+}
+
+void SimhDevices::pseudoCommand(uint8_t cmd) {
+  pseudo_cmd = cmd;
+  pseudo_pos = 0;
+  pseudo_out_len = pseudo_out_pos = 0;
+  switch (cmd) {
+    case SIMH_SET_CLOCK_ZSDOS:
+    case SIMH_SET_CLOCK_CPM3:
+    case SIMH_SET_TIMER_DELTA:
+    case SIMH_SET_TIMER_ADDR:
+      pseudo_need = 2;
+      break;
+    case SIMH_SET_BANK:
+      pseudo_need = 1;
+      break;
+    default:
+      pseudoExecute();
+      break;
+  }
+}
+
+void SimhDevices::pseudoExecute() {
+  switch (pseudo_cmd) {
+    case SIMH_GET_VERSION:
+      pseudoResult((const uint8_t*)SIMH_VERSION, sizeof(SIMH_VERSION));  // With NUL
+      break;
+
+    case SIMH_GET_CLOCK_ZSDOS: {
+      emu_time t;
+      emu_get_time(&t);
+      uint8_t r[6] = {bcd(t.year % 100), bcd(t.month), bcd(t.day),
+                      bcd(t.hour), bcd(t.minute), bcd(t.second)};
+      pseudoResult(r, 6);
+      break;
+    }
+
+    case SIMH_GET_CLOCK_CPM3: {
+      emu_time t;
+      emu_get_time(&t);
+      int days = cpm3_days(t.year, t.month, t.day);
+      uint8_t r[5] = {(uint8_t)days, (uint8_t)(days >> 8),
+                      bcd(t.hour), bcd(t.minute), bcd(t.second)};
+      pseudoResult(r, 5);
+      break;
+    }
+
+    case SIMH_GET_COMMON: {
+      uint8_t r[2] = {0x00, banked_mem::BANK_BOUNDARY >> 8};
+      pseudoResult(r, 2);
+      break;
+    }
+
+    case SIMH_GET_BANK:
+    case SIMH_HAS_BANKED_MEMORY: {
+      // Banking here is the SBC MMU on ports 0x78/0x7C, not SIMH's
+      uint8_t r = 0;
+      pseudoResult(&r, 1);
+      break;
+    }
+
+    case SIMH_ATTACH_PTR:
+    case SIMH_ATTACH_PTP: {
+      uint8_t r = 1;  // No paper tape devices
+      pseudoResult(&r, 1);
+      break;
+    }
+
+    case SIMH_GET_PATH_SEPARATOR: {
+      uint8_t r = '/';
+      pseudoResult(&r, 1);
+      break;
+    }
+
+    case SIMH_RESET:
+      reset();
+      break;
+
+    case SIMH_SET_CLOCK_ZSDOS:
+    case SIMH_SET_CLOCK_CPM3:
+    case SIMH_SET_BANK:
+    case SIMH_SET_TIMER_DELTA:
+    case SIMH_SET_TIMER_ADDR:
+      break;  // Parameters consumed, nothing to change
+
+    default:
+      EMU_DLOG(LOG_SYS, "[SIMH] Ignored pseudo device command %d\n", pseudo_cmd);
+      break;
+  }
+  pseudo_cmd = -1;
+}
+
+void SimhDevices::pseudoResult(const uint8_t* data, int len) {
+  if (len > (int)sizeof(pseudo_out)) len = sizeof(pseudo_out);
+  memcpy(pseudo_out, data, len);
+  pseudo_out_len = len;
+  pseudo_out_pos = 0;
+}
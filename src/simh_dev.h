@@ -0,0 +1,83 @@
+/*
+ * SIMH Devices - AltairZ80 I/O devices used by the stock RomWBW SIMH ROMs
+ *
+ * The SBC_simh_std ROMs run their own HBIOS in Z80 code and reach the
+ * host only through SIMH's I/O ports:
+ *
+ *   0x68/0x6D  SSER console: data, status (bit 0 = input ready,
+ *              bit 5 = output ready)
+ *   0xFD       HDSK hard disk: OTIR a 7-byte command block (command,
+ *              unit, sector, track lo/hi, DMA lo/hi), then IN the result
+ *              (0 = OK). RomWBW's hdsk.asm puts LBA bits 0-7 in the sector
+ *              and bits 8-23 in the track, so an image is linear 512-byte
+ *              blocks. The 512 bytes move between the disk and memory in
+ *              one copy at the DMA address, as SIMH does.
+ *   0xFE       SIMH pseudo device: OUT a command and its parameter bytes,
+ *              then IN the result bytes (clock, version, memory layout)
+ *
+ * Console bytes and HDSK transfers count as progress for the watchdog
+ * (HBIOSDispatch::countProgress), and inputIdle() as waiting for input.
+ *
+ * HDSK unit N is the disk attached with --diskN. Setting the clock is
+ * accepted and ignored, like HBIOS RTCSETTIM. The paper tape commands
+ * (R.COM/W.COM transfers) report failure; the HBIOS host file functions
+ * cover that use.
+ */
+
+#ifndef SIMH_DEV_H
+#define SIMH_DEV_H
+
+#include <cstddef>
+#include <cstdint>
+
+class banked_mem;
+class HBIOSDispatch;
+
+class SimhDevices {
+public:
+  static constexpr uint8_t SSER_DATA = 0x68;
+  static constexpr uint8_t SSER_STATUS = 0x6D;
+  static constexpr uint8_t HDSK_PORT = 0xFD;
+  static constexpr uint8_t PSEUDO_PORT = 0xFE;
+
+  // cycles is the CPU's T-state count, used to tell an idle status poll
+  // loop from a busy program
+  uint8_t portIn(uint8_t port, uint64_t cycles, banked_mem* memory, HBIOSDispatch* hbios);
+  void portOut(uint8_t port, uint8_t value, banked_mem* memory, HBIOSDispatch* hbios);
+
+  // Abandon partial commands (checkpoint restore)
+  void reset();
+
+  // True while the guest spins on an empty console status port, i.e. it
+  // is waiting for input (the SIMH ROMs' equivalent of a blocked CIOIN)
+  bool inputIdle() const { return idle_polls == SSER_IDLE_POLLS; }
+
+private:
+  // HDSK commands
+  enum { HDSK_NONE = 0, HDSK_RESET = 1, HDSK_READ = 2, HDSK_WRITE = 3, HDSK_PARAM = 4 };
+  static constexpr size_t HDSK_BLOCK = 512;
+  static constexpr unsigned SSER_IDLE_POLLS = 1000;  // See simh_dev.cc
+
+  uint8_t hdsk_cmd = HDSK_NONE;
+  int hdsk_pos = 0;         // Parameter bytes received
+  uint8_t hdsk_args[6] = {};
+
+  // Pseudo device: command being given parameters, and queued results
+  int pseudo_cmd = -1;
+  int pseudo_need = 0;      // Parameter bytes still expected
+  int pseudo_pos = 0;
+  uint8_t pseudo_args[4] = {};
+  uint8_t pseudo_out[16] = {};
+  int pseudo_out_len = 0;
+  int pseudo_out_pos = 0;
+
+  unsigned idle_polls = 0;  // Dense empty status reads (SSER_IDLE_POLLS = idle)
+  uint64_t last_poll = 0;   // Cycle count at the last status read
+
+  uint8_t hdskTransfer(banked_mem* memory, HBIOSDispatch* hbios);
+  void pseudoCommand(uint8_t cmd);
+  void pseudoExecute();
+  void pseudoResult(const uint8_t* data, int len);
+};
+
+#endif // SIMH_DEV_H
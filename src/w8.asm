@@ -1,7 +1,8 @@
-; W8.COM - Write CP/M file to host filesystem (RomWBW/HBIOS version)
+; W8.COM - Write CP/M files to host filesystem (RomWBW/HBIOS version)
 ;
 ; Usage: W8 <cpmname>
-;   Exports CP/M file to host with lowercase filename
+;   Exports each CP/M file matching cpmname (which may contain * and ?)
+;   to the host with lowercase filename
 ;
 ; Uses HBIOS extension functions for host file access
 
@@ -18,13 +19,17 @@ C_WRITE	equ	2
 C_PRINT	equ	9
 F_OPEN	equ	15
 F_CLOSE	equ	16
+F_SFIRST equ	17
+F_SNEXT	equ	18
 F_READ	equ	20
 F_DMA	equ	26
 
 ; HBIOS extension functions for host file transfer
-H_OPEN_W equ	0E2h	; Open host file for writing (DE=path)
-H_WRITE	equ	0E4h	; Write byte (E=byte)
-H_CLOSE	equ	0E5h	; Close file (C=0 read, C=1 write)
+H_HOPEN	equ	0D8h	; Open handle (C=1 write; DE=path; returns E=handle)
+H_HWRITE equ	0DAh	; Write block (C=handle, DE=buf, HL=count; returns HL=bytes)
+H_HCLOSE equ	0DBh	; Close handle (C=handle)
+
+MAXFILES equ	64	; Matching files handled per run
 
 	org	TPA
 
@@ -39,16 +44,98 @@ start:
 	cp	' '
 	jp	z,no_args
 
-	; Copy FCB to our FCB area
-	ld	hl,FCB
-	ld	de,cpm_fcb
-	ld	bc,36
-	ldir
-
-	; Zero extent and record count for open
+	; Collect the names of all matching files first: CP/M cannot
+	; search the directory while other files are being opened
+	ld	de,dma_buffer
+	ld	c,F_DMA
+	call	BDOS
 	xor	a
-	ld	(cpm_fcb+12),a
-	ld	(cpm_fcb+32),a
+	ld	(FCB+12),a	; Extent 0 only, one entry per file
+	ld	(name_count),a
+	ld	hl,name_table
+	ld	(name_ptr),hl
+	ld	de,FCB
+	ld	c,F_SFIRST
+	call	BDOS
+
+search_loop:
+	cp	0FFh
+	jr	z,search_done
+	ld	hl,name_count
+	ld	b,a
+	ld	a,(hl)
+	cp	MAXFILES
+	jr	z,search_done
+	inc	(hl)
+
+	; Entry A (0-3) of the directory record: name at +1
+	ld	a,b
+	rrca
+	rrca
+	rrca			; A * 32
+	ld	e,a
+	ld	d,0
+	ld	hl,dma_buffer+1
+	add	hl,de
+	ld	de,(name_ptr)
+	ld	b,11
+save_name:
+	ld	a,(hl)
+	and	7Fh		; Drop attribute bits
+	ld	(de),a
+	inc	hl
+	inc	de
+	djnz	save_name
+	ld	(name_ptr),de
+
+	ld	de,FCB
+	ld	c,F_SNEXT
+	call	BDOS
+	jr	search_loop
+
+search_done:
+	ld	a,(name_count)
+	or	a
+	jr	nz,have_files
+	ld	de,msg_cpm_err
+	ld	c,C_PRINT
+	call	BDOS
+	rst	0
+
+have_files:
+
+	; Export each collected file
+	ld	hl,name_table
+	ld	(name_ptr),hl
+next_file:
+	call	export_file
+	ld	hl,(name_ptr)
+	ld	de,11
+	add	hl,de
+	ld	(name_ptr),hl
+	ld	hl,name_count
+	dec	(hl)
+	jr	nz,next_file
+
+	rst	0
+
+; Export the file named at (name_ptr)
+export_file:
+	; Build our FCB: default FCB's drive, saved name, rest zero
+	ld	hl,cpm_fcb
+	ld	a,(FCB)
+	ld	(hl),a
+	inc	hl
+	ex	de,hl
+	ld	hl,(name_ptr)
+	ld	bc,11
+	ldir
+	ex	de,hl
+	ld	b,24
+clear_fcb:
+	ld	(hl),0
+	inc	hl
+	djnz	clear_fcb
 
 	; Display CP/M filename
 	ld	de,msg_writing
@@ -81,10 +168,13 @@ start:
 
 	; Open host file for writing
 	ld	de,hostpath
-	ld	b,H_OPEN_W
+	ld	c,1
+	ld	b,H_HOPEN
 	rst	8
 	or	a
 	jp	nz,host_open_error
+	ld	a,e
+	ld	(handle),a
 
 	; Set DMA to our buffer
 	ld	de,dma_buffer
@@ -105,52 +195,47 @@ read_loop:
 	or	a
 	jr	nz,read_done
 
-	; Write 128 bytes to host (or until ^Z)
+	; Write the record to host up to any ^Z (EOF)
 	ld	hl,dma_buffer
-	ld	b,128
-
-write_loop:
-	ld	a,(hl)
-
-	; ^Z means EOF
-	cp	1Ah
-	jr	z,read_done
-
-	; Write byte to host
-	ld	e,a
-	push	hl
-	push	bc
-	ld	b,H_WRITE
+	ld	bc,128
+	ld	a,1Ah
+	cpir
+	ld	a,128
+	jr	nz,no_eof
+	dec	a
+	sub	c		; Bytes before the ^Z
+no_eof:
+	ld	(rec_len),a
+	ld	l,a
+	ld	h,0
+	ld	a,(handle)
+	ld	c,a
+	ld	de,dma_buffer
+	ld	b,H_HWRITE
 	rst	8
-	pop	bc
-	pop	hl
 	or	a
 	jp	nz,host_write_error
 
-	; Increment byte count
-	push	hl
-	push	bc
-	ld	hl,(byte_count)
-	inc	hl
+	; Add to byte count
+	ld	de,(byte_count)
+	add	hl,de
 	ld	(byte_count),hl
-	ld	a,h
-	or	l
-	jr	nz,no_high_inc
+	jr	nc,no_high_inc
 	ld	hl,(byte_count+2)
 	inc	hl
 	ld	(byte_count+2),hl
 no_high_inc:
-	pop	bc
-	pop	hl
 
-	inc	hl
-	djnz	write_loop
-	jr	read_loop
+	; A short record ended at ^Z
+	ld	a,(rec_len)
+	cp	128
+	jr	z,read_loop
 
 read_done:
 	; Close host file
-	ld	b,H_CLOSE
-	ld	c,1
+	ld	a,(handle)
+	ld	c,a
+	ld	b,H_HCLOSE
 	rst	8
 
 	; Close CP/M file
@@ -169,9 +254,7 @@ read_done:
 
 	ld	de,msg_bytes
 	ld	c,C_PRINT
-	call	BDOS
-
-	rst	0
+	jp	BDOS
 
 ; Create host path from FCB (8.3 -> lowercase)
 fcb_to_hostpath:
@@ -343,11 +426,11 @@ no_args:
 	call	BDOS
 	rst	0
 
+; Open errors are reported and the next file tried
 cpm_open_error:
 	ld	de,msg_cpm_err
 	ld	c,C_PRINT
-	call	BDOS
-	rst	0
+	jp	BDOS
 
 host_open_error:
 	ld	de,cpm_fcb
@@ -355,12 +438,12 @@ host_open_error:
 	call	BDOS
 	ld	de,msg_host_err
 	ld	c,C_PRINT
-	call	BDOS
-	rst	0
+	jp	BDOS
 
 host_write_error:
-	ld	b,H_CLOSE
-	ld	c,1
+	ld	a,(handle)
+	ld	c,a
+	ld	b,H_HCLOSE
 	rst	8
 	ld	de,cpm_fcb
 	ld	c,F_CLOSE
@@ -401,6 +484,16 @@ dma_buffer:
 	ds	128
 byte_count:
 	dw	0,0
+rec_len:
+	db	0
+handle:
+	db	0
+name_count:
+	db	0
+name_ptr:
+	dw	0
+name_table:
+	ds	MAXFILES*11
 print_flag:
 	db	0
 
@@ -0,0 +1,1173 @@
+/*
+ * Z80 Lazy - Optional in-tree Z80 core with lazy flag evaluation
+ *
+ * Opcodes are decoded by their x/y/z/p/q bit fields. Flags come from
+ * precomputed S/Z/Y/X(/P) tables plus half-carry and overflow tables
+ * indexed by bits 3 and 7 of both operands and the result.
+ */
+
+#include "z80_lazy.h"
+#include "hbios_cpu.h"
+#include "emu_checkpoint.h"
+
+namespace {
+
+enum : uint8_t {
+  FC = 0x01,  // Carry
+  FN = 0x02,  // Add/subtract
+  FV = 0x04,  // Parity/overflow
+  FX = 0x08,  // Undocumented bit 3
+  FH = 0x10,  // Half carry
+  FY = 0x20,  // Undocumented bit 5
+  FZ = 0x40,  // Zero
+  FS = 0x80,  // Sign
+};
+
+struct FlagTables {
+  uint8_t sz53[256];   // S, Z, Y, X for a result byte
+  uint8_t sz53p[256];  // Same plus even parity in P/V
+
+  FlagTables() {
+    for (int i = 0; i < 256; i++) {
+      uint8_t f = i & (FS | FY | FX);
+      if (i == 0) f |= FZ;
+      int bits = 0;
+      for (int b = 0; b < 8; b++) bits += (i >> b) & 1;
+      sz53[i] = f;
+      sz53p[i] = f | ((bits & 1) ? 0 : FV);
+    }
+  }
+};
+
+const FlagTables tables;
+
+// Indexed by flag_index(): bits 0-2 select half carry, bits 4-6 overflow
+const uint8_t halfcarry_add[8] = { 0, FH, FH, FH, 0, 0, 0, FH };
+const uint8_t halfcarry_sub[8] = { 0, 0, FH, 0, FH, 0, FH, FH };
+const uint8_t overflow_add[8] = { 0, 0, 0, FV, FV, 0, 0, 0 };
+const uint8_t overflow_sub[8] = { 0, FV, 0, 0, 0, 0, FV, 0 };
+
+inline unsigned flag_index(uint8_t a, uint8_t b, uint8_t r) {
+  return ((a & 0x88) >> 3) | ((b & 0x88) >> 2) | ((r & 0x88) >> 1);
+}
+
+// Base T-states for unprefixed opcodes (branches not taken, CB/DD/ED/FD = 0)
+const uint8_t cycles_main[256] = {
+   4, 10,  7,  6,  4,  4,  7,  4,  4, 11,  7,  6,  4,  4,  7,  4,  // 00
+   8, 10,  7,  6,  4,  4,  7,  4, 12, 11,  7,  6,  4,  4,  7,  4,  // 10
+   7, 10, 16,  6,  4,  4,  7,  4,  7, 11, 16,  6,  4,  4,  7,  4,  // 20
+   7, 10, 13,  6, 11, 11, 10,  4,  7, 11, 13,  6,  4,  4,  7,  4,  // 30
+   4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,  // 40
+   4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,  // 50
+   4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,  // 60
+   7,  7,  7,  7,  7,  7,  4,  7,  4,  4,  4,  4,  4,  4,  7,  4,  // 70
+   4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,  // 80
+   4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,  // 90
+   4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,  // A0
+   4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,  // B0
+   5, 10, 10, 10, 10, 11,  7, 11,  5, 10, 10,  0, 10, 17,  7, 11,  // C0
+   5, 10, 10, 11, 10, 11,  7, 11,  5,  4, 10, 11, 10,  0,  7, 11,  // D0
+   5, 10, 10, 19, 10, 11,  7, 11,  5,  4, 10,  4, 10,  0,  7, 11,  // E0
+   5, 10, 10,  4, 10, 11,  7, 11,  5,  6, 10,  4, 10,  0,  7, 11,  // F0
+};
+
+} // namespace
+
+//=============================================================================
+// Construction
+//=============================================================================
+
+z80_lazy::z80_lazy(hbios_cpu* owner, qkz80_cpu_mem* memory)
+  : cpu(owner), mem(memory) {
+}
+
+void z80_lazy::reset() {
+  lz_op = LZ_NONE;
+  af2 = bc2 = de2 = hl2 = 0;
+  reg_i = 0;
+  reg_r = 0;
+  im = 0;
+  wz = 0;
+  iff1 = iff2 = false;
+  ei_delay = false;
+  halted = false;
+  int_req = false;
+  nmi_pending = false;
+}
+
+//=============================================================================
+// Lazy flags
+//=============================================================================
+
+uint8_t z80_lazy::compute_flags() const {
+  uint8_t r = lz_r & 0xFF;
+  uint8_t c = (lz_r >> 8) & FC;
+
+  switch (lz_op) {
+    case LZ_ADD: {
+      unsigned i = flag_index(lz_a, lz_b, r);
+      return c | halfcarry_add[i & 7] | overflow_add[i >> 4] | tables.sz53[r];
+    }
+    case LZ_SUB: {
+      unsigned i = flag_index(lz_a, lz_b, r);
+      return c | FN | halfcarry_sub[i & 7] | overflow_sub[i >> 4] | tables.sz53[r];
+    }
+    case LZ_CP: {
+      // X/Y come from the operand, not the discarded result
+      unsigned i = flag_index(lz_a, lz_b, r);
+      return c | FN | halfcarry_sub[i & 7] | overflow_sub[i >> 4] |
+             (tables.sz53[r] & (FS | FZ)) | (lz_b & (FX | FY));
+    }
+    case LZ_SZP:
+      return tables.sz53p[r] | lz_keep;
+    case LZ_INC:
+      return lz_keep | (r == 0x80 ? FV : 0) | ((r & 0x0F) ? 0 : FH) | tables.sz53[r];
+    case LZ_DEC:
+      return lz_keep | FN | (r == 0x7F ? FV : 0) |
+             ((r & 0x0F) == 0x0F ? FH : 0) | tables.sz53[r];
+    default:
+      return cpu->regs.AF.get_low();
+  }
+}
+
+uint8_t z80_lazy::flags() {
+  if (lz_op != LZ_NONE) {
+    cpu->regs.AF.set_low(compute_flags());
+    lz_op = LZ_NONE;
+  }
+  return cpu->regs.AF.get_low();
+}
+
+void z80_lazy::set_flags(uint8_t f) {
+  cpu->regs.AF.set_low(f);
+  lz_op = LZ_NONE;
+}
+
+void z80_lazy::sync_flags() {
+  flags();
+}
+
+void z80_lazy::save_state(StateWriter& w) {
+  flags();
+  w.u16(af2); w.u16(bc2); w.u16(de2); w.u16(hl2);
+  w.u8(reg_i); w.u8(reg_r); w.u8(im);
+  w.flag(iff1); w.flag(iff2); w.flag(ei_delay); w.flag(halted);
+  w.flag(int_req); w.u8(int_data); w.flag(nmi_pending);
+  w.u16(wz);
+}
+
+void z80_lazy::load_state(StateReader& r) {
+  lz_op = LZ_NONE;
+  af2 = r.u16(); bc2 = r.u16(); de2 = r.u16(); hl2 = r.u16();
+  reg_i = r.u8(); reg_r = r.u8(); im = r.u8();
+  iff1 = r.flag(); iff2 = r.flag(); ei_delay = r.flag(); halted = r.flag();
+  int_req = r.flag(); int_data = r.u8(); nmi_pending = r.flag();
+  wz = r.remaining() >= 2 ? r.u16() : 0;  // Not in older checkpoints
+}
+
+bool z80_lazy::flag_z() const {
+  if (lz_op == LZ_NONE) return cpu->regs.AF.get_low() & FZ;
+  return (lz_r & 0xFF) == 0;
+}
+
+bool z80_lazy::flag_c() const {
+  switch (lz_op) {
+    case LZ_NONE: return cpu->regs.AF.get_low() & FC;
+    case LZ_ADD:
+    case LZ_SUB:
+    case LZ_CP: return lz_r & 0x100;
+    default: return lz_keep & FC;
+  }
+}
+
+bool z80_lazy::flag_s() const {
+  if (lz_op == LZ_NONE) return cpu->regs.AF.get_low() & FS;
+  return lz_r & 0x80;
+}
+
+bool z80_lazy::condition(unsigned cc) {
+  switch (cc) {
+    case 0: return !flag_z();          // NZ
+    case 1: return flag_z();           // Z
+    case 2: return !flag_c();          // NC
+    case 3: return flag_c();           // C
+    case 4: return !(flags() & FV);    // PO
+    case 5: return flags() & FV;       // PE
+    case 6: return !flag_s();          // P
+    default: return flag_s();          // M
+  }
+}
+
+//=============================================================================
+// Fetch, stack and register helpers
+//=============================================================================
+
+uint8_t z80_lazy::fetch() {
+  uint16_t pc = cpu->regs.PC.get_pair16();
+  cpu->regs.PC.set_pair16(pc + 1);
+  return mem->fetch_mem(pc, true);
+}
+
+uint16_t z80_lazy::fetch16() {
+  uint8_t lo = fetch();
+  return lo | (fetch() << 8);
+}
+
+void z80_lazy::push(uint16_t v) {
+  uint16_t sp = cpu->regs.SP.get_pair16() - 2;
+  cpu->regs.SP.set_pair16(sp);
+  wr16(sp, v);
+}
+
+uint16_t z80_lazy::pop() {
+  uint16_t sp = cpu->regs.SP.get_pair16();
+  cpu->regs.SP.set_pair16(sp + 2);
+  return rd16(sp);
+}
+
+uint16_t z80_lazy::get_hl() const {
+  switch (xy) {
+    case 1: return cpu->regs.IX.get_pair16();
+    case 2: return cpu->regs.IY.get_pair16();
+    default: return cpu->regs.HL.get_pair16();
+  }
+}
+
+void z80_lazy::set_hl(uint16_t v) {
+  switch (xy) {
+    case 1: cpu->regs.IX.set_pair16(v); break;
+    case 2: cpu->regs.IY.set_pair16(v); break;
+    default: cpu->regs.HL.set_pair16(v); break;
+  }
+}
+
+uint16_t z80_lazy::mem_addr() {
+  if (!ea_valid) {
+    if (xy) {
+      int8_t d = (int8_t)fetch();
+      ea = get_hl() + d;
+      wz = ea;
+      cyc += 8;
+    } else {
+      ea = cpu->regs.HL.get_pair16();
+    }
+    ea_valid = true;
+  }
+  return ea;
+}
+
+uint8_t z80_lazy::get_a() const {
+  return cpu->regs.AF.get_high();
+}
+
+void z80_lazy::set_a(uint8_t v) {
+  cpu->regs.AF.set_high(v);
+}
+
+uint8_t z80_lazy::get_r8_plain(unsigned r) {
+  switch (r) {
+    case 0: return cpu->regs.BC.get_high();
+    case 1: return cpu->regs.BC.get_low();
+    case 2: return cpu->regs.DE.get_high();
+    case 3: return cpu->regs.DE.get_low();
+    case 4: return cpu->regs.HL.get_high();
+    case 5: return cpu->regs.HL.get_low();
+    case 6: return rd(cpu->regs.HL.get_pair16());
+    default: return get_a();
+  }
+}
+
+void z80_lazy::set_r8_plain(unsigned r, uint8_t v) {
+  switch (r) {
+    case 0: cpu->regs.BC.set_high(v); break;
+    case 1: cpu->regs.BC.set_low(v); break;
+    case 2: cpu->regs.DE.set_high(v); break;
+    case 3: cpu->regs.DE.set_low(v); break;
+    case 4: cpu->regs.HL.set_high(v); break;
+    case 5: cpu->regs.HL.set_low(v); break;
+    case 6: wr(cpu->regs.HL.get_pair16(), v); break;
+    default: set_a(v); break;
+  }
+}
+
+uint8_t z80_lazy::get_r8(unsigned r) {
+  if (r == 6) return rd(mem_addr());
+  if (xy && (r == 4 || r == 5)) {
+    uint16_t v = get_hl();
+    return (r == 4) ? (v >> 8) : (v & 0xFF);
+  }
+  return get_r8_plain(r);
+}
+
+void z80_lazy::set_r8(unsigned r, uint8_t v) {
+  if (r == 6) {
+    wr(mem_addr(), v);
+  } else if (xy && (r == 4 || r == 5)) {
+    uint16_t hl = get_hl();
+    set_hl((r == 4) ? ((hl & 0x00FF) | (v << 8)) : ((hl & 0xFF00) | v));
+  } else {
+    set_r8_plain(r, v);
+  }
+}
+
+uint16_t z80_lazy::get_rp(unsigned p) {
+  switch (p) {
+    case 0: return cpu->regs.BC.get_pair16();
+    case 1: return cpu->regs.DE.get_pair16();
+    case 2: return get_hl();
+    default: return cpu->regs.SP.get_pair16();
+  }
+}
+
+void z80_lazy::set_rp(unsigned p, uint16_t v) {
+  switch (p) {
+    case 0: cpu->regs.BC.set_pair16(v); break;
+    case 1: cpu->regs.DE.set_pair16(v); break;
+    case 2: set_hl(v); break;
+    default: cpu->regs.SP.set_pair16(v); break;
+  }
+}
+
+uint16_t z80_lazy::get_rp2(unsigned p) {
+  if (p == 3) {
+    flags();
+    return cpu->regs.AF.get_pair16();
+  }
+  return get_rp(p);
+}
+
+void z80_lazy::set_rp2(unsigned p, uint16_t v) {
+  if (p == 3) {
+    cpu->regs.AF.set_pair16(v);
+    lz_op = LZ_NONE;
+  } else {
+    set_rp(p, v);
+  }
+}
+
+//=============================================================================
+// ALU
+//=============================================================================
+
+void z80_lazy::alu(unsigned op, uint8_t v) {
+  uint8_t a = get_a();
+
+  switch (op) {
+    case 0:    // ADD
+    case 1: {  // ADC
+      unsigned c = (op == 1 && flag_c()) ? 1 : 0;
+      lz_r = a + v + c;
+      lz_a = a;
+      lz_b = v;
+      lz_op = LZ_ADD;
+      set_a(lz_r & 0xFF);
+      break;
+    }
+    case 2:    // SUB
+    case 3:    // SBC
+    case 7: {  // CP
+      unsigned c = (op == 3 && flag_c()) ? 1 : 0;
+      lz_r = (a - v - c) & 0x1FF;
+      lz_a = a;
+      lz_b = v;
+      if (op == 7) {
+        lz_op = LZ_CP;
+      } else {
+        lz_op = LZ_SUB;
+        set_a(lz_r & 0xFF);
+      }
+      break;
+    }
+    case 4:    // AND
+      lz_r = a & v;
+      lz_keep = FH;
+      lz_op = LZ_SZP;
+      set_a(lz_r);
+      break;
+    case 5:    // XOR
+      lz_r = a ^ v;
+      lz_keep = 0;
+      lz_op = LZ_SZP;
+      set_a(lz_r);
+      break;
+    default:   // OR
+      lz_r = a | v;
+      lz_keep = 0;
+      lz_op = LZ_SZP;
+      set_a(lz_r);
+      break;
+  }
+}
+
+uint8_t z80_lazy::inc8(uint8_t v) {
+  lz_keep = flag_c() ? FC : 0;
+  lz_r = (uint8_t)(v + 1);
+  lz_op = LZ_INC;
+  return lz_r;
+}
+
+uint8_t z80_lazy::dec8(uint8_t v) {
+  lz_keep = flag_c() ? FC : 0;
+  lz_r = (uint8_t)(v - 1);
+  lz_op = LZ_DEC;
+  return lz_r;
+}
+
+uint8_t z80_lazy::rot(unsigned op, uint8_t v) {
+  uint8_t c;
+  uint8_t r;
+
+  switch (op) {
+    case 0: c = v >> 7; r = (v << 1) | c; break;                  // RLC
+    case 1: c = v & 1; r = (v >> 1) | (c << 7); break;            // RRC
+    case 2: c = v >> 7; r = (v << 1) | (flag_c() ? 1 : 0); break; // RL
+    case 3: c = v & 1; r = (v >> 1) | (flag_c() ? 0x80 : 0); break; // RR
+    case 4: c = v >> 7; r = v << 1; break;                        // SLA
+    case 5: c = v & 1; r = (v >> 1) | (v & 0x80); break;          // SRA
+    case 6: c = v >> 7; r = (v << 1) | 1; break;                  // SLL
+    default: c = v & 1; r = v >> 1; break;                        // SRL
+  }
+
+  lz_r = r;
+  lz_keep = c ? FC : 0;
+  lz_op = LZ_SZP;
+  return r;
+}
+
+void z80_lazy::add16(uint16_t v) {
+  uint16_t hl = get_hl();
+  uint32_t r = hl + v;
+  wz = hl + 1;
+  uint8_t f = flags() & (FS | FZ | FV);
+  f |= ((r >> 16) & FC) | (((hl ^ v ^ r) >> 8) & FH) | ((r >> 8) & (FX | FY));
+  set_flags(f);
+  set_hl(r);
+}
+
+void z80_lazy::adc16(uint16_t v) {
+  uint16_t hl = cpu->regs.HL.get_pair16();
+  uint32_t r = hl + v + (flag_c() ? 1 : 0);
+  wz = hl + 1;
+  uint8_t f = ((r >> 16) & FC) | (((hl ^ v ^ r) >> 8) & FH) |
+              ((r >> 8) & (FS | FX | FY)) | ((r & 0xFFFF) ? 0 : FZ);
+  if (~(hl ^ v) & (hl ^ r) & 0x8000) f |= FV;
+  set_flags(f);
+  cpu->regs.HL.set_pair16(r);
+}
+
+void z80_lazy::sbc16(uint16_t v) {
+  uint16_t hl = cpu->regs.HL.get_pair16();
+  uint32_t r = hl - v - (flag_c() ? 1 : 0);
+  wz = hl + 1;
+  uint8_t f = FN | ((r >> 16) & FC) | (((hl ^ v ^ r) >> 8) & FH) |
+              ((r >> 8) & (FS | FX | FY)) | ((r & 0xFFFF) ? 0 : FZ);
+  if ((hl ^ v) & (hl ^ r) & 0x8000) f |= FV;
+  set_flags(f);
+  cpu->regs.HL.set_pair16(r);
+}
+
+void z80_lazy::daa() {
+  uint8_t a = get_a();
+  uint8_t f = flags();
+  uint8_t adjust = 0;
+  uint8_t carry = f & FC;
+  uint8_t half;
+
+  if ((f & FH) || (a & 0x0F) > 9) adjust = 0x06;
+  if (carry || a > 0x99) {
+    adjust |= 0x60;
+    carry = FC;
+  }
+
+  uint8_t r;
+  if (f & FN) {
+    r = a - adjust;
+    half = ((f & FH) && (a & 0x0F) < 6) ? FH : 0;
+  } else {
+    r = a + adjust;
+    half = ((a & 0x0F) > 9) ? FH : 0;
+  }
+
+  set_a(r);
+  set_flags(tables.sz53p[r] | carry | (f & FN) | half);
+}
+
+//=============================================================================
+// Port I/O (flags are synced so HBIOS handlers see and may set F)
+//=============================================================================
+
+uint8_t z80_lazy::port_in(uint8_t port_lo, uint8_t port_hi) {
+  (void)port_hi;
+  flags();
+  return cpu->port_in(port_lo);
+}
+
+void z80_lazy::port_out(uint8_t port_lo, uint8_t port_hi, uint8_t v) {
+  (void)port_hi;
+  flags();
+  cpu->port_out(port_lo, v);
+}
+
+//=============================================================================
+// Execution
+//=============================================================================
+
+void z80_lazy::execute() {
+  reg_r = (reg_r & 0x80) | ((reg_r + 1) & 0x7F);
+  ei_delay = false;
+
+  if (halted) {
+    cpu->cycles += 4;
+    return;
+  }
+
+  xy = 0;
+  ea_valid = false;
+  cyc = 0;
+
+  uint8_t op = fetch();
+  while (op == 0xDD || op == 0xFD) {
+    xy = (op == 0xDD) ? 1 : 2;
+    cyc += 4;
+    reg_r = (reg_r & 0x80) | ((reg_r + 1) & 0x7F);
+    op = fetch();
+  }
+
+  if (op == 0xCB) {
+    if (xy) {
+      exec_xycb();
+    } else {
+      reg_r = (reg_r & 0x80) | ((reg_r + 1) & 0x7F);
+      exec_cb();
+    }
+  } else if (op == 0xED) {
+    xy = 0;
+    reg_r = (reg_r & 0x80) | ((reg_r + 1) & 0x7F);
+    exec_ed(fetch());
+  } else {
+    exec_main(op);
+  }
+
+  cpu->cycles += cyc;
+}
+
+void z80_lazy::exec_main(uint8_t op) {
+  unsigned x = op >> 6;
+  unsigned y = (op >> 3) & 7;
+  unsigned z = op & 7;
+  unsigned p = y >> 1;
+  unsigned q = y & 1;
+
+  cyc += cycles_main[op];
+
+  switch (x) {
+    case 0:
+      switch (z) {
+        case 0:
+          switch (y) {
+            case 0:  // NOP
+              break;
+            case 1: {  // EX AF,AF'
+              uint16_t af = get_rp2(3);
+              set_rp2(3, af2);
+              af2 = af;
+              break;
+            }
+            case 2: {  // DJNZ d
+              int8_t d = (int8_t)fetch();
+              uint8_t b = cpu->regs.BC.get_high() - 1;
+              cpu->regs.BC.set_high(b);
+              if (b) {
+                wz = cpu->regs.PC.get_pair16() + d;
+                cpu->regs.PC.set_pair16(wz);
+                cyc += 5;
+              }
+              break;
+            }
+            case 3: {  // JR d
+              int8_t d = (int8_t)fetch();
+              wz = cpu->regs.PC.get_pair16() + d;
+              cpu->regs.PC.set_pair16(wz);
+              break;
+            }
+            default: {  // JR cc,d
+              int8_t d = (int8_t)fetch();
+              if (condition(y - 4)) {
+                wz = cpu->regs.PC.get_pair16() + d;
+                cpu->regs.PC.set_pair16(wz);
+                cyc += 5;
+              }
+              break;
+            }
+          }
+          break;
+
+        case 1:
+          if (q == 0) set_rp(p, fetch16());   // LD rp,nn
+          else add16(get_rp(p));              // ADD HL,rp
+          break;
+
+        case 2: {
+          // MEMPTR is the address + 1; stores of A put A in its high byte
+          uint16_t addr = (y < 2) ? cpu->regs.BC.get_pair16() :
+                          (y < 4) ? cpu->regs.DE.get_pair16() : fetch16();
+          wz = addr + 1;
+          switch (y) {
+            case 0:                                // LD (BC),A
+            case 2:                                // LD (DE),A
+            case 6:                                // LD (nn),A
+              wr(addr, get_a());
+              wz = (wz & 0xFF) | (get_a() << 8);
+              break;
+            case 4: wr16(addr, get_hl()); break;   // LD (nn),HL
+            case 5: set_hl(rd16(addr)); break;     // LD HL,(nn)
+            default: set_a(rd(addr)); break;       // LD A,(BC/DE/nn)
+          }
+          break;
+        }
+
+        case 3:
+          set_rp(p, get_rp(p) + (q ? -1 : 1));  // INC/DEC rp
+          break;
+
+        case 4:
+          if (y == 6) {
+            uint16_t addr = mem_addr();
+            wr(addr, inc8(rd(addr)));
+          } else {
+            set_r8(y, inc8(get_r8(y)));
+          }
+          break;
+
+        case 5:
+          if (y == 6) {
+            uint16_t addr = mem_addr();
+            wr(addr, dec8(rd(addr)));
+          } else {
+            set_r8(y, dec8(get_r8(y)));
+          }
+          break;
+
+        case 6:
+          if (y == 6) {
+            uint16_t addr = mem_addr();  // Displacement precedes n
+            if (xy) cyc -= 3;            // LD (IX+d),n is 19, not 22
+            wr(addr, fetch());
+          } else {
+            set_r8(y, fetch());
+          }
+          break;
+
+        default: {
+          uint8_t a = get_a();
+          switch (y) {
+            case 0: {  // RLCA
+              uint8_t r = (a << 1) | (a >> 7);
+              set_a(r);
+              set_flags((flags() & (FS | FZ | FV)) | (a >> 7) | (r & (FX | FY)));
+              break;
+            }
+            case 1: {  // RRCA
+              uint8_t r = (a >> 1) | (a << 7);
+              set_a(r);
+              set_flags((flags() & (FS | FZ | FV)) | (a & FC) | (r & (FX | FY)));
+              break;
+            }
+            case 2: {  // RLA
+              uint8_t r = (a << 1) | (flag_c() ? 1 : 0);
+              set_a(r);
+              set_flags((flags() & (FS | FZ | FV)) | (a >> 7) | (r & (FX | FY)));
+              break;
+            }
+            case 3: {  // RRA
+              uint8_t r = (a >> 1) | (flag_c() ? 0x80 : 0);
+              set_a(r);
+              set_flags((flags() & (FS | FZ | FV)) | (a & FC) | (r & (FX | FY)));
+              break;
+            }
+            case 4:  // DAA
+              daa();
+              break;
+            case 5:  // CPL
+              a = ~a;
+              set_a(a);
+              set_flags((flags() & (FS | FZ | FV | FC)) | FH | FN | (a & (FX | FY)));
+              break;
+            case 6:  // SCF
+              set_flags((flags() & (FS | FZ | FV)) | FC | (a & (FX | FY)));
+              break;
+            default: {  // CCF
+              uint8_t f = flags();
+              set_flags((f & (FS | FZ | FV)) | ((f & FC) ? FH : FC) | (a & (FX | FY)));
+              break;
+            }
+          }
+          break;
+        }
+      }
+      break;
+
+    case 1:
+      if (op == 0x76) {  // HALT
+        halted = true;
+        cpu->halt();
+      } else if (z == 6) {
+        set_r8_plain(y, rd(mem_addr()));   // LD r,(HL) - H/L not substituted
+      } else if (y == 6) {
+        wr(mem_addr(), get_r8_plain(z));   // LD (HL),r
+      } else {
+        set_r8(y, get_r8(z));              // LD r,r'
+      }
+      break;
+
+    case 2:
+      alu(y, get_r8(z));  // ALU A,r
+      break;
+
+    default:
+      switch (z) {
+        case 0:  // RET cc
+          if (condition(y)) {
+            wz = pop();
+            cpu->regs.PC.set_pair16(wz);
+            cyc += 6;
+          }
+          break;
+
+        case 1:
+          if (q == 0) {
+            set_rp2(p, pop());  // POP rp2
+          } else {
+            switch (p) {
+              case 0:  // RET
+                wz = pop();
+                cpu->regs.PC.set_pair16(wz);
+                break;
+              case 1: {  // EXX
+                uint16_t t;
+                t = cpu->regs.BC.get_pair16(); cpu->regs.BC.set_pair16(bc2); bc2 = t;
+                t = cpu->regs.DE.get_pair16(); cpu->regs.DE.set_pair16(de2); de2 = t;
+                t = cpu->regs.HL.get_pair16(); cpu->regs.HL.set_pair16(hl2); hl2 = t;
+                break;
+              }
+              case 2:  // JP (HL)
+                cpu->regs.PC.set_pair16(get_hl());
+                break;
+              default:  // LD SP,HL
+                cpu->regs.SP.set_pair16(get_hl());
+                break;
+            }
+          }
+          break;
+
+        case 2: {  // JP cc,nn
+          uint16_t nn = fetch16();
+          wz = nn;  // Taken or not
+          if (condition(y)) cpu->regs.PC.set_pair16(nn);
+          break;
+        }
+
+        case 3:
+          switch (y) {
+            case 0:  // JP nn
+              wz = fetch16();
+              cpu->regs.PC.set_pair16(wz);
+              break;
+            case 2: {  // OUT (n),A
+              uint8_t n = fetch();
+              wz = ((n + 1) & 0xFF) | (get_a() << 8);
+              port_out(n, get_a(), get_a());
+              break;
+            }
+            case 3: {  // IN A,(n)
+              uint8_t n = fetch();
+              wz = ((get_a() << 8) | n) + 1;
+              set_a(port_in(n, get_a()));
+              break;
+            }
+            case 4: {  // EX (SP),HL
+              uint16_t sp = cpu->regs.SP.get_pair16();
+              uint16_t v = rd16(sp);
+              wr16(sp, get_hl());
+              set_hl(v);
+              wz = v;
+              break;
+            }
+            case 5: {  // EX DE,HL (never IX/IY)
+              uint16_t t = cpu->regs.DE.get_pair16();
+              cpu->regs.DE.set_pair16(cpu->regs.HL.get_pair16());
+              cpu->regs.HL.set_pair16(t);
+              break;
+            }
+            case 6:  // DI
+              iff1 = iff2 = false;
+              break;
+            case 7:  // EI
+              iff1 = iff2 = true;
+              ei_delay = true;
+              break;
+            default:  // CB - handled by execute()
+              break;
+          }
+          break;
+
+        case 4: {  // CALL cc,nn
+          uint16_t nn = fetch16();
+          wz = nn;  // Taken or not
+          if (condition(y)) {
+            push(cpu->regs.PC.get_pair16());
+            cpu->regs.PC.set_pair16(nn);
+            cyc += 7;
+          }
+          break;
+        }
+
+        case 5:
+          if (q == 0) {
+            push(get_rp2(p));  // PUSH rp2
+          } else if (p == 0) {  // CALL nn
+            uint16_t nn = fetch16();
+            wz = nn;
+            push(cpu->regs.PC.get_pair16());
+            cpu->regs.PC.set_pair16(nn);
+          }
+          break;
+
+        case 6:
+          alu(y, fetch());  // ALU A,n
+          break;
+
+        default:  // RST
+          push(cpu->regs.PC.get_pair16());
+          wz = y << 3;
+          cpu->regs.PC.set_pair16(wz);
+          break;
+      }
+      break;
+  }
+}
+
+void z80_lazy::exec_cb() {
+  uint8_t op = fetch();
+  unsigned x = op >> 6;
+  unsigned y = (op >> 3) & 7;
+  unsigned z = op & 7;
+
+  cyc += (z == 6) ? (x == 1 ? 12 : 15) : 8;
+
+  uint8_t v = get_r8(z);
+  switch (x) {
+    case 0:  // Rotate/shift
+      set_r8(z, rot(y, v));
+      break;
+    case 1: {  // BIT y,r - X/Y from MEMPTR for (HL)
+      uint8_t xy_bits = (z == 6) ? (wz >> 8) : v;
+      uint8_t f = (flag_c() ? FC : 0) | FH | (xy_bits & (FX | FY));
+      if (!(v & (1 << y))) f |= FZ | FV;
+      if (y == 7 && (v & 0x80)) f |= FS;
+      set_flags(f);
+      break;
+    }
+    case 2:  // RES y,r
+      set_r8(z, v & ~(1 << y));
+      break;
+    default:  // SET y,r
+      set_r8(z, v | (1 << y));
+      break;
+  }
+}
+
+void z80_lazy::exec_xycb() {
+  // DD CB d op / FD CB d op: displacement comes before the opcode
+  int8_t d = (int8_t)fetch();
+  uint8_t op = fetch();
+  unsigned x = op >> 6;
+  unsigned y = (op >> 3) & 7;
+  unsigned z = op & 7;
+
+  ea = get_hl() + d;
+  ea_valid = true;
+  wz = ea;
+  cyc += (x == 1) ? 16 : 19;
+
+  uint8_t v = rd(ea);
+  uint8_t r;
+  switch (x) {
+    case 0:
+      r = rot(y, v);
+      break;
+    case 1: {  // BIT y,(IX+d) - X/Y from the address high byte
+      uint8_t f = (flag_c() ? FC : 0) | FH | ((ea >> 8) & (FX | FY));
+      if (!(v & (1 << y))) f |= FZ | FV;
+      if (y == 7 && (v & 0x80)) f |= FS;
+      set_flags(f);
+      return;
+    }
+    case 2:
+      r = v & ~(1 << y);
+      break;
+    default:
+      r = v | (1 << y);
+      break;
+  }
+
+  wr(ea, r);
+  if (z != 6) set_r8_plain(z, r);  // Undocumented register copy
+}
+
+void z80_lazy::exec_ed(uint8_t op) {
+  unsigned x = op >> 6;
+  unsigned y = (op >> 3) & 7;
+  unsigned z = op & 7;
+  unsigned p = y >> 1;
+  unsigned q = y & 1;
+
+  if (x == 2 && z <= 3 && y >= 4) {
+    int dir = (y & 1) ? -1 : 1;
+    bool repeat = y >= 6;
+    cyc += 16;
+    switch (z) {
+      case 0: block_ld(dir, repeat); break;
+      case 1: block_cp(dir, repeat); break;
+      case 2: block_in(dir, repeat); break;
+      default: block_out(dir, repeat); break;
+    }
+    return;
+  }
+
+  if (x != 1) {
+    cyc += 8;  // Undefined - acts as NOP
+    return;
+  }
+
+  switch (z) {
+    case 0: {  // IN r,(C)
+      cyc += 12;
+      wz = cpu->regs.BC.get_pair16() + 1;
+      uint8_t v = port_in(cpu->regs.BC.get_low(), cpu->regs.BC.get_high());
+      if (y != 6) set_r8_plain(y, v);
+      lz_keep = flag_c() ? FC : 0;
+      lz_r = v;
+      lz_op = LZ_SZP;
+      break;
+    }
+
+    case 1:  // OUT (C),r
+      cyc += 12;
+      wz = cpu->regs.BC.get_pair16() + 1;
+      port_out(cpu->regs.BC.get_low(), cpu->regs.BC.get_high(),
+               (y == 6) ? 0 : get_r8_plain(y));
+      break;
+
+    case 2:
+      cyc += 15;
+      if (q == 0) sbc16(get_rp(p));  // SBC HL,rp
+      else adc16(get_rp(p));         // ADC HL,rp
+      break;
+
+    case 3: {
+      cyc += 20;
+      uint16_t nn = fetch16();
+      wz = nn + 1;
+      if (q == 0) wr16(nn, get_rp(p));  // LD (nn),rp
+      else set_rp(p, rd16(nn));         // LD rp,(nn)
+      break;
+    }
+
+    case 4: {  // NEG
+      cyc += 8;
+      uint8_t a = get_a();
+      lz_r = (0 - a) & 0x1FF;
+      lz_a = 0;
+      lz_b = a;
+      lz_op = LZ_SUB;
+      set_a(lz_r & 0xFF);
+      break;
+    }
+
+    case 5:  // RETN/RETI
+      cyc += 14;
+      iff1 = iff2;
+      wz = pop();
+      cpu->regs.PC.set_pair16(wz);
+      break;
+
+    case 6: {  // IM 0/1/2
+      static const uint8_t modes[8] = { 0, 0, 1, 2, 0, 0, 1, 2 };
+      cyc += 8;
+      im = modes[y];
+      break;
+    }
+
+    default:
+      switch (y) {
+        case 0:  // LD I,A
+          cyc += 9;
+          reg_i = get_a();
+          break;
+        case 1:  // LD R,A
+          cyc += 9;
+          reg_r = get_a();
+          break;
+        case 2:  // LD A,I
+        case 3: {  // LD A,R
+          cyc += 9;
+          uint8_t v = (y == 2) ? reg_i : reg_r;
+          set_a(v);
+          set_flags((flag_c() ? FC : 0) | tables.sz53[v] | (iff2 ? FV : 0));
+          break;
+        }
+        case 4:    // RRD
+        case 5: {  // RLD
+          cyc += 18;
+          uint16_t hl = cpu->regs.HL.get_pair16();
+          uint8_t m = rd(hl);
+          uint8_t a = get_a();
+          wz = hl + 1;
+          if (y == 4) {
+            wr(hl, (a << 4) | (m >> 4));
+            a = (a & 0xF0) | (m & 0x0F);
+          } else {
+            wr(hl, (m << 4) | (a & 0x0F));
+            a = (a & 0xF0) | (m >> 4);
+          }
+          set_a(a);
+          lz_keep = flag_c() ? FC : 0;
+          lz_r = a;
+          lz_op = LZ_SZP;
+          break;
+        }
+        default:
+          cyc += 8;
+          break;
+      }
+      break;
+  }
+}
+
+//=============================================================================
+// Block instructions
+//=============================================================================
+
+void z80_lazy::block_ld(int dir, bool repeat) {
+  uint16_t hl = cpu->regs.HL.get_pair16();
+  uint16_t de = cpu->regs.DE.get_pair16();
+  uint16_t bc = cpu->regs.BC.get_pair16() - 1;
+  uint8_t v = rd(hl);
+  wr(de, v);
+  cpu->regs.HL.set_pair16(hl + dir);
+  cpu->regs.DE.set_pair16(de + dir);
+  cpu->regs.BC.set_pair16(bc);
+
+  uint8_t n = v + get_a();
+  set_flags((flags() & (FS | FZ | FC)) | (n & FX) | ((n & 0x02) ? FY : 0) | (bc ? FV : 0));
+
+  if (repeat && bc) {
+    cpu->regs.PC.set_pair16(cpu->regs.PC.get_pair16() - 2);
+    wz = cpu->regs.PC.get_pair16() + 1;
+    cyc += 5;
+  }
+}
+
+void z80_lazy::block_cp(int dir, bool repeat) {
+  uint16_t hl = cpu->regs.HL.get_pair16();
+  uint16_t bc = cpu->regs.BC.get_pair16() - 1;
+  uint8_t v = rd(hl);
+  uint8_t a = get_a();
+  uint8_t r = a - v;
+  uint8_t half = (a ^ v ^ r) & FH;
+  uint8_t n = r - (half ? 1 : 0);
+  cpu->regs.HL.set_pair16(hl + dir);
+  cpu->regs.BC.set_pair16(bc);
+
+  set_flags((flag_c() ? FC : 0) | FN | half | (tables.sz53[r] & (FS | FZ)) |
+            (n & FX) | ((n & 0x02) ? FY : 0) | (bc ? FV : 0));
+
+  if (repeat && bc && r != 0) {
+    cpu->regs.PC.set_pair16(cpu->regs.PC.get_pair16() - 2);
+    wz = cpu->regs.PC.get_pair16() + 1;
+    cyc += 5;
+  } else {
+    wz += dir;
+  }
+}
+
+void z80_lazy::block_in(int dir, bool repeat) {
+  uint16_t hl = cpu->regs.HL.get_pair16();
+  wz = cpu->regs.BC.get_pair16() + dir;
+  uint8_t v = port_in(cpu->regs.BC.get_low(), cpu->regs.BC.get_high());
+  uint8_t b = cpu->regs.BC.get_high() - 1;
+  wr(hl, v);
+  cpu->regs.HL.set_pair16(hl + dir);
+  cpu->regs.BC.set_high(b);
+
+  set_flags((flags() & FC) | FN | tables.sz53[b]);
+
+  if (repeat && b) {
+    cpu->regs.PC.set_pair16(cpu->regs.PC.get_pair16() - 2);
+    cyc += 5;
+  }
+}
+
+void z80_lazy::block_out(int dir, bool repeat) {
+  uint16_t hl = cpu->regs.HL.get_pair16();
+  uint8_t v = rd(hl);
+  uint8_t b = cpu->regs.BC.get_high() - 1;
+  cpu->regs.BC.set_high(b);  // B is decremented before the port is written
+  wz = cpu->regs.BC.get_pair16() + dir;
+  port_out(cpu->regs.BC.get_low(), b, v);
+  cpu->regs.HL.set_pair16(hl + dir);
+
+  set_flags((flags() & FC) | FN | tables.sz53[b]);
+
+  if (repeat && b) {
+    cpu->regs.PC.set_pair16(cpu->regs.PC.get_pair16() - 2);
+    cyc += 5;
+  }
+}
+
+//=============================================================================
+// Interrupts
+//=============================================================================
+
+void z80_lazy::request_int(uint8_t data) {
+  int_req = true;
+  int_data = data;
+}
+
+void z80_lazy::check_interrupts() {
+  if (nmi_pending) {
+    nmi_pending = false;
+    halted = false;
+    iff1 = false;
+    push(cpu->regs.PC.get_pair16());
+    wz = 0x0066;
+    cpu->regs.PC.set_pair16(wz);
+    cpu->cycles += 11;
+    return;
+  }
+
+  if (!int_req || !iff1 || ei_delay) return;
+
+  int_req = false;
+  halted = false;
+  iff1 = iff2 = false;
+  reg_r = (reg_r & 0x80) | ((reg_r + 1) & 0x7F);
+  push(cpu->regs.PC.get_pair16());
+
+  switch (im) {
+    case 0:  // Only RST opcodes are supported on the data bus
+      wz = int_data & 0x38;
+      cpu->cycles += 13;
+      break;
+    case 1:
+      wz = 0x0038;
+      cpu->cycles += 13;
+      break;
+    default:
+      wz = rd16((reg_i << 8) | int_data);
+      cpu->cycles += 19;
+      break;
+  }
+  cpu->regs.PC.set_pair16(wz);
+}
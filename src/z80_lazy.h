@@ -0,0 +1,154 @@
+/*
+ * Z80 Lazy - Optional in-tree Z80 core with lazy flag evaluation
+ *
+ * Executes on the qkz80 register set of its owner (hbios_cpu), so
+ * HBIOSDispatch, the console and the main loop see the same registers
+ * whichever core is selected. Only the alternate registers, I, R, IFF
+ * and IM live here.
+ *
+ * ALU instructions record their operands and result instead of computing
+ * F. The F byte in regs.AF is only brought up to date when something reads
+ * it: an instruction that consumes flags (conditional branches test Z/C/S
+ * straight from the recorded result), PUSH AF, a port I/O callback (the
+ * HBIOS handlers set flags), or sync_flags(). Code that inspects regs.AF
+ * between instructions must call sync_flags() first.
+ *
+ * The internal MEMPTR (WZ) latch is tracked because BIT n,(HL) copies
+ * its high byte into the undocumented X/Y flags, which ZEXALL checks.
+ */
+
+#ifndef Z80_LAZY_H
+#define Z80_LAZY_H
+
+#include "qkz80_mem.h"
+#include <cstdint>
+
+class hbios_cpu;
+class StateWriter;
+class StateReader;
+
+class z80_lazy {
+public:
+  // owner supplies registers, port I/O, halt() and the cycle counter
+  z80_lazy(hbios_cpu* owner, qkz80_cpu_mem* memory);
+
+  void reset();
+
+  // Execute one instruction (or one interrupt-wait cycle while halted)
+  void execute();
+
+  // Bring regs.AF low byte up to date with the last ALU operation
+  void sync_flags();
+
+  // Interrupts (same semantics as the qkz80 request API)
+  void request_int(uint8_t data);   // Data bus byte (IM0 opcode / IM2 vector)
+  void request_rst(unsigned n) { request_int(0xC7 | ((n & 7) << 3)); }
+  void request_nmi() { nmi_pending = true; }
+  void check_interrupts();
+  bool int_pending() const { return int_req; }
+
+  // Checkpoint the registers and interrupt state held here (syncs flags)
+  void save_state(StateWriter& w);
+  void load_state(StateReader& r);
+
+private:
+  // Lazy flag state: which operation last set flags
+  enum LazyOp : uint8_t {
+    LZ_NONE = 0,  // F in regs.AF is current
+    LZ_ADD,       // ADD/ADC: r = a + b + c (9 bits)
+    LZ_SUB,       // SUB/SBC/NEG: r = a - b - c (9 bits)
+    LZ_CP,        // CP: like SUB, X/Y from operand
+    LZ_SZP,       // Logic/shift: sz53p[r] | keep
+    LZ_INC,       // INC r: keep = old carry
+    LZ_DEC,       // DEC r: keep = old carry
+  };
+
+  hbios_cpu* cpu;
+  qkz80_cpu_mem* mem;
+
+  LazyOp lz_op = LZ_NONE;
+  uint8_t lz_a = 0;
+  uint8_t lz_b = 0;
+  uint8_t lz_keep = 0;
+  uint16_t lz_r = 0;
+
+  // Registers not held in the qkz80 register set
+  uint16_t af2 = 0, bc2 = 0, de2 = 0, hl2 = 0;
+  uint8_t reg_i = 0;
+  uint8_t reg_r = 0;
+  uint8_t im = 0;
+  uint16_t wz = 0;         // MEMPTR
+  bool iff1 = false;
+  bool iff2 = false;
+  bool ei_delay = false;  // EI takes effect after the next instruction
+  bool halted = false;
+
+  // Interrupt requests
+  bool int_req = false;
+  uint8_t int_data = 0xFF;
+  bool nmi_pending = false;
+
+  // Per-instruction decode state
+  uint8_t xy = 0;          // 0=HL, 1=IX, 2=IY (DD/FD prefix)
+  uint16_t ea = 0;         // (HL)/(IX+d)/(IY+d) address once computed
+  bool ea_valid = false;
+  unsigned cyc = 0;        // T-states for the current instruction
+
+  // Flags
+  uint8_t flags();
+  void set_flags(uint8_t f);
+  bool flag_z() const;
+  bool flag_c() const;
+  bool flag_s() const;
+  bool condition(unsigned cc);
+  uint8_t compute_flags() const;
+
+  // Memory and fetch
+  uint8_t rd(uint16_t addr) { return mem->fetch_mem(addr); }
+  void wr(uint16_t addr, uint8_t v) { mem->store_mem(addr, v); }
+  uint16_t rd16(uint16_t addr) { return rd(addr) | (rd(addr + 1) << 8); }
+  void wr16(uint16_t addr, uint16_t v) { wr(addr, v & 0xFF); wr(addr + 1, v >> 8); }
+  uint8_t fetch();
+  uint16_t fetch16();
+  void push(uint16_t v);
+  uint16_t pop();
+
+  // Register access by opcode field
+  uint16_t get_hl() const;          // HL, IX or IY
+  void set_hl(uint16_t v);
+  uint16_t mem_addr();              // (HL) or (IX+d), fetching d once
+  uint8_t get_r8(unsigned r);       // r=6 is the memory operand
+  void set_r8(unsigned r, uint8_t v);
+  uint8_t get_r8_plain(unsigned r); // H/L never substituted
+  void set_r8_plain(unsigned r, uint8_t v);
+  uint16_t get_rp(unsigned p);      // BC, DE, HL/IX/IY, SP
+  void set_rp(unsigned p, uint16_t v);
+  uint16_t get_rp2(unsigned p);     // BC, DE, HL/IX/IY, AF
+  void set_rp2(unsigned p, uint16_t v);
+  uint8_t get_a() const;
+  void set_a(uint8_t v);
+
+  // ALU
+  void alu(unsigned op, uint8_t v);
+  uint8_t inc8(uint8_t v);
+  uint8_t dec8(uint8_t v);
+  uint8_t rot(unsigned op, uint8_t v);
+  void add16(uint16_t v);
+  void adc16(uint16_t v);
+  void sbc16(uint16_t v);
+  void daa();
+
+  // Decoders
+  void exec_main(uint8_t op);
+  void exec_cb();
+  void exec_xycb();
+  void exec_ed(uint8_t op);
+  void block_ld(int dir, bool repeat);
+  void block_cp(int dir, bool repeat);
+  void block_in(int dir, bool repeat);
+  void block_out(int dir, bool repeat);
+  uint8_t port_in(uint8_t port_lo, uint8_t port_hi);
+  void port_out(uint8_t port_lo, uint8_t port_hi, uint8_t v);
+};
+
+#endif // Z80_LAZY_H
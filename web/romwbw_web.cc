@@ -9,6 +9,7 @@
 #include "../src/hbios_cpu.h"  // Shared CPU with port I/O
 #include "../src/emu_io.h"
 #include "../src/emu_init.h"   // Shared initialization functions
+#include "../src/emu_latency.h" // Keystroke-to-echo latency
 #include <emscripten.h>
 #include <cstdio>
 #include <cstdlib>
@@ -328,6 +329,20 @@ int romwbw_get_pc() {
   return emu ? emu->cpu.regs.PC.get_pair16() : 0;
 }
 
+// Start (or stop) keystroke-to-echo latency tracking
+EMSCRIPTEN_KEEPALIVE
+void romwbw_set_latency_tracking(int enable) {
+  emu_latency_enable(enable != 0);
+}
+
+// Latency percentile table for this session (valid until the next call)
+EMSCRIPTEN_KEEPALIVE
+const char* romwbw_get_latency_report() {
+  static std::string report;
+  report = emu_latency_report();
+  return report.c_str();
+}
+
 // Set debug mode
 EMSCRIPTEN_KEEPALIVE
 void romwbw_set_debug(int enable) {